@@ -0,0 +1,525 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* the scenes the loader, bvh, and render benchmarks run over: a few
+   procedurally generated ones, which get written out as obj/mtl/png
+   and then loaded through the regular loader (so they exercise
+   exactly the same code paths as a real model), plus sponza, if it
+   can be found */
+#include "oscCore/Camera.h"
+#include "oscCore/Model.h"
+#include "3rdParty/stb_image_write.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! where the benchmarks write their (temporary) files; set
+      OSC_BENCH_OUTPUT_DIR to use a specific disk */
+  inline std::string benchFileName(const std::string &name)
+  {
+    const char *dir = getenv("OSC_BENCH_OUTPUT_DIR");
+    return std::string(dir ? dir : ".") + "/" + name;
+  }
+
+  /*! the sponza obj; set OSC_BENCH_SPONZA if it is not in the place
+      the examples expect it */
+  inline std::string sponzaFileName()
+  {
+    const char *fromEnv = getenv("OSC_BENCH_SPONZA");
+    return fromEnv ? fromEnv : "../models/sponza.obj";
+  }
+
+  enum BenchSceneID {
+    /*! 8x8 spheres on a ground plane, 64K triangles */
+    BENCH_SCENE_SPHERES_SMALL=0,
+    /*! 16x16 finer spheres, 590K triangles */
+    BENCH_SCENE_SPHERES_LARGE,
+    BENCH_SCENE_SPONZA,
+    /*! 32x32 city blocks, one mesh per building, 700K triangles;
+        the camera is at street level, so most of it is out of view */
+    BENCH_SCENE_CITY,
+    /*! a hall of long, thin, diagonal triangles - floor planks,
+        twisted columns, folded drapes - whose boxes overlap badly,
+        as in many architectural models; 175K triangles */
+    BENCH_SCENE_SLIVERS,
+    BENCH_SCENE_COUNT
+  };
+
+  struct BenchScene {
+    ~BenchScene() { delete model; }
+
+    std::string  name;
+    std::string  objFile;
+    size_t       objFileSize { 0 };
+    /*! texture files the materials reference, for the decode
+        benchmarks */
+    std::vector<std::string> textureFiles;
+    Model       *model { nullptr };
+    size_t       numTriangles { 0 };
+    Camera       camera;
+    QuadLight    light;
+  };
+
+  /*! a 512x512 png with some structure (so it compresses like a real
+      texture, not like a solid color) */
+  inline void writeBenchTexture(const std::string &fileName)
+  {
+    const int res = 512;
+    std::vector<uint32_t> pixels(res*res);
+    for (int y=0;y<res;y++)
+      for (int x=0;x<res;x++) {
+        const bool     check = ((x/32) ^ (y/32)) & 1;
+        const uint32_t r = check ? 200 : 60;
+        const uint32_t g = (x*255)/res;
+        const uint32_t b = ((x*y) >> 6) & 0xff;
+        pixels[x+y*res] = r | (g << 8) | (b << 16) | 0xff000000u;
+      }
+    stbi_write_png(fileName.c_str(),res,res,4,pixels.data(),res*sizeof(uint32_t));
+  }
+
+  /*! writes a grid of n x n uv-spheres, each tessellated with
+      'tess' x 'tess/2' quads, on a ground plane, as an obj file that
+      looks like exported ones: one group per object, positions,
+      normals, and texcoords in separate (shared) arrays, and faces
+      referencing them with v/vt/vn. Every other material has a
+      diffuse texture */
+  inline void writeSpheresOBJ(const std::string &baseName, int n, int tess)
+  {
+    const std::string objFile = benchFileName(baseName+".obj");
+    const std::string mtlFile = benchFileName(baseName+".mtl");
+    writeBenchTexture(benchFileName(baseName+"_texture.png"));
+
+    const int numMaterials = 8;
+    {
+      std::ofstream mtl(mtlFile);
+      for (int m=0;m<numMaterials;m++) {
+        mtl << "newmtl material" << m << "\n"
+            << "Kd " << .2f+.1f*m << " " << .8f-.05f*m << " " << .5f << "\n";
+        if (m & 1) mtl << "map_Kd " << baseName << "_texture.png\n";
+      }
+    }
+
+    std::ofstream obj(objFile);
+    obj << "mtllib " << baseName << ".mtl\n";
+    const float size = 10.f*n;
+    // ground plane
+    obj << "o ground\nusemtl material0\n"
+        << "v 0 0 0\nv " << size << " 0 0\nv " << size << " 0 " << size << "\nv 0 0 " << size << "\n"
+        << "vn 0 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        << "f 1/1/1 2/2/1 3/3/1\nf 1/1/1 3/3/1 4/4/1\n";
+    int numV = 4, numVT = 4, numVN = 1;
+
+    const int rings = tess/2;
+    char line[256];
+    for (int iz=0;iz<n;iz++)
+      for (int ix=0;ix<n;ix++) {
+        const vec3f center(10.f*ix+5.f,4.f,10.f*iz+5.f);
+        const float radius = 3.f+.9f*((ix*7+iz*13)%3);
+        obj << "o sphere_" << ix << "_" << iz << "\n"
+            << "usemtl material" << ((ix+iz*n) % numMaterials) << "\n";
+        for (int r=0;r<=rings;r++)
+          for (int s=0;s<=tess;s++) {
+            const float theta = float(M_PI)*r/rings;
+            const float phi   = 2.f*float(M_PI)*s/tess;
+            const vec3f N(sinf(theta)*cosf(phi),cosf(theta),sinf(theta)*sinf(phi));
+            const vec3f P = center+radius*N;
+            snprintf(line,sizeof(line),"v %f %f %f\nvn %f %f %f\nvt %f %f\n",
+                     P.x,P.y,P.z,N.x,N.y,N.z,float(s)/tess,float(r)/rings);
+            obj << line;
+          }
+        for (int r=0;r<rings;r++)
+          for (int s=0;s<tess;s++) {
+            const int i00 = r*(tess+1)+s, i01 = i00+1;
+            const int i10 = i00+tess+1,   i11 = i10+1;
+            const int quad[4] = { i00, i01, i11, i10 };
+            obj << "f";
+            for (int k=0;k<4;k++)
+              obj << " " << numV+1+quad[k] << "/" << numVT+1+quad[k] << "/" << numVN+1+quad[k];
+            obj << "\n";
+          }
+        const int numSphereVertices = (rings+1)*(tess+1);
+        numV  += numSphereVertices;
+        numVT += numSphereVertices;
+        numVN += numSphereVertices;
+      }
+  }
+
+  /*! writes an n x n grid of city blocks with one building each, as
+      an obj file with one group (and thus, mesh) per building. Every
+      facade is a grid of one quad per floor and window column, so
+      buildings have a few hundred to a thousand triangles each */
+  inline void writeCityOBJ(const std::string &baseName, int n)
+  {
+    const std::string objFile = benchFileName(baseName+".obj");
+    const std::string mtlFile = benchFileName(baseName+".mtl");
+    writeBenchTexture(benchFileName(baseName+"_texture.png"));
+
+    const int numMaterials = 8;
+    {
+      std::ofstream mtl(mtlFile);
+      for (int m=0;m<numMaterials;m++) {
+        mtl << "newmtl material" << m << "\n"
+            << "Kd " << .5f+.05f*m << " " << .5f << " " << .6f-.05f*m << "\n";
+        if (m & 1) mtl << "map_Kd " << baseName << "_texture.png\n";
+      }
+    }
+
+    std::ofstream obj(objFile);
+    obj << "mtllib " << baseName << ".mtl\n";
+    const float blockSize = 20.f;
+    const float size = blockSize*n;
+    obj << "o ground\nusemtl material0\n"
+        << "v 0 0 0\nv " << size << " 0 0\nv " << size << " 0 " << size << "\nv 0 0 " << size << "\n"
+        << "vn 0 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        << "f 1/1/1 3/3/1 2/2/1\nf 1/1/1 4/4/1 3/3/1\n";
+    int numV = 4, numVT = 4, numVN = 1;
+
+    const int columns = 6;
+    char line[256];
+    for (int iz=0;iz<n;iz++)
+      for (int ix=0;ix<n;ix++) {
+        // some (deterministic) variation in footprint and height
+        const int   hash   = (ix*73856093) ^ (iz*19349663);
+        const float width  = 10.f+float((hash >> 3) & 3);
+        const float depth  = 10.f+float((hash >> 5) & 3);
+        const int   floors = 4+((hash >> 7) & 15);
+        const float height = 3.5f*floors;
+        const vec3f lower(blockSize*ix+.5f*(blockSize-width),0.f,
+                          blockSize*iz+.5f*(blockSize-depth));
+        const vec3f upper = lower+vec3f(width,height,depth);
+        obj << "o building_" << ix << "_" << iz << "\n"
+            << "usemtl material" << ((hash >> 11) & (numMaterials-1)) << "\n";
+
+        // the four facades, counter-clockwise seen from outside
+        const vec3f corner[4] = {
+          vec3f(lower.x,0.f,lower.z), vec3f(upper.x,0.f,lower.z),
+          vec3f(upper.x,0.f,upper.z), vec3f(lower.x,0.f,upper.z)
+        };
+        int numBuildingVertices = 0;
+        for (int side=0;side<4;side++) {
+          const vec3f p0 = corner[(side+1)%4], p1 = corner[side];
+          const vec3f N  = normalize(cross(p1-p0,vec3f(0.f,1.f,0.f)));
+          for (int f=0;f<=floors;f++)
+            for (int c=0;c<=columns;c++) {
+              const vec3f P = p0+(c/float(columns))*(p1-p0)+vec3f(0.f,height*f/floors,0.f);
+              snprintf(line,sizeof(line),"v %f %f %f\nvn %f %f %f\nvt %f %f\n",
+                       P.x,P.y,P.z,N.x,N.y,N.z,float(c)/columns,float(f)/4.f);
+              obj << line;
+            }
+          for (int f=0;f<floors;f++)
+            for (int c=0;c<columns;c++) {
+              const int i00 = numBuildingVertices+f*(columns+1)+c, i01 = i00+1;
+              const int i10 = i00+columns+1, i11 = i10+1;
+              const int quad[4] = { i00, i01, i11, i10 };
+              obj << "f";
+              for (int k=0;k<4;k++)
+                obj << " " << numV+1+quad[k] << "/" << numVT+1+quad[k] << "/" << numVN+1+quad[k];
+              obj << "\n";
+            }
+          numBuildingVertices += (floors+1)*(columns+1);
+        }
+        // and the roof
+        for (int k=0;k<4;k++) {
+          const vec3f P = corner[k]+vec3f(0.f,height,0.f);
+          snprintf(line,sizeof(line),"v %f %f %f\nvn 0 1 0\nvt %f %f\n",
+                   P.x,P.y,P.z,float(k&1),float(k>>1));
+          obj << line;
+        }
+        const int roof = numBuildingVertices;
+        obj << "f";
+        for (int k=3;k>=0;k--)
+          obj << " " << numV+1+roof+k << "/" << numVT+1+roof+k << "/" << numVN+1+roof+k;
+        obj << "\n";
+        numBuildingVertices += 4;
+
+        numV  += numBuildingVertices;
+        numVT += numBuildingVertices;
+        numVN += numBuildingVertices;
+      }
+  }
+
+  /*! writes the sliver hall: n x n bays, each with a twisted
+      column and two folded drapes hung along its diagonals, over a
+      floor of planks that run across the entire hall at an angle.
+      One group per bay, plus one for the floor */
+  inline void writeSliversOBJ(const std::string &baseName, int n)
+  {
+    const std::string objFile = benchFileName(baseName+".obj");
+    const std::string mtlFile = benchFileName(baseName+".mtl");
+    writeBenchTexture(benchFileName(baseName+"_texture.png"));
+
+    const int numMaterials = 4;
+    {
+      std::ofstream mtl(mtlFile);
+      for (int m=0;m<numMaterials;m++) {
+        mtl << "newmtl material" << m << "\n"
+            << "Kd " << .4f+.1f*m << " " << .6f-.1f*m << " " << .5f << "\n";
+        if (m & 1) mtl << "map_Kd " << baseName << "_texture.png\n";
+      }
+    }
+
+    std::ofstream obj(objFile);
+    obj << "mtllib " << baseName << ".mtl\n";
+    const float bay    = 10.f;
+    const float size   = bay*n;
+    const float height = 8.f;
+    char line[256];
+    int numV = 0;
+    // (one normal and texcoord per vertex, as for the other scenes)
+    auto vertex = [&](const vec3f &P, const vec3f &N, float u, float v) -> int {
+      snprintf(line,sizeof(line),"v %f %f %f\nvn %f %f %f\nvt %f %f\n",
+               P.x,P.y,P.z,N.x,N.y,N.z,u,v);
+      obj << line;
+      return ++numV;
+    };
+    auto triangle = [&](int a, int b, int c) {
+      obj << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b
+          << " " << c << "/" << c << "/" << c << "\n";
+    };
+
+    // floor planks, running across the hall at 30 degrees
+    obj << "o floor\nusemtl material0\n";
+    const vec3f along(cosf(float(M_PI)/6.f),0.f,sinf(float(M_PI)/6.f));
+    const vec3f across(-along.z,0.f,along.x);
+    const int   numPlanks  = 20*n;
+    const float plankWidth = 2.f*size/numPlanks;
+    const vec3f center(.5f*size,0.f,.5f*size);
+    const vec3f up(0.f,1.f,0.f);
+    for (int i=0;i<numPlanks;i++) {
+      const vec3f mid = center+((i+.5f)*plankWidth-size)*across;
+      // (clipped to the hall, so the scene bounds are the hall's)
+      float t0 = -size, t1 = size;
+      for (int dim=0;dim<3;dim+=2) {
+        const float ta = (0.f-mid[dim])/along[dim], tb = (size-mid[dim])/along[dim];
+        t0 = std::max(t0,std::min(ta,tb));
+        t1 = std::min(t1,std::max(ta,tb));
+      }
+      if (t0 >= t1) continue;
+      const vec3f p0 = mid+t0*along, p1 = mid+t1*along;
+      const vec3f w  = .95f*plankWidth*across;
+      const int a = vertex(p0,up,0.f,0.f), b = vertex(p1,up,1.f,0.f);
+      const int c = vertex(p1+w,up,1.f,1.f), d = vertex(p0+w,up,0.f,1.f);
+      triangle(a,c,b);
+      triangle(a,d,c);
+    }
+
+    const int columnSegments = 24;
+    const int drapeFolds     = 64;
+    for (int iz=0;iz<n;iz++)
+      for (int ix=0;ix<n;ix++) {
+        obj << "o bay_" << ix << "_" << iz << "\n"
+            << "usemtl material" << ((ix+iz) % numMaterials) << "\n";
+        const vec3f corner(bay*ix,0.f,bay*iz);
+
+        // a column with its sides twisted by a quarter turn
+        const vec3f base = corner+vec3f(.5f*bay,0.f,.5f*bay);
+        const float radius = .4f;
+        for (int s=0;s<columnSegments;s++) {
+          const float a0 = 2.f*float(M_PI)*s/columnSegments;
+          const float a1 = 2.f*float(M_PI)*(s+1)/columnSegments;
+          const float twist = .5f*float(M_PI);
+          const vec3f n0(cosf(a0),0.f,sinf(a0)), n1(cosf(a1),0.f,sinf(a1));
+          const vec3f t0(cosf(a0+twist),0.f,sinf(a0+twist));
+          const vec3f t1(cosf(a1+twist),0.f,sinf(a1+twist));
+          const int b0 = vertex(base+radius*n0,n0,0.f,0.f);
+          const int b1 = vertex(base+radius*n1,n1,1.f,0.f);
+          const int u1 = vertex(base+radius*t1+vec3f(0.f,height,0.f),t1,1.f,1.f);
+          const int u0 = vertex(base+radius*t0+vec3f(0.f,height,0.f),t0,0.f,1.f);
+          triangle(b0,u1,b1);
+          triangle(b0,u0,u1);
+        }
+
+        // two drapes along the bay's diagonals, one fold per vertical
+        // strip, hanging a bit skewed
+        for (int d=0;d<2;d++) {
+          const vec3f p0 = corner+(d ? vec3f(bay,0.f,0.f) : vec3f(0.f));
+          const vec3f p1 = corner+(d ? vec3f(0.f,0.f,bay) : vec3f(bay,0.f,bay));
+          const vec3f N  = normalize(cross(p1-p0,up));
+          const vec3f skew = .1f*bay*normalize(p1-p0);
+          int prevTop = 0, prevBottom = 0;
+          for (int f=0;f<=drapeFolds;f++) {
+            const float t = f/float(drapeFolds);
+            const vec3f P = p0+t*(p1-p0)+((f & 1) ? .3f : -.3f)*N;
+            const int top    = vertex(P+vec3f(0.f,height,0.f),N,t,1.f);
+            const int bottom = vertex(P+vec3f(0.f,.5f,0.f)+skew,N,t,0.f);
+            if (f > 0) {
+              triangle(prevBottom,bottom,top);
+              triangle(prevBottom,top,prevTop);
+            }
+            prevTop    = top;
+            prevBottom = bottom;
+          }
+        }
+      }
+  }
+
+  /*! a deep copy of the model, for benchmarks that modify the model
+      (so the benchmark scenes themselves stay untouched) */
+  inline Model *copyModel(const Model &model)
+  {
+    Model *copy = new Model;
+    for (auto mesh : model.meshes)
+      copy->meshes.push_back(new TriangleMesh(*mesh));
+    for (auto texture : model.textures) {
+      Texture *t = new Texture;
+      t->resolution = texture->resolution;
+      t->pixel = new uint32_t[texture->resolution.x*texture->resolution.y];
+      memcpy(t->pixel,texture->pixel,
+             texture->resolution.x*texture->resolution.y*sizeof(uint32_t));
+      copy->textures.push_back(t);
+    }
+    copy->bounds = model.bounds;
+    return copy;
+  }
+
+  /*! returns the given scene, generating and/or loading it on first
+      use; nullptr if it is not available (ie, sponza not found) */
+  inline const BenchScene *getBenchScene(int sceneID)
+  {
+    static std::unique_ptr<BenchScene> scenes[BENCH_SCENE_COUNT];
+    static bool tried[BENCH_SCENE_COUNT] = { false };
+    if (tried[sceneID]) return scenes[sceneID].get();
+    tried[sceneID] = true;
+
+    std::unique_ptr<BenchScene> scene(new BenchScene);
+    if (sceneID == BENCH_SCENE_SPONZA) {
+      scene->name    = "sponza";
+      scene->objFile = sponzaFileName();
+      if (!std::ifstream(scene->objFile).good())
+        return nullptr;
+    } else if (sceneID == BENCH_SCENE_CITY) {
+      scene->name    = "osc_bench_city";
+      scene->objFile = benchFileName(scene->name+".obj");
+      writeCityOBJ(scene->name,32);
+    } else if (sceneID == BENCH_SCENE_SLIVERS) {
+      scene->name    = "osc_bench_slivers";
+      scene->objFile = benchFileName(scene->name+".obj");
+      writeSliversOBJ(scene->name,24);
+    } else {
+      const bool large = sceneID == BENCH_SCENE_SPHERES_LARGE;
+      scene->name    = large ? "osc_bench_spheres_large" : "osc_bench_spheres_small";
+      scene->objFile = benchFileName(scene->name+".obj");
+      writeSpheresOBJ(scene->name,large ? 16 : 8,large ? 48 : 32);
+    }
+    try {
+      scene->model = loadOBJ(scene->objFile);
+    } catch (const std::exception &e) {
+      std::cerr << "could not load " << scene->objFile << ": " << e.what() << std::endl;
+      return nullptr;
+    }
+    scene->objFileSize = std::ifstream(scene->objFile,std::ios::ate|std::ios::binary).tellg();
+    for (auto mesh : scene->model->meshes)
+      scene->numTriangles += mesh->index.size();
+
+    // the texture files, straight from the mtl file
+    const std::string mtlFile
+      = scene->objFile.substr(0,scene->objFile.rfind('.'))+".mtl";
+    const std::string modelDir
+      = scene->objFile.substr(0,scene->objFile.rfind('/')+1);
+    std::ifstream mtl(mtlFile);
+    std::string keyword, texture;
+    std::vector<std::string> seen;
+    while (mtl >> keyword) {
+      if (keyword != "map_Kd") continue;
+      mtl >> texture;
+      for (auto &c : texture) if (c == '\\') c = '/';
+      if (std::find(seen.begin(),seen.end(),texture) != seen.end()) continue;
+      seen.push_back(texture);
+      scene->textureFiles.push_back(modelDir+texture);
+    }
+
+    const box3f bounds = scene->model->bounds;
+    if (sceneID == BENCH_SCENE_SPONZA) {
+      // same view and light as example 12
+      scene->camera = { vec3f(-1293.07f, 154.681f, -0.7304f),
+                        bounds.center()-vec3f(0,400,0),
+                        vec3f(0.f,1.f,0.f) };
+      const float light_size = 200.f;
+      scene->light = { vec3f(-1000-light_size,800,-light_size),
+                       vec3f(2.f*light_size,0,0),
+                       vec3f(0,0,2.f*light_size),
+                       vec3f(3000000.f) };
+    } else if (sceneID == BENCH_SCENE_CITY) {
+      // at street level, looking down a street, slightly off its
+      // center line (so the view is not perfectly symmetric)
+      const vec3f span = bounds.span();
+      scene->camera = { vec3f(bounds.center().x+1.f,6.f,bounds.lower.z+.1f*span.z),
+                        vec3f(bounds.center().x+4.f,8.f,bounds.upper.z),
+                        vec3f(0.f,1.f,0.f) };
+      const float lightSize = .05f*span.x;
+      scene->light = { bounds.center()+vec3f(-lightSize,.5f*span.x,-lightSize),
+                       vec3f(2.f*lightSize,0,0),
+                       vec3f(0,0,2.f*lightSize),
+                       vec3f(.5f*span.x*span.x) };
+    } else if (sceneID == BENCH_SCENE_SLIVERS) {
+      // a bit above the drapes, looking across the hall at a grazing
+      // angle, so most rays pass close to lots of slivers
+      const vec3f span = bounds.span();
+      scene->camera = { vec3f(bounds.lower.x+.1f*span.x,2.5f*span.y,bounds.lower.z+.1f*span.z),
+                        bounds.center(),
+                        vec3f(0.f,1.f,0.f) };
+      const float lightSize = .05f*span.x;
+      scene->light = { bounds.center()+vec3f(-lightSize,.5f*span.x,-lightSize),
+                       vec3f(2.f*lightSize,0,0),
+                       vec3f(0,0,2.f*lightSize),
+                       vec3f(.5f*span.x*span.x) };
+    } else {
+      const vec3f span = bounds.span();
+      scene->camera = { bounds.center()+vec3f(-.2f*span.x,.35f*span.x,-.75f*span.z),
+                        bounds.center(),
+                        vec3f(0.f,1.f,0.f) };
+      const float lightSize = .1f*span.x;
+      scene->light = { bounds.center()+vec3f(-lightSize,.8f*span.x,-lightSize),
+                       vec3f(2.f*lightSize,0,0),
+                       vec3f(0,0,2.f*lightSize),
+                       vec3f(.5f*span.x*span.x) };
+    }
+    scenes[sceneID] = std::move(scene);
+    return scenes[sceneID].get();
+  }
+
+  /*! the scene for the benchmark's first argument, or nullptr (with
+      the benchmark marked as skipped) if it is not available */
+  inline const BenchScene *benchSceneFor(benchmark::State &state)
+  {
+    const BenchScene *scene = getBenchScene((int)state.range(0));
+    if (!scene)
+      state.SkipWithError("scene not available (for sponza, set OSC_BENCH_SPONZA)");
+    else
+      state.SetLabel(scene->name);
+    return scene;
+  }
+
+  /*! all scenes, as the first argument */
+  inline void allBenchScenes(benchmark::internal::Benchmark *b)
+  {
+    b->ArgName("scene");
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      b->Arg(sceneID);
+  }
+
+} // ::osc
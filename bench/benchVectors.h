@@ -16,50 +16,37 @@
 
 #pragma once
 
-#include "gdt/math/AffineSpace.h"
+/* input data for the benchmarks of vector kernels (simd types,
+   batched transforms), and the check of their results against a
+   scalar reference */
+#include "gdt/math/vec.h"
+#include <algorithm>
+#include <random>
 #include <vector>
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
   using namespace gdt;
-  
-  /*! a simple indexed triangle mesh that our sample renderer will
-      render */
-  struct TriangleMesh {
-    std::vector<vec3f> vertex;
-    std::vector<vec3f> normal;
-    std::vector<vec2f> texcoord;
-    std::vector<vec3i> index;
 
-    // material data:
-    vec3f              diffuse;
-    int                diffuseTextureID { -1 };
-  };
+  /*! n vectors, uniform in [-100,100]^3 */
+  inline std::vector<vec3f> randomVectors(size_t n, uint32_t seed)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> coord(-100.f,100.f);
+    std::vector<vec3f> v(n);
+    for (auto &vi : v) vi = vec3f(coord(rng),coord(rng),coord(rng));
+    return v;
+  }
 
-  struct QuadLight {
-    vec3f origin, du, dv, power;
-  };
-  
-  struct Texture {
-    ~Texture()
-    { if (pixel) delete[] pixel; }
-    
-    uint32_t *pixel      { nullptr };
-    vec2i     resolution { -1 };
-  };
-  
-  struct Model {
-    ~Model()
-    {
-      for (auto mesh : meshes) delete mesh;
-      for (auto texture : textures) delete texture;
-    }
-    
-    std::vector<TriangleMesh *> meshes;
-    std::vector<Texture *>      textures;
-    //! bounding box of all vertices in the model
-    box3f bounds;
-  };
+  /*! the largest difference between a[i] and b[i], relative to
+      a[i]'s length (or absolute, for lengths below one) */
+  inline float maxRelativeError(const std::vector<vec3f> &a,
+                                const std::vector<vec3f> &b)
+  {
+    float maxError = 0.f;
+    for (size_t i=0;i<a.size();i++)
+      maxError = std::max(maxError,length(a[i]-b[i])/std::max(1.f,length(a[i])));
+    return maxError;
+  }
 
-  Model *loadOBJ(const std::string &objFile);
-}
+} // ::osc
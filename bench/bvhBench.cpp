@@ -0,0 +1,523 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "benchScenes.h"
+#include "oscCore/CPUScene.h"
+#include "oscCore/SceneCache.h"
+#include "gdt/parallel/parallel_for.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the bounds of all of a model's triangles */
+  static std::vector<box3f> triangleBounds(const Model &model)
+  {
+    std::vector<box3f> bounds;
+    for (auto mesh : model.meshes)
+      for (auto index : mesh->index)
+        bounds.push_back(box3f(mesh->vertex[index.x])
+                         .including(mesh->vertex[index.y])
+                         .including(mesh->vertex[index.z]));
+    return bounds;
+  }
+
+  /*! the corners of all of a model's triangles, three per triangle,
+      in the same order as triangleBounds() */
+  static std::vector<vec3f> triangleCorners(const Model &model)
+  {
+    std::vector<vec3f> corners;
+    for (auto mesh : model.meshes)
+      for (auto index : mesh->index) {
+        corners.push_back(mesh->vertex[index.x]);
+        corners.push_back(mesh->vertex[index.y]);
+        corners.push_back(mesh->vertex[index.z]);
+      }
+    return corners;
+  }
+
+  static bool contains(const box3f &outer, const box3f &inner)
+  {
+    return outer.lower.x <= inner.lower.x && outer.lower.y <= inner.lower.y
+      &&   outer.lower.z <= inner.lower.z && outer.upper.x >= inner.upper.x
+      &&   outer.upper.y >= inner.upper.y && outer.upper.z >= inner.upper.z;
+  }
+
+  /*! checks that every primitive is in a leaf (exactly one, unless
+      the builder splits primitives, in which case the leaf only has
+      to overlap it), and that all nodes contain their children */
+  static bool validBVH(const BVH &bvh, const std::vector<box3f> &primBounds,
+                       bool splitPrims)
+  {
+    std::vector<int> found(primBounds.size(),0);
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty()) {
+      const BVHNode &node = bvh.nodes[stack.back()];
+      stack.pop_back();
+      if (node.isLeaf()) {
+        for (uint32_t i=node.offset;i<node.offset+node.count;i++) {
+          const box3f &prim = primBounds[bvh.primIDs[i]];
+          found[bvh.primIDs[i]]++;
+          const box3f overlap(max(prim.lower,node.lower),min(prim.upper,node.upper));
+          if (splitPrims ? overlap.empty() : !contains(node.bounds(),prim))
+            return false;
+        }
+        continue;
+      }
+      for (uint32_t c=node.offset;c<node.offset+2;c++) {
+        if (!contains(node.bounds(),bvh.nodes[c].bounds())) return false;
+        stack.push_back(c);
+      }
+    }
+    for (auto count : found)
+      if (count < 1 || (count > 1 && !splitPrims)) return false;
+    return true;
+  }
+
+  static void BM_BuildBVH(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const BVHBuildSettings settings
+      = bvhBuildSettingsFor((BVHBuildQuality)state.range(1));
+    const std::vector<box3f> bounds  = triangleBounds(*scene->model);
+    const std::vector<vec3f> corners = triangleCorners(*scene->model);
+    const BVHSplitPrimFunc splitPrim
+      = [&](uint32_t primID, int dim, float pos, box3f &left, box3f &right) {
+      splitTriangle(corners[3*primID],corners[3*primID+1],corners[3*primID+2],
+                    dim,pos,left,right);
+    };
+    BVH bvh;
+    buildBVH(bvh,bounds.data(),bounds.size(),settings,splitPrim);
+    if (!validBVH(bvh,bounds,settings.method == BVH_BUILD_SBVH)) {
+      state.SkipWithError("bvh does not contain every primitive exactly once");
+      return;
+    }
+    for (auto _ : state)
+      buildBVH(bvh,bounds.data(),bounds.size(),settings,splitPrim);
+    state.counters["nodes"]   = double(bvh.nodes.size());
+    state.counters["MB"]      = bvh.sizeInBytes()*1e-6;
+    state.counters["sahCost"] = bvh.sahCost();
+    state.counters["refs/prim"] = bvh.primIDs.size()/double(std::max(size_t(1),bounds.size()));
+    state.counters["Mprims/s"]
+      = benchmark::Counter(1e-6*bounds.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  enum RayKind {
+    /*! camera rays, as for the first hit */
+    PRIMARY_RAYS=0,
+    /*! from the primary hit points to random points on the light */
+    SHADOW_RAYS,
+    /*! random origins inside the scene, random directions - the
+        incoherent case */
+    RANDOM_RAYS
+  };
+
+  /*! the scene's CPUScene with a bvh of given quality, built once */
+  static const CPUScene &cpuScene(const BenchScene &scene,
+                                  BVHBuildQuality quality = BVH_BUILD_QUALITY_HIGH)
+  {
+    static std::map<std::pair<const BenchScene *,int>,std::unique_ptr<CPUScene>> cache;
+    auto &cpuScene = cache[std::make_pair(&scene,(int)quality)];
+    if (!cpuScene) cpuScene.reset(new CPUScene(scene.model,bvhBuildSettingsFor(quality)));
+    return *cpuScene;
+  }
+
+  /*! a fixed set of rays of given kind, for given scene; always the
+      same for the same scene, so results are comparable across runs */
+  static const std::vector<Ray> &benchRays(const BenchScene &scene, RayKind kind)
+  {
+    static std::map<std::pair<const BenchScene *,int>,std::vector<Ray>> cache;
+    std::vector<Ray> &rays = cache[std::make_pair(&scene,(int)kind)];
+    if (!rays.empty()) return rays;
+
+    const vec2i size(512,512);
+    const CameraFrame camera = computeCameraFrame(scene.camera,1.f);
+    std::mt19937 rng(0x1234+kind);
+    std::uniform_real_distribution<float> uniform(0.f,1.f);
+    if (kind == RANDOM_RAYS) {
+      const box3f bounds = scene.model->bounds;
+      for (int i=0;i<size.x*size.y;i++) {
+        Ray ray;
+        ray.org  = bounds.lower + vec3f(uniform(rng),uniform(rng),uniform(rng))*bounds.span();
+        ray.dir  = normalize(vec3f(uniform(rng),uniform(rng),uniform(rng))-vec3f(.5f));
+        ray.tmin = 0.f;
+        ray.tmax = 1e20f;
+        rays.push_back(ray);
+      }
+      return rays;
+    }
+
+    for (int iy=0;iy<size.y;iy++)
+      for (int ix=0;ix<size.x;ix++) {
+        const vec2f screen(vec2f(ix+.5f,iy+.5f)/vec2f(size));
+        Ray ray;
+        ray.org  = camera.position;
+        ray.dir  = normalize(camera.direction
+                             + (screen.x - 0.5f) * camera.horizontal
+                             + (screen.y - 0.5f) * camera.vertical);
+        ray.tmin = 0.f;
+        ray.tmax = 1e20f;
+        if (kind == PRIMARY_RAYS) {
+          rays.push_back(ray);
+          continue;
+        }
+        Hit hit;
+        if (!cpuScene(scene).intersect(ray,hit)) continue;
+        const vec3f surfPos  = ray.org + hit.t*ray.dir;
+        const vec3f lightPos = scene.light.origin
+          + uniform(rng)*scene.light.du + uniform(rng)*scene.light.dv;
+        Ray shadowRay;
+        shadowRay.org  = surfPos;
+        shadowRay.dir  = normalize(lightPos-surfPos);
+        shadowRay.tmin = 1e-4f*length(scene.model->bounds.span());
+        shadowRay.tmax = length(lightPos-surfPos)*(1.f-1e-3f);
+        rays.push_back(shadowRay);
+      }
+    return rays;
+  }
+
+  /*! closest-hit queries for primary and random rays, occlusion
+      queries for shadow rays */
+  static void BM_Traverse(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const RayKind kind = (RayKind)state.range(1);
+    const CPUScene &cpu = cpuScene(*scene,(BVHBuildQuality)state.range(2));
+    const std::vector<Ray> &rays = benchRays(*scene,kind);
+    const size_t raysPerTask = 4096;
+    const size_t numTasks = divRoundUp(uint64_t(rays.size()),uint64_t(raysPerTask));
+    std::vector<TraversalStats> stats(numTasks);
+    std::vector<int> numHits(numTasks);
+    for (auto _ : state) {
+      parallel_for(numTasks,[&](size_t taskID){
+          TraversalStats &taskStats = stats[taskID];
+          taskStats = TraversalStats();
+          int hits = 0;
+          const size_t end = std::min(rays.size(),(taskID+1)*raysPerTask);
+          for (size_t i=taskID*raysPerTask;i<end;i++) {
+            if (kind == SHADOW_RAYS)
+              hits += cpu.occluded(rays[i],&taskStats);
+            else {
+              Hit hit;
+              hits += cpu.intersect(rays[i],hit,&taskStats);
+            }
+          }
+          numHits[taskID] = hits;
+        });
+    }
+    TraversalStats total;
+    int hits = 0;
+    for (size_t i=0;i<numTasks;i++) {
+      total.numRays    += stats[i].numRays;
+      total.nodeVisits += stats[i].nodeVisits;
+      total.primTests  += stats[i].primTests;
+      hits             += numHits[i];
+    }
+    const double numRays = double(std::max(uint64_t(1),total.numRays));
+    state.counters["sahCost"]   = cpu.getBVH().sahCost();
+    state.counters["nodes/ray"] = total.nodeVisits/numRays;
+    state.counters["tris/ray"]  = total.primTests/numRays;
+    state.counters["hitRate"]   = hits/numRays;
+    state.counters["triMB"]     = cpu.triangleBytes()*1e-6;
+    state.counters["groupFill"] = cpu.groupFill();
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*rays.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  // ------------------------------------------------------------------
+  // ray/triangle intersection alone
+  // ------------------------------------------------------------------
+
+  /*! the leaf layout CPUScene had before TriangleGroups: 40 bytes
+      per triangle, tested one at a time with moeller-trumbore */
+  struct AoSTriangle {
+    vec3f v0;
+    int   primID;
+    vec3f e1, e2;
+  };
+
+  static inline bool intersectAoS(const AoSTriangle &tri, const Ray &ray,
+                                  float &tmax, float &u, float &v)
+  {
+    const vec3f p   = cross(ray.dir,tri.e2);
+    const float det = dot(tri.e1,p);
+    if (det == 0.f) return false;
+    const float rcpDet = 1.f/det;
+    const vec3f s  = ray.org-tri.v0;
+    const float bu = dot(s,p)*rcpDet;
+    if (bu < 0.f || bu > 1.f) return false;
+    const vec3f q  = cross(s,tri.e1);
+    const float bv = dot(ray.dir,q)*rcpDet;
+    if (bv < 0.f || bu+bv > 1.f) return false;
+    const float t  = dot(tri.e2,q)*rcpDet;
+    if (t < ray.tmin || t > tmax) return false;
+    tmax = t;
+    u    = bu;
+    v    = bv;
+    return true;
+  }
+
+  /*! every ray against one chunk of this many triangles */
+  static const int trianglesPerRay = 64;
+
+  struct IntersectionData {
+    std::vector<vec3f>            vertex;
+    std::vector<AoSTriangle>      aos;
+    std::vector<TriangleGroup<4>> groups4;
+    std::vector<TriangleGroup<8>> groups8;
+    std::vector<Ray>              rays;
+  };
+
+  /*! 4K small random triangles in the unit cube (so they stay in
+      the cache - this is about the intersection math, not memory),
+      and rays through the cube */
+  static const IntersectionData &intersectionData()
+  {
+    static IntersectionData data;
+    if (!data.rays.empty()) return data;
+    const int numTriangles = 4*1024;
+    std::mt19937 rng(0x789);
+    std::uniform_real_distribution<float> uniform(0.f,1.f);
+    auto randomPoint = [&]() { return vec3f(uniform(rng),uniform(rng),uniform(rng)); };
+    data.groups4.resize(numTriangles/4);
+    data.groups8.resize(numTriangles/8);
+    for (int i=0;i<numTriangles;i++) {
+      const vec3f center = randomPoint();
+      const vec3f v0 = center+.3f*(randomPoint()-vec3f(.5f));
+      const vec3f v1 = center+.3f*(randomPoint()-vec3f(.5f));
+      const vec3f v2 = center+.3f*(randomPoint()-vec3f(.5f));
+      data.aos.push_back({ v0, i, v1-v0, v2-v0 });
+      data.groups4[i/4].set(i%4,v0,v1,v2,0,i);
+      data.groups8[i/8].set(i%8,v0,v1,v2,0,i);
+    }
+    for (int i=0;i<256*1024;i++) {
+      Ray ray;
+      ray.org  = randomPoint();
+      ray.dir  = normalize(randomPoint()-vec3f(.5f));
+      ray.tmin = 0.f;
+      ray.tmax = 1e20f;
+      data.rays.push_back(ray);
+    }
+    return data;
+  }
+
+  static const std::vector<TriangleGroup<4>> &groupsOf(const IntersectionData &data, const TriangleGroup<4> *)
+  { return data.groups4; }
+  static const std::vector<TriangleGroup<8>> &groupsOf(const IntersectionData &data, const TriangleGroup<8> *)
+  { return data.groups8; }
+
+  /*! closest hit of each ray among its chunk of triangles, with the
+      moeller-trumbore test on the old layout */
+  static void intersectChunksAoS(const IntersectionData &data, std::vector<int> &hitPrim,
+                                 std::vector<float> &hitT)
+  {
+    const size_t numChunks = data.aos.size()/trianglesPerRay;
+    for (size_t i=0;i<data.rays.size();i++) {
+      const Ray &ray = data.rays[i];
+      const size_t first = (i % numChunks)*trianglesPerRay;
+      float tmax = ray.tmax, u, v;
+      int prim = -1;
+      for (size_t j=first;j<first+trianglesPerRay;j++)
+        if (intersectAoS(data.aos[j],ray,tmax,u,v)) prim = data.aos[j].primID;
+      hitPrim[i] = prim;
+      hitT[i]    = tmax;
+    }
+  }
+
+  /*! same, with the watertight test on groups of W triangles */
+  template<int W>
+  static void intersectChunks(const IntersectionData &data, std::vector<int> &hitPrim,
+                              std::vector<float> &hitT)
+  {
+    const std::vector<TriangleGroup<W>> &groups = groupsOf(data,(const TriangleGroup<W> *)nullptr);
+    const size_t numChunks = data.aos.size()/trianglesPerRay;
+    for (size_t i=0;i<data.rays.size();i++) {
+      const Ray &ray = data.rays[i];
+      const WatertightRay watertight(ray.org,ray.dir,ray.tmin);
+      const size_t first = (i % numChunks)*trianglesPerRay/W;
+      float tmax = ray.tmax, u, v;
+      int prim = -1;
+      for (size_t j=first;j<first+trianglesPerRay/W;j++) {
+        const int lane = intersectGroup(groups[j],watertight,tmax,u,v);
+        if (lane >= 0) prim = groups[j].primID[lane];
+      }
+      hitPrim[i] = prim;
+      hitT[i]    = tmax;
+    }
+  }
+
+  /*! moeller-trumbore on the old layout ('width' 1) vs watertight
+      tests on groups of four and eight */
+  static void BM_IntersectTriangles(benchmark::State &state)
+  {
+    const int width = (int)state.range(0);
+    const IntersectionData &data = intersectionData();
+    auto kernel
+      = width == 1 ? intersectChunksAoS
+      : width == 4 ? intersectChunks<4>
+      : intersectChunks<8>;
+    std::vector<int>   expectedPrim(data.rays.size()), hitPrim(data.rays.size());
+    std::vector<float> expectedT(data.rays.size()), hitT(data.rays.size());
+    intersectChunksAoS(data,expectedPrim,expectedT);
+    kernel(data,hitPrim,hitT);
+    // (the two tests may disagree right on an edge, or for the
+    // closer of two hits at almost the same distance)
+    size_t numDifferent = 0, numHits = 0;
+    for (size_t i=0;i<hitPrim.size();i++) {
+      numHits += expectedPrim[i] >= 0;
+      numDifferent += hitPrim[i] != expectedPrim[i]
+        || fabsf(hitT[i]-expectedT[i]) > 1e-4f*std::max(1.f,expectedT[i]);
+    }
+    if (numDifferent > hitPrim.size()/1000) {
+      state.SkipWithError("group intersection does not match moeller-trumbore");
+      return;
+    }
+    for (auto _ : state) {
+      kernel(data,hitPrim,hitT);
+      benchmark::DoNotOptimize(hitPrim.data());
+    }
+    state.counters["hitRate"]   = numHits/double(hitPrim.size());
+    state.counters["different"] = numDifferent;
+    state.counters["bytes/tri"] = width == 1 ? sizeof(AoSTriangle)
+      : width == 4 ? sizeof(TriangleGroup<4>)/4. : sizeof(TriangleGroup<8>)/8.;
+    state.counters["Mtests/s"]
+      = benchmark::Counter(1e-6*data.rays.size()*trianglesPerRay*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  // ------------------------------------------------------------------
+  // scene caches
+  // ------------------------------------------------------------------
+
+  /*! true if both scenes give the exact same results, and do the
+      exact same work, for the given rays */
+  static bool sameTraversal(const CPUScene &a, const CPUScene &b,
+                            const std::vector<Ray> &rays)
+  {
+    TraversalStats statsA, statsB;
+    for (auto &ray : rays) {
+      Hit hitA, hitB;
+      const bool foundA = a.intersect(ray,hitA,&statsA);
+      const bool foundB = b.intersect(ray,hitB,&statsB);
+      if (foundA != foundB) return false;
+      if (foundA && (hitA.t != hitB.t || hitA.u != hitB.u || hitA.v != hitB.v
+                     || hitA.meshID != hitB.meshID || hitA.primID != hitB.primID))
+        return false;
+    }
+    return statsA.nodeVisits == statsB.nodeVisits
+      &&   statsA.primTests  == statsB.primTests;
+  }
+
+  /*! getting from a scene cache to a CPUScene that can trace rays:
+      either building the bvh ('warm'==0), or reading it from the
+      cache as well */
+  static void BM_SceneStartup(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const BVHBuildQuality quality = (BVHBuildQuality)state.range(1);
+    const bool warm = state.range(2);
+    const BVHBuildSettings settings = bvhBuildSettingsFor(quality);
+    const CPUScene &built = cpuScene(*scene,quality);
+    const uint64_t key = CPUScene::bvhCacheKey(scene->model,settings);
+    const std::string cacheFile = benchFileName(scene->name+"_bvh.osccache");
+    saveSceneCache(scene->model,cacheFile,{ { key, &built.getBVH() } });
+
+    {
+      std::unique_ptr<Model> model(loadSceneCache(cacheFile));
+      BVH bvh;
+      if (CPUScene::bvhCacheKey(model.get(),settings) != key
+          || !loadSceneCacheBVH(cacheFile,key,bvh)) {
+        state.SkipWithError("did not find the bvh in the scene cache");
+        return;
+      }
+      if (bvh.nodes.size() != built.getBVH().nodes.size()
+          || bvh.primIDs != built.getBVH().primIDs
+          || memcmp(bvh.nodes.data(),built.getBVH().nodes.data(),
+                    bvh.nodes.size()*sizeof(BVHNode))) {
+        state.SkipWithError("bvh from the scene cache differs from the one built");
+        return;
+      }
+      const CPUScene loaded(model.get(),settings,std::vector<int>(),&bvh);
+      if (!sameTraversal(built,loaded,benchRays(*scene,PRIMARY_RAYS))
+          || !sameTraversal(built,loaded,benchRays(*scene,RANDOM_RAYS))) {
+        state.SkipWithError("bvh from the scene cache traverses differently");
+        return;
+      }
+    }
+
+    double buildSeconds = 0.;
+    for (auto _ : state) {
+      std::unique_ptr<Model> model(loadSceneCache(cacheFile));
+      std::unique_ptr<CPUScene> cpu;
+      if (warm) {
+        BVH bvh;
+        loadSceneCacheBVH(cacheFile,CPUScene::bvhCacheKey(model.get(),settings),bvh);
+        cpu.reset(new CPUScene(model.get(),settings,std::vector<int>(),&bvh));
+      } else
+        cpu.reset(new CPUScene(model.get(),settings));
+      buildSeconds = cpu->buildSeconds;
+    }
+    const size_t fileSize = std::ifstream(cacheFile,std::ios::ate|std::ios::binary).tellg();
+    remove(cacheFile.c_str());
+    state.counters["fileMB"]       = fileSize*1e-6;
+    state.counters["bvhMB"]        = built.getBVH().sizeInBytes()*1e-6;
+    state.counters["buildSeconds"] = buildSeconds;
+  }
+
+  /*! scene x build quality */
+  static void buildArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","quality"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int quality=0;quality<BVH_BUILD_QUALITY_COUNT;quality++)
+        b->Args({sceneID,quality});
+  }
+
+  /*! scene x ray kind x build quality */
+  static void traversalArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","rays","quality"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int kind=PRIMARY_RAYS;kind<=RANDOM_RAYS;kind++)
+        for (int quality=0;quality<BVH_BUILD_QUALITY_COUNT;quality++)
+          b->Args({sceneID,kind,quality});
+  }
+
+  /*! scene x build quality x cold/warm start; for the qualities
+      where a build takes long enough to be worth caching */
+  static void startupArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","quality","warm"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int quality=BVH_BUILD_QUALITY_HIGH;quality<BVH_BUILD_QUALITY_COUNT;quality++)
+        for (int warm=0;warm<2;warm++)
+          b->Args({sceneID,quality,warm});
+  }
+
+  BENCHMARK(BM_BuildBVH)->Apply(buildArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_Traverse)->Apply(traversalArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_SceneStartup)->Apply(startupArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_IntersectTriangles)->ArgName("width")->Arg(1)->Arg(4)->Arg(8)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
@@ -0,0 +1,94 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+// a hardware cache miss counter, for benchmarks that are about
+// memory access patterns; uses linux perf events, and is simply not
+// available elsewhere (or where the kernel does not allow it, eg, in
+// many vms and containers)
+
+#include <cstdint>
+#include <cstring>
+#if defined(__linux__)
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! counts last level cache misses of the calling thread, between
+      start() and stop(); work that parallel_for hands to the pool's
+      workers does not get counted, so for complete numbers run with
+      GDT_NUM_THREADS=1 */
+  class CacheMissCounter {
+  public:
+    CacheMissCounter()
+    {
+#if defined(__linux__)
+      perf_event_attr attr;
+      memset(&attr,0,sizeof(attr));
+      attr.size           = sizeof(attr);
+      attr.type           = PERF_TYPE_HARDWARE;
+      attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+      attr.disabled       = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv     = 1;
+      fd = (int)syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+#endif
+    }
+    ~CacheMissCounter()
+    {
+#if defined(__linux__)
+      if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+      if (fd < 0) return;
+      ioctl(fd,PERF_EVENT_IOC_RESET,0);
+      ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+#endif
+    }
+
+    /*! misses since start(); 0 if not available */
+    uint64_t stop()
+    {
+      uint64_t count = 0;
+#if defined(__linux__)
+      if (fd < 0) return 0;
+      ioctl(fd,PERF_EVENT_IOC_DISABLE,0);
+      if (read(fd,&count,sizeof(count)) != sizeof(count)) count = 0;
+#endif
+      return count;
+    }
+
+  private:
+    CacheMissCounter(const CacheMissCounter &) = delete;
+    CacheMissCounter &operator=(const CacheMissCounter &) = delete;
+
+    int fd { -1 };
+  };
+
+} // ::osc
@@ -0,0 +1,161 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "oscCore/CPURenderer.h"
+#include "gdt/parallel/parallel_for.h"
+#include <map>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const vec2i cullingBenchSize(640,480);
+
+  /*! the scene's CPUScene, built once; not const, since culling
+      changes it */
+  static CPUScene &cullingScene(const BenchScene &scene)
+  {
+    static std::map<const BenchScene *,std::unique_ptr<CPUScene>> cache;
+    auto &cpuScene = cache[&scene];
+    if (!cpuScene) cpuScene.reset(new CPUScene(scene.model));
+    return *cpuScene;
+  }
+
+  static std::vector<Ray> cameraRays(const CameraFrame &camera, const vec2i &size)
+  {
+    std::vector<Ray> rays;
+    for (int iy=0;iy<size.y;iy++)
+      for (int ix=0;ix<size.x;ix++) {
+        const vec2f screen(vec2f(ix+.5f,iy+.5f)/vec2f(size));
+        Ray ray;
+        ray.org  = camera.position;
+        ray.dir  = normalize(camera.direction
+                             + (screen.x - 0.5f) * camera.horizontal
+                             + (screen.y - 0.5f) * camera.vertical);
+        ray.tmin = 0.f;
+        ray.tmax = 1e20f;
+        rays.push_back(ray);
+      }
+    return rays;
+  }
+
+  /*! camera rays, traced against the entire scene, or against only
+      the meshes in the view frustum - with the per-frame cost of
+      culling (and building the bvh over the visible meshes)
+      included. Checks that both find the same hits */
+  static void BM_PrimaryCulling(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const bool culled = state.range(1) != 0;
+    CPUScene &cpu = cullingScene(*scene);
+    const CameraFrame camera
+      = computeCameraFrame(scene->camera,cullingBenchSize.x/float(cullingBenchSize.y));
+    const std::vector<Ray> rays = cameraRays(camera,cullingBenchSize);
+    const Frustum frustum = computeFrustum(camera);
+
+    // the hits have to be exactly the same either way
+    cpu.cull(frustum);
+    size_t numDifferent = 0;
+    for (auto &ray : rays) {
+      Hit a, b;
+      const bool hitA = cpu.intersect(ray,a);
+      const bool hitB = cpu.intersectPrimary(ray,b);
+      if (hitA != hitB || (hitA && a.t != b.t)) numDifferent++;
+    }
+    if (numDifferent > 0) {
+      state.SkipWithError("culled traversal finds different hits");
+      return;
+    }
+
+    const size_t raysPerTask = 4096;
+    const size_t numTasks = divRoundUp(rays.size(),raysPerTask);
+    std::vector<TraversalStats> stats(numTasks);
+    double cullSeconds = 0.;
+    for (auto _ : state) {
+      if (culled) {
+        const double t0 = getCurrentTime();
+        cpu.cull(frustum);
+        cullSeconds += getCurrentTime()-t0;
+      }
+      parallel_for(numTasks,[&](size_t taskID){
+          TraversalStats &taskStats = stats[taskID];
+          taskStats = TraversalStats();
+          const size_t end = std::min(rays.size(),(taskID+1)*raysPerTask);
+          for (size_t i=taskID*raysPerTask;i<end;i++) {
+            Hit hit;
+            if (culled)
+              cpu.intersectPrimary(rays[i],hit,&taskStats);
+            else
+              cpu.intersect(rays[i],hit,&taskStats);
+          }
+        });
+    }
+    TraversalStats total;
+    for (auto &s : stats) {
+      total.numRays    += s.numRays;
+      total.nodeVisits += s.nodeVisits;
+      total.primTests  += s.primTests;
+    }
+    const double numRays = double(std::max(uint64_t(1),total.numRays));
+    state.counters["nodes/ray"] = total.nodeVisits/numRays;
+    state.counters["tris/ray"]  = total.primTests/numRays;
+    state.counters["visible"]
+      = culled ? cpu.numVisibleMeshes()/double(cpu.numMeshes()) : 1.;
+    state.counters["cullMs"]    = 1e3*cullSeconds/std::max(int64_t(1),int64_t(state.iterations()));
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*rays.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! full frames, with and without CPURenderer::frustumCulling;
+      shadow rays always go through the entire scene */
+  static void BM_CulledRender(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    CPURenderer renderer(scene->model,scene->light);
+    renderer.resize(cullingBenchSize);
+    renderer.setCamera(scene->camera);
+    renderer.accumulate     = false;
+    renderer.frustumCulling = state.range(1) != 0;
+    // (the first culled frame also builds the per-mesh bvhs)
+    renderer.render();
+    uint64_t numRays = 0;
+    for (auto _ : state) {
+      renderer.render();
+      numRays += renderer.stats.numRays;
+    }
+    state.counters["visible"]
+      = renderer.stats.numVisibleMeshes/double(renderer.getScene().numMeshes());
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+  }
+
+  /*! scene x {all meshes, frustum-culled} */
+  static void cullingArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","culled"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int culled=0;culled<2;culled++)
+        b->Args({sceneID,culled});
+  }
+
+  BENCHMARK(BM_PrimaryCulling)->Apply(cullingArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_CulledRender)->Apply(cullingArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
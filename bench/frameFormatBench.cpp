@@ -0,0 +1,100 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "syntheticFrame.h"
+#include "oscCore/CPUDenoiser.h"
+#include "oscCore/ToneMap.h"
+#include <benchmark/benchmark.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const vec2i formatBenchSize(1280,720);
+
+  static FrameFormat formatFor(const benchmark::State &state)
+  {
+    return state.range(0) ? FrameFormat::packed() : FrameFormat::full();
+  }
+
+  static void setTrafficCounters(benchmark::State &state,
+                                 const FrameFormat &format,
+                                 const FrameBuffer &fb,
+                                 size_t stageBytes)
+  {
+    const FrameTraffic traffic = computeFrameTraffic(format,fb.size,true,true);
+    state.counters["fbMB"]       = fb.sizeInBytes()*1e-6;
+    state.counters["stageMB"]    = stageBytes*1e-6;
+    state.counters["frameMB"]    = traffic.total()*1e-6;
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*fb.numPixels()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  static void BM_RenderPass(benchmark::State &state)
+  {
+    const FrameFormat format = formatFor(state);
+    FrameBuffer fb;
+    fb.resize(formatBenchSize,format);
+    int frameID = 0;
+    for (auto _ : state) {
+      renderSyntheticFrame(fb,frameID++);
+      benchmark::DoNotOptimize(fb.color.data());
+    }
+    setTrafficCounters(state,format,fb,
+                       computeFrameTraffic(format,fb.size,true,true).render);
+  }
+
+  static void BM_CPUDenoise(benchmark::State &state)
+  {
+    const FrameFormat format = formatFor(state);
+    FrameBuffer fb;
+    fb.resize(formatBenchSize,format);
+    renderSyntheticFrame(fb,0);
+    std::vector<uint8_t> output(fb.color.size());
+    CPUDenoiser denoiser;
+    for (auto _ : state) {
+      denoiser.denoise(fb,output.data());
+      benchmark::DoNotOptimize(output.data());
+    }
+    setTrafficCounters(state,format,fb,
+                       computeFrameTraffic(format,fb.size,true,true).denoise);
+  }
+
+  static void BM_ToneMapFormat(benchmark::State &state)
+  {
+    const FrameFormat format = formatFor(state);
+    FrameBuffer fb;
+    fb.resize(formatBenchSize,format);
+    renderSyntheticFrame(fb,0);
+    std::vector<uint32_t> pixels(fb.numPixels());
+    ToneMapParams params;
+    for (auto _ : state) {
+      toneMap(params,format.color,fb.color.data(),pixels.data(),fb.size);
+      benchmark::DoNotOptimize(pixels.data());
+    }
+    setTrafficCounters(state,format,fb,
+                       computeFrameTraffic(format,fb.size,true,true).toneMap);
+  }
+
+  /*! 0 = all float4, 1 = half3/oct32/rgba8 */
+  BENCHMARK(BM_RenderPass)->ArgName("packed")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_CPUDenoise)->ArgName("packed")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_ToneMapFormat)->ArgName("packed")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
@@ -0,0 +1,279 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "benchScenes.h"
+#include "syntheticFrame.h"
+#include "oscCore/ImageOutput.h"
+#include "oscCore/ToneMap.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const vec2i outputFrameSize(1280,720);
+
+  /*! a rendered frame, both as the linear color AOV and tone mapped
+      to rgba8, the way an example would hand it to the output */
+  struct TestFrame {
+    TestFrame(const vec2i &size, int frameID)
+    {
+      FrameBuffer fb;
+      fb.resize(size,FrameFormat::full());
+      for (int i=0;i<=frameID%4;i++)
+        renderSyntheticFrame(fb,i);
+      const vec4f *color = (const vec4f *)fb.color.data();
+      linear.resize(fb.numPixels());
+      for (size_t i=0;i<linear.size();i++)
+        linear[i] = vec3f(color[i]);
+      rgba.resize(fb.numPixels());
+      toneMap(ToneMapParams(),color,rgba.data(),size);
+    }
+    std::vector<vec3f>    linear;
+    std::vector<uint32_t> rgba;
+  };
+
+  static const TestFrame &testFrame()
+  {
+    static TestFrame frame(outputFrameSize,3);
+    return frame;
+  }
+
+  // ------------------------------------------------------------------
+  // a minimal reader for the exr files we write ourselves, to check
+  // that what we write is what we meant to write
+  // ------------------------------------------------------------------
+
+  static void rleDecompress(const int8_t *in, size_t inLength,
+                            std::vector<uint8_t> &out)
+  {
+    out.clear();
+    const int8_t *inEnd = in+inLength;
+    while (in < inEnd) {
+      if (*in < 0) {
+        const int count = -*in++;
+        out.insert(out.end(),(const uint8_t *)in,(const uint8_t *)in+count);
+        in += count;
+      } else {
+        const int count = *in++ + 1;
+        out.insert(out.end(),count,(uint8_t)*in++);
+      }
+    }
+  }
+
+  /*! reads back a FLOAT3 exr as written by writeImage() (channels
+      B,G,R, one scanline per block), into top-down rgb floats */
+  static bool readOwnEXR(const std::string &fileName, const vec2i &size,
+                         std::vector<vec3f> &rgb)
+  {
+    FILE *file = fopen(fileName.c_str(),"rb");
+    if (!file) return false;
+    std::vector<uint8_t> data;
+    uint8_t buffer[1<<16];
+    size_t n;
+    while ((n = fread(buffer,1,sizeof(buffer),file)) > 0)
+      data.insert(data.end(),buffer,buffer+n);
+    fclose(file);
+
+    // skip the header attributes, they are all fixed for our files
+    size_t pos = 8;
+    while (data.at(pos) != 0) {
+      pos += strlen((const char *)&data[pos])+1;
+      pos += strlen((const char *)&data[pos])+1;
+      int32_t attribSize;
+      memcpy(&attribSize,&data.at(pos),4);
+      pos += 4+attribSize;
+    }
+    pos += 1 + size.y*sizeof(uint64_t);
+
+    rgb.resize(size_t(size.x)*size.y);
+    const size_t lineSize = 3*sizeof(float)*size.x;
+    std::vector<uint8_t> decoded, line(lineSize);
+    for (int i=0;i<size.y;i++) {
+      int32_t y, blockSize;
+      memcpy(&y,&data.at(pos),4);
+      memcpy(&blockSize,&data.at(pos+4),4);
+      pos += 8;
+      if (y < 0 || y >= size.y || pos+blockSize > data.size()) return false;
+      if (size_t(blockSize) == lineSize)
+        memcpy(line.data(),&data[pos],lineSize);
+      else {
+        rleDecompress((const int8_t *)&data[pos],blockSize,decoded);
+        if (decoded.size() != lineSize) return false;
+        for (size_t j=1;j<lineSize;j++)
+          decoded[j] = uint8_t(int(decoded[j-1]) + int(decoded[j]) - 128);
+        const uint8_t *t1 = decoded.data();
+        const uint8_t *t2 = decoded.data()+(lineSize+1)/2;
+        for (size_t j=0;j<lineSize;j++)
+          line[j] = (j & 1) ? *t2++ : *t1++;
+      }
+      pos += blockSize;
+      const float *channel = (const float *)line.data();
+      for (int x=0;x<size.x;x++) {
+        rgb[x+y*size.x].z = channel[0*size.x+x];
+        rgb[x+y*size.x].y = channel[1*size.x+x];
+        rgb[x+y*size.x].x = channel[2*size.x+x];
+      }
+    }
+    return true;
+  }
+
+  /*! writes given rgb pixels as exr and reads them back */
+  static bool exrRoundTrips(const std::vector<vec3f> &pixels,
+                            ExrCompression compression, std::string &error)
+  {
+    const std::string fileName = benchFileName("osc_bench_roundtrip.exr");
+    writeImage(OutputImage(fileName,outputFrameSize,OutputImage::FLOAT3,
+                           pixels.data()),compression);
+    std::vector<vec3f> readBack;
+    const bool ok = readOwnEXR(fileName,outputFrameSize,readBack);
+    remove(fileName.c_str());
+    if (!ok) {
+      error = "could not read back exr file";
+      return false;
+    }
+    // the file is top-down, the frame bottom-up
+    for (int y=0;y<outputFrameSize.y;y++)
+      if (memcmp(&readBack[y*outputFrameSize.x],
+                 &pixels[(outputFrameSize.y-1-y)*outputFrameSize.x],
+                 outputFrameSize.x*sizeof(vec3f))) {
+        error = "exr read back does not match what was written";
+        return false;
+      }
+    return true;
+  }
+
+  /*! round trip both the (noisy, hardly compressible) test frame and
+      a smooth image with flat regions, which makes rle actually kick
+      in */
+  static bool exrRoundTrips(ExrCompression compression, std::string &error)
+  {
+    std::vector<vec3f> smooth(outputFrameSize.x*outputFrameSize.y);
+    for (int y=0;y<outputFrameSize.y;y++)
+      for (int x=0;x<outputFrameSize.x;x++)
+        smooth[x+y*outputFrameSize.x]
+          = vec3f(float(x/64),.5f,(x < y) ? y*(1.f/outputFrameSize.y) : 0.f);
+    return exrRoundTrips(smooth,compression,error)
+      &&   exrRoundTrips(testFrame().linear,compression,error);
+  }
+
+  static OutputImage imageFor(ImageFileFormat format, const std::string &name)
+  {
+    const TestFrame &frame = testFrame();
+    if (format == IMAGE_FILE_PNG)
+      return OutputImage(benchFileName(name+".png"),outputFrameSize,
+                         OutputImage::RGBA8,frame.rgba.data());
+    const char *ext = format == IMAGE_FILE_EXR ? ".exr"
+      : format == IMAGE_FILE_PFM ? ".pfm" : ".raw";
+    return OutputImage(benchFileName(name+ext),outputFrameSize,
+                       OutputImage::FLOAT3,frame.linear.data());
+  }
+
+  /*! synchronous encode + write of one frame, per file format (and
+      exr compression) */
+  static void BM_WriteImage(benchmark::State &state)
+  {
+    const ImageFileFormat format      = (ImageFileFormat)state.range(0);
+    const ExrCompression  compression = (ExrCompression)state.range(1);
+    if (format == IMAGE_FILE_EXR) {
+      std::string error;
+      if (!exrRoundTrips(compression,error)) {
+        state.SkipWithError(error.c_str());
+        return;
+      }
+    }
+    const OutputImage image = imageFor(format,"osc_bench_write");
+    size_t bytes = 0;
+    for (auto _ : state)
+      bytes = writeImage(image,compression);
+    remove(image.fileName.c_str());
+    state.counters["fileMB"]  = bytes*1e-6;
+    state.counters["ratio"]   = double(bytes)/image.sizeInBytes();
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*outputFrameSize.x*outputFrameSize.y*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! a sequence render: every frame gets 'rendered' (the tone mapped
+      result is copied into an OutputImage, which is all the renderer
+      has to do), then a png and an exr of it go to the output queue.
+      'renderMs' is what the producer spends per frame on its own, and
+      stallMs what it additionally waited on the queue; with enough
+      workers and queue slots the latter should be zero */
+  static void BM_SequenceOutput(benchmark::State &state)
+  {
+    const int    numWorkers    = (int)state.range(0);
+    const size_t maxQueueDepth = (size_t)state.range(1);
+    const int    numFrames     = 16;
+    const TestFrame &frame = testFrame();
+
+    ImageOutput output(numWorkers,maxQueueDepth);
+    double producerSeconds = 0.;
+    for (auto _ : state) {
+      output.resetMetrics();
+      const double t0 = getCurrentTime();
+      for (int frameID=0;frameID<numFrames;frameID++) {
+        char name[64];
+        snprintf(name,sizeof(name),"osc_bench_seq_%i",frameID % 4);
+        output.push(OutputImage(benchFileName(std::string(name)+".png"),
+                                outputFrameSize,OutputImage::RGBA8,
+                                frame.rgba.data()));
+        output.push(OutputImage(benchFileName(std::string(name)+".exr"),
+                                outputFrameSize,OutputImage::FLOAT3,
+                                frame.linear.data()));
+      }
+      producerSeconds = getCurrentTime()-t0;
+      output.flush();
+    }
+    const ImageOutput::Metrics metrics = output.getMetrics();
+    for (int i=0;i<4;i++) {
+      char name[64];
+      snprintf(name,sizeof(name),"osc_bench_seq_%i",i);
+      remove(benchFileName(std::string(name)+".png").c_str());
+      remove(benchFileName(std::string(name)+".exr").c_str());
+    }
+    if (metrics.numFailed) {
+      state.SkipWithError("some images could not be written");
+      return;
+    }
+    state.counters["producerMs/frame"] = 1e3*producerSeconds/numFrames;
+    state.counters["stallMs/frame"]    = 1e3*metrics.stallSeconds/numFrames;
+    state.counters["stalls"]           = double(metrics.numStalls);
+    state.counters["maxQueueDepth"]    = double(metrics.maxQueueDepth);
+    state.counters["encodeMs"]         = 1e3*metrics.avgEncodeSeconds();
+    state.counters["maxEncodeMs"]      = 1e3*metrics.maxEncodeSeconds;
+    state.counters["frames/s"]
+      = benchmark::Counter(double(numFrames)*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! file format x exr compression */
+  BENCHMARK(BM_WriteImage)->ArgNames({"format","rle"})
+    ->Args({IMAGE_FILE_PNG,0})
+    ->Args({IMAGE_FILE_EXR,EXR_COMPRESSION_NONE})
+    ->Args({IMAGE_FILE_EXR,EXR_COMPRESSION_RLE})
+    ->Args({IMAGE_FILE_PFM,0})
+    ->Args({IMAGE_FILE_RAW,0})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  /*! workers x queue depth */
+  BENCHMARK(BM_SequenceOutput)->ArgNames({"workers","queue"})
+    ->Args({1,2})->Args({1,32})->Args({2,8})->Args({4,32})
+    ->Unit(benchmark::kMillisecond)->UseRealTime()->Iterations(2);
+
+} // ::osc
@@ -0,0 +1,157 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "benchScenes.h"
+#include "oscCore/ModelLoader.h"
+#include <fstream>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static void setTriangleCounters(benchmark::State &state, const BenchScene &scene)
+  {
+    state.counters["triangles"] = double(scene.numTriangles);
+    state.counters["Mtris/s"]
+      = benchmark::Counter(1e-6*scene.numTriangles*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! tinyobj's parsing of the obj and mtl files */
+  static void BM_ParseOBJ(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    for (auto _ : state) {
+      OBJData obj;
+      parseOBJ(scene->objFile,obj);
+      benchmark::DoNotOptimize(obj.shapes.data());
+    }
+    setTriangleCounters(state,*scene);
+    state.counters["MB/s"]
+      = benchmark::Counter(1e-6*scene->objFileSize*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! building the meshes from the parsed obj - which is mostly
+      de-duplicating vertices - without loading any textures */
+  static void BM_VertexDedup(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    OBJData obj;
+    parseOBJ(scene->objFile,obj);
+    for (auto &material : obj.materials)
+      material.diffuse_texname = "";
+    size_t numVertices = 0;
+    for (auto _ : state) {
+      Model model;
+      buildMeshes(&model,obj);
+      numVertices = 0;
+      for (auto mesh : model.meshes) numVertices += mesh->vertex.size();
+    }
+    setTriangleCounters(state,*scene);
+    state.counters["objVertices"] = double(obj.attributes.vertices.size()/3);
+    state.counters["vertices"]    = double(numVertices);
+  }
+
+  /*! the scene's texture files, read into memory once */
+  static const std::vector<std::vector<char>> &textureFiles(const BenchScene &scene)
+  {
+    static std::map<const BenchScene *,std::vector<std::vector<char>>> cache;
+    auto &files = cache[&scene];
+    if (files.empty())
+      for (auto &fileName : scene.textureFiles) {
+        std::ifstream file(fileName,std::ios::binary);
+        files.push_back(std::vector<char>((std::istreambuf_iterator<char>(file)),
+                                          std::istreambuf_iterator<char>()));
+      }
+    return files;
+  }
+
+  /*! decoding all of the scene's textures (including the flip) */
+  static void BM_DecodeTextures(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const auto &files = textureFiles(*scene);
+    size_t numPixels = 0;
+    for (auto _ : state) {
+      numPixels = 0;
+      for (auto &file : files) {
+        Texture *texture = decodeTexture(file.data(),file.size());
+        if (texture) numPixels += size_t(texture->resolution.x)*texture->resolution.y;
+        delete texture;
+      }
+    }
+    state.counters["textures"] = double(files.size());
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*numPixels*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! just the flip (and copy) of the decoded textures */
+  static void BM_FlipTextures(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const Model &model = *scene->model;
+    size_t numPixels = 0;
+    for (auto texture : model.textures)
+      numPixels += size_t(texture->resolution.x)*texture->resolution.y;
+    for (auto _ : state)
+      for (auto texture : model.textures)
+        delete createTexture(texture->pixel,texture->resolution);
+    state.counters["textures"] = double(model.textures.size());
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*numPixels*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! the model's bounding box over all vertices */
+  static void BM_ComputeBounds(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    Model &model = *scene->model;
+    size_t numVertices = 0;
+    for (auto mesh : model.meshes) numVertices += mesh->vertex.size();
+    for (auto _ : state) {
+      computeBounds(&model);
+      benchmark::DoNotOptimize(model.bounds);
+    }
+    state.counters["Mvertices/s"]
+      = benchmark::Counter(1e-6*numVertices*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! the whole loadOBJ() */
+  static void BM_LoadOBJ(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    for (auto _ : state)
+      delete loadOBJ(scene->objFile);
+    setTriangleCounters(state,*scene);
+  }
+
+  BENCHMARK(BM_ParseOBJ)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_VertexDedup)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_DecodeTextures)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_FlipTextures)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_ComputeBounds)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LoadOBJ)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
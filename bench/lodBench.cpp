@@ -0,0 +1,222 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "oscCore/CPURenderer.h"
+#include "oscCore/MeshLOD.h"
+#include "oscCore/SceneCache.h"
+#include <cstdio>
+#include <map>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a copy of the scene's model, with levels of detail */
+  static const Model &lodModel(const BenchScene &scene)
+  {
+    static std::map<const BenchScene *,std::unique_ptr<Model>> cache;
+    auto &model = cache[&scene];
+    if (!model) {
+      model.reset(copyModel(*scene.model));
+      buildLODs(model.get());
+    }
+    return *model;
+  }
+
+  /*! whether every level only references existing vertices, has
+      fewer triangles than the one before, and still has every seam
+      vertex (one whose position has other vertices, too) that the
+      full mesh uses - since those must not move */
+  static bool lodsAreValid(const TriangleMesh &mesh)
+  {
+    std::map<std::tuple<float,float,float>,int> verticesWithPosition;
+    for (auto &v : mesh.vertex)
+      verticesWithPosition[std::make_tuple(v.x,v.y,v.z)]++;
+    auto isSeam = [&](int i) {
+      const vec3f v = mesh.vertex[i];
+      return verticesWithPosition[std::make_tuple(v.x,v.y,v.z)] > 1;
+    };
+    std::vector<bool> seamUsed(mesh.vertex.size(),false);
+    for (auto &index : mesh.index)
+      for (int j=0;j<3;j++)
+        if (isSeam(index[j])) seamUsed[index[j]] = true;
+
+    for (int lod=1;lod<mesh.numLODs();lod++) {
+      if (mesh.numTriangles(lod) >= mesh.numTriangles(lod-1)) return false;
+      std::vector<bool> used(mesh.vertex.size(),false);
+      for (int primID=0;primID<mesh.numTriangles(lod);primID++) {
+        const vec3i index = mesh.getIndex(primID,lod);
+        for (int j=0;j<3;j++) {
+          if (index[j] < 0 || index[j] >= (int)mesh.vertex.size()) return false;
+          used[index[j]] = true;
+        }
+      }
+      for (size_t i=0;i<used.size();i++)
+        if (seamUsed[i] && !used[i]) return false;
+    }
+    return true;
+  }
+
+  /*! building all levels of all meshes; reports how many triangles
+      (relative to the full model) each level has, and how much
+      memory the levels' index buffers take */
+  static void BM_BuildLODs(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    for (auto _ : state) {
+      state.PauseTiming();
+      std::unique_ptr<Model> model(copyModel(*scene->model));
+      state.ResumeTiming();
+      buildLODs(model.get());
+    }
+
+    const Model &model = lodModel(*scene);
+    const int maxLevels = LODSettings().numLevels;
+    std::vector<size_t> levelTriangles(maxLevels+1,0);
+    size_t fullBytes = 0, lodBytes = 0;
+    for (auto mesh : model.meshes) {
+      if (!lodsAreValid(*mesh)) {
+        state.SkipWithError("invalid levels of detail");
+        return;
+      }
+      // (meshes with fewer levels count with their coarsest one)
+      for (int lod=0;lod<=maxLevels;lod++)
+        levelTriangles[lod] += mesh->numTriangles(std::min(lod,mesh->numLODs()-1));
+      fullBytes += mesh->sizeInBytes()-mesh->lodSizeInBytes();
+      lodBytes  += mesh->lodSizeInBytes();
+    }
+    for (int lod=1;lod<=maxLevels;lod++)
+      state.counters["tris"+std::to_string(lod)] = levelTriangles[lod]/double(levelTriangles[0]);
+    state.counters["lodMemory"] = lodBytes/double(fullBytes);
+    state.counters["Mtris/s"]
+      = benchmark::Counter(1e-6*scene->numTriangles*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  static const vec2i lodBenchSize(640,480);
+
+  /*! one (deterministic) frame of the lod model, at given pixel error */
+  static std::vector<uint32_t> renderLODFrame(CPURenderer &renderer, float lodPixelError)
+  {
+    renderer.lodPixelError = lodPixelError;
+    renderer.render();
+    std::vector<uint32_t> pixels(lodBenchSize.x*lodBenchSize.y);
+    renderer.downloadPixels(pixels.data());
+    return pixels;
+  }
+
+  /*! psnr of the rgb channels of 'image' relative to 'reference' */
+  static double psnr(const std::vector<uint32_t> &reference,
+                     const std::vector<uint32_t> &image)
+  {
+    double sumSquares = 0.;
+    for (size_t i=0;i<image.size();i++)
+      for (int c=0;c<3;c++) {
+        const double d = double((reference[i] >> (8*c)) & 0xff) - double((image[i] >> (8*c)) & 0xff);
+        sumSquares += d*d;
+      }
+    const double mse = sumSquares/(3.*image.size());
+    return mse == 0. ? 99. : 10.*log10(255.*255./mse);
+  }
+
+  /*! frames at full detail (x=0), or with the levels that stay below
+      x pixels of error; reports the triangles actually traced, the
+      memory of the scene the renderer built, and the image's psnr
+      relative to the full detail one */
+  static void BM_LODRender(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const float lodPixelError = float(state.range(1));
+    CPURenderer renderer(&lodModel(*scene),scene->light);
+    renderer.resize(lodBenchSize);
+    renderer.setCamera(scene->camera);
+    renderer.accumulate = false;
+    const std::vector<uint32_t> reference = renderLODFrame(renderer,0.f);
+    const size_t fullTriangles = renderer.stats.numTriangles;
+    const size_t fullBytes = renderer.getScene().sizeInBytes();
+    const std::vector<uint32_t> image = renderLODFrame(renderer,lodPixelError);
+
+    uint64_t numRays = 0;
+    for (auto _ : state) {
+      renderer.render();
+      numRays += renderer.stats.numRays;
+    }
+    state.counters["tris"]    = renderer.stats.numTriangles/double(fullTriangles);
+    state.counters["bvhMB"]   = renderer.getScene().sizeInBytes()*1e-6;
+    state.counters["memory"]  = renderer.getScene().sizeInBytes()/double(fullBytes);
+    state.counters["psnr"]    = psnr(reference,image);
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+  }
+
+  /*! scene x max pixel error (0 = full detail) */
+  static void lodRenderArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","x"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int pixels : { 0, 1, 4 })
+        b->Args({sceneID,pixels});
+  }
+
+  static bool sameMeshes(const Model &a, const Model &b)
+  {
+    if (a.meshes.size() != b.meshes.size()) return false;
+    for (size_t meshID=0;meshID<a.meshes.size();meshID++) {
+      const TriangleMesh &ma = *a.meshes[meshID], &mb = *b.meshes[meshID];
+      if (ma.vertex != mb.vertex || ma.normal != mb.normal
+          || ma.texcoord != mb.texcoord || ma.index != mb.index
+          || ma.diffuse != mb.diffuse || ma.diffuseTextureID != mb.diffuseTextureID
+          || ma.numLODs() != mb.numLODs())
+        return false;
+      for (size_t lod=0;lod<ma.lods.size();lod++)
+        if (ma.lods[lod].index != mb.lods[lod].index
+            || ma.lods[lod].error != mb.lods[lod].error)
+          return false;
+    }
+    return a.textures.size() == b.textures.size() && a.bounds == b.bounds;
+  }
+
+  /*! loading the lod model from a scene cache; compare with
+      BM_LoadOBJ, which has to parse (and then still build the lods) */
+  static void BM_LoadSceneCache(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const std::string cacheFile = benchFileName(scene->name+".osccache");
+    saveSceneCache(&lodModel(*scene),cacheFile);
+    std::unique_ptr<Model> loaded(loadSceneCache(cacheFile));
+    if (!sameMeshes(lodModel(*scene),*loaded)) {
+      state.SkipWithError("scene cache did not reproduce the model");
+      return;
+    }
+    for (auto _ : state)
+      delete loadSceneCache(cacheFile);
+    const size_t fileSize = std::ifstream(cacheFile,std::ios::ate|std::ios::binary).tellg();
+    remove(cacheFile.c_str());
+    state.counters["fileMB"] = fileSize*1e-6;
+    state.counters["MB/s"]
+      = benchmark::Counter(1e-6*fileSize*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  BENCHMARK(BM_BuildLODs)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LODRender)->Apply(lodRenderArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LoadSceneCache)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
@@ -0,0 +1,245 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "oscCore/CPURenderer.h"
+#include "oscCore/MeshOptimize.h"
+#include <map>
+#include <random>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! which mesh layout the benchmark runs with */
+  enum MeshLayout {
+    /*! as the loader created it (which, for the generated scenes,
+        is already a pretty regular order) */
+    MESH_LAYOUT_LOADED=0,
+    /*! triangles and vertices randomly permuted, as a stand-in for
+        an exporter that writes them in no particular order */
+    MESH_LAYOUT_SHUFFLED,
+    /*! the shuffled meshes, optimized for the vertex cache */
+    MESH_LAYOUT_VERTEX_CACHE,
+    /*! the shuffled meshes, in morton order */
+    MESH_LAYOUT_MORTON,
+    MESH_LAYOUT_COUNT
+  };
+
+  /*! puts each vertex array entry i at newID[i] */
+  template<typename T>
+  static void renumber(std::vector<T> &v, const std::vector<int> &newID)
+  {
+    if (v.empty()) return;
+    std::vector<T> renumbered(v.size());
+    for (size_t i=0;i<v.size();i++) renumbered[newID[i]] = v[i];
+    v.swap(renumbered);
+  }
+
+  /*! randomly permutes the mesh's triangles and vertices */
+  static void shuffleMesh(TriangleMesh *mesh, uint32_t seed)
+  {
+    std::mt19937 rng(seed);
+    std::shuffle(mesh->index.begin(),mesh->index.end(),rng);
+    std::vector<int> newID(mesh->vertex.size());
+    for (size_t i=0;i<newID.size();i++) newID[i] = int(i);
+    std::shuffle(newID.begin(),newID.end(),rng);
+    renumber(mesh->vertex,newID);
+    renumber(mesh->normal,newID);
+    renumber(mesh->texcoord,newID);
+    for (auto &tri : mesh->index)
+      tri = vec3i(newID[tri.x],newID[tri.y],newID[tri.z]);
+  }
+
+  static Model *layoutModel(const Model &model, MeshLayout layout)
+  {
+    Model *copy = copyModel(model);
+    if (layout == MESH_LAYOUT_LOADED) return copy;
+    for (size_t meshID=0;meshID<copy->meshes.size();meshID++)
+      shuffleMesh(copy->meshes[meshID],uint32_t(0x1234+meshID));
+    if (layout == MESH_LAYOUT_VERTEX_CACHE)
+      optimizeModel(copy,TRIANGLE_ORDER_VERTEX_CACHE);
+    if (layout == MESH_LAYOUT_MORTON)
+      optimizeModel(copy,TRIANGLE_ORDER_MORTON);
+    return copy;
+  }
+
+  static const Model &benchModel(const BenchScene &scene, MeshLayout layout)
+  {
+    static std::map<std::pair<const BenchScene *,int>,std::unique_ptr<Model>> cache;
+    auto &model = cache[std::make_pair(&scene,(int)layout)];
+    if (!model) model.reset(layoutModel(*scene.model,layout));
+    return *model;
+  }
+
+  /*! acmr over all meshes, weighted by their triangle counts */
+  static float averageCacheMissRatio(const Model &model)
+  {
+    double misses = 0., numTriangles = 0.;
+    for (auto mesh : model.meshes) {
+      misses += averageCacheMissRatio(mesh->index,int(mesh->vertex.size()))*mesh->index.size();
+      numTriangles += mesh->index.size();
+    }
+    return float(misses/numTriangles);
+  }
+
+  /*! whether both models have the same triangles, as in, the same
+      vertex data for each, in whichever order */
+  static bool sameTriangles(const Model &a, const Model &b)
+  {
+    typedef std::vector<float> TriangleKey;
+    auto triangleKeys = [](const TriangleMesh &mesh) {
+      std::vector<TriangleKey> keys;
+      for (auto &tri : mesh.index) {
+        TriangleKey key;
+        for (int j=0;j<3;j++) {
+          const vec3f v = mesh.vertex[tri[j]], n = mesh.normal[tri[j]];
+          const vec2f t = mesh.texcoord[tri[j]];
+          key.insert(key.end(),{ v.x,v.y,v.z,n.x,n.y,n.z,t.x,t.y });
+        }
+        keys.push_back(key);
+      }
+      std::sort(keys.begin(),keys.end());
+      return keys;
+    };
+    for (size_t meshID=0;meshID<a.meshes.size();meshID++)
+      if (triangleKeys(*a.meshes[meshID]) != triangleKeys(*b.meshes[meshID]))
+        return false;
+    return true;
+  }
+
+  /*! optimizing the shuffled meshes; also checks that the result is
+      still the same set of triangles */
+  static void BM_OptimizeModel(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const TriangleOrder order = (TriangleOrder)state.range(1);
+    const Model &shuffled = benchModel(*scene,MESH_LAYOUT_SHUFFLED);
+    for (auto _ : state) {
+      state.PauseTiming();
+      std::unique_ptr<Model> model(copyModel(shuffled));
+      state.ResumeTiming();
+      optimizeModel(model.get(),order);
+    }
+    const Model &optimized
+      = benchModel(*scene,order == TRIANGLE_ORDER_MORTON
+                   ? MESH_LAYOUT_MORTON : MESH_LAYOUT_VERTEX_CACHE);
+    if (!sameTriangles(*scene->model,optimized)) {
+      state.SkipWithError("optimized meshes do not have the same triangles");
+      return;
+    }
+    state.counters["acmrLoaded"]    = averageCacheMissRatio(*scene->model);
+    state.counters["acmrShuffled"]  = averageCacheMissRatio(shuffled);
+    state.counters["acmrOptimized"] = averageCacheMissRatio(optimized);
+    state.counters["Mtris/s"]
+      = benchmark::Counter(1e-6*scene->numTriangles*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! scene x triangle order */
+  static void optimizeArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","order"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int order=0;order<TRIANGLE_ORDER_COUNT;order++)
+        b->Args({sceneID,order});
+  }
+
+  static const vec2i localityBenchSize(640,480);
+
+  /*! the shading part of a frame: fetching and interpolating the
+      vertex data of each pixel's primary hit, in pixel order - which
+      is where the mesh layout shows (the bvh has its own copy of the
+      triangles, in leaf order, so traversal itself never touches the
+      meshes) */
+  static void BM_LocalityShade(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const Model &model = benchModel(*scene,(MeshLayout)state.range(1));
+    const CPUScene cpu(&model);
+    const CameraFrame camera
+      = computeCameraFrame(scene->camera,localityBenchSize.x/float(localityBenchSize.y));
+    std::vector<Hit> hits;
+    for (int iy=0;iy<localityBenchSize.y;iy++)
+      for (int ix=0;ix<localityBenchSize.x;ix++) {
+        const vec2f screen(vec2f(ix+.5f,iy+.5f)/vec2f(localityBenchSize));
+        Ray ray;
+        ray.org  = camera.position;
+        ray.dir  = normalize(camera.direction
+                             + (screen.x - 0.5f) * camera.horizontal
+                             + (screen.y - 0.5f) * camera.vertical);
+        ray.tmin = 0.f;
+        ray.tmax = 1e20f;
+        Hit hit;
+        if (cpu.intersect(ray,hit)) hits.push_back(hit);
+      }
+
+    for (auto _ : state) {
+      vec3f sum(0.f);
+      for (auto &hit : hits) {
+        const TriangleMesh &mesh = *model.meshes[hit.meshID];
+        const vec3i index = mesh.index[hit.primID];
+        const float u = hit.u, v = hit.v;
+        const vec3f P
+          = (1.f-u-v)*mesh.vertex[index.x] + u*mesh.vertex[index.y] + v*mesh.vertex[index.z];
+        const vec3f N
+          = normalize((1.f-u-v)*mesh.normal[index.x] + u*mesh.normal[index.y] + v*mesh.normal[index.z]);
+        const vec2f tc
+          = (1.f-u-v)*mesh.texcoord[index.x] + u*mesh.texcoord[index.y] + v*mesh.texcoord[index.z];
+        sum += P + N + vec3f(tc.x,tc.y,0.f);
+      }
+      benchmark::DoNotOptimize(sum);
+    }
+    state.counters["acmr"] = averageCacheMissRatio(model);
+    state.counters["Mhits/s"]
+      = benchmark::Counter(1e-6*hits.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! full frames, including the bvh traversal */
+  static void BM_LocalityRender(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    CPURenderer renderer(&benchModel(*scene,(MeshLayout)state.range(1)),scene->light);
+    renderer.resize(localityBenchSize);
+    renderer.setCamera(scene->camera);
+    renderer.accumulate = false;
+    uint64_t numRays = 0;
+    for (auto _ : state) {
+      renderer.render();
+      numRays += renderer.stats.numRays;
+    }
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+  }
+
+  /*! scene x mesh layout */
+  static void layoutArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","layout"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int layout=0;layout<MESH_LAYOUT_COUNT;layout++)
+        b->Args({sceneID,layout});
+  }
+
+  BENCHMARK(BM_OptimizeModel)->Apply(optimizeArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LocalityShade)->Apply(layoutArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LocalityRender)->Apply(layoutArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
@@ -0,0 +1,157 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "oscCore/ModelLoader.h"
+#include <cstdio>
+#include <map>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! which way the ply benchmark loads its file */
+  enum PLYPath {
+    /*! binary file, loadPLYBinary() */
+    PLY_PATH_BINARY_FAST=0,
+    /*! the same binary file, through the ply library */
+    PLY_PATH_BINARY_GENERIC,
+    /*! an ascii file, through the ply library */
+    PLY_PATH_ASCII_GENERIC,
+    PLY_PATH_COUNT
+  };
+
+  /*! all meshes of the model, merged into one (which is what a ply
+      file holds) */
+  static TriangleMesh mergedMesh(const Model &model)
+  {
+    TriangleMesh merged;
+    for (auto mesh : model.meshes) {
+      const int base = int(merged.vertex.size());
+      merged.vertex.insert(merged.vertex.end(),mesh->vertex.begin(),mesh->vertex.end());
+      merged.normal.insert(merged.normal.end(),mesh->normal.begin(),mesh->normal.end());
+      merged.texcoord.insert(merged.texcoord.end(),mesh->texcoord.begin(),mesh->texcoord.end());
+      for (auto &tri : mesh->index)
+        merged.index.push_back(tri+vec3i(base));
+    }
+    return merged;
+  }
+
+  /*! writes the mesh (which has to have normals and texcoords) as a
+      ply file, the way a scanner pipeline would: positions, normals,
+      and texcoords as floats, and faces as uchar-counted int lists */
+  static void writePLY(const TriangleMesh &mesh, const std::string &fileName, bool binary)
+  {
+    FILE *file = fopen(fileName.c_str(),"wb");
+    fprintf(file,"ply\nformat %s 1.0\ncomment written by oscBench\n",
+            binary ? "binary_little_endian" : "ascii");
+    fprintf(file,"element vertex %zu\n",mesh.vertex.size());
+    for (auto name : { "x", "y", "z", "nx", "ny", "nz", "u", "v" })
+      fprintf(file,"property float %s\n",name);
+    fprintf(file,"element face %zu\nproperty list uchar int vertex_indices\nend_header\n",
+            mesh.index.size());
+    for (size_t i=0;i<mesh.vertex.size();i++) {
+      const float v[8] = {
+        mesh.vertex[i].x, mesh.vertex[i].y, mesh.vertex[i].z,
+        mesh.normal[i].x, mesh.normal[i].y, mesh.normal[i].z,
+        mesh.texcoord[i].x, mesh.texcoord[i].y
+      };
+      if (binary)
+        fwrite(v,sizeof(v),1,file);
+      else
+        // (%.9g, so the floats read back exactly)
+        fprintf(file,"%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                v[0],v[1],v[2],v[3],v[4],v[5],v[6],v[7]);
+    }
+    for (auto &tri : mesh.index) {
+      if (binary) {
+        const uint8_t n = 3;
+        fwrite(&n,1,1,file);
+        fwrite(&tri,sizeof(tri),1,file);
+      } else
+        fprintf(file,"3 %i %i %i\n",tri.x,tri.y,tri.z);
+    }
+    fclose(file);
+  }
+
+  struct PLYBenchFile {
+    std::string  fileName;
+    size_t       fileSize { 0 };
+    TriangleMesh mesh;
+  };
+
+  /*! the scene as a ply file of given kind, written on first use */
+  static const PLYBenchFile &plyBenchFile(const BenchScene &scene, bool binary)
+  {
+    static std::map<std::pair<const BenchScene *,bool>,std::unique_ptr<PLYBenchFile>> cache;
+    auto &file = cache[std::make_pair(&scene,binary)];
+    if (!file) {
+      file.reset(new PLYBenchFile);
+      file->mesh = mergedMesh(*scene.model);
+      file->fileName = benchFileName(scene.name+(binary ? "_binary.ply" : "_ascii.ply"));
+      writePLY(file->mesh,file->fileName,binary);
+      file->fileSize = std::ifstream(file->fileName,std::ios::ate|std::ios::binary).tellg();
+    }
+    return *file;
+  }
+
+  static TriangleMesh loadPLYMesh(const std::string &fileName, PLYPath path)
+  {
+    TriangleMesh mesh;
+    if (path != PLY_PATH_BINARY_FAST)
+      loadPLYGeneric(fileName,mesh);
+    else if (!loadPLYBinary(fileName,mesh))
+      throw std::runtime_error("fast path did not take a binary ply file");
+    return mesh;
+  }
+
+  /*! loading the scene's meshes from a ply file; compare with
+      BM_LoadOBJ for the same triangles from the obj file */
+  static void BM_LoadPLY(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const PLYPath path = (PLYPath)state.range(1);
+    const PLYBenchFile &file = plyBenchFile(*scene,path != PLY_PATH_ASCII_GENERIC);
+    const TriangleMesh loaded = loadPLYMesh(file.fileName,path);
+    if (loaded.vertex != file.mesh.vertex || loaded.normal != file.mesh.normal
+        || loaded.texcoord != file.mesh.texcoord || loaded.index != file.mesh.index) {
+      state.SkipWithError("ply file did not load the mesh it was written from");
+      return;
+    }
+    for (auto _ : state)
+      benchmark::DoNotOptimize(loadPLYMesh(file.fileName,path).index.data());
+    state.counters["fileMB"] = file.fileSize*1e-6;
+    state.counters["MB/s"]
+      = benchmark::Counter(1e-6*file.fileSize*state.iterations(),
+                           benchmark::Counter::kIsRate);
+    state.counters["Mtris/s"]
+      = benchmark::Counter(1e-6*file.mesh.index.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! scene x load path */
+  static void plyArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","path"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int path=0;path<PLY_PATH_COUNT;path++)
+        b->Args({sceneID,path});
+  }
+
+  BENCHMARK(BM_LoadPLY)->Apply(plyArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
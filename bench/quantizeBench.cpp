@@ -0,0 +1,238 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "oscCore/CPURenderer.h"
+#include <map>
+#include <random>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const Model &benchModel(const BenchScene &scene, bool quantized)
+  {
+    static std::map<std::pair<const BenchScene *,bool>,std::unique_ptr<Model>> cache;
+    auto &model = cache[std::make_pair(&scene,quantized)];
+    if (!model) {
+      model.reset(copyModel(*scene.model));
+      if (quantized) quantizeModel(model.get());
+    }
+    return *model;
+  }
+
+  static size_t sizeInBytes(const Model &model)
+  {
+    size_t bytes = 0;
+    for (auto mesh : model.meshes) bytes += mesh->sizeInBytes();
+    return bytes;
+  }
+
+  /*! the largest decode error of any vertex, normal, and texcoord,
+      each relative to the bound QuantizedMesh promises for it (so
+      anything above 1 is a bug) */
+  struct QuantizationError {
+    float vertex   { 0.f };
+    float normal   { 0.f };
+    float texcoord { 0.f };
+    /*! the largest normal error, in degrees */
+    float normalDegrees { 0.f };
+  };
+
+  static QuantizationError quantizationError(const Model &original,
+                                             const Model &quantized)
+  {
+    QuantizationError error;
+    for (size_t meshID=0;meshID<original.meshes.size();meshID++) {
+      const TriangleMesh &mesh = *original.meshes[meshID];
+      const TriangleMesh &q    = *quantized.meshes[meshID];
+      const vec3f vertexBound   = q.quantized.vertexErrorBound();
+      const vec2f texcoordBound = q.quantized.texcoordErrorBound();
+      for (size_t i=0;i<mesh.vertex.size();i++) {
+        const vec3f d = abs(q.getVertex(int(i))-mesh.vertex[i]);
+        for (int dim=0;dim<3;dim++)
+          error.vertex = std::max(error.vertex,
+                                  vertexBound[dim] > 0.f ? d[dim]/vertexBound[dim] : d[dim]);
+      }
+      for (size_t i=0;i<mesh.normal.size();i++) {
+        // (atan2 rather than acos, which is too imprecise for tiny angles)
+        const vec3f a = normalize(mesh.normal[i]), b = q.getNormal(int(i));
+        const float angle = atan2f(length(cross(a,b)),dot(a,b));
+        error.normal = std::max(error.normal,angle/QuantizedMesh::normalErrorBound());
+        error.normalDegrees = std::max(error.normalDegrees,angle*float(180.f/M_PI));
+      }
+      for (size_t i=0;i<mesh.texcoord.size();i++) {
+        const vec2f d = abs(q.getTexcoord(int(i))-mesh.texcoord[i]);
+        for (int dim=0;dim<2;dim++)
+          error.texcoord = std::max(error.texcoord,
+                                    texcoordBound[dim] > 0.f ? d[dim]/texcoordBound[dim] : d[dim]);
+      }
+      for (int primID=0;primID<mesh.numTriangles();primID++)
+        if (q.getIndex(primID) != mesh.index[primID])
+          error.vertex = std::numeric_limits<float>::infinity();
+    }
+    return error;
+  }
+
+  /*! quantizing all meshes of a scene; also checks the decoded
+      vertex data against the error bounds, and reports how much
+      memory it saves */
+  static void BM_QuantizeModel(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    for (auto _ : state) {
+      state.PauseTiming();
+      std::unique_ptr<Model> model(copyModel(*scene->model));
+      state.ResumeTiming();
+      quantizeModel(model.get());
+    }
+
+    const Model &quantized = benchModel(*scene,true);
+    const QuantizationError error = quantizationError(*scene->model,quantized);
+    if (error.vertex > 1.f || error.normal > 1.f || error.texcoord > 1.f) {
+      state.SkipWithError("quantization error exceeds the promised bounds");
+      return;
+    }
+    const size_t fullBytes      = sizeInBytes(*scene->model);
+    const size_t quantizedBytes = sizeInBytes(quantized);
+    state.counters["fullMB"]      = fullBytes*1e-6;
+    state.counters["quantizedMB"] = quantizedBytes*1e-6;
+    state.counters["ratio"]       = fullBytes/double(quantizedBytes);
+    state.counters["vertexErr"]   = error.vertex;
+    state.counters["normalErr"]   = error.normal;
+    state.counters["normalDeg"]   = error.normalDegrees;
+    state.counters["uvErr"]       = error.texcoord;
+    state.counters["Mtris/s"]
+      = benchmark::Counter(1e-6*scene->numTriangles*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! what the hit shading path does with the mesh data: for random
+      hit points, fetch and interpolate position, normal, and
+      texcoord - from either the regular or the quantized arrays */
+  static void BM_DecodeHits(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const Model &model = benchModel(*scene,state.range(1) != 0);
+
+    struct HitPoint { int meshID, primID; float u, v; };
+    std::vector<HitPoint> hits(1<<20);
+    std::mt19937 rng(0x789);
+    std::uniform_int_distribution<int> meshDist(0,int(model.meshes.size())-1);
+    std::uniform_real_distribution<float> bary(0.f,.5f);
+    for (auto &hit : hits) {
+      hit.meshID = meshDist(rng);
+      hit.primID = std::uniform_int_distribution<int>
+        (0,model.meshes[hit.meshID]->numTriangles()-1)(rng);
+      hit.u = bary(rng);
+      hit.v = bary(rng);
+    }
+
+    for (auto _ : state) {
+      vec3f sum(0.f);
+      for (auto &hit : hits) {
+        const TriangleMesh &mesh = *model.meshes[hit.meshID];
+        const vec3i index = mesh.getIndex(hit.primID);
+        const float u = hit.u, v = hit.v;
+        const vec3f P
+          = (1.f-u-v)*mesh.getVertex(index.x) + u*mesh.getVertex(index.y) + v*mesh.getVertex(index.z);
+        const vec3f N = mesh.hasNormals()
+          ? normalize((1.f-u-v)*mesh.getNormal(index.x) + u*mesh.getNormal(index.y) + v*mesh.getNormal(index.z))
+          : vec3f(0.f);
+        const vec2f tc = mesh.hasTexcoords()
+          ? (1.f-u-v)*mesh.getTexcoord(index.x) + u*mesh.getTexcoord(index.y) + v*mesh.getTexcoord(index.z)
+          : vec2f(0.f);
+        sum += P + N + vec3f(tc.x,tc.y,0.f);
+      }
+      benchmark::DoNotOptimize(sum);
+    }
+    state.counters["Mhits/s"]
+      = benchmark::Counter(1e-6*hits.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! camera rays through the scene built from either the regular or
+      the quantized meshes (the bvh's own triangle copy is full
+      precision either way, so this should be the same for both) */
+  static void BM_QuantizedTraverse(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const CPUScene cpu(&benchModel(*scene,state.range(1) != 0));
+    const vec2i size(512,512);
+    const CameraFrame camera = computeCameraFrame(scene->camera,1.f);
+    std::vector<Ray> rays;
+    for (int iy=0;iy<size.y;iy++)
+      for (int ix=0;ix<size.x;ix++) {
+        const vec2f screen(vec2f(ix+.5f,iy+.5f)/vec2f(size));
+        Ray ray;
+        ray.org  = camera.position;
+        ray.dir  = normalize(camera.direction
+                             + (screen.x - 0.5f) * camera.horizontal
+                             + (screen.y - 0.5f) * camera.vertical);
+        ray.tmin = 0.f;
+        ray.tmax = 1e20f;
+        rays.push_back(ray);
+      }
+    for (auto _ : state) {
+      int numHits = 0;
+      for (auto &ray : rays) {
+        Hit hit;
+        numHits += cpu.intersect(ray,hit);
+      }
+      benchmark::DoNotOptimize(numHits);
+    }
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*rays.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! full frames, with shading decoding the quantized data on the
+      fly */
+  static void BM_QuantizedRender(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    CPURenderer renderer(&benchModel(*scene,state.range(1) != 0),scene->light);
+    renderer.resize(vec2i(640,480));
+    renderer.setCamera(scene->camera);
+    renderer.accumulate = false;
+    uint64_t numRays = 0;
+    for (auto _ : state) {
+      renderer.render();
+      numRays += renderer.stats.numRays;
+    }
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+  }
+
+  /*! scene x {full precision, quantized} */
+  static void quantizedArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","quantized"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int quantized=0;quantized<2;quantized++)
+        b->Args({sceneID,quantized});
+  }
+
+  BENCHMARK(BM_QuantizeModel)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_DecodeHits)->Apply(quantizedArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_QuantizedTraverse)->Apply(quantizedArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_QuantizedRender)->Apply(quantizedArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
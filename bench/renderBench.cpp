@@ -0,0 +1,717 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "benchScenes.h"
+#include "cacheMissCounter.h"
+#include "oscCore/CPURenderer.h"
+#include "oscCore/ImageOutput.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const vec2i renderBenchSize(640,480);
+
+  /*! a cpu renderer for the scene, set up with the scene's camera
+      and light */
+  static CPURenderer &sceneRenderer(const BenchScene &scene)
+  {
+    static std::map<const BenchScene *,std::unique_ptr<CPURenderer>> cache;
+    auto &renderer = cache[&scene];
+    if (!renderer) {
+      renderer.reset(new CPURenderer(scene.model,scene.light));
+      renderer->resize(renderBenchSize);
+      renderer->setCamera(scene.camera);
+    }
+    return *renderer;
+  }
+
+  /*! a few accumulated frames of the scene, as input for the image
+      stages below */
+  static const FrameBuffer &sceneFrame(const BenchScene &scene)
+  {
+    static std::map<const BenchScene *,FrameBuffer> cache;
+    FrameBuffer &fb = cache[&scene];
+    if (fb.size.x == 0) {
+      CPURenderer &renderer = sceneRenderer(scene);
+      renderer.setCamera(scene.camera);
+      for (int i=0;i<4;i++)
+        renderer.render();
+      fb = renderer.getFrameBuffer();
+    }
+    return fb;
+  }
+
+  static void setPixelCounters(benchmark::State &state)
+  {
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*renderBenchSize.x*renderBenchSize.y*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! one frame (one sample per pixel, four shadow rays per hit) */
+  static void BM_RenderFrame(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    CPURenderer &renderer = sceneRenderer(*scene);
+    renderer.accumulate = false;
+    uint64_t numRays = 0;
+    for (auto _ : state) {
+      renderer.render();
+      numRays += renderer.stats.numRays;
+    }
+    renderer.accumulate = true;
+    setPixelCounters(state);
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+  }
+
+  /*! the same frame, with the scene's bvh built with given quality */
+  static void BM_RenderFrameBVH(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const BVHBuildSettings settings
+      = bvhBuildSettingsFor((BVHBuildQuality)state.range(1));
+    CPURenderer renderer(scene->model,scene->light,settings);
+    renderer.resize(renderBenchSize);
+    renderer.setCamera(scene->camera);
+    renderer.accumulate = false;
+    uint64_t numRays = 0;
+    for (auto _ : state) {
+      renderer.render();
+      numRays += renderer.stats.numRays;
+    }
+    setPixelCounters(state);
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+    state.counters["buildSeconds"] = renderer.getScene().buildSeconds;
+    state.counters["sceneMB"]      = renderer.getScene().sizeInBytes()*1e-6;
+  }
+
+  /*! scene x bvh build quality */
+  static void renderBVHArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","quality"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int quality=0;quality<BVH_BUILD_QUALITY_COUNT;quality++)
+        b->Args({sceneID,quality});
+  }
+
+  /*! the small spheres, with all meshes given the same attributes:
+      shading normals or not, all textured or none, quantized or not */
+  static const Model &shadingModel(bool normals, bool texture, bool quantized)
+  {
+    static std::map<int,std::unique_ptr<Model>> cache;
+    auto &model = cache[4*normals+2*texture+quantized];
+    if (!model) {
+      model.reset(copyModel(*getBenchScene(BENCH_SCENE_SPHERES_SMALL)->model));
+      int textureID = -1;
+      for (auto mesh : model->meshes)
+        textureID = std::max(textureID,mesh->diffuseTextureID);
+      for (auto mesh : model->meshes) {
+        if (!normals) mesh->normal.clear();
+        mesh->diffuseTextureID = texture ? textureID : -1;
+      }
+      if (quantized) quantizeModel(model.get());
+    }
+    return *model;
+  }
+
+  /*! gives the benchmark access to the closest hit programs, to
+      time shading without the primary rays around it */
+  class ShadingBenchRenderer : public CPURenderer {
+  public:
+    using CPURenderer::CPURenderer;
+
+    /*! shades the given hits, with the same variants render() would
+        use; returns the seconds that took */
+    double shadeHits(const std::vector<Ray> &rays, const std::vector<Hit> &hits)
+    {
+      selectShaders();
+      RayCounts counts;
+      vec3f sum(0.f);
+      const double t0 = getCurrentTime();
+      for (size_t i=0;i<hits.size();i++) {
+        Random random;
+        random.init(int(i),0);
+        sum += (this->*meshShaders[hits[i].meshID])(rays[i],hits[i],random,counts,nullptr).color;
+      }
+      const double seconds = getCurrentTime()-t0;
+      benchmark::DoNotOptimize(sum);
+      return seconds;
+    }
+  };
+
+  /*! the shading variant for the given attributes and light sample
+      count, or the generic variant that checks all of them per hit,
+      on all primary hits of a frame */
+  static void BM_ShadingVariant(benchmark::State &state)
+  {
+    const BenchScene *scene = getBenchScene(BENCH_SCENE_SPHERES_SMALL);
+    const Model &model = shadingModel(state.range(0) != 0,state.range(1) != 0,
+                                      state.range(2) != 0);
+    ShadingBenchRenderer renderer(&model,scene->light);
+    renderer.resize(renderBenchSize);
+    renderer.setCamera(scene->camera);
+    renderer.accumulate      = false;
+    renderer.numLightSamples = (int)state.range(3);
+
+    // either variant has to give the exact same pixels
+    renderer.specializedShading = false;
+    renderer.render();
+    const std::vector<uint8_t> expected = renderer.getFrameBuffer().color;
+    renderer.specializedShading = state.range(4) != 0;
+    renderer.render();
+    if (renderer.getFrameBuffer().color != expected) {
+      state.SkipWithError("specialized shading does not match generic shading");
+      return;
+    }
+
+    // one hit per pixel, for the same view
+    const CameraFrame camera
+      = computeCameraFrame(scene->camera,renderBenchSize.x/float(renderBenchSize.y));
+    std::vector<Ray> rays;
+    std::vector<Hit> hits;
+    for (int iy=0;iy<renderBenchSize.y;iy++)
+      for (int ix=0;ix<renderBenchSize.x;ix++) {
+        const vec2f screen((vec2f(ix,iy)+.5f)/vec2f(renderBenchSize));
+        Ray ray;
+        ray.org  = camera.position;
+        ray.dir  = normalize(camera.direction
+                             + (screen.x - 0.5f) * camera.horizontal
+                             + (screen.y - 0.5f) * camera.vertical);
+        ray.tmin = 0.f;
+        ray.tmax = 1e20f;
+        Hit hit;
+        if (!renderer.getScene().intersect(ray,hit)) continue;
+        rays.push_back(ray);
+        hits.push_back(hit);
+      }
+
+    for (auto _ : state)
+      state.SetIterationTime(renderer.shadeHits(rays,hits));
+    state.SetLabel(scene->name);
+    state.counters["Mhits/s"]
+      = benchmark::Counter(1e-6*hits.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! mesh attributes x {ambient only, four light samples} x
+      {generic, specialized} */
+  static void shadingVariantArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"normals","texture","quantized","lightSamples","specialized"});
+    for (int normals=0;normals<2;normals++)
+      for (int texture=0;texture<2;texture++)
+        for (int quantized=0;quantized<2;quantized++)
+          for (int lightSamples : { 0, 4 })
+            for (int specialized=0;specialized<2;specialized++)
+              b->Args({normals,texture,quantized,lightSamples,specialized});
+  }
+
+  /*! one frame, shading each hit right away, or in wavefronts with
+      the hits sorted by material */
+  static void BM_RenderWavefront(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    CPURenderer renderer(scene->model,scene->light);
+    renderer.resize(renderBenchSize);
+    renderer.setCamera(scene->camera);
+    renderer.accumulate = false;
+
+    // either way has to give the exact same pixels
+    renderer.wavefront = false;
+    renderer.render();
+    const std::vector<uint8_t> expected = renderer.getFrameBuffer().color;
+    renderer.wavefront = state.range(1) != 0;
+    renderer.render();
+    if (renderer.getFrameBuffer().color != expected) {
+      state.SkipWithError("wavefront rendering does not match immediate shading");
+      return;
+    }
+
+    CacheMissCounter cacheMisses;
+    uint64_t numRays = 0, numHits = 0, numMisses = 0;
+    for (auto _ : state) {
+      cacheMisses.start();
+      renderer.render();
+      numMisses += cacheMisses.stop();
+      numRays   += renderer.stats.numRays;
+      numHits   += renderer.stats.numHits;
+    }
+    setPixelCounters(state);
+    state.counters["Mrays/s"]
+      = benchmark::Counter(1e-6*numRays,benchmark::Counter::kIsRate);
+    state.counters["Mhits/s"]
+      = benchmark::Counter(1e-6*numHits,benchmark::Counter::kIsRate);
+    if (cacheMisses.available())
+      state.counters["LLCmisses/ray"] = numMisses/double(std::max(uint64_t(1),numRays));
+  }
+
+  /*! scene x {immediate, wavefront} */
+  static void wavefrontArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","wavefront"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int wavefront=0;wavefront<2;wavefront++)
+        b->Args({sceneID,wavefront});
+  }
+
+  /*! light sampling gets compared at a lower resolution, so the
+      reference images do not take forever */
+  static const vec2i lightSamplingSize(160,120);
+
+  /*! a renderer for given model, with the scene's light and camera,
+      at lightSamplingSize */
+  static std::unique_ptr<CPURenderer> lightSamplingRenderer(const Model *model,
+                                                            const BenchScene &scene)
+  {
+    std::unique_ptr<CPURenderer> renderer(new CPURenderer(model,scene.light));
+    renderer->resize(lightSamplingSize);
+    renderer->setCamera(scene.camera);
+    return renderer;
+  }
+
+  /*! the converged image that 'key' names: 'numFrames' accumulated
+      frames of the renderer that configure() sets up. Gets rendered
+      on first use, and cached */
+  static const std::vector<vec3f> &
+  convergedReference(const std::string &key, int numFrames,
+                     const std::function<std::unique_ptr<CPURenderer>()> &configure)
+  {
+    static std::map<std::string,std::vector<vec3f>> cache;
+    std::vector<vec3f> &reference = cache[key];
+    if (reference.empty()) {
+      std::unique_ptr<CPURenderer> renderer = configure();
+      for (int i=0;i<numFrames;i++)
+        renderer->render();
+      const FrameBuffer &fb = renderer->getFrameBuffer();
+      for (size_t i=0;i<fb.numPixels();i++)
+        reference.push_back(loadColor(fb.format.color,fb.color.data(),i));
+    }
+    return reference;
+  }
+
+  /*! how far the images of a benchmark's iterations are off from
+      their reference, summed over the iterations */
+  struct ImageError {
+    /*! sum of the images' mean squared (per channel) error */
+    double squaredError { 0. };
+    /*! sum of the images' mean pixel values */
+    double color        { 0. };
+  };
+
+  /*! the average of all channels of all pixels */
+  static double meanColor(const std::vector<vec3f> &image)
+  {
+    double sum = 0.;
+    for (auto &c : image) sum += (c.x+c.y+c.z)/3.;
+    return sum/image.size();
+  }
+
+  /*! renders 'numFrames' frames, accumulated on top of whatever the
+      renderer has accumulated so far (so restart that first), and
+      adds how far the result is off from the reference to 'error';
+      sums up the frames' stats in 'frameStats', if given */
+  static void accumulateError(CPURenderer &renderer,
+                              const std::vector<vec3f> &reference,
+                              int numFrames,
+                              ImageError &error,
+                              CPURenderer::Stats *frameStats = nullptr)
+  {
+    for (int i=0;i<numFrames;i++) {
+      renderer.render();
+      if (frameStats) {
+        frameStats->seconds    += renderer.stats.seconds;
+        frameStats->numRays    += renderer.stats.numRays;
+        frameStats->numHits    += renderer.stats.numHits;
+        frameStats->numBounces += renderer.stats.numBounces;
+      }
+    }
+    const FrameBuffer &fb = renderer.getFrameBuffer();
+    std::vector<vec3f> image;
+    double squaredError = 0.;
+    for (size_t i=0;i<fb.numPixels();i++) {
+      image.push_back(loadColor(fb.format.color,fb.color.data(),i));
+      const vec3f diff = image.back()-reference[i];
+      squaredError += dot(diff,diff)/3.;
+    }
+    error.squaredError += squaredError/fb.numPixels();
+    error.color        += meanColor(image);
+  }
+
+  /*! the counters all error benchmarks report: the rmse to the
+      converged image, and how much error goes away per time spent
+      (1/(rmse^2*seconds), which is independent of the number of
+      frames) */
+  static void setErrorCounters(benchmark::State &state, const ImageError &error)
+  {
+    const double mse = error.squaredError/state.iterations();
+    state.counters["rmse"] = sqrt(mse);
+    state.counters["efficiency"]
+      = benchmark::Counter(state.iterations()/mse,benchmark::Counter::kIsRate);
+  }
+
+  /*! how far the average pixel is off from the reference's (which,
+      for an unbiased estimator, only gets smaller with more
+      iterations) */
+  static double meanError(benchmark::State &state, const ImageError &error,
+                          const std::vector<vec3f> &reference)
+  {
+    return error.color/state.iterations()/meanColor(reference)-1.;
+  }
+
+  /*! sixteen accumulated frames with given light sampling and number
+      of light samples, against the scene converged with stratified
+      samples on the quad (which is unbiased independent of the solid
+      angle mapping the other ways get checked for) */
+  static void BM_LightSamplingRMSE(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const std::vector<vec3f> &reference
+      = convergedReference("lightSampling/"+scene->name,128,[&]{
+          std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(scene->model,*scene);
+          renderer->numLightSamples = 16;
+          renderer->lightSampling   = LIGHT_SAMPLING_STRATIFIED;
+          return renderer;
+        });
+    std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(scene->model,*scene);
+    renderer->lightSampling   = (LightSampling)state.range(1);
+    renderer->numLightSamples = (int)state.range(2);
+    ImageError error;
+    for (auto _ : state) {
+      renderer->setCamera(scene->camera);
+      accumulateError(*renderer,reference,16,error);
+    }
+    setErrorCounters(state,error);
+  }
+
+  /*! scene x sampling x {1, 4} light samples */
+  static void lightSamplingArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","sampling","lightSamples"});
+    for (int sceneID=0;sceneID<BENCH_SCENE_COUNT;sceneID++)
+      for (int sampling=0;sampling<LIGHT_SAMPLING_COUNT;sampling++)
+        for (int lightSamples : { 1, 4 })
+          b->Args({sceneID,sampling,lightSamples});
+  }
+
+  /*! the city, plus n emissive triangles ("street lamps") a few units
+      above its streets, in four materials with different Ke. The
+      lamps go through an obj/mtl file and the regular loader, so
+      this also checks that Ke makes it into the meshes; nullptr if it
+      does not */
+  static const Model *manyLightsModel(int numLamps)
+  {
+    static std::map<int,std::unique_ptr<Model>> cache;
+    std::unique_ptr<Model> &model = cache[numLamps];
+    if (model) return model.get();
+
+    const Model &city = *getBenchScene(BENCH_SCENE_CITY)->model;
+    const std::string baseName = "osc_bench_lamps_"+std::to_string(numLamps);
+    {
+      std::ofstream mtl(benchFileName(baseName+".mtl"));
+      for (int m=0;m<4;m++) {
+        const float Ke = 50.f*(1<<m);
+        mtl << "newmtl lamp" << m << "\n"
+            << "Kd 0 0 0\n"
+            << "Ke " << Ke << " " << .8f*Ke << " " << .6f*Ke << "\n";
+      }
+      std::ofstream obj(benchFileName(baseName+".obj"));
+      obj << "mtllib " << baseName << ".mtl\n" << "o lamps\n";
+      // the city's streets run along every multiple of its block
+      // size (20), in x and in z
+      std::mt19937 rng(numLamps);
+      const float size = city.bounds.span().x;
+      std::uniform_int_distribution<int>    street(0,int(size/20.f));
+      std::uniform_real_distribution<float> along(0.f,size);
+      const float height = 4.5f, r = .4f;
+      char line[256];
+      for (int i=0;i<numLamps;i++) {
+        const float s = 20.f*street(rng), t = along(rng);
+        const vec3f P = (i & 1) ? vec3f(s,height,t) : vec3f(t,height,s);
+        snprintf(line,sizeof(line),"usemtl lamp%d\nv %f %f %f\nv %f %f %f\nv %f %f %f\nf -3 -2 -1\n",
+                 (i >> 1) & 3,
+                 P.x-r,P.y,P.z-r, P.x+r,P.y,P.z-r, P.x,P.y,P.z+r);
+        obj << line;
+      }
+    }
+    std::unique_ptr<Model> lamps(loadOBJ(benchFileName(baseName+".obj")));
+    size_t numEmissive = 0;
+    for (auto mesh : lamps->meshes)
+      if (reduce_max(mesh->emission) > 0.f)
+        numEmissive += mesh->index.size();
+    if ((int)numEmissive != numLamps) return nullptr;
+
+    model.reset(copyModel(city));
+    for (auto mesh : lamps->meshes)
+      model->meshes.push_back(mesh);
+    lamps->meshes.clear();
+    return model.get();
+  }
+
+  /*! the city with the quad light plus n lamps, sixteen accumulated
+      frames of four light samples each, with given light selection,
+      against the lamp scene converged with the light tree: the frame
+      time (and shadow rays per hit) should not depend on n, only the
+      noise should. Reports rmse and efficiency as
+      BM_LightSamplingRMSE does, and the mean error */
+  static void BM_ManyLights(benchmark::State &state)
+  {
+    const int numLamps = (int)state.range(0);
+    const BenchScene *city = getBenchScene(BENCH_SCENE_CITY);
+    const Model *model = city ? manyLightsModel(numLamps) : nullptr;
+    if (!model) {
+      state.SkipWithError("could not build the lamp scene, or its lamps are not emissive");
+      return;
+    }
+    const std::vector<vec3f> &reference
+      = convergedReference("manyLights/"+std::to_string(numLamps),64,[&]{
+          std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(model,*city);
+          renderer->numLightSamples = 16;
+          renderer->lightSelection  = LIGHT_SELECTION_TREE;
+          return renderer;
+        });
+    std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(model,*city);
+    renderer->numLightSamples = 4;
+    renderer->lightSelection  = (LightSelection)state.range(1);
+    ImageError error;
+    CPURenderer::Stats frameStats;
+    for (auto _ : state) {
+      renderer->setCamera(city->camera);
+      accumulateError(*renderer,reference,16,error,&frameStats);
+    }
+    const uint64_t numPrimaryRays
+      = uint64_t(state.iterations())*16*renderer->getFrameBuffer().numPixels();
+    setErrorCounters(state,error);
+    state.counters["lights"] = double(renderer->getLights().size());
+    state.counters["shadowRaysPerHit"]
+      = double(frameStats.numRays-numPrimaryRays)/std::max(frameStats.numHits,uint64_t(1));
+    state.counters["meanError"] = meanError(state,error,reference);
+  }
+
+  /*! lamps x light selection */
+  static void manyLightsArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"lamps","selection"});
+    for (int numLamps : { 1, 10, 100, 1000, 10000 })
+      for (int selection=0;selection<LIGHT_SELECTION_COUNT;selection++)
+        b->Args({numLamps,selection});
+  }
+
+  /*! a clear sky as an hdr environment map: a blue gradient that gets
+      brighter towards the horizon, a dull ground below it, and a
+      small sun that outshines all of the sky together. Gets
+      written as a radiance (.hdr) file, and read back through
+      loadEnvironmentMap() */
+  static const EnvironmentMap &benchEnvironment()
+  {
+    static std::unique_ptr<EnvironmentMap> environment;
+    if (environment) return *environment;
+    const vec2i res(512,256);
+    const vec3f sunDir = normalize(vec3f(.5f,.6f,.4f));
+    const float sunCos = cosf(float(2.*M_PI/180.));
+    std::vector<vec3f> pixels;
+    for (int y=0;y<res.y;y++)
+      for (int x=0;x<res.x;x++) {
+        const vec3f dir = environmentDirection(vec2f((x+.5f)/res.x,(y+.5f)/res.y));
+        vec3f radiance
+          = dir.y < 0.f
+          ? vec3f(.2f,.18f,.15f)
+          : (1.f-dir.y)*vec3f(.8f,.85f,.9f) + dir.y*vec3f(.25f,.4f,.8f);
+        if (dot(dir,sunDir) > sunCos)
+          radiance = vec3f(800.f,760.f,700.f);
+        pixels.push_back(radiance);
+      }
+    const std::string fileName = benchFileName("osc_bench_sky.hdr");
+    stbi_write_hdr(fileName.c_str(),res.x,res.y,3,&pixels[0].x);
+    environment.reset(loadEnvironmentMap(fileName));
+    return *environment;
+  }
+
+  /*! sixteen accumulated frames lit only by the sky, with given
+      environment sampling and number of samples per hit, against the
+      scene converged with many importance sampled directions per
+      hit; reports rmse and efficiency as BM_LightSamplingRMSE does */
+  static void BM_EnvironmentLighting(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const std::vector<vec3f> &reference
+      = convergedReference("environment/"+scene->name,64,[&]{
+          std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(scene->model,*scene);
+          renderer->setEnvironment(&benchEnvironment());
+          renderer->numLightSamples       = 0;
+          renderer->numEnvironmentSamples = 16;
+          renderer->environmentSampling   = ENVIRONMENT_SAMPLING_IMPORTANCE;
+          return renderer;
+        });
+    std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(scene->model,*scene);
+    renderer->setEnvironment(&benchEnvironment());
+    renderer->numLightSamples       = 0;
+    renderer->environmentSampling   = (EnvironmentSampling)state.range(1);
+    renderer->numEnvironmentSamples = (int)state.range(2);
+    ImageError error;
+    for (auto _ : state) {
+      renderer->setCamera(scene->camera);
+      accumulateError(*renderer,reference,16,error);
+    }
+    setErrorCounters(state,error);
+  }
+
+  /*! the two outdoor scenes x sampling x {1, 4} samples */
+  static void environmentArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","sampling","envSamples"});
+    for (int sceneID : { BENCH_SCENE_SPHERES_SMALL, BENCH_SCENE_CITY })
+      for (int sampling=0;sampling<ENVIRONMENT_SAMPLING_COUNT;sampling++)
+        for (int envSamples : { 1, 4 })
+          b->Args({sceneID,sampling,envSamples});
+  }
+
+  /*! the path tracing scenes: the small spheres, and the city with
+      the 100 lamps of BM_ManyLights, so that bounces also hit
+      emitters; both with the quad light, and under the sky */
+  static const Model *pathTracingModel(const BenchScene &scene)
+  {
+    return &scene == getBenchScene(BENCH_SCENE_CITY) ? manyLightsModel(100) : scene.model;
+  }
+
+  /*! sixteen accumulated frames of one path per pixel, with given
+      maximum depth, and with or without russian roulette (from
+      rouletteDepth 3 on), against the scene converged with paths
+      that only roulette ends. Reports the average path length,
+      paths/s, rmse and efficiency as BM_LightSamplingRMSE does, and
+      the mean error, which is how much light the depth limit cuts
+      off */
+  static void BM_PathTracing(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const Model *model = pathTracingModel(*scene);
+    if (!model) {
+      state.SkipWithError("could not build the lamp scene");
+      return;
+    }
+    const std::vector<vec3f> &reference
+      = convergedReference("pathTracing/"+scene->name,256,[&]{
+          std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(model,*scene);
+          renderer->setEnvironment(&benchEnvironment());
+          renderer->pathTracing   = true;
+          renderer->maxPathDepth  = 64;
+          renderer->rouletteDepth = 8;
+          return renderer;
+        });
+    std::unique_ptr<CPURenderer> renderer = lightSamplingRenderer(model,*scene);
+    renderer->setEnvironment(&benchEnvironment());
+    renderer->pathTracing   = true;
+    renderer->maxPathDepth  = (int)state.range(1);
+    renderer->rouletteDepth = state.range(2) ? 3 : renderer->maxPathDepth;
+    ImageError error;
+    CPURenderer::Stats frameStats;
+    for (auto _ : state) {
+      renderer->setCamera(scene->camera);
+      accumulateError(*renderer,reference,16,error,&frameStats);
+    }
+    const double numPaths
+      = double(state.iterations())*16*renderer->getFrameBuffer().numPixels();
+    setErrorCounters(state,error);
+    state.counters["pathLength"] = 1.+frameStats.numBounces/numPaths;
+    state.counters["paths/s"]
+      = benchmark::Counter(numPaths,benchmark::Counter::kIsRate);
+    state.counters["meanError"] = meanError(state,error,reference);
+  }
+
+  /*! the two path tracing scenes x max depth x roulette off/on
+      (paths of up to three segments never get to roulette) */
+  static void pathTracingArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"scene","depth","roulette"});
+    for (int sceneID : { BENCH_SCENE_SPHERES_SMALL, BENCH_SCENE_CITY })
+      for (int depth : { 1, 2, 4, 8, 16 })
+        for (int roulette : { 0, 1 })
+          if (depth > 3 || !roulette)
+            b->Args({sceneID,depth,roulette});
+  }
+
+  static void BM_SceneToneMap(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const FrameBuffer &fb = sceneFrame(*scene);
+    std::vector<uint32_t> pixels(fb.numPixels());
+    ToneMapParams params;
+    params.op           = TONE_MAP_ACES;
+    params.transfer     = OUTPUT_SRGB;
+    params.autoExposure = true;
+    for (auto _ : state) {
+      toneMap(params,fb.format.color,fb.color.data(),pixels.data(),fb.size);
+      benchmark::DoNotOptimize(pixels.data());
+    }
+    setPixelCounters(state);
+  }
+
+  static void BM_SceneDenoise(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const FrameBuffer &fb = sceneFrame(*scene);
+    std::vector<uint8_t> denoised(fb.color.size());
+    CPUDenoiser denoiser;
+    for (auto _ : state) {
+      denoiser.denoise(fb,denoised.data());
+      benchmark::DoNotOptimize(denoised.data());
+    }
+    setPixelCounters(state);
+  }
+
+  static void BM_ScenePNG(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    const FrameBuffer &fb = sceneFrame(*scene);
+    std::vector<uint32_t> pixels(fb.numPixels());
+    toneMap(ToneMapParams(),fb.format.color,fb.color.data(),pixels.data(),fb.size);
+    const OutputImage image(benchFileName("osc_bench_"+scene->name+".png"),
+                            fb.size,OutputImage::RGBA8,pixels.data());
+    size_t bytes = 0;
+    for (auto _ : state)
+      bytes = writeImage(image);
+    remove(image.fileName.c_str());
+    state.counters["fileMB"] = bytes*1e-6;
+    setPixelCounters(state);
+  }
+
+  BENCHMARK(BM_RenderFrame)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_RenderFrameBVH)->Apply(renderBVHArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_ShadingVariant)->Apply(shadingVariantArgs)->Unit(benchmark::kMillisecond)->UseManualTime();
+  BENCHMARK(BM_RenderWavefront)->Apply(wavefrontArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LightSamplingRMSE)->Apply(lightSamplingArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_ManyLights)->Apply(manyLightsArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_EnvironmentLighting)->Apply(environmentArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_PathTracing)->Apply(pathTracingArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_SceneToneMap)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_SceneDenoise)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_ScenePNG)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
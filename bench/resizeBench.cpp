@@ -0,0 +1,143 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "syntheticFrame.h"
+#include "oscCore/CPUDenoiser.h"
+#include "oscCore/ToneMap.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! simulated time between two frames, in seconds */
+  static const double FRAME_TIME = 1./60.;
+
+  /*! a scripted window drag: grow from 320x180 to 640x360 and back
+      in one-event-per-frame steps, then sit still for half a
+      second */
+  static std::vector<vec2i> resizeScript()
+  {
+    std::vector<vec2i> sizes;
+    const vec2i small(320,180), large(640,360);
+    const int   numSteps = 30;
+    for (int i=0;i<=numSteps;i++)
+      sizes.push_back(small + (large-small)*i/numSteps);
+    for (int i=numSteps;i>=0;i--)
+      sizes.push_back(small + (large-small)*i/numSteps);
+    for (int i=0;i<30;i++)
+      sizes.push_back(small);
+    return sizes;
+  }
+
+  static void addStats(ResourceStats &sum, const ResourceStats &stats)
+  {
+    sum.numAllocations    += stats.numAllocations;
+    sum.numReuses         += stats.numReuses;
+    sum.numDenoiserSetups += stats.numDenoiserSetups;
+    sum.bytesAllocated    += stats.bytesAllocated;
+  }
+
+  /*! runs the script through render + denoise + tone map, either the
+      way SampleRenderer::resize() used to do it (everything
+      re-created on every resize event, and denoised every frame), or
+      with capacity reuse and deferred denoiser setup */
+  static void BM_ResizeScript(benchmark::State &state)
+  {
+    const bool managed = state.range(0) != 0;
+    const std::vector<vec2i> script = resizeScript();
+
+    ResourceStats stats;
+    std::vector<double> frameTimes;
+    size_t numDenoisedFrames = 0;
+    for (auto _ : state) {
+      std::unique_ptr<FrameBuffer> fb(new FrameBuffer);
+      std::unique_ptr<CPUDenoiser> denoiser(new CPUDenoiser);
+      denoiser->numIterations = 3;
+      std::vector<uint8_t>  denoised;
+      std::vector<uint32_t> pixels;
+      ResizeSettler settler;
+      ResourceStats scriptStats;
+
+      double now = 0.;
+      vec2i  lastSize(0);
+      int    frameID = 0;
+      for (auto size : script) {
+        const double t0 = getCurrentTime();
+        if (size != lastSize) {
+          if (managed) {
+            fb->resize(size,FrameFormat::packed());
+            resizeWithCapacity(denoised,fb->color.size(),&scriptStats);
+            resizeWithCapacity(pixels,fb->numPixels(),&scriptStats);
+            settler.resized(size,now);
+          } else {
+            addStats(scriptStats,fb->stats);
+            addStats(scriptStats,denoiser->stats);
+            fb.reset(new FrameBuffer);
+            fb->resize(size,FrameFormat::packed());
+            denoiser.reset(new CPUDenoiser);
+            denoiser->numIterations = 3;
+            denoised = std::vector<uint8_t>(fb->color.size());
+            pixels   = std::vector<uint32_t>(fb->numPixels());
+            scriptStats.numAllocations += 2;
+            scriptStats.numDenoiserSetups++;
+          }
+          lastSize = size;
+          frameID  = 0;
+        }
+
+        renderSyntheticFrame(*fb,frameID++);
+        bool denoise = true;
+        if (managed) {
+          if (settler.needsSetup(now)) {
+            settler.setupDone();
+            scriptStats.numDenoiserSetups++;
+          }
+          denoise = settler.isSetUp();
+        }
+        if (denoise) {
+          denoiser->denoise(*fb,denoised.data());
+          numDenoisedFrames++;
+        } else
+          memcpy(denoised.data(),fb->color.data(),fb->color.size());
+        toneMap(ToneMapParams(),fb->format.color,denoised.data(),pixels.data(),size);
+
+        frameTimes.push_back(getCurrentTime()-t0);
+        now += FRAME_TIME;
+      }
+      addStats(scriptStats,fb->stats);
+      addStats(scriptStats,denoiser->stats);
+      addStats(stats,scriptStats);
+    }
+
+    std::sort(frameTimes.begin(),frameTimes.end());
+    const double numScripts = double(state.iterations());
+    state.counters["allocs"]     = stats.numAllocations/numScripts;
+    state.counters["setups"]     = stats.numDenoiserSetups/numScripts;
+    state.counters["allocMB"]    = stats.bytesAllocated*1e-6/numScripts;
+    state.counters["denoised"]   = numDenoisedFrames/numScripts;
+    state.counters["p50ms"]      = 1e3*frameTimes[frameTimes.size()/2];
+    state.counters["p95ms"]      = 1e3*frameTimes[frameTimes.size()*95/100];
+    state.counters["maxms"]      = 1e3*frameTimes.back();
+  }
+
+  /*! 0 = re-create everything on every resize, 1 = managed */
+  BENCHMARK(BM_ResizeScript)->ArgName("managed")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime()->Iterations(1);
+
+} // ::osc
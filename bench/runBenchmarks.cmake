@@ -0,0 +1,55 @@
+# ======================================================================== #
+# Copyright 2018-2019 Ingo Wald                                            #
+#                                                                          #
+# Licensed under the Apache License, Version 2.0 (the "License");          #
+# you may not use this file except in compliance with the License.         #
+# You may obtain a copy of the License at                                  #
+#                                                                          #
+#     http://www.apache.org/licenses/LICENSE-2.0                           #
+#                                                                          #
+# Unless required by applicable law or agreed to in writing, software      #
+# distributed under the License is distributed on an "AS IS" BASIS,        #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. #
+# See the License for the specific language governing permissions and      #
+# limitations under the License.                                           #
+# ======================================================================== #
+
+# runs oscBench, and writes its results as json, tagged with the git
+# commit they are for, to oscBench-<commit>.json (in the current
+# directory) - so results of different commits on the same host can
+# be compared. Invoked through the 'bench_json' target; expects
+# OSC_BENCH (the executable) and OSC_SOURCE_DIR to be set
+
+execute_process(
+  COMMAND git rev-parse --short HEAD
+  WORKING_DIRECTORY ${OSC_SOURCE_DIR}
+  OUTPUT_VARIABLE commit
+  OUTPUT_STRIP_TRAILING_WHITESPACE
+  ERROR_QUIET
+  )
+if (NOT commit)
+  set(commit "unknown")
+endif()
+execute_process(
+  COMMAND git status --porcelain --untracked-files=no
+  WORKING_DIRECTORY ${OSC_SOURCE_DIR}
+  OUTPUT_VARIABLE changes
+  ERROR_QUIET
+  )
+if (changes)
+  set(commit "${commit}-dirty")
+endif()
+
+set(output "oscBench-${commit}.json")
+message(STATUS "running benchmarks, writing results to ${output}")
+execute_process(
+  COMMAND ${OSC_BENCH}
+    --benchmark_out=${output}
+    --benchmark_out_format=json
+    --benchmark_context=git_commit=${commit},build_type=${OSC_BUILD_TYPE}
+    ${OSC_BENCH_ARGS}
+  RESULT_VARIABLE result
+  )
+if (NOT result EQUAL 0)
+  message(FATAL_ERROR "oscBench failed")
+endif()
@@ -0,0 +1,272 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "benchVectors.h"
+#include "gdt/math/simd.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! which vector types a kernel gets implemented with */
+  enum SIMDImpl {
+    /*! plain vec3f, as in all of the existing code */
+    SIMD_IMPL_SCALAR=0,
+    /*! one simd::vec3fa per vector */
+    SIMD_IMPL_VEC3FA,
+    /*! eight vectors at a time, in one simd::vec3f8 */
+    SIMD_IMPL_VEC3F8,
+    SIMD_IMPL_COUNT
+  };
+
+  static const size_t numBenchVectors = 1<<20;
+
+  static void setVectorRate(benchmark::State &state, size_t numVectors)
+  {
+    state.counters["Mvectors/s"]
+      = benchmark::Counter(1e-6*numVectors*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  // ------------------------------------------------------------------
+  // bounds of an array of (12-byte) vec3fs
+  // ------------------------------------------------------------------
+
+  static box3f boundsScalar(const std::vector<vec3f> &v)
+  {
+    box3f bounds;
+    for (auto &vi : v) bounds.extend(vi);
+    return bounds;
+  }
+
+  static box3f boundsVec3fa(const std::vector<vec3f> &v)
+  {
+    simd::box3fa bounds;
+    for (auto &vi : v) bounds.extend(simd::vec3fa(vi));
+    return simd::toScalar(bounds);
+  }
+
+  static void BM_SIMDBounds(benchmark::State &state)
+  {
+    const SIMDImpl impl = (SIMDImpl)state.range(0);
+    const std::vector<vec3f> v = randomVectors(numBenchVectors,0x123);
+    const box3f expected = boundsScalar(v);
+    auto kernel = impl == SIMD_IMPL_SCALAR ? boundsScalar : boundsVec3fa;
+    if (kernel(v) != expected) {
+      state.SkipWithError("simd bounds do not match scalar bounds");
+      return;
+    }
+    for (auto _ : state)
+      benchmark::DoNotOptimize(kernel(v));
+    setVectorRate(state,v.size());
+  }
+
+  // ------------------------------------------------------------------
+  // transforming points with an affine transform
+  // ------------------------------------------------------------------
+
+  static void transformScalar(const affine3f &xfm,
+                              const std::vector<vec3f> &in,
+                              std::vector<vec3f> &out)
+  {
+    for (size_t i=0;i<in.size();i++)
+      out[i] = xfmPoint(xfm,in[i]);
+  }
+
+  static void transformVec3fa(const affine3f &xfm,
+                              const std::vector<vec3f> &in,
+                              std::vector<vec3f> &out)
+  {
+    const simd::affine3fa xfma(xfm);
+    for (size_t i=0;i<in.size();i++)
+      out[i] = vec3f(simd::xfmPoint(xfma,simd::vec3fa(in[i])));
+  }
+
+  /*! note this transposes from and to AoS on the fly, so it does not
+      get the benefit of SoA data that an actual batched kernel would
+      keep its data in */
+  static void transformVec3f8(const affine3f &xfm,
+                              const std::vector<vec3f> &in,
+                              std::vector<vec3f> &out)
+  {
+    size_t i = 0;
+    for (;i+8<=in.size();i+=8)
+      simd::xfmPoint(xfm,simd::vec3f8::loadu(&in[i])).storeu(&out[i]);
+    for (;i<in.size();i++)
+      out[i] = xfmPoint(xfm,in[i]);
+  }
+
+  static void BM_SIMDTransform(benchmark::State &state)
+  {
+    const SIMDImpl impl = (SIMDImpl)state.range(0);
+    const std::vector<vec3f> in = randomVectors(numBenchVectors,0x234);
+    affine3f xfm = affine3f::rotate(normalize(vec3f(1.f,2.f,3.f)),.3f);
+    xfm.p = vec3f(10.f,-20.f,30.f);
+
+    auto kernel
+      = impl == SIMD_IMPL_SCALAR ? transformScalar
+      : impl == SIMD_IMPL_VEC3FA ? transformVec3fa
+      : transformVec3f8;
+    std::vector<vec3f> expected(in.size()), out(in.size());
+    transformScalar(xfm,in,expected);
+    kernel(xfm,in,out);
+    const float error = maxRelativeError(expected,out);
+    if (error > 1e-5f) {
+      state.SkipWithError("simd transform does not match scalar transform");
+      return;
+    }
+
+    for (auto _ : state) {
+      kernel(xfm,in,out);
+      benchmark::DoNotOptimize(out.data());
+    }
+    setVectorRate(state,in.size());
+    state.counters["maxError"] = error;
+  }
+
+  // ------------------------------------------------------------------
+  // the core of a lambertian shader, as in the cpu renderer: fetch
+  // and interpolate the vertex normals of the hit triangle, and
+  // compute the (two-sided) cosine with the ray direction
+  // ------------------------------------------------------------------
+
+  struct ShadingData {
+    std::vector<vec3f>   normal;
+    std::vector<vec3i>   index;
+    std::vector<int32_t> hitPrim;
+    std::vector<float>   hitU, hitV;
+    std::vector<vec3f>   rayDir;
+    vec3f                diffuse { .7f, .5f, .3f };
+  };
+
+  static const ShadingData &shadingData()
+  {
+    static ShadingData data;
+    if (!data.normal.empty()) return data;
+    const size_t numVertices = 256*1024;
+    data.normal = randomVectors(numVertices,0x345);
+    for (auto &n : data.normal) n = normalize(n);
+    std::mt19937 rng(0x456);
+    std::uniform_int_distribution<int> vertex(0,int(numVertices)-1);
+    data.index.resize(2*numVertices);
+    for (auto &idx : data.index) idx = vec3i(vertex(rng),vertex(rng),vertex(rng));
+    std::uniform_int_distribution<int> prim(0,int(data.index.size())-1);
+    std::uniform_real_distribution<float> bary(0.f,.5f);
+    for (size_t i=0;i<numBenchVectors;i++) {
+      data.hitPrim.push_back(prim(rng));
+      data.hitU.push_back(bary(rng));
+      data.hitV.push_back(bary(rng));
+    }
+    data.rayDir = randomVectors(numBenchVectors,0x567);
+    for (auto &d : data.rayDir) d = normalize(d);
+    return data;
+  }
+
+  static void shadeScalar(const ShadingData &data, std::vector<vec3f> &color)
+  {
+    for (size_t i=0;i<data.hitPrim.size();i++) {
+      const vec3i index = data.index[data.hitPrim[i]];
+      const float u = data.hitU[i], v = data.hitV[i];
+      const vec3f N = normalize((1.f-u-v)*data.normal[index.x]
+                                +      u *data.normal[index.y]
+                                +      v *data.normal[index.z]);
+      const float cosDN = fabsf(dot(data.rayDir[i],N));
+      color[i] = (.2f + .8f*cosDN) * data.diffuse;
+    }
+  }
+
+  static void shadeVec3fa(const ShadingData &data, std::vector<vec3f> &color)
+  {
+    const simd::vec3fa diffuse(data.diffuse);
+    for (size_t i=0;i<data.hitPrim.size();i++) {
+      const vec3i index = data.index[data.hitPrim[i]];
+      const float u = data.hitU[i], v = data.hitV[i];
+      const simd::vec3fa N
+        = simd::normalize((1.f-u-v)*simd::vec3fa(data.normal[index.x])
+                          +      u *simd::vec3fa(data.normal[index.y])
+                          +      v *simd::vec3fa(data.normal[index.z]));
+      const float cosDN = fabsf(simd::dot(simd::vec3fa(data.rayDir[i]),N));
+      color[i] = vec3f((.2f + .8f*cosDN) * diffuse);
+    }
+  }
+
+  static void shadeVec3f8(const ShadingData &data, std::vector<vec3f> &color)
+  {
+    const size_t numHits = data.hitPrim.size();
+    const simd::vec3f8 diffuse(data.diffuse);
+    size_t i = 0;
+    for (;i+8<=numHits;i+=8) {
+      int32_t i0[8], i1[8], i2[8];
+      for (int j=0;j<8;j++) {
+        const vec3i index = data.index[data.hitPrim[i+j]];
+        i0[j] = index.x; i1[j] = index.y; i2[j] = index.z;
+      }
+      const simd::vfloat8 u = simd::vfloat8::loadu(&data.hitU[i]);
+      const simd::vfloat8 v = simd::vfloat8::loadu(&data.hitV[i]);
+      const simd::vec3f8 N
+        = simd::normalize((simd::vfloat8(1.f)-u-v)*simd::vec3f8::gather(data.normal.data(),i0)
+                          +                    u *simd::vec3f8::gather(data.normal.data(),i1)
+                          +                    v *simd::vec3f8::gather(data.normal.data(),i2));
+      const simd::vfloat8 cosDN = abs(simd::dot(simd::vec3f8::loadu(&data.rayDir[i]),N));
+      (simd::madd(simd::vfloat8(.8f),cosDN,simd::vfloat8(.2f)) * diffuse).storeu(&color[i]);
+    }
+    for (;i<numHits;i++) {
+      const vec3i index = data.index[data.hitPrim[i]];
+      const float u = data.hitU[i], v = data.hitV[i];
+      const vec3f N = normalize((1.f-u-v)*data.normal[index.x]
+                                +      u *data.normal[index.y]
+                                +      v *data.normal[index.z]);
+      color[i] = (.2f + .8f*fabsf(dot(data.rayDir[i],N))) * data.diffuse;
+    }
+  }
+
+  static void BM_SIMDShade(benchmark::State &state)
+  {
+    const SIMDImpl impl = (SIMDImpl)state.range(0);
+    const ShadingData &data = shadingData();
+    auto kernel
+      = impl == SIMD_IMPL_SCALAR ? shadeScalar
+      : impl == SIMD_IMPL_VEC3FA ? shadeVec3fa
+      : shadeVec3f8;
+    std::vector<vec3f> expected(data.hitPrim.size()), color(data.hitPrim.size());
+    shadeScalar(data,expected);
+    kernel(data,color);
+    const float error = maxRelativeError(expected,color);
+    if (error > 1e-5f) {
+      state.SkipWithError("simd shading does not match scalar shading");
+      return;
+    }
+
+    for (auto _ : state) {
+      kernel(data,color);
+      benchmark::DoNotOptimize(color.data());
+    }
+    state.counters["Mhits/s"]
+      = benchmark::Counter(1e-6*color.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+    state.counters["maxError"] = error;
+  }
+
+  BENCHMARK(BM_SIMDBounds)->ArgName("impl")->DenseRange(SIMD_IMPL_SCALAR,SIMD_IMPL_VEC3FA)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_SIMDTransform)->ArgName("impl")->DenseRange(0,SIMD_IMPL_COUNT-1)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_SIMDShade)->ArgName("impl")->DenseRange(0,SIMD_IMPL_COUNT-1)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
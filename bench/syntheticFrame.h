@@ -0,0 +1,54 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "oscCore/FrameBuffer.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/random/random.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! writes one (noisy) sample per pixel of a synthetic image into
+      the frame buffer - a few tilted planes with a checker albedo -
+      averaging with what is there when 'frameID' > 0, just like the
+      raygen program does */
+  inline void renderSyntheticFrame(FrameBuffer &fb, int frameID)
+  {
+    const vec2i size = fb.size;
+    parallel_for_blocked(0,size.y,16,[&](size_t yBegin, size_t yEnd){
+        LCG<16> random;
+        for (int y=(int)yBegin;y<(int)yEnd;y++)
+          for (int x=0;x<size.x;x++) {
+            random.init(x+y*size.x,frameID);
+            const size_t pixelID = x+size_t(y)*size.x;
+            const int    plane   = (x*3/size.x + y*2/size.y) % 3;
+            const vec3f  normal  = normalize(vec3f(plane-1.f,.5f,1.f));
+            const vec3f  albedo  = ((x/32 + y/32) & 1) ? vec3f(.8f,.7f,.5f) : vec3f(.2f,.3f,.6f);
+            const float  lit     = (random() < .3f) ? 4.f*random() : .2f;
+            vec3f color = lit*albedo;
+            if (frameID > 0)
+              color = (color + float(frameID)*loadColor(fb.format.color,fb.color.data(),pixelID))
+                / (frameID+1.f);
+            storeColor(fb.format.color,fb.color.data(),pixelID,color);
+            storeNormal(fb.format.normal,fb.normal.data(),pixelID,normal);
+            storeAlbedo(fb.format.albedo,fb.albedo.data(),pixelID,albedo);
+          }
+      });
+  }
+
+} // ::osc
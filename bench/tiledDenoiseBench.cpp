@@ -0,0 +1,110 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "syntheticFrame.h"
+#include "oscCore/TiledDenoiser.h"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the 'poster' resolution to denoise; defaults to something that
+      finishes in reasonable time on small machines, set
+      OSC_BENCH_POSTER=15360x8640 (or so) for the real thing */
+  static vec2i posterSize()
+  {
+    vec2i size(2048,2048);
+    const char *fromEnv = getenv("OSC_BENCH_POSTER");
+    if (fromEnv) sscanf(fromEnv,"%ix%i",&size.x,&size.y);
+    return size;
+  }
+
+  /*! the frame buffer for the poster; kept around across benchmarks
+      since it is big, and slow to fill */
+  static const FrameBuffer &posterFrame()
+  {
+    static FrameBuffer fb;
+    if (fb.size != posterSize()) {
+      fb.resize(posterSize(),FrameFormat::packed());
+      renderSyntheticFrame(fb,0);
+    }
+    return fb;
+  }
+
+  /*! check that tiling does not change the result: denoise a small
+      frame with and without tiles (with tile borders in awkward
+      places), and compare bit by bit */
+  static bool tiledMatchesUntiled(std::string &error)
+  {
+    FrameBuffer fb;
+    fb.resize(vec2i(509,307),FrameFormat::packed());
+    renderSyntheticFrame(fb,0);
+
+    std::vector<uint8_t> reference(fb.color.size()), tiled(fb.color.size());
+    CPUDenoiser denoiser;
+    denoiser.numIterations = 3;
+    denoiser.denoise(fb,reference.data());
+
+    TiledDenoiser tiledDenoiser;
+    tiledDenoiser.filter.numIterations = 3;
+    tiledDenoiser.tileSize = vec2i(100,64);
+    tiledDenoiser.denoise(fb,tiled.data());
+    if (memcmp(reference.data(),tiled.data(),reference.size())) {
+      error = "tiled denoise differs from un-tiled denoise";
+      return false;
+    }
+    return true;
+  }
+
+  static void BM_TiledDenoise(benchmark::State &state)
+  {
+    std::string error;
+    if (!tiledMatchesUntiled(error)) {
+      state.SkipWithError(error.c_str());
+      return;
+    }
+
+    const FrameBuffer &fb = posterFrame();
+    std::vector<uint8_t> output(fb.color.size());
+    TiledDenoiser denoiser;
+    denoiser.filter.numIterations = 3;
+    denoiser.tileSize     = vec2i((int)state.range(0));
+    denoiser.memoryBudget = size_t(state.range(1)) << 20;
+    for (auto _ : state) {
+      denoiser.denoise(fb,output.data());
+      benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["width"]     = fb.size.x;
+    state.counters["height"]    = fb.size.y;
+    state.counters["slots"]     = denoiser.stats.numSlots;
+    state.counters["tiles"]     = double(denoiser.stats.numTiles);
+    state.counters["peakMB"]    = denoiser.stats.peakMemoryInBytes*1e-6;
+    // what an un-tiled denoise would need for its scratch alone
+    state.counters["untiledMB"] = fb.numPixels()*CPUDenoiser::scratchBytesPerPixel()*1e-6;
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*fb.numPixels()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! tile size x memory budget (in MB) */
+  BENCHMARK(BM_TiledDenoise)->ArgNames({"tile","budgetMB"})
+    ->Args({128,64})->Args({256,64})->Args({512,64})->Args({256,16})
+    ->Unit(benchmark::kMillisecond)->UseRealTime()->Iterations(1);
+
+} // ::osc
@@ -0,0 +1,135 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "oscCore/ToneMap.h"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a full-hd frame of random hdr values, roughly log-distributed
+      around 1, with a few very bright 'fireflies' */
+  static const std::vector<vec4f> &testFrame(const vec2i &size)
+  {
+    static std::vector<vec4f> frame;
+    if (frame.size() == size_t(size.x)*size.y) return frame;
+    frame.resize(size_t(size.x)*size.y);
+    std::mt19937 rng(0x1234);
+    std::uniform_real_distribution<float> logValue(-6.f,4.f);
+    for (auto &pixel : frame)
+      pixel = vec4f(exp2f(logValue(rng)),
+                    exp2f(logValue(rng)),
+                    exp2f(logValue(rng)),
+                    1.f);
+    return frame;
+  }
+
+  static const vec2i benchFrameSize(1920,1080);
+
+  static ToneMapParams paramsFor(const benchmark::State &state)
+  {
+    ToneMapParams params;
+    params.op           = (ToneMapOperator)state.range(0);
+    params.transfer     = (OutputTransform)state.range(1);
+    params.autoExposure = state.range(2) != 0;
+    return params;
+  }
+
+  /*! the reference: one toneMapPixel() call per pixel, on a single
+      thread; this is exactly what the cuda kernel does per thread */
+  static void BM_ToneMapScalar(benchmark::State &state)
+  {
+    const ToneMapParams params = paramsFor(state);
+    const vec2i size = benchFrameSize;
+    const std::vector<vec4f> &in = testFrame(size);
+    std::vector<uint32_t> out(in.size());
+    for (auto _ : state) {
+      float logSum = 0.f;
+      if (params.autoExposure)
+        for (auto &pixel : in) logSum += logLuminance(vec3f(pixel));
+      const float exposure = computeExposure(params,logSum,(int)in.size());
+      for (int y=0;y<size.y;y++)
+        for (int x=0;x<size.x;x++)
+          out[x+y*size.x] = toneMapPixel(params,vec3f(in[x+y*size.x]),exposure,x,y);
+      benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*in.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! the simd + multi-threaded host path, including verification
+      against the scalar reference (we allow one lsb of difference,
+      for the approximated pow() of the gamma and srgb transforms) */
+  static void BM_ToneMap(benchmark::State &state)
+  {
+    const ToneMapParams params = paramsFor(state);
+    const vec2i size = benchFrameSize;
+    const std::vector<vec4f> &in = testFrame(size);
+    std::vector<uint32_t> out(in.size());
+
+    toneMap(params,in.data(),out.data(),size);
+    const float exposure
+      = computeExposure(params,computeLogLuminanceSum(in.data(),in.size()),(int)in.size());
+    for (int y=0;y<size.y;y++)
+      for (int x=0;x<size.x;x++) {
+        const uint32_t expected = toneMapPixel(params,vec3f(in[x+y*size.x]),exposure,x,y);
+        for (int c=0;c<32;c+=8) {
+          const int delta = int((expected >> c) & 0xff) - int((out[x+y*size.x] >> c) & 0xff);
+          if (delta < -1 || delta > 1) {
+            state.SkipWithError("simd tone mapper does not match reference");
+            return;
+          }
+        }
+      }
+
+    for (auto _ : state) {
+      toneMap(params,in.data(),out.data(),size);
+      benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*in.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! just the auto-exposure reduction */
+  static void BM_LogLuminanceSum(benchmark::State &state)
+  {
+    const std::vector<vec4f> &in = testFrame(benchFrameSize);
+    for (auto _ : state)
+      benchmark::DoNotOptimize(computeLogLuminanceSum(in.data(),in.size()));
+    state.counters["Mpixels/s"]
+      = benchmark::Counter(1e-6*in.size()*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  /*! op x transfer x autoExposure */
+  static void toneMapArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgNames({"op","transfer","autoExposure"});
+    for (int op=0;op<TONE_MAP_OPERATOR_COUNT;op++)
+      for (int transfer=0;transfer<OUTPUT_TRANSFORM_COUNT;transfer++)
+        b->Args({op,transfer,0});
+    b->Args({TONE_MAP_ACES,OUTPUT_SRGB,1});
+  }
+
+  BENCHMARK(BM_ToneMapScalar)->Apply(toneMapArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_ToneMap)->Apply(toneMapArgs)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_LogLuminanceSum)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
@@ -0,0 +1,114 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "oscCore/CameraPath.h"
+#include "oscCore/CPURenderer.h"
+#include <map>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const vec2i walkthroughSize(320,240);
+  static const int   walkthroughFrames = 48;
+
+  /*! a fixed fly-through for the scene: starting at the scene's
+      camera, once around (and over) the center, with unevenly spaced
+      keyframes - the kind of path one would record by hand */
+  static CameraPath walkthroughPath(const BenchScene &scene,
+                                    std::vector<Camera> &keyCameras)
+  {
+    const vec3f center = scene.camera.at;
+    const vec3f start  = scene.camera.from-center;
+    const float radius = length(vec3f(start.x,0.f,start.z));
+    const float angle0 = atan2f(start.z,start.x);
+    const float height = start.y;
+    CameraPath path;
+    const float times[] = { 0.f, 1.f, 2.5f, 3.f, 4.5f, 6.f, 7.f };
+    const int numKeys = sizeof(times)/sizeof(times[0]);
+    for (int i=0;i<numKeys;i++) {
+      const float f     = i/float(numKeys-1);
+      const float angle = angle0 + 2.f*float(M_PI)*f;
+      const float r     = radius*(1.f-.4f*sinf(float(M_PI)*f));
+      const vec3f from  = center + vec3f(r*cosf(angle),height*(1.f+.5f*sinf(2.f*float(M_PI)*f)),r*sinf(angle));
+      // look a bit ahead of the center, so orientations do not just
+      // follow the position
+      const vec3f at    = center + .1f*radius*vec3f(cosf(3.f*angle),0.f,sinf(3.f*angle));
+      keyCameras.push_back(Camera{ from, at, vec3f(0.f,1.f,0.f) });
+      path.addKeyframe(keyCameras.back(),times[i]);
+    }
+    return path;
+  }
+
+  static float cameraDistance(const Camera &a, const Camera &b)
+  {
+    return std::max(length(a.from-b.from),
+                    length(normalize(a.at-a.from)-normalize(b.at-b.from)));
+  }
+
+  /*! renders the scene's walkthrough with the cpu renderer, a fixed
+      number of frames per iteration, and reports frame time
+      percentiles. Also checks that the path goes through its
+      keyframes, and that it survives a save/load round trip
+      unchanged */
+  static void BM_Walkthrough(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    std::vector<Camera> keyCameras;
+    const CameraPath path = walkthroughPath(*scene,keyCameras);
+
+    const float sceneSize = length(scene->model->bounds.span());
+    for (size_t i=0;i<keyCameras.size();i++)
+      if (cameraDistance(path.cameraAt(path.keyframes[i].time),keyCameras[i]) > 1e-4f*sceneSize) {
+        state.SkipWithError("interpolated camera path misses its keyframes");
+        return;
+      }
+    const std::string pathFile = benchFileName("osc_bench_walkthrough.path");
+    path.save(pathFile);
+    const CameraPath loaded = CameraPath::load(pathFile);
+    remove(pathFile.c_str());
+    for (int i=0;i<walkthroughFrames;i++)
+      if (cameraDistance(loaded.frameCamera(i,walkthroughFrames),
+                         path.frameCamera(i,walkthroughFrames)) > 0.f) {
+        state.SkipWithError("camera path changed in save/load round trip");
+        return;
+      }
+
+    CPURenderer renderer(scene->model,scene->light);
+    renderer.resize(walkthroughSize);
+    renderer.accumulate = false;
+    std::vector<uint32_t> pixels(walkthroughSize.x*walkthroughSize.y);
+    FrameTimes times;
+    for (auto _ : state) {
+      const FrameTimes run = playCameraPath(renderer,path,walkthroughFrames,pixels.data());
+      times.seconds.insert(times.seconds.end(),run.seconds.begin(),run.seconds.end());
+    }
+    state.counters["meanMs"] = 1e3*times.mean();
+    state.counters["p50Ms"]  = 1e3*times.percentile(50);
+    state.counters["p90Ms"]  = 1e3*times.percentile(90);
+    state.counters["p99Ms"]  = 1e3*times.percentile(99);
+    state.counters["maxMs"]  = 1e3*times.percentile(100);
+    state.counters["fps"]
+      = benchmark::Counter(double(walkthroughFrames*state.iterations()),
+                           benchmark::Counter::kIsRate);
+  }
+
+  BENCHMARK(BM_Walkthrough)->Apply(allBenchScenes)->Iterations(1)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
@@ -0,0 +1,202 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "benchScenes.h"
+#include "benchVectors.h"
+#include "gdt/math/xfmBatch.h"
+#include <benchmark/benchmark.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  enum XfmImpl {
+    /*! one xfmPoint() etc per vector, on one thread */
+    XFM_IMPL_SCALAR=0,
+    /*! the batched functions, on AoS vec3f arrays */
+    XFM_IMPL_BATCHED,
+    /*! the batched functions, on SoA streams */
+    XFM_IMPL_BATCHED_SOA,
+    XFM_IMPL_COUNT
+  };
+
+  static affine3f benchTransform()
+  {
+    affine3f xfm = affine3f::rotate(normalize(vec3f(1.f,2.f,3.f)),.3f);
+    xfm.l = xfm.l * LinearSpace3f::scale(vec3f(1.f,2.f,.5f));
+    xfm.p = vec3f(10.f,-20.f,30.f);
+    return xfm;
+  }
+
+  /*! Mvertices/s, plus the memory bandwidth that corresponds to (one
+      read and one write per vertex) */
+  static void setVertexRate(benchmark::State &state, size_t numVertices, int bytesPerVertex)
+  {
+    state.counters["Mvertices/s"]
+      = benchmark::Counter(1e-6*numVertices*state.iterations(),
+                           benchmark::Counter::kIsRate);
+    state.counters["GB/s"]
+      = benchmark::Counter(1e-9*numVertices*bytesPerVertex*state.iterations(),
+                           benchmark::Counter::kIsRate);
+  }
+
+  static void BM_XfmPoints(benchmark::State &state)
+  {
+    const XfmImpl impl = (XfmImpl)state.range(0);
+    const std::vector<vec3f> in = randomVectors(state.range(1),0x789);
+    const affine3f xfm = benchTransform();
+    const size_t n = in.size();
+
+    std::vector<vec3f> expected(n), out(n);
+    for (size_t i=0;i<n;i++) expected[i] = xfmPoint(xfm,in[i]);
+
+    std::vector<float> soaIn(3*n), soaOut(3*n);
+    for (size_t i=0;i<n;i++)
+      for (int d=0;d<3;d++) soaIn[d*n+i] = in[i][d];
+    const vec3fStream inStream  = { soaIn.data(),  soaIn.data()+n,  soaIn.data()+2*n  };
+    const vec3fStream outStream = { soaOut.data(), soaOut.data()+n, soaOut.data()+2*n };
+
+    auto run = [&](){
+      switch (impl) {
+      case XFM_IMPL_SCALAR:
+        for (size_t i=0;i<n;i++) out[i] = xfmPoint(xfm,in[i]);
+        break;
+      case XFM_IMPL_BATCHED:
+        xfmPoints(xfm,in.data(),out.data(),n);
+        break;
+      default:
+        xfmPoints(xfm,inStream,outStream,n);
+      }
+    };
+    run();
+    if (impl == XFM_IMPL_BATCHED_SOA)
+      for (size_t i=0;i<n;i++)
+        out[i] = vec3f(soaOut[i],soaOut[n+i],soaOut[2*n+i]);
+    const float error = maxRelativeError(expected,out);
+    if (error > 1e-5f) {
+      state.SkipWithError("batched transform does not match xfmPoint()");
+      return;
+    }
+
+    for (auto _ : state) {
+      run();
+      benchmark::ClobberMemory();
+    }
+    setVertexRate(state,n,2*sizeof(vec3f));
+    state.counters["maxError"] = error;
+  }
+
+  static void BM_XfmNormals(benchmark::State &state)
+  {
+    const bool batched = state.range(0) != 0;
+    const std::vector<vec3f> in = randomVectors(state.range(1),0x789);
+    const affine3f xfm = benchTransform();
+    const size_t n = in.size();
+
+    std::vector<vec3f> expected(n), out(n);
+    for (size_t i=0;i<n;i++) expected[i] = xfmNormal(xfm,in[i]);
+    auto run = [&](){
+      if (batched)
+        xfmNormals(xfm,in.data(),out.data(),n);
+      else
+        // what per-vertex code does: one matrix inverse per normal
+        for (size_t i=0;i<n;i++) out[i] = xfmNormal(xfm,in[i]);
+    };
+    run();
+    const float error = maxRelativeError(expected,out);
+    if (error > 1e-5f) {
+      state.SkipWithError("batched transform does not match xfmNormal()");
+      return;
+    }
+
+    for (auto _ : state) {
+      run();
+      benchmark::ClobberMemory();
+    }
+    setVertexRate(state,n,2*sizeof(vec3f));
+  }
+
+  static void BM_XfmBounds(benchmark::State &state)
+  {
+    const bool batched = state.range(0) != 0;
+    const std::vector<vec3f> in = randomVectors(state.range(1),0x789);
+    const affine3f xfm = benchTransform();
+
+    auto run = [&](){
+      if (batched) return xfmBounds(xfm,in);
+      box3f bounds;
+      for (auto &p : in) bounds.extend(xfmPoint(xfm,p));
+      return bounds;
+    };
+    const box3f expected = [&](){
+      box3f bounds;
+      for (auto &p : in) bounds.extend(xfmPoint(xfm,p));
+      return bounds;
+    }();
+    const box3f bounds = run();
+    if (length(bounds.lower-expected.lower) > 1e-3f ||
+        length(bounds.upper-expected.upper) > 1e-3f) {
+      state.SkipWithError("batched bounds do not match scalar bounds");
+      return;
+    }
+
+    for (auto _ : state)
+      benchmark::DoNotOptimize(run());
+    setVertexRate(state,in.size(),sizeof(vec3f));
+  }
+
+  /*! baking an instance transform into all meshes of a scene (or
+      rather, into a copy of their vertices and normals), in place */
+  static void BM_TransformMesh(benchmark::State &state)
+  {
+    const BenchScene *scene = benchSceneFor(state);
+    if (!scene) return;
+    std::vector<TriangleMesh> meshes;
+    size_t numVertices = 0;
+    for (auto mesh : scene->model->meshes) {
+      TriangleMesh copy;
+      copy.vertex = mesh->vertex;
+      copy.normal = mesh->normal;
+      meshes.push_back(copy);
+      numVertices += mesh->vertex.size() + mesh->normal.size();
+    }
+    const affine3f xfm = benchTransform();
+    for (auto _ : state)
+      for (auto &mesh : meshes)
+        transformMesh(&mesh,xfm);
+    setVertexRate(state,numVertices,2*sizeof(vec3f));
+  }
+
+  static void xfmArgs(benchmark::internal::Benchmark *b, int numImpls)
+  {
+    b->ArgNames({"impl","vertices"});
+    for (int impl=0;impl<numImpls;impl++)
+      for (int64_t n : { 64*1024, 4*1024*1024 })
+        b->Args({impl,n});
+  }
+
+  BENCHMARK(BM_XfmPoints)
+  ->Apply([](benchmark::internal::Benchmark *b){ xfmArgs(b,XFM_IMPL_COUNT); })
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_XfmNormals)
+  ->Apply([](benchmark::internal::Benchmark *b){ xfmArgs(b,2); })
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_XfmBounds)
+  ->Apply([](benchmark::internal::Benchmark *b){ xfmArgs(b,2); })
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_TransformMesh)->Apply(allBenchScenes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // ::osc
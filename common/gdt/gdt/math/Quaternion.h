@@ -38,6 +38,13 @@
 
 namespace gdt
 {
+#ifndef __CUDACC__
+  /*! (cuda has its own; gdt.h leaves these out so they do not clash
+      with those) */
+  inline float  rsqrt(const float f)  { return 1.f/sqrtf(f); }
+  inline double rsqrt(const double d) { return 1./::sqrt(d); }
+#endif
+
   ////////////////////////////////////////////////////////////////
   // Quaternion Struct
   ////////////////////////////////////////////////////////////////
@@ -152,6 +159,30 @@ namespace gdt
   template<typename T> __both__ bool operator !=( const QuaternionT<T>& a, const QuaternionT<T>& b ) { return a.r != b.r || a.i != b.i || a.j != b.j || a.k != b.k; }
 
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Interpolation
+  ////////////////////////////////////////////////////////////////////////////////
+
+  template<typename T> __both__ T dot( const QuaternionT<T>& a, const QuaternionT<T>& b ) { return a.r*b.r + a.i*b.i + a.j*b.j + a.k*b.k; }
+
+  /*! spherical linear interpolation between unit quaternions a (at
+      t=0) and b (at t=1), along the shorter arc - ie, rotation at
+      constant angular velocity. Falls back to normalized linear
+      interpolation where the two are so close that sin(theta) would
+      be all rounding error */
+  template<typename T> __both__ QuaternionT<T> slerp( const QuaternionT<T>& a, const QuaternionT<T>& b, const T& t )
+  {
+    T cosTheta = dot(a,b);
+    // q and -q are the same rotation; take the one that is closer
+    const QuaternionT<T> c = cosTheta < T(zero) ? -b : b;
+    cosTheta = cosTheta < T(zero) ? -cosTheta : cosTheta;
+    if (cosTheta > T(0.9995f))
+      return normalize(a + t*(c-a));
+    const T theta    = acos(cosTheta);
+    const T sinTheta = sin(theta);
+    return (sin((T(one)-t)*theta)/sinTheta)*a + (sin(t*theta)/sinTheta)*c;
+  }
+
   ////////////////////////////////////////////////////////////////////////////////
   /// Orientation Functions
   ////////////////////////////////////////////////////////////////////////////////
@@ -22,15 +22,54 @@
 
 namespace gdt {
 
-  /*! a n-bit fixed-point float in the [0..1] region */
+  /*! a Nbits fixed-point number, stored in (the lower Nbits of) a
+      storageT. Unsigned ones ('unorm') represent [0..1], with all
+      bits set meaning 1; signed ones ('snorm') represent [-1..+1],
+      with the most negative value clamped to -1 - ie, the same
+      conventions as the UNORM/SNORM texture formats in gl, d3d, and
+      cuda. Values outside the range get clamped, and encoding rounds
+      to the nearest representable value, so the error for values in
+      range is at most maxError() */
   template<typename storageT, int Nbits, int is_signed>
   struct FixedPoint {
-    FixedPoint();
+    static_assert(Nbits > 0 && Nbits <= 8*(int)sizeof(storageT) && Nbits <= 32,
+                  "invalid number of bits for fixed point storage type");
+    typedef storageT storage_t;
 
-    float operator float() const {
-      return bits / float((1ULL << Nbits)-1);
+    inline __both__ FixedPoint() = default;
+    inline __both__ explicit FixedPoint(const float f) : bits(encode(f)) {}
+
+    inline __both__ operator float() const { return decode(bits); }
+
+    /*! the largest value of 'bits', which represents 1.f */
+    static inline __both__ float maxBits()
+    { return float((1ULL << (Nbits-is_signed))-1); }
+
+    static inline __both__ storageT encode(float f)
+    {
+      const float lo = is_signed ? -1.f : 0.f;
+      f = f < lo ? lo : (f > 1.f ? 1.f : f);
+      // (note f != f catches nans, which we map to 0)
+      if (f != f) f = 0.f;
+      return (storageT)(int64_t)floorf(f*maxBits()+.5f);
+    }
+
+    static inline __both__ float decode(const storageT bits)
+    {
+      const float f = float(bits) * (1.f/maxBits());
+      return is_signed && f < -1.f ? -1.f : f;
     }
+
+    /*! the largest error that encode-then-decode introduces for any
+        value in range: half a quantization step */
+    static inline __both__ float maxError() { return .5f/maxBits(); }
+
     storageT bits;
   };
-}
- 
+
+  typedef FixedPoint<uint8_t, 8, 0> unorm8;
+  typedef FixedPoint<int8_t,  8, 1> snorm8;
+  typedef FixedPoint<uint16_t,16,0> unorm16;
+  typedef FixedPoint<int16_t, 16,1> snorm16;
+
+} // ::gdt
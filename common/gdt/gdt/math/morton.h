@@ -0,0 +1,69 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+
+namespace gdt {
+
+  /*! spreads the lower 10 bits of x out to every third bit */
+  inline __both__ uint32_t mortonExpandBits(uint32_t x)
+  {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+  }
+
+  /*! the 30-bit morton code of a point in [0,1]^3 (points outside
+      get clamped), with x in the most significant of each three
+      bits */
+  inline __both__ uint32_t mortonCode(const vec3f &p)
+  {
+    const float scale = 1024.f;
+    const uint32_t x = (uint32_t)max(0.f,min(p.x*scale,scale-1.f));
+    const uint32_t y = (uint32_t)max(0.f,min(p.y*scale,scale-1.f));
+    const uint32_t z = (uint32_t)max(0.f,min(p.z*scale,scale-1.f));
+    return (mortonExpandBits(x) << 2) | (mortonExpandBits(y) << 1) | mortonExpandBits(z);
+  }
+
+  /*! spreads the lower 21 bits of x out to every third bit */
+  inline __both__ uint64_t mortonExpandBits63(uint32_t x)
+  {
+    uint64_t v = x & 0x1fffff;
+    v = (v | (v << 32)) & 0x001f00000000ffffull;
+    v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+    v = (v | (v <<  8)) & 0x100f00f00f00f00full;
+    v = (v | (v <<  4)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v <<  2)) & 0x1249249249249249ull;
+    return v;
+  }
+
+  /*! same as mortonCode(), with 21 instead of 10 bits per axis */
+  inline __both__ uint64_t mortonCode63(const vec3f &p)
+  {
+    const float scale = 2097152.f;
+    const uint32_t x = (uint32_t)max(0.f,min(p.x*scale,scale-1.f));
+    const uint32_t y = (uint32_t)max(0.f,min(p.y*scale,scale-1.f));
+    const uint32_t z = (uint32_t)max(0.f,min(p.z*scale,scale-1.f));
+    return (mortonExpandBits63(x) << 2) | (mortonExpandBits63(y) << 1) | mortonExpandBits63(z);
+  }
+
+} // ::gdt
@@ -0,0 +1,653 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* simd-backed vector types for host-side hot loops. This header is
+   opt-in: nothing in vec.h includes it, and the plain vec_t<T,N>
+   types (which are what all __both__ and device code uses) are not
+   changed in any way. What it adds, in namespace gdt::simd, is
+
+   - vec3fa : a 16-byte aligned float3 (with one unused lane)
+   - vec4f  : a 16-byte aligned float4
+   - vec3f8 : eight float3s in SoA layout, for batched kernels
+   - box3fa : box_t<vec3fa>
+   - vbool4/vbool8 : per-lane masks, from comparing vfloat4/vfloat8s
+
+   all implemented with sse (x86-64), neon (aarch64), or - on any
+   other platform - plain scalar code. The types convert explicitly
+   from and to the regular vec3f/vec4f, so code can keep its data in
+   the regular types, and only use these in the inner loops.
+
+   The whole header is skipped in the device compilation pass, so it
+   can be included from .cu files (for their host code) as well */
+
+#include "gdt/math/vec.h"
+#include "gdt/math/box.h"
+#include "gdt/math/AffineSpace.h"
+
+#ifndef __CUDA_ARCH__
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define GDT_SIMD_SSE 1
+#  include <emmintrin.h>
+#  if defined(__AVX__)
+#    include <immintrin.h>
+#  endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#  define GDT_SIMD_NEON 1
+#  include <arm_neon.h>
+#else
+#  define GDT_SIMD_SCALAR 1
+#endif
+
+namespace gdt {
+  namespace simd {
+
+    // =======================================================
+    // vfloat4: one native 4-wide register
+    // =======================================================
+
+#if GDT_SIMD_SSE
+    typedef __m128 native4;
+#elif GDT_SIMD_NEON
+    typedef float32x4_t native4;
+#else
+    struct alignas(16) native4 { float f[4]; };
+#endif
+
+    struct vfloat4 {
+      inline vfloat4() = default;
+      inline vfloat4(const native4 v) : v(v) {}
+#if GDT_SIMD_SSE
+      inline vfloat4(const float f) : v(_mm_set1_ps(f)) {}
+      inline vfloat4(const float x, const float y, const float z, const float w)
+        : v(_mm_setr_ps(x,y,z,w)) {}
+      static inline vfloat4 loadu(const float *ptr) { return _mm_loadu_ps(ptr); }
+      /*! loads (x,y,z,0) from three consecutive floats; unlike a
+          4-wide load this never reads past the end of the input */
+      static inline vfloat4 load3(const float *ptr)
+      {
+        return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double *)ptr)),
+                             _mm_load_ss(ptr+2));
+      }
+      inline void storeu(float *ptr) const { _mm_storeu_ps(ptr,v); }
+      /*! stores x,y,z to three consecutive floats */
+      inline void store3(float *ptr) const
+      {
+        _mm_store_sd((double *)ptr,_mm_castps_pd(v));
+        _mm_store_ss(ptr+2,_mm_movehl_ps(v,v));
+      }
+      inline float first() const { return _mm_cvtss_f32(v); }
+#elif GDT_SIMD_NEON
+      inline vfloat4(const float f) : v(vdupq_n_f32(f)) {}
+      inline vfloat4(const float x, const float y, const float z, const float w)
+      { const float f[4] = { x,y,z,w }; v = vld1q_f32(f); }
+      static inline vfloat4 loadu(const float *ptr) { return vld1q_f32(ptr); }
+      static inline vfloat4 load3(const float *ptr)
+      { return vcombine_f32(vld1_f32(ptr),vset_lane_f32(ptr[2],vdup_n_f32(0.f),0)); }
+      inline void storeu(float *ptr) const { vst1q_f32(ptr,v); }
+      inline void store3(float *ptr) const
+      { vst1_f32(ptr,vget_low_f32(v)); vst1q_lane_f32(ptr+2,v,2); }
+      inline float first() const { return vgetq_lane_f32(v,0); }
+#else
+      inline vfloat4(const float f) { v.f[0] = v.f[1] = v.f[2] = v.f[3] = f; }
+      inline vfloat4(const float x, const float y, const float z, const float w)
+      { v.f[0] = x; v.f[1] = y; v.f[2] = z; v.f[3] = w; }
+      static inline vfloat4 loadu(const float *ptr) { return vfloat4(ptr[0],ptr[1],ptr[2],ptr[3]); }
+      static inline vfloat4 load3(const float *ptr) { return vfloat4(ptr[0],ptr[1],ptr[2],0.f); }
+      inline void storeu(float *ptr) const { for (int i=0;i<4;i++) ptr[i] = v.f[i]; }
+      inline void store3(float *ptr) const { for (int i=0;i<3;i++) ptr[i] = v.f[i]; }
+      inline float first() const { return v.f[0]; }
+#endif
+      native4 v;
+    };
+
+#if GDT_SIMD_SSE
+    inline vfloat4 operator+(const vfloat4 &a, const vfloat4 &b) { return _mm_add_ps(a.v,b.v); }
+    inline vfloat4 operator-(const vfloat4 &a, const vfloat4 &b) { return _mm_sub_ps(a.v,b.v); }
+    inline vfloat4 operator*(const vfloat4 &a, const vfloat4 &b) { return _mm_mul_ps(a.v,b.v); }
+    inline vfloat4 operator/(const vfloat4 &a, const vfloat4 &b) { return _mm_div_ps(a.v,b.v); }
+    inline vfloat4 operator-(const vfloat4 &a) { return _mm_xor_ps(a.v,_mm_set1_ps(-0.f)); }
+    inline vfloat4 min (const vfloat4 &a, const vfloat4 &b) { return _mm_min_ps(a.v,b.v); }
+    inline vfloat4 max (const vfloat4 &a, const vfloat4 &b) { return _mm_max_ps(a.v,b.v); }
+    inline vfloat4 sqrt(const vfloat4 &a) { return _mm_sqrt_ps(a.v); }
+    inline vfloat4 abs (const vfloat4 &a) { return _mm_andnot_ps(_mm_set1_ps(-0.f),a.v); }
+    template<int i0, int i1, int i2, int i3>
+    inline vfloat4 shuffle(const vfloat4 &a) { return _mm_shuffle_ps(a.v,a.v,_MM_SHUFFLE(i3,i2,i1,i0)); }
+    /*! (a[i0],a[i1],b[i2],b[i3]) */
+    template<int i0, int i1, int i2, int i3>
+    inline vfloat4 shuffle(const vfloat4 &a, const vfloat4 &b) { return _mm_shuffle_ps(a.v,b.v,_MM_SHUFFLE(i3,i2,i1,i0)); }
+#elif GDT_SIMD_NEON
+    inline vfloat4 operator+(const vfloat4 &a, const vfloat4 &b) { return vaddq_f32(a.v,b.v); }
+    inline vfloat4 operator-(const vfloat4 &a, const vfloat4 &b) { return vsubq_f32(a.v,b.v); }
+    inline vfloat4 operator*(const vfloat4 &a, const vfloat4 &b) { return vmulq_f32(a.v,b.v); }
+    inline vfloat4 operator/(const vfloat4 &a, const vfloat4 &b) { return vdivq_f32(a.v,b.v); }
+    inline vfloat4 operator-(const vfloat4 &a) { return vnegq_f32(a.v); }
+    inline vfloat4 min (const vfloat4 &a, const vfloat4 &b) { return vminq_f32(a.v,b.v); }
+    inline vfloat4 max (const vfloat4 &a, const vfloat4 &b) { return vmaxq_f32(a.v,b.v); }
+    inline vfloat4 sqrt(const vfloat4 &a) { return vsqrtq_f32(a.v); }
+    inline vfloat4 abs (const vfloat4 &a) { return vabsq_f32(a.v); }
+    template<int i0, int i1, int i2, int i3>
+    inline vfloat4 shuffle(const vfloat4 &a)
+    {
+# if defined(__clang__)
+      return __builtin_shufflevector(a.v,a.v,i0,i1,i2,i3);
+# else
+      return __builtin_shuffle(a.v,(uint32x4_t){i0,i1,i2,i3});
+# endif
+    }
+    template<int i0, int i1, int i2, int i3>
+    inline vfloat4 shuffle(const vfloat4 &a, const vfloat4 &b)
+    {
+# if defined(__clang__)
+      return __builtin_shufflevector(a.v,b.v,i0,i1,i2+4,i3+4);
+# else
+      return __builtin_shuffle(a.v,b.v,(uint32x4_t){i0,i1,i2+4,i3+4});
+# endif
+    }
+#else
+#  define _define_scalar_op(op)                                         \
+    inline vfloat4 operator op(const vfloat4 &a, const vfloat4 &b)      \
+    { return vfloat4(a.v.f[0] op b.v.f[0],a.v.f[1] op b.v.f[1],         \
+                     a.v.f[2] op b.v.f[2],a.v.f[3] op b.v.f[3]); }
+    _define_scalar_op(+)
+    _define_scalar_op(-)
+    _define_scalar_op(*)
+    _define_scalar_op(/)
+#  undef _define_scalar_op
+#  define _define_scalar_fct(fct,expr)                                  \
+    inline vfloat4 fct(const vfloat4 &a)                                \
+    { vfloat4 r; for (int i=0;i<4;i++) { const float x = a.v.f[i]; r.v.f[i] = expr; } return r; }
+    _define_scalar_fct(operator-,-x)
+    _define_scalar_fct(sqrt,sqrtf(x))
+    _define_scalar_fct(abs,fabsf(x))
+#  undef _define_scalar_fct
+    inline vfloat4 min(const vfloat4 &a, const vfloat4 &b)
+    { vfloat4 r; for (int i=0;i<4;i++) r.v.f[i] = a.v.f[i] < b.v.f[i] ? a.v.f[i] : b.v.f[i]; return r; }
+    inline vfloat4 max(const vfloat4 &a, const vfloat4 &b)
+    { vfloat4 r; for (int i=0;i<4;i++) r.v.f[i] = a.v.f[i] > b.v.f[i] ? a.v.f[i] : b.v.f[i]; return r; }
+    template<int i0, int i1, int i2, int i3>
+    inline vfloat4 shuffle(const vfloat4 &a)
+    { return vfloat4(a.v.f[i0],a.v.f[i1],a.v.f[i2],a.v.f[i3]); }
+    template<int i0, int i1, int i2, int i3>
+    inline vfloat4 shuffle(const vfloat4 &a, const vfloat4 &b)
+    { return vfloat4(a.v.f[i0],a.v.f[i1],b.v.f[i2],b.v.f[i3]); }
+#endif
+
+    inline vfloat4 madd(const vfloat4 &a, const vfloat4 &b, const vfloat4 &c) { return a*b+c; }
+    inline vfloat4 rcp(const vfloat4 &a) { return vfloat4(1.f)/a; }
+
+    // =======================================================
+    // vbool4: a mask of four lanes, eg, from comparing vfloat4s
+    // =======================================================
+
+#if GDT_SIMD_SSE
+    struct vbool4 {
+      inline vbool4() = default;
+      inline vbool4(const __m128 m) : m(m) {}
+      /*! one bit per lane, lane 0 in bit 0 */
+      inline int mask() const { return _mm_movemask_ps(m); }
+      __m128 m;
+    };
+    inline vbool4 operator&(const vbool4 &a, const vbool4 &b) { return _mm_and_ps(a.m,b.m); }
+    inline vbool4 operator|(const vbool4 &a, const vbool4 &b) { return _mm_or_ps(a.m,b.m); }
+    inline vbool4 operator!(const vbool4 &a) { return _mm_xor_ps(a.m,_mm_castsi128_ps(_mm_set1_epi32(-1))); }
+    inline vbool4 operator< (const vfloat4 &a, const vfloat4 &b) { return _mm_cmplt_ps(a.v,b.v); }
+    inline vbool4 operator<=(const vfloat4 &a, const vfloat4 &b) { return _mm_cmple_ps(a.v,b.v); }
+    inline vbool4 operator> (const vfloat4 &a, const vfloat4 &b) { return _mm_cmpgt_ps(a.v,b.v); }
+    inline vbool4 operator>=(const vfloat4 &a, const vfloat4 &b) { return _mm_cmpge_ps(a.v,b.v); }
+    inline vbool4 operator==(const vfloat4 &a, const vfloat4 &b) { return _mm_cmpeq_ps(a.v,b.v); }
+    inline vbool4 operator!=(const vfloat4 &a, const vfloat4 &b) { return _mm_cmpneq_ps(a.v,b.v); }
+    /*! per lane, m ? t : f */
+    inline vfloat4 select(const vbool4 &m, const vfloat4 &t, const vfloat4 &f)
+    { return _mm_or_ps(_mm_and_ps(m.m,t.v),_mm_andnot_ps(m.m,f.v)); }
+#elif GDT_SIMD_NEON
+    struct vbool4 {
+      inline vbool4() = default;
+      inline vbool4(const uint32x4_t m) : m(m) {}
+      inline int mask() const
+      {
+        const uint32x4_t bits = vshrq_n_u32(m,31);
+        return int(vgetq_lane_u32(bits,0)      | vgetq_lane_u32(bits,1) << 1
+                   | vgetq_lane_u32(bits,2) << 2 | vgetq_lane_u32(bits,3) << 3);
+      }
+      uint32x4_t m;
+    };
+    inline vbool4 operator&(const vbool4 &a, const vbool4 &b) { return vandq_u32(a.m,b.m); }
+    inline vbool4 operator|(const vbool4 &a, const vbool4 &b) { return vorrq_u32(a.m,b.m); }
+    inline vbool4 operator!(const vbool4 &a) { return vmvnq_u32(a.m); }
+    inline vbool4 operator< (const vfloat4 &a, const vfloat4 &b) { return vcltq_f32(a.v,b.v); }
+    inline vbool4 operator<=(const vfloat4 &a, const vfloat4 &b) { return vcleq_f32(a.v,b.v); }
+    inline vbool4 operator> (const vfloat4 &a, const vfloat4 &b) { return vcgtq_f32(a.v,b.v); }
+    inline vbool4 operator>=(const vfloat4 &a, const vfloat4 &b) { return vcgeq_f32(a.v,b.v); }
+    inline vbool4 operator==(const vfloat4 &a, const vfloat4 &b) { return vceqq_f32(a.v,b.v); }
+    inline vbool4 operator!=(const vfloat4 &a, const vfloat4 &b) { return vmvnq_u32(vceqq_f32(a.v,b.v)); }
+    inline vfloat4 select(const vbool4 &m, const vfloat4 &t, const vfloat4 &f)
+    { return vbslq_f32(m.m,t.v,f.v); }
+#else
+    struct vbool4 {
+      inline int mask() const { return b[0] | b[1] << 1 | b[2] << 2 | b[3] << 3; }
+      bool b[4];
+    };
+#  define _define_scalar_mask_op(op)                                    \
+    inline vbool4 operator op(const vbool4 &a, const vbool4 &b)         \
+    { vbool4 r; for (int i=0;i<4;i++) r.b[i] = a.b[i] op b.b[i]; return r; }
+    _define_scalar_mask_op(&)
+    _define_scalar_mask_op(|)
+#  undef _define_scalar_mask_op
+    inline vbool4 operator!(const vbool4 &a)
+    { vbool4 r; for (int i=0;i<4;i++) r.b[i] = !a.b[i]; return r; }
+#  define _define_scalar_cmp(op)                                        \
+    inline vbool4 operator op(const vfloat4 &a, const vfloat4 &b)       \
+    { vbool4 r; for (int i=0;i<4;i++) r.b[i] = a.v.f[i] op b.v.f[i]; return r; }
+    _define_scalar_cmp(<)
+    _define_scalar_cmp(<=)
+    _define_scalar_cmp(>)
+    _define_scalar_cmp(>=)
+    _define_scalar_cmp(==)
+    _define_scalar_cmp(!=)
+#  undef _define_scalar_cmp
+    inline vfloat4 select(const vbool4 &m, const vfloat4 &t, const vfloat4 &f)
+    { vfloat4 r; for (int i=0;i<4;i++) r.v.f[i] = m.b[i] ? t.v.f[i] : f.v.f[i]; return r; }
+#endif
+
+    /*! x+y+z, broadcast to all four lanes */
+    inline vfloat4 sum3(const vfloat4 &a)
+    { return shuffle<0,0,0,0>(a) + shuffle<1,1,1,1>(a) + shuffle<2,2,2,2>(a); }
+    /*! x+y+z+w, broadcast to all four lanes */
+    inline vfloat4 sum4(const vfloat4 &a)
+    { const vfloat4 t = a + shuffle<1,0,3,2>(a); return t + shuffle<2,3,0,1>(t); }
+
+    /*! loads four consecutive float3s (ie, 12 floats, in three 4-wide
+        loads) and transposes them to SoA */
+    inline void loadTransposed(const float *ptr, vfloat4 &x, vfloat4 &y, vfloat4 &z)
+    {
+      const vfloat4 a = vfloat4::loadu(ptr+0); // x0 y0 z0 x1
+      const vfloat4 b = vfloat4::loadu(ptr+4); // y1 z1 x2 y2
+      const vfloat4 c = vfloat4::loadu(ptr+8); // z2 x3 y3 z3
+      x = shuffle<0,3,0,2>(a,shuffle<2,2,1,1>(b,c));
+      y = shuffle<0,2,0,2>(shuffle<1,1,0,0>(a,b),shuffle<3,3,2,2>(b,c));
+      z = shuffle<0,2,0,2>(shuffle<2,2,1,1>(a,b),shuffle<0,0,3,3>(c,c));
+    }
+
+    /*! the inverse of loadTransposed() */
+    inline void storeTransposed(float *ptr, const vfloat4 &x, const vfloat4 &y, const vfloat4 &z)
+    {
+      shuffle<0,2,0,2>(shuffle<0,0,0,0>(x,y),shuffle<0,0,1,1>(z,x)).storeu(ptr+0);
+      shuffle<0,2,0,2>(shuffle<1,1,1,1>(y,z),shuffle<2,2,2,2>(x,y)).storeu(ptr+4);
+      shuffle<0,2,0,2>(shuffle<2,2,3,3>(z,x),shuffle<3,3,3,3>(y,z)).storeu(ptr+8);
+    }
+
+    // =======================================================
+    // vec3fa
+    // =======================================================
+
+    /*! a float3 in one 16-byte register; the fourth lane ('a') is
+        undefined, and is ignored by all operations below */
+    struct vec3fa {
+      enum { dims = 3 };
+      typedef float scalar_t;
+
+      inline vec3fa() = default;
+      inline vec3fa(const vfloat4 &m) : m(m) {}
+      inline vec3fa(const float f) : m(f) {}
+      inline vec3fa(const float x, const float y, const float z) : m(x,y,z,0.f) {}
+      inline explicit vec3fa(const gdt::vec3f &v) : m(vfloat4::load3(&v.x)) {}
+      inline explicit operator gdt::vec3f() const { gdt::vec3f v; m.store3(&v.x); return v; }
+
+      inline float &operator[](size_t dim) { return (&x)[dim]; }
+      inline const float &operator[](size_t dim) const { return (&x)[dim]; }
+
+      union {
+        vfloat4 m;
+        struct { float x, y, z, a; };
+      };
+    };
+
+    // =======================================================
+    // vec4f
+    // =======================================================
+
+    /*! a float4 in one 16-byte register */
+    struct vec4f {
+      enum { dims = 4 };
+      typedef float scalar_t;
+
+      inline vec4f() = default;
+      inline vec4f(const vfloat4 &m) : m(m) {}
+      inline vec4f(const float f) : m(f) {}
+      inline vec4f(const float x, const float y, const float z, const float w) : m(x,y,z,w) {}
+      inline vec4f(const vec3fa &xyz, const float w) : m(xyz.x,xyz.y,xyz.z,w) {}
+      inline explicit vec4f(const gdt::vec4f &v) : m(vfloat4::loadu(&v.x)) {}
+      inline explicit operator gdt::vec4f() const { return gdt::vec4f(x,y,z,w); }
+
+      inline float &operator[](size_t dim) { return (&x)[dim]; }
+      inline const float &operator[](size_t dim) const { return (&x)[dim]; }
+
+      union {
+        vfloat4 m;
+        struct { float x, y, z, w; };
+      };
+    };
+
+#define _define_operators(vec)                                          \
+    inline vec operator+(const vec &a, const vec &b) { return a.m+b.m; } \
+    inline vec operator-(const vec &a, const vec &b) { return a.m-b.m; } \
+    inline vec operator*(const vec &a, const vec &b) { return a.m*b.m; } \
+    inline vec operator/(const vec &a, const vec &b) { return a.m/b.m; } \
+    inline vec operator*(const vec &a, const float b) { return a.m*vfloat4(b); } \
+    inline vec operator*(const float a, const vec &b) { return vfloat4(a)*b.m; } \
+    inline vec operator/(const vec &a, const float b) { return a.m*vfloat4(1.f/b); } \
+    inline vec operator-(const vec &a) { return -a.m; }                 \
+    inline vec operator+(const vec &a) { return a; }                    \
+    inline vec &operator+=(vec &a, const vec &b) { return a = a+b; }    \
+    inline vec &operator-=(vec &a, const vec &b) { return a = a-b; }    \
+    inline vec &operator*=(vec &a, const vec &b) { return a = a*b; }    \
+    inline vec &operator*=(vec &a, const float b) { return a = a*b; }   \
+    inline vec &operator/=(vec &a, const float b) { return a = a/b; }   \
+    inline vec min (const vec &a, const vec &b) { return min(a.m,b.m); } \
+    inline vec max (const vec &a, const vec &b) { return max(a.m,b.m); } \
+    inline vec abs (const vec &a) { return abs(a.m); }                  \
+    inline vec sqrt(const vec &a) { return sqrt(a.m); }                 \
+    inline vec rcp (const vec &a) { return rcp(a.m); }                  \
+    inline vec madd(const vec &a, const vec &b, const vec &c)           \
+    { return madd(a.m,b.m,c.m); }                                       \
+
+    _define_operators(vec3fa)
+    _define_operators(vec4f)
+#undef _define_operators
+
+    inline bool operator==(const vec3fa &a, const vec3fa &b)
+    { return a.x == b.x && a.y == b.y && a.z == b.z; }
+    inline bool operator!=(const vec3fa &a, const vec3fa &b) { return !(a == b); }
+
+    inline float dot(const vec3fa &a, const vec3fa &b) { return sum3(a.m*b.m).first(); }
+    inline float dot(const vec4f  &a, const vec4f  &b) { return sum4(a.m*b.m).first(); }
+
+    inline vec3fa cross(const vec3fa &a, const vec3fa &b)
+    {
+      // (a * b.yzx - a.yzx * b).yzx, which needs one shuffle less
+      // than the textbook a.yzx*b.zxy - a.zxy*b.yzx
+      const vfloat4 c = a.m*shuffle<1,2,0,3>(b.m) - shuffle<1,2,0,3>(a.m)*b.m;
+      return shuffle<1,2,0,3>(c);
+    }
+
+    inline float  length   (const vec3fa &v) { return sqrt(sum3(v.m*v.m)).first(); }
+    inline float  length   (const vec4f  &v) { return sqrt(sum4(v.m*v.m)).first(); }
+    /*! note this stays in registers all the way; the length gets
+        computed (and broadcast) in simd lanes, and is never moved to
+        a scalar float */
+    inline vec3fa normalize(const vec3fa &v) { return v.m/sqrt(sum3(v.m*v.m)); }
+    inline vec4f  normalize(const vec4f  &v) { return v.m/sqrt(sum4(v.m*v.m)); }
+
+    inline float reduce_min(const vec3fa &v)
+    { return min(shuffle<0,0,0,0>(v.m),min(shuffle<1,1,1,1>(v.m),shuffle<2,2,2,2>(v.m))).first(); }
+    inline float reduce_max(const vec3fa &v)
+    { return max(shuffle<0,0,0,0>(v.m),max(shuffle<1,1,1,1>(v.m),shuffle<2,2,2,2>(v.m))).first(); }
+
+    // note: box_t<> also needs these two for contains() etc
+    inline bool any_less_than(const vec3fa &a, const vec3fa &b)
+    { return a.x < b.x || a.y < b.y || a.z < b.z; }
+    inline bool any_greater_than(const vec3fa &a, const vec3fa &b)
+    { return a.x > b.x || a.y > b.y || a.z > b.z; }
+
+    inline std::ostream &operator<<(std::ostream &o, const vec3fa &v)
+    { return o << "(" << v.x << "," << v.y << "," << v.z << ")"; }
+    inline std::ostream &operator<<(std::ostream &o, const vec4f &v)
+    { return o << "(" << v.x << "," << v.y << "," << v.z << "," << v.w << ")"; }
+
+    typedef box_t<vec3fa> box3fa;
+
+    inline box3fa toSIMD(const box3f &b) { return box3fa(vec3fa(b.lower),vec3fa(b.upper)); }
+    inline box3f  toScalar(const box3fa &b) { return box3f(vec3f(b.lower),vec3f(b.upper)); }
+
+    /*! surface area; same order of operations as area(box3f), so
+        both give bit-identical results */
+    inline float area(const box3fa &b)
+    {
+      const vfloat4 d = b.upper.m - b.lower.m;
+      return 2.f*sum3(d*shuffle<1,2,0,3>(d)).first();
+    }
+
+    // =======================================================
+    // affine transforms
+    // =======================================================
+
+    /*! an AffineSpace3f with its columns in registers */
+    struct affine3fa {
+      inline affine3fa() = default;
+      inline explicit affine3fa(const AffineSpace3f &xfm)
+        : vx(xfm.l.vx), vy(xfm.l.vy), vz(xfm.l.vz), p(xfm.p)
+      {}
+      vec3fa vx, vy, vz, p;
+    };
+
+    inline vec3fa xfmVector(const affine3fa &xfm, const vec3fa &v)
+    {
+      return madd(shuffle<0,0,0,0>(v.m),xfm.vx.m,
+                  madd(shuffle<1,1,1,1>(v.m),xfm.vy.m,
+                       shuffle<2,2,2,2>(v.m)*xfm.vz.m));
+    }
+
+    inline vec3fa xfmPoint(const affine3fa &xfm, const vec3fa &p)
+    { return xfmVector(xfm,p) + xfm.p; }
+
+    // =======================================================
+    // vfloat8: eight floats, as one avx register or two sse/neon
+    // registers
+    // =======================================================
+
+    struct vfloat8 {
+      inline vfloat8() = default;
+#if GDT_SIMD_SSE && defined(__AVX__)
+      inline vfloat8(const __m256 v) : v(v) {}
+      inline vfloat8(const float f) : v(_mm256_set1_ps(f)) {}
+      inline vfloat8(const vfloat4 &lo, const vfloat4 &hi)
+        : v(_mm256_insertf128_ps(_mm256_castps128_ps256(lo.v),hi.v,1)) {}
+      static inline vfloat8 loadu(const float *ptr) { return _mm256_loadu_ps(ptr); }
+      inline void storeu(float *ptr) const { _mm256_storeu_ps(ptr,v); }
+      inline vfloat4 low()  const { return _mm256_castps256_ps128(v); }
+      inline vfloat4 high() const { return _mm256_extractf128_ps(v,1); }
+      __m256 v;
+#else
+      inline vfloat8(const vfloat4 &lo, const vfloat4 &hi) : lo(lo), hi(hi) {}
+      inline vfloat8(const float f) : lo(f), hi(f) {}
+      static inline vfloat8 loadu(const float *ptr)
+      { return vfloat8(vfloat4::loadu(ptr),vfloat4::loadu(ptr+4)); }
+      inline void storeu(float *ptr) const { lo.storeu(ptr); hi.storeu(ptr+4); }
+      inline vfloat4 low()  const { return lo; }
+      inline vfloat4 high() const { return hi; }
+      vfloat4 lo, hi;
+#endif
+    };
+
+#if GDT_SIMD_SSE && defined(__AVX__)
+    inline vfloat8 operator+(const vfloat8 &a, const vfloat8 &b) { return _mm256_add_ps(a.v,b.v); }
+    inline vfloat8 operator-(const vfloat8 &a, const vfloat8 &b) { return _mm256_sub_ps(a.v,b.v); }
+    inline vfloat8 operator*(const vfloat8 &a, const vfloat8 &b) { return _mm256_mul_ps(a.v,b.v); }
+    inline vfloat8 operator/(const vfloat8 &a, const vfloat8 &b) { return _mm256_div_ps(a.v,b.v); }
+    inline vfloat8 operator-(const vfloat8 &a) { return _mm256_xor_ps(a.v,_mm256_set1_ps(-0.f)); }
+    inline vfloat8 min (const vfloat8 &a, const vfloat8 &b) { return _mm256_min_ps(a.v,b.v); }
+    inline vfloat8 max (const vfloat8 &a, const vfloat8 &b) { return _mm256_max_ps(a.v,b.v); }
+    inline vfloat8 sqrt(const vfloat8 &a) { return _mm256_sqrt_ps(a.v); }
+    inline vfloat8 abs (const vfloat8 &a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f),a.v); }
+#else
+#  define _define_binary(fct)                                           \
+    inline vfloat8 fct(const vfloat8 &a, const vfloat8 &b)              \
+    { return vfloat8(fct(a.lo,b.lo),fct(a.hi,b.hi)); }
+#  define _define_unary(fct)                                            \
+    inline vfloat8 fct(const vfloat8 &a)                                \
+    { return vfloat8(fct(a.lo),fct(a.hi)); }
+    _define_binary(operator+)
+    _define_binary(operator-)
+    _define_binary(operator*)
+    _define_binary(operator/)
+    _define_binary(min)
+    _define_binary(max)
+    _define_unary(operator-)
+    _define_unary(sqrt)
+    _define_unary(abs)
+#  undef _define_binary
+#  undef _define_unary
+#endif
+
+    inline vfloat8 madd(const vfloat8 &a, const vfloat8 &b, const vfloat8 &c) { return a*b+c; }
+    inline vfloat8 rcp(const vfloat8 &a) { return vfloat8(1.f)/a; }
+
+    // =======================================================
+    // vbool8
+    // =======================================================
+
+#if GDT_SIMD_SSE && defined(__AVX__)
+    struct vbool8 {
+      inline vbool8() = default;
+      inline vbool8(const __m256 m) : m(m) {}
+      inline int mask() const { return _mm256_movemask_ps(m); }
+      __m256 m;
+    };
+    inline vbool8 operator&(const vbool8 &a, const vbool8 &b) { return _mm256_and_ps(a.m,b.m); }
+    inline vbool8 operator|(const vbool8 &a, const vbool8 &b) { return _mm256_or_ps(a.m,b.m); }
+    inline vbool8 operator!(const vbool8 &a)
+    { return _mm256_xor_ps(a.m,_mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    inline vbool8 operator< (const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v,b.v,_CMP_LT_OQ); }
+    inline vbool8 operator<=(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v,b.v,_CMP_LE_OQ); }
+    inline vbool8 operator> (const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v,b.v,_CMP_GT_OQ); }
+    inline vbool8 operator>=(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v,b.v,_CMP_GE_OQ); }
+    inline vbool8 operator==(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v,b.v,_CMP_EQ_OQ); }
+    inline vbool8 operator!=(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v,b.v,_CMP_NEQ_UQ); }
+    inline vfloat8 select(const vbool8 &m, const vfloat8 &t, const vfloat8 &f)
+    { return _mm256_blendv_ps(f.v,t.v,m.m); }
+#else
+    struct vbool8 {
+      inline vbool8() = default;
+      inline vbool8(const vbool4 &lo, const vbool4 &hi) : lo(lo), hi(hi) {}
+      inline int mask() const { return lo.mask() | hi.mask() << 4; }
+      vbool4 lo, hi;
+    };
+#  define _define_mask_op(op)                                           \
+    inline vbool8 operator op(const vbool8 &a, const vbool8 &b)         \
+    { return vbool8(a.lo op b.lo,a.hi op b.hi); }
+    _define_mask_op(&)
+    _define_mask_op(|)
+#  undef _define_mask_op
+    inline vbool8 operator!(const vbool8 &a) { return vbool8(!a.lo,!a.hi); }
+#  define _define_cmp(op)                                               \
+    inline vbool8 operator op(const vfloat8 &a, const vfloat8 &b)       \
+    { return vbool8(a.lo op b.lo,a.hi op b.hi); }
+    _define_cmp(<)
+    _define_cmp(<=)
+    _define_cmp(>)
+    _define_cmp(>=)
+    _define_cmp(==)
+    _define_cmp(!=)
+#  undef _define_cmp
+    inline vfloat8 select(const vbool8 &m, const vfloat8 &t, const vfloat8 &f)
+    { return vfloat8(select(m.lo,t.lo,f.lo),select(m.hi,t.hi,f.hi)); }
+#endif
+
+    // =======================================================
+    // vec3f8
+    // =======================================================
+
+    /*! eight float3s in SoA layout - ie, one vfloat8 each for x, y,
+        and z - so that every operation below works on eight vectors
+        at once, without any shuffling */
+    struct vec3f8 {
+      enum { dims = 3 };
+      typedef vfloat8 scalar_t;
+
+      inline vec3f8() = default;
+      inline vec3f8(const vfloat8 &x, const vfloat8 &y, const vfloat8 &z) : x(x), y(y), z(z) {}
+      /*! broadcast one vector to all eight slots */
+      inline explicit vec3f8(const gdt::vec3f &v) : x(v.x), y(v.y), z(v.z) {}
+
+      /*! load eight vectors from SoA arrays */
+      static inline vec3f8 loadu(const float *x, const float *y, const float *z)
+      { return vec3f8(vfloat8::loadu(x),vfloat8::loadu(y),vfloat8::loadu(z)); }
+      inline void storeu(float *x, float *y, float *z) const
+      { this->x.storeu(x); this->y.storeu(y); this->z.storeu(z); }
+
+      /*! load (ie, transpose) eight consecutive AoS vectors */
+      static inline vec3f8 loadu(const gdt::vec3f *v)
+      {
+        vfloat4 x0, y0, z0, x1, y1, z1;
+        loadTransposed(&v[0].x,x0,y0,z0);
+        loadTransposed(&v[4].x,x1,y1,z1);
+        return vec3f8(vfloat8(x0,x1),vfloat8(y0,y1),vfloat8(z0,z1));
+      }
+      /*! gather eight AoS vectors v[index[0..7]] */
+      static inline vec3f8 gather(const gdt::vec3f *v, const int32_t *index)
+      {
+        float t[3][8];
+        for (int i=0;i<8;i++) {
+          const gdt::vec3f &vi = v[index[i]];
+          t[0][i] = vi.x; t[1][i] = vi.y; t[2][i] = vi.z;
+        }
+        return loadu(t[0],t[1],t[2]);
+      }
+      /*! store (ie, transpose) to eight consecutive AoS vectors */
+      inline void storeu(gdt::vec3f *v) const
+      {
+        storeTransposed(&v[0].x,x.low(),y.low(),z.low());
+        storeTransposed(&v[4].x,x.high(),y.high(),z.high());
+      }
+
+      vfloat8 x, y, z;
+    };
+
+#define _define_operator(op)                                            \
+    inline vec3f8 operator op(const vec3f8 &a, const vec3f8 &b)         \
+    { return vec3f8(a.x op b.x,a.y op b.y,a.z op b.z); }                \
+    inline vec3f8 operator op(const vec3f8 &a, const vfloat8 &b)        \
+    { return vec3f8(a.x op b,a.y op b,a.z op b); }                      \
+    inline vec3f8 operator op(const vfloat8 &a, const vec3f8 &b)        \
+    { return vec3f8(a op b.x,a op b.y,a op b.z); }
+    _define_operator(+)
+    _define_operator(-)
+    _define_operator(*)
+    _define_operator(/)
+#undef _define_operator
+
+    inline vec3f8 operator-(const vec3f8 &a) { return vec3f8(-a.x,-a.y,-a.z); }
+    inline vec3f8 min(const vec3f8 &a, const vec3f8 &b)
+    { return vec3f8(min(a.x,b.x),min(a.y,b.y),min(a.z,b.z)); }
+    inline vec3f8 max(const vec3f8 &a, const vec3f8 &b)
+    { return vec3f8(max(a.x,b.x),max(a.y,b.y),max(a.z,b.z)); }
+    inline vec3f8 abs(const vec3f8 &a) { return vec3f8(abs(a.x),abs(a.y),abs(a.z)); }
+    inline vec3f8 madd(const vfloat8 &a, const vec3f8 &b, const vec3f8 &c)
+    { return vec3f8(madd(a,b.x,c.x),madd(a,b.y,c.y),madd(a,b.z,c.z)); }
+
+    inline vfloat8 dot(const vec3f8 &a, const vec3f8 &b)
+    { return madd(a.x,b.x,madd(a.y,b.y,a.z*b.z)); }
+    inline vec3f8 cross(const vec3f8 &a, const vec3f8 &b)
+    { return vec3f8(a.y*b.z-a.z*b.y,a.z*b.x-a.x*b.z,a.x*b.y-a.y*b.x); }
+    inline vfloat8 length(const vec3f8 &v) { return sqrt(dot(v,v)); }
+    inline vec3f8 normalize(const vec3f8 &v) { return v * rcp(sqrt(dot(v,v))); }
+
+    inline vec3f8 xfmVector(const AffineSpace3f &xfm, const vec3f8 &v)
+    {
+      return madd(v.x,vec3f8(xfm.l.vx),
+                  madd(v.y,vec3f8(xfm.l.vy),
+                       v.z*vec3f8(xfm.l.vz)));
+    }
+    inline vec3f8 xfmPoint(const AffineSpace3f &xfm, const vec3f8 &p)
+    { return xfmVector(xfm,p) + vec3f8(xfm.p); }
+
+  } // ::gdt::simd
+} // ::gdt
+
+#endif // __CUDA_ARCH__
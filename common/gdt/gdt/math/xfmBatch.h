@@ -0,0 +1,210 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* batched versions of xfmPoint/xfmVector/xfmNormal, for transforming
+   entire vertex arrays (baking instance transforms, animation,
+   per-frame refitting). Arrays get split into blocks that run in
+   parallel, and each block uses the simd types from simd.h, so for
+   large arrays these run at (or close to) memory bandwidth.
+
+   All functions allow in-place operation, ie, 'out == in'. Like
+   simd.h, this is host-only */
+
+#include "gdt/math/simd.h"
+#include "gdt/parallel/parallel_for.h"
+
+#ifndef __CUDA_ARCH__
+
+namespace gdt {
+
+  /*! number of vectors that one parallel task transforms; small
+      enough to balance well, large enough for the per-task overhead
+      not to matter */
+  #define GDT_XFM_BATCH_BLOCK_SIZE (16*1024)
+
+  namespace detail {
+    /*! transforms in[0..count) with the given linear transform plus
+        translation p. Four vectors at a time get loaded with three
+        4-wide loads, and transposed in registers, so the transform
+        itself is pure SoA math (which is what makes this faster than
+        one vec3fa per vector). The order of operations is the same
+        as in xfmPoint(), so results are bit-identical to it (as long
+        as the compiler does not contract either one into fmas) */
+    inline void xfmBlock(const affine3f &xfm, bool translate,
+                         const vec3f *in, vec3f *out, size_t count)
+    {
+      // (broadcast everything up front: 'out' may alias 'xfm' as far
+      // as the compiler knows, so it would re-load them per iteration)
+      const vec3f p = translate ? xfm.p : vec3f(0.f);
+      const simd::vfloat4 m[4][3] = {
+        { xfm.l.vx.x, xfm.l.vx.y, xfm.l.vx.z },
+        { xfm.l.vy.x, xfm.l.vy.y, xfm.l.vy.z },
+        { xfm.l.vz.x, xfm.l.vz.y, xfm.l.vz.z },
+        { p.x, p.y, p.z }
+      };
+      const size_t numQuads = count/4;
+      for (size_t q=0;q<numQuads;q++) {
+        const size_t i = 4*q;
+        simd::vfloat4 x, y, z;
+        simd::loadTransposed(&in[i].x,x,y,z);
+        simd::vfloat4 o[3];
+        for (int d=0;d<3;d++)
+          o[d] = simd::madd(x,m[0][d],simd::madd(y,m[1][d],simd::madd(z,m[2][d],m[3][d])));
+        simd::storeTransposed(&out[i].x,o[0],o[1],o[2]);
+      }
+      for (size_t i=4*numQuads;i<count;i++)
+        out[i] = translate ? xfmPoint(xfm,in[i]) : xfmVector(xfm,in[i]);
+    }
+
+    inline void xfmBatch(const affine3f &xfm, bool translate,
+                         const vec3f *in, vec3f *out, size_t count)
+    {
+      parallel_for_blocked(0,count,GDT_XFM_BATCH_BLOCK_SIZE,[&](size_t begin, size_t end){
+          xfmBlock(xfm,translate,in+begin,out+begin,end-begin);
+        });
+    }
+  }
+
+  // ------------------------------------------------------------------
+  // AoS arrays of vec3f
+  // ------------------------------------------------------------------
+
+  /*! out[i] = xfmPoint(xfm,in[i]), for all i in [0,count) */
+  inline void xfmPoints(const affine3f &xfm, const vec3f *in, vec3f *out, size_t count)
+  { detail::xfmBatch(xfm,true,in,out,count); }
+
+  /*! out[i] = xfmVector(xfm,in[i]), for all i in [0,count) */
+  inline void xfmVectors(const affine3f &xfm, const vec3f *in, vec3f *out, size_t count)
+  { detail::xfmBatch(xfm,false,in,out,count); }
+
+  /*! out[i] = xfmNormal(xfm,in[i]), for all i in [0,count); the
+      inverse transpose gets computed only once. Like xfmNormal(),
+      this does not re-normalize the results */
+  inline void xfmNormals(const affine3f &xfm, const vec3f *in, vec3f *out, size_t count)
+  {
+    const affine3f normalXfm(xfm.l.inverse().transposed(),vec3f(0.f));
+    detail::xfmBatch(normalXfm,false,in,out,count);
+  }
+
+  /*! @{ in-place versions for entire vectors */
+  inline void xfmPoints(const affine3f &xfm, std::vector<vec3f> &v)
+  { xfmPoints(xfm,v.data(),v.data(),v.size()); }
+  inline void xfmVectors(const affine3f &xfm, std::vector<vec3f> &v)
+  { xfmVectors(xfm,v.data(),v.data(),v.size()); }
+  inline void xfmNormals(const affine3f &xfm, std::vector<vec3f> &v)
+  { xfmNormals(xfm,v.data(),v.data(),v.size()); }
+  /*! @} */
+
+  /*! bounds of all xfmPoint(xfm,points[i]), without writing out the
+      transformed points; eg, for computing world-space bounds of an
+      instance, or refitting */
+  inline box3f xfmBounds(const affine3f &xfm, const vec3f *points, size_t count)
+  {
+    const simd::vfloat4 m[4][3] = {
+      { xfm.l.vx.x, xfm.l.vx.y, xfm.l.vx.z },
+      { xfm.l.vy.x, xfm.l.vy.y, xfm.l.vy.z },
+      { xfm.l.vz.x, xfm.l.vz.y, xfm.l.vz.z },
+      { xfm.p.x, xfm.p.y, xfm.p.z }
+    };
+    const size_t numBlocks = divRoundUp(count,size_t(GDT_XFM_BATCH_BLOCK_SIZE));
+    std::vector<box3f> blockBounds(numBlocks);
+    parallel_for(numBlocks,[&](size_t blockID){
+        const size_t begin = blockID*GDT_XFM_BATCH_BLOCK_SIZE;
+        const size_t end   = std::min(count,begin+GDT_XFM_BATCH_BLOCK_SIZE);
+        // per-lane bounds of four points at a time, same as in
+        // detail::xfmBlock()
+        simd::vfloat4 lo[3] = { +INFINITY, +INFINITY, +INFINITY };
+        simd::vfloat4 hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+        const size_t numQuads = (end-begin)/4;
+        for (size_t q=0;q<numQuads;q++) {
+          simd::vfloat4 x, y, z;
+          simd::loadTransposed(&points[begin+4*q].x,x,y,z);
+          for (int d=0;d<3;d++) {
+            const simd::vfloat4 o
+              = simd::madd(x,m[0][d],simd::madd(y,m[1][d],simd::madd(z,m[2][d],m[3][d])));
+            lo[d] = min(lo[d],o);
+            hi[d] = max(hi[d],o);
+          }
+        }
+        box3f bounds;
+        for (int d=0;d<3;d++) {
+          float l[4], h[4];
+          lo[d].storeu(l);
+          hi[d].storeu(h);
+          bounds.lower[d] = std::min(std::min(l[0],l[1]),std::min(l[2],l[3]));
+          bounds.upper[d] = std::max(std::max(h[0],h[1]),std::max(h[2],h[3]));
+        }
+        for (size_t i=begin+4*numQuads;i<end;i++)
+          bounds.extend(xfmPoint(xfm,points[i]));
+        blockBounds[blockID] = bounds;
+      });
+    box3f bounds;
+    for (auto &block : blockBounds) bounds.extend(block);
+    return bounds;
+  }
+
+  inline box3f xfmBounds(const affine3f &xfm, const std::vector<vec3f> &points)
+  { return xfmBounds(xfm,points.data(),points.size()); }
+
+  // ------------------------------------------------------------------
+  // SoA streams, ie, separate x, y, and z arrays
+  // ------------------------------------------------------------------
+
+  /*! a set of SoA arrays; in and out streams may be the same */
+  struct vec3fStream {
+    float *x, *y, *z;
+  };
+
+  /*! same as xfmPoints() above, for SoA streams; this processes
+      eight points at a time, with no shuffling at all */
+  inline void xfmPoints(const affine3f &xfm,
+                        const vec3fStream &in, const vec3fStream &out,
+                        size_t count)
+  {
+    parallel_for_blocked(0,count,GDT_XFM_BATCH_BLOCK_SIZE,[&](size_t begin, size_t end){
+        size_t i = begin;
+        for (;i+8<=end;i+=8)
+          simd::xfmPoint(xfm,simd::vec3f8::loadu(in.x+i,in.y+i,in.z+i))
+            .storeu(out.x+i,out.y+i,out.z+i);
+        for (;i<end;i++) {
+          const vec3f p = xfmPoint(xfm,vec3f(in.x[i],in.y[i],in.z[i]));
+          out.x[i] = p.x; out.y[i] = p.y; out.z[i] = p.z;
+        }
+      });
+  }
+
+  /*! same as xfmVectors() above, for SoA streams */
+  inline void xfmVectors(const affine3f &xfm,
+                         const vec3fStream &in, const vec3fStream &out,
+                         size_t count)
+  {
+    parallel_for_blocked(0,count,GDT_XFM_BATCH_BLOCK_SIZE,[&](size_t begin, size_t end){
+        size_t i = begin;
+        for (;i+8<=end;i+=8)
+          simd::xfmVector(xfm,simd::vec3f8::loadu(in.x+i,in.y+i,in.z+i))
+            .storeu(out.x+i,out.y+i,out.z+i);
+        for (;i<end;i++) {
+          const vec3f v = xfmVector(xfm,vec3f(in.x[i],in.y[i],in.z[i]));
+          out.x[i] = v.x; out.y[i] = v.y; out.z[i] = v.z;
+        }
+      });
+  }
+
+} // ::gdt
+
+#endif // __CUDA_ARCH__
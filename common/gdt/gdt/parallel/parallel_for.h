@@ -0,0 +1,198 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/gdt.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gdt {
+
+  /*! a minimal pool of persistent worker threads, so we can use
+      parallel_for in per-frame code without paying for thread
+      creation every time. We intentionally do not depend on tbb or
+      openmp here, to keep the 'minimal dependencies' promise of this
+      project.
+
+      Only one job runs at any time; parallel_for calls made from
+      within a running task get executed serially on the calling
+      thread (which avoids any possibility of deadlocks for nested
+      loops) */
+  class ThreadPool {
+    struct Job {
+      const std::function<void(size_t)> *task;
+      size_t                             numTasks;
+      std::atomic<size_t>                nextTask;
+      int                                numWorkers;
+      std::exception_ptr                 exception;
+    };
+  public:
+    /*! the process-wide pool; the number of threads can be
+        overridden through the GDT_NUM_THREADS environment variable */
+    static ThreadPool &get()
+    {
+      static ThreadPool pool(defaultThreadCount());
+      return pool;
+    }
+
+    ThreadPool(int numThreads)
+    {
+      for (int i=1;i<numThreads;i++)
+        workers.push_back(std::thread([this](){ workerLoop(); }));
+    }
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+      }
+      jobAvailable.notify_all();
+      for (auto &worker : workers) worker.join();
+    }
+
+    /*! number of threads that execute tasks, including the caller */
+    int numThreads() const { return (int)workers.size()+1; }
+
+    /*! run task(i) for all i in [0,numTasks), and return once all
+        of them are done. If any task throws, the first exception
+        gets re-thrown on the calling thread */
+    void run(size_t numTasks, const std::function<void(size_t)> &task)
+    {
+      if (numTasks == 0) return;
+      if (numTasks == 1 || workers.empty() || nestingLevel() > 0) {
+        for (size_t i=0;i<numTasks;i++) task(i);
+        return;
+      }
+
+      std::lock_guard<std::mutex> oneJobAtATime(runMutex);
+      Job job;
+      job.task       = &task;
+      job.numTasks   = numTasks;
+      job.nextTask   = 0;
+      job.numWorkers = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = &job;
+        generation++;
+      }
+      jobAvailable.notify_all();
+
+      execute(job);
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        // no new worker can pick up this job after this point ...
+        current = nullptr;
+        // ... and we wait for the ones that already did
+        jobDone.wait(lock,[&job](){ return job.numWorkers == 0; });
+      }
+      if (job.exception)
+        std::rethrow_exception(job.exception);
+    }
+
+  private:
+    static int defaultThreadCount()
+    {
+      const char *fromEnv = getenv("GDT_NUM_THREADS");
+      if (fromEnv && atoi(fromEnv) > 0)
+        return atoi(fromEnv);
+      return std::max(1,(int)std::thread::hardware_concurrency());
+    }
+
+    static int &nestingLevel()
+    {
+      static thread_local int level = 0;
+      return level;
+    }
+
+    void execute(Job &job)
+    {
+      nestingLevel()++;
+      while (true) {
+        const size_t taskID = job.nextTask++;
+        if (taskID >= job.numTasks) break;
+        try {
+          (*job.task)(taskID);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!job.exception) job.exception = std::current_exception();
+        }
+      }
+      nestingLevel()--;
+    }
+
+    void workerLoop()
+    {
+      size_t seenGeneration = 0;
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        jobAvailable.wait(lock,[&](){
+            return stop || (current && generation != seenGeneration);
+          });
+        if (stop) return;
+        seenGeneration = generation;
+        Job *job = current;
+        job->numWorkers++;
+        lock.unlock();
+        execute(*job);
+        lock.lock();
+        if (--job->numWorkers == 0)
+          jobDone.notify_all();
+      }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex               runMutex;
+    std::mutex               mutex;
+    std::condition_variable  jobAvailable;
+    std::condition_variable  jobDone;
+    Job                     *current    { nullptr };
+    size_t                   generation { 0 };
+    bool                     stop       { false };
+  };
+
+  /*! execute func(taskID) for all taskIDs in [0,numTasks), in
+      parallel */
+  template<typename Lambda>
+  inline void parallel_for(size_t numTasks, const Lambda &func)
+  {
+    ThreadPool::get().run(numTasks,std::function<void(size_t)>(func));
+  }
+
+  /*! execute func(begin,end) over blocks of (at most) blockSize
+      elements that together cover [begin,end), in parallel */
+  template<typename Lambda>
+  inline void parallel_for_blocked(size_t begin, size_t end, size_t blockSize,
+                                   const Lambda &func)
+  {
+    if (end <= begin) return;
+    const size_t numBlocks = divRoundUp(uint64_t(end-begin),uint64_t(blockSize));
+    parallel_for(numBlocks,[&](size_t blockID){
+        const size_t blockBegin = begin+blockID*blockSize;
+        const size_t blockEnd   = std::min(end,blockBegin+blockSize);
+        func(blockBegin,blockEnd);
+      });
+  }
+
+} // ::gdt
@@ -0,0 +1,1186 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "BVH.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/math/simd.h"
+#include "gdt/math/morton.h"
+// std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  float BVH::sahCost(float traversalCost, float intersectionCost) const
+  {
+    if (nodes.empty()) return 0.f;
+    const float rootArea = area(nodes[0].bounds());
+    if (rootArea <= 0.f) return 0.f;
+    float cost = 0.f;
+    for (auto &node : nodes)
+      cost += area(node.bounds())/rootArea
+        * (node.isLeaf() ? node.count*intersectionCost : traversalCost);
+    return cost;
+  }
+
+  /*! the number of blocks that a leaf of 'count' primitives gets
+      intersected in (see BVHBuildSettings::leafBlockSize); what all
+      builders' sah leaf costs are proportional to */
+  static inline float blocksOf(uint32_t count, const BVHBuildSettings &settings)
+  {
+    const uint32_t blockSize = (uint32_t)std::max(1,settings.leafBlockSize);
+    return float((count+blockSize-1)/blockSize);
+  }
+
+  // ------------------------------------------------------------------
+  // binned sah builder
+  // ------------------------------------------------------------------
+
+  /*! nodes with fewer primitives than this get binned serially */
+  #define PARALLEL_BINNING_THRESHOLD (64*1024)
+  #define MAX_BINS 64
+
+  /*! bin bounds are kept in simd boxes: extending them is what the
+      binning loop spends most of its time on */
+  struct Bin {
+    simd::box3fa bounds;
+    uint32_t count { 0 };
+  };
+
+  struct BinSet {
+    Bin bins[3][MAX_BINS];
+  };
+
+  /*! a range of primIDs that still needs to become a subtree */
+  struct BuildTask {
+    uint32_t nodeID;
+    uint32_t begin, end;
+    box3f    centroidBounds;
+  };
+
+  struct BinnedSAHBuilder {
+    BinnedSAHBuilder(BVH &bvh, const box3f *primBounds, size_t numPrims,
+                     const BVHBuildSettings &settings)
+      : bvh(bvh), primBounds(primBounds), settings(settings),
+        numBins(std::max(2,std::min(MAX_BINS,settings.numBins)))
+    {
+      centroids.resize(numPrims);
+      bvh.primIDs.resize(numPrims);
+      parallel_for_blocked(0,numPrims,16*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            bvh.primIDs[i] = (uint32_t)i;
+            centroids[i]   = primBounds[i].center();
+          }
+        });
+    }
+
+    inline int binOf(const vec3f &centroid, int dim,
+                     const box3f &centroidBounds, float scale) const
+    {
+      const int bin = int((centroid[dim]-centroidBounds.lower[dim])*scale);
+      return std::min(numBins-1,std::max(0,bin));
+    }
+
+    void binRange(BinSet &bins, uint32_t begin, uint32_t end,
+                  const box3f &centroidBounds, const vec3f &scale) const
+    {
+      for (uint32_t i=begin;i<end;i++) {
+        const uint32_t primID   = bvh.primIDs[i];
+        const vec3f    centroid = centroids[primID];
+        const simd::box3fa bounds = simd::toSIMD(primBounds[primID]);
+        for (int dim=0;dim<3;dim++) {
+          Bin &bin = bins.bins[dim][binOf(centroid,dim,centroidBounds,scale[dim])];
+          bin.bounds.extend(bounds);
+          bin.count++;
+        }
+      }
+    }
+
+    void computeBins(BinSet &bins, const BuildTask &task, const vec3f &scale) const
+    {
+      const uint32_t numPrims = task.end-task.begin;
+      if (numPrims < PARALLEL_BINNING_THRESHOLD) {
+        binRange(bins,task.begin,task.end,task.centroidBounds,scale);
+        return;
+      }
+      const size_t blockSize = PARALLEL_BINNING_THRESHOLD/4;
+      std::vector<BinSet> blockBins(divRoundUp(uint64_t(numPrims),uint64_t(blockSize)));
+      parallel_for(blockBins.size(),[&](size_t blockID){
+          const uint32_t begin = task.begin+uint32_t(blockID*blockSize);
+          const uint32_t end   = std::min(task.end,uint32_t(begin+blockSize));
+          binRange(blockBins[blockID],begin,end,task.centroidBounds,scale);
+        });
+      for (auto &block : blockBins)
+        for (int dim=0;dim<3;dim++)
+          for (int b=0;b<numBins;b++) {
+            bins.bins[dim][b].bounds.extend(block.bins[dim][b].bounds);
+            bins.bins[dim][b].count += block.bins[dim][b].count;
+          }
+    }
+
+    void makeLeaf(const BuildTask &task)
+    {
+      bvh.nodes[task.nodeID].offset = task.begin;
+      bvh.nodes[task.nodeID].count  = task.end-task.begin;
+    }
+
+    /*! splits the task's range in two, into the two given children
+        tasks; returns false if it should rather become a leaf */
+    bool split(const BuildTask &task, BuildTask &left, BuildTask &right)
+    {
+      const uint32_t numPrims = task.end-task.begin;
+      if (numPrims <= 1) return false;
+
+      uint32_t mid = task.begin;
+      const vec3f extent = task.centroidBounds.span();
+      if (reduce_max(extent) <= 0.f) {
+        // all centroids in the same spot - no spatial split possible
+        if ((int)numPrims <= settings.maxLeafSize) return false;
+        mid = task.begin+numPrims/2;
+      } else {
+        vec3f scale;
+        for (int dim=0;dim<3;dim++)
+          scale[dim] = extent[dim] > 0.f ? numBins/extent[dim] : 0.f;
+        BinSet bins;
+        computeBins(bins,task,scale);
+
+        // sweep from the right, then from the left, to find the
+        // split plane with the lowest sah cost
+        float bestCost = std::numeric_limits<float>::infinity();
+        int   bestDim = -1, bestBin = -1;
+        for (int dim=0;dim<3;dim++) {
+          if (extent[dim] <= 0.f) continue;
+          float    rightArea[MAX_BINS];
+          uint32_t rightCount[MAX_BINS];
+          simd::box3fa bounds;
+          uint32_t count = 0;
+          for (int b=numBins-1;b>0;--b) {
+            bounds.extend(bins.bins[dim][b].bounds);
+            count += bins.bins[dim][b].count;
+            rightArea[b]  = count ? area(bounds) : 0.f;
+            rightCount[b] = count;
+          }
+          bounds = simd::box3fa();
+          count  = 0;
+          for (int b=1;b<numBins;b++) {
+            bounds.extend(bins.bins[dim][b-1].bounds);
+            count += bins.bins[dim][b-1].count;
+            if (count == 0 || rightCount[b] == 0) continue;
+            const float cost = blocksOf(count,settings)*area(bounds)
+              + blocksOf(rightCount[b],settings)*rightArea[b];
+            if (cost < bestCost) {
+              bestCost = cost;
+              bestDim  = dim;
+              bestBin  = b;
+            }
+          }
+        }
+
+        const float nodeArea = area(bvh.nodes[task.nodeID].bounds());
+        const float leafCost = blocksOf(numPrims,settings)*settings.intersectionCost;
+        const float splitCost = nodeArea > 0.f
+          ? settings.traversalCost + settings.intersectionCost*bestCost/nodeArea
+          : leafCost;
+        if (bestDim < 0 || (splitCost >= leafCost && (int)numPrims <= settings.maxLeafSize))
+          return false;
+
+        if (bestDim >= 0) {
+          const float s = scale[bestDim];
+          uint32_t *middle
+            = std::partition(bvh.primIDs.data()+task.begin,
+                             bvh.primIDs.data()+task.end,
+                             [&](uint32_t primID){
+                               return binOf(centroids[primID],bestDim,
+                                            task.centroidBounds,s) < bestBin;
+                             });
+          mid = uint32_t(middle-bvh.primIDs.data());
+        }
+        if (mid == task.begin || mid == task.end)
+          // can happen if all binned into one bin (eg, for huge
+          // primitive counts with a few outliers); fall back to
+          // splitting in the middle
+          mid = task.begin+numPrims/2;
+      }
+
+      const uint32_t childID = (uint32_t)bvh.nodes.size();
+      bvh.nodes.resize(bvh.nodes.size()+2);
+      bvh.nodes[task.nodeID].offset = childID;
+      bvh.nodes[task.nodeID].count  = 0;
+      left  = { childID,   task.begin, mid,      box3f() };
+      right = { childID+1, mid,        task.end, box3f() };
+      initNode(left);
+      initNode(right);
+      return true;
+    }
+
+    /*! computes node bounds and centroid bounds for a task's range */
+    void initNode(BuildTask &task)
+    {
+      simd::box3fa bounds, centroidBounds;
+      for (uint32_t i=task.begin;i<task.end;i++) {
+        const uint32_t primID = bvh.primIDs[i];
+        bounds.extend(simd::toSIMD(primBounds[primID]));
+        centroidBounds.extend(simd::vec3fa(centroids[primID]));
+      }
+      task.centroidBounds = simd::toScalar(centroidBounds);
+      BVHNode &node = bvh.nodes[task.nodeID];
+      node.lower  = vec3f(bounds.lower);
+      node.upper  = vec3f(bounds.upper);
+      node.offset = task.begin;
+      node.count  = task.end-task.begin;
+    }
+
+    void build()
+    {
+      const uint32_t numPrims = (uint32_t)centroids.size();
+      bvh.nodes.clear();
+      bvh.nodes.reserve(std::max(size_t(1),2*size_t(numPrims)));
+      bvh.nodes.push_back(BVHNode());
+      BuildTask root = { 0, 0, numPrims, box3f() };
+      initNode(root);
+      if (numPrims == 0) return;
+
+      std::vector<BuildTask> stack = { root };
+      while (!stack.empty()) {
+        const BuildTask task = stack.back();
+        stack.pop_back();
+        BuildTask left, right;
+        if (!split(task,left,right)) {
+          makeLeaf(task);
+          continue;
+        }
+        stack.push_back(right);
+        stack.push_back(left);
+      }
+    }
+
+    BVH                     &bvh;
+    const box3f             *primBounds;
+    const BVHBuildSettings   settings;
+    const int                numBins;
+    std::vector<vec3f>       centroids;
+  };
+
+  // ------------------------------------------------------------------
+  // linear bvh builder
+  // ------------------------------------------------------------------
+
+  /*! elements per task in the parallel loops of the lbvh builder */
+  #define LBVH_BLOCK_SIZE (16*1024)
+  /*! buckets per radix sort pass, for the largest digits we use */
+  #define LBVH_MAX_DIGITS 1024
+  /*! max leaves of a treelet; restructuring tries all topologies
+      over them, through all of their 2^N subsets */
+  #define LBVH_TREELET_SIZE 7
+  /*! only subtrees with more primitives than this get restructured;
+      below that, what the restructuring gains does not pay for it */
+  #define LBVH_TREELET_MIN_PRIMS 64
+  /*! subtrees below this many levels of the final bvh get written
+      out in parallel */
+  #define LBVH_SERIAL_EMIT_LEVELS 8
+
+  static inline int countLeadingZeros(uint64_t x)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index,x);
+    return 63-int(index);
+#else
+    return __builtin_clzll(x);
+#endif
+  }
+
+  struct LBVHBuilder {
+    /*! an inner node of the binary tree that the builder works on.
+        Node IDs [0,numPrims-1) are inner nodes, and numPrims-1+i is
+        the i'th primitive in morton order - those leaves only exist
+        implicitly, which saves us touching (and first of all,
+        allocating) another numPrims nodes. Either way, the root is
+        node 0 */
+    struct Node {
+      box3f    bounds;
+      uint32_t child[2];
+      uint32_t parent;
+      /*! primitives in this subtree */
+      uint32_t count;
+      /*! sah cost of this subtree (not normalized by any area) */
+      float    cost;
+      /*! nodes below this one in the final bvh */
+      uint32_t numDescendants;
+      /*! true if this subtree becomes a single leaf */
+      bool     collapse;
+    };
+
+    /*! one node that still has to be written to the final bvh,
+        together with where it and its descendants go */
+    struct EmitTask {
+      uint32_t nodeID;
+      uint32_t outID;
+      uint32_t childOffset;
+      uint32_t primOffset;
+    };
+
+    /*! the leaves and inner nodes of a treelet; inner[0] is its root */
+    struct Treelet {
+      uint32_t leaves[LBVH_TREELET_SIZE];
+      uint32_t inner[LBVH_TREELET_SIZE-1];
+      uint8_t  split[1<<LBVH_TREELET_SIZE];
+      int      numLeaves;
+    };
+
+    LBVHBuilder(BVH &bvh, const box3f *primBounds, size_t numPrims,
+                const BVHBuildSettings &settings)
+      : bvh(bvh), primBounds(primBounds), numPrims(numPrims), settings(settings)
+    {}
+
+    inline bool isPrimLeaf(uint32_t nodeID) const
+    { return nodeID >= numPrims-1; }
+    inline uint32_t leafNode(size_t sortedID) const
+    { return uint32_t(numPrims-1+sortedID); }
+    inline uint32_t primOf(uint32_t leafID) const
+    { return sortedIDs[leafID-(numPrims-1)]; }
+
+    /*! @{ the same for inner nodes and (implicit) primitive leaves */
+    inline const box3f &boundsOf(uint32_t nodeID) const
+    { return isPrimLeaf(nodeID) ? primBounds[primOf(nodeID)] : nodes[nodeID].bounds; }
+    inline uint32_t countOf(uint32_t nodeID) const
+    { return isPrimLeaf(nodeID) ? 1 : nodes[nodeID].count; }
+    inline float costOf(uint32_t nodeID) const
+    {
+      return isPrimLeaf(nodeID)
+        ? settings.intersectionCost*area(primBounds[primOf(nodeID)])
+        : nodes[nodeID].cost;
+    }
+    inline uint32_t descendantsOf(uint32_t nodeID) const
+    { return isPrimLeaf(nodeID) ? 0 : nodes[nodeID].numDescendants; }
+    inline uint32_t &parentOf(uint32_t nodeID)
+    {
+      return isPrimLeaf(nodeID)
+        ? leafParents[nodeID-(numPrims-1)] : nodes[nodeID].parent;
+    }
+    /*! @} */
+
+    /*! the morton codes of the primitives' centroids, on a grid over
+        the bounds of all centroids */
+    void computeCodes()
+    {
+      const size_t numBlocks = divRoundUp(numPrims,size_t(LBVH_BLOCK_SIZE));
+      std::vector<box3f> blockBounds(numBlocks);
+      parallel_for(numBlocks,[&](size_t blockID){
+          const size_t begin = blockID*LBVH_BLOCK_SIZE;
+          const size_t end   = std::min(numPrims,begin+LBVH_BLOCK_SIZE);
+          simd::box3fa bounds;
+          for (size_t i=begin;i<end;i++)
+            bounds.extend(simd::vec3fa(primBounds[i].center()));
+          blockBounds[blockID] = simd::toScalar(bounds);
+        });
+      box3f centroidBounds;
+      for (auto &bounds : blockBounds) centroidBounds.extend(bounds);
+      const vec3f extent = centroidBounds.span();
+      vec3f scale;
+      for (int dim=0;dim<3;dim++)
+        scale[dim] = extent[dim] > 0.f ? 1.f/extent[dim] : 0.f;
+
+      const bool use63Bits = settings.mortonBits > 30;
+      keys.resize(numPrims);
+      sortedIDs.resize(numPrims);
+      parallel_for_blocked(0,numPrims,LBVH_BLOCK_SIZE,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const vec3f p = (primBounds[i].center()-centroidBounds.lower)*scale;
+            keys[i]      = use63Bits ? mortonCode63(p) : uint64_t(mortonCode(p));
+            sortedIDs[i] = uint32_t(i);
+          }
+        });
+    }
+
+    /*! sorts the keys, and the primIDs along with them: a parallel
+        lsd radix sort, in three passes of ten bits for 30-bit codes,
+        or seven passes of nine bits for 63-bit ones. Passes in which
+        all keys have the same digit get skipped */
+    void sortCodes()
+    {
+      const bool     use63Bits = settings.mortonBits > 30;
+      const int      numPasses = use63Bits ? 7 : 3;
+      const int      digitBits = use63Bits ? 9 : 10;
+      const int      numDigits = 1 << digitBits;
+      const uint64_t digitMask = numDigits-1;
+      const size_t numBlocks = divRoundUp(numPrims,size_t(LBVH_BLOCK_SIZE));
+      std::vector<uint64_t> tmpKeys(numPrims);
+      std::vector<uint32_t> tmpIDs(numPrims);
+      std::vector<std::array<uint32_t,LBVH_MAX_DIGITS>> offsets(numBlocks);
+      for (int pass=0;pass<numPasses;pass++) {
+        const int shift = digitBits*pass;
+        parallel_for(numBlocks,[&](size_t blockID){
+            std::array<uint32_t,LBVH_MAX_DIGITS> &histogram = offsets[blockID];
+            std::fill(histogram.begin(),histogram.begin()+numDigits,0);
+            const size_t end = std::min(numPrims,(blockID+1)*LBVH_BLOCK_SIZE);
+            for (size_t i=blockID*LBVH_BLOCK_SIZE;i<end;i++)
+              histogram[(keys[i] >> shift) & digitMask]++;
+          });
+
+        // each block's first output position per digit; going over
+        // the blocks in order for each digit keeps the sort stable
+        uint32_t sum = 0;
+        bool allSameDigit = false;
+        for (int digit=0;digit<numDigits;digit++) {
+          const uint32_t digitBegin = sum;
+          for (auto &block : offsets) {
+            const uint32_t count = block[digit];
+            block[digit] = sum;
+            sum += count;
+          }
+          allSameDigit |= (sum-digitBegin == numPrims);
+        }
+        if (allSameDigit) continue;
+
+        parallel_for(numBlocks,[&](size_t blockID){
+            std::array<uint32_t,LBVH_MAX_DIGITS> &offset = offsets[blockID];
+            const size_t end = std::min(numPrims,(blockID+1)*LBVH_BLOCK_SIZE);
+            for (size_t i=blockID*LBVH_BLOCK_SIZE;i<end;i++) {
+              const uint32_t pos = offset[(keys[i] >> shift) & digitMask]++;
+              tmpKeys[pos] = keys[i];
+              tmpIDs[pos]  = sortedIDs[i];
+            }
+          });
+        keys.swap(tmpKeys);
+        sortedIDs.swap(tmpIDs);
+      }
+    }
+
+    /*! length of the common prefix of sorted keys i and j, or -1 if
+        j is out of range. Duplicate keys get told apart by their
+        index, as if it was appended to the key */
+    inline int delta(int64_t i, int64_t j) const
+    {
+      if (j < 0 || j >= (int64_t)numPrims) return -1;
+      if (keys[i] == keys[j]) return 64+countLeadingZeros(uint64_t(i^j));
+      return countLeadingZeros(keys[i]^keys[j]);
+    }
+
+    /*! finds the children of all inner nodes, each one independently
+        of all others: inner node i covers a range of sorted keys
+        that starts or ends at i, and gets split where the highest
+        bit that differs within that range changes */
+    void buildHierarchy()
+    {
+      nodes.resize(numPrims-1);
+      leafParents.resize(numPrims);
+      parentOf(0) = uint32_t(-1);
+      parallel_for_blocked(0,numPrims-1,LBVH_BLOCK_SIZE,[&](size_t begin, size_t end){
+          for (int64_t i=begin;i<(int64_t)end;i++) {
+            // which way the range goes from i, and its other end
+            const int64_t d = delta(i,i+1) > delta(i,i-1) ? 1 : -1;
+            const int deltaMin = delta(i,i-d);
+            int64_t maxLength = 2;
+            while (delta(i,i+maxLength*d) > deltaMin)
+              maxLength *= 2;
+            int64_t length = 0;
+            for (int64_t step=maxLength/2;step>=1;step/=2)
+              if (delta(i,i+(length+step)*d) > deltaMin)
+                length += step;
+            const int64_t j = i+length*d;
+
+            // the split position, by binary search
+            const int deltaNode = delta(i,j);
+            int64_t split = 0, step = length;
+            do {
+              step = (step+1)/2;
+              if (delta(i,i+(split+step)*d) > deltaNode)
+                split += step;
+            } while (step > 1);
+            const int64_t gamma = i+split*d+std::min(d,int64_t(0));
+
+            Node &node = nodes[i];
+            node.child[0] = std::min(i,j) == gamma   ? leafNode(gamma)   : uint32_t(gamma);
+            node.child[1] = std::max(i,j) == gamma+1 ? leafNode(gamma+1) : uint32_t(gamma+1);
+            parentOf(node.child[0]) = uint32_t(i);
+            parentOf(node.child[1]) = uint32_t(i);
+          }
+        });
+    }
+
+    /*! calls visit(nodeID) for all inner nodes, children before
+        parents, in parallel: every primitive walks up towards the
+        root, and of the two walks that arrive at a node, the second
+        one visits it and moves on */
+    template<typename Lambda>
+    void bottomUp(const Lambda &visit)
+    {
+      std::vector<std::atomic<uint32_t>> arrivals(numPrims-1);
+      parallel_for_blocked(0,arrivals.size(),LBVH_BLOCK_SIZE,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) arrivals[i].store(0,std::memory_order_relaxed);
+        });
+      parallel_for_blocked(0,numPrims,LBVH_BLOCK_SIZE,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            uint32_t nodeID = leafParents[i];
+            while (nodeID != uint32_t(-1) && arrivals[nodeID]++ == 1) {
+              visit(nodeID);
+              nodeID = nodes[nodeID].parent;
+            }
+          }
+        });
+    }
+
+    /*! recomputes an inner node from its children, and decides
+        whether its subtree becomes a leaf, the same way the sah
+        builder does */
+    void refit(uint32_t nodeID)
+    {
+      Node &node = nodes[nodeID];
+      node.bounds = boundsOf(node.child[0]);
+      node.bounds.extend(boundsOf(node.child[1]));
+      node.count = countOf(node.child[0])+countOf(node.child[1]);
+      const float nodeArea  = area(node.bounds);
+      const float splitCost = settings.traversalCost*nodeArea
+        + costOf(node.child[0]) + costOf(node.child[1]);
+      const float leafCost  = settings.intersectionCost*nodeArea*blocksOf(node.count,settings);
+      node.collapse = (int)node.count <= settings.maxLeafSize && leafCost <= splitCost;
+      node.cost     = node.collapse ? leafCost : splitCost;
+      node.numDescendants = node.collapse
+        ? 0 : 2+descendantsOf(node.child[0])+descendantsOf(node.child[1]);
+    }
+
+    /*! re-links subset 'subset' of the treelet's leaves below nodeID,
+        as found by optimizeTreelet(), taking new inner nodes from
+        treelet.inner[nextInner...] */
+    void relinkTreelet(const Treelet &treelet, int subset, uint32_t nodeID, int &nextInner)
+    {
+      const int halves[2] = { treelet.split[subset], subset ^ treelet.split[subset] };
+      for (int side=0;side<2;side++) {
+        const int half = halves[side];
+        uint32_t childID;
+        if ((half & (half-1)) == 0) {
+          int leaf = 0;
+          while (!(half & (1<<leaf))) leaf++;
+          childID = treelet.leaves[leaf];
+        } else {
+          childID = treelet.inner[nextInner++];
+          relinkTreelet(treelet,half,childID,nextInner);
+        }
+        nodes[nodeID].child[side] = childID;
+        parentOf(childID) = nodeID;
+      }
+      refit(nodeID);
+    }
+
+    /*! grows a treelet below nodeID, always expanding the treelet
+        leaf with the largest surface area, and replaces it with the
+        topology of lowest sah cost over the same leaves, if that is
+        any better */
+    void optimizeTreelet(uint32_t rootID)
+    {
+      Treelet treelet;
+      treelet.inner[0]  = rootID;
+      treelet.leaves[0] = nodes[rootID].child[0];
+      treelet.leaves[1] = nodes[rootID].child[1];
+      treelet.numLeaves = 2;
+      int numInner = 1;
+      while (treelet.numLeaves < LBVH_TREELET_SIZE) {
+        int   largest = -1;
+        float largestArea = -1.f;
+        for (int i=0;i<treelet.numLeaves;i++) {
+          if (isPrimLeaf(treelet.leaves[i])) continue;
+          const float leafArea = area(nodes[treelet.leaves[i]].bounds);
+          if (leafArea > largestArea) {
+            largest     = i;
+            largestArea = leafArea;
+          }
+        }
+        if (largest < 0) break;
+        const Node &expanded = nodes[treelet.leaves[largest]];
+        treelet.inner[numInner++] = treelet.leaves[largest];
+        treelet.leaves[largest]   = expanded.child[0];
+        treelet.leaves[treelet.numLeaves++] = expanded.child[1];
+      }
+      if (treelet.numLeaves < 3) return;
+
+      // lowest cost of any subtree over each subset of the leaves;
+      // subsets are numbered such that all of a subset's own subsets
+      // come before it
+      const int numSubsets = 1 << treelet.numLeaves;
+      float    cost[1<<LBVH_TREELET_SIZE];
+      box3f    bounds[1<<LBVH_TREELET_SIZE];
+      uint32_t count[1<<LBVH_TREELET_SIZE];
+      for (int leaf=0;leaf<treelet.numLeaves;leaf++) {
+        const int subset = 1<<leaf;
+        cost[subset]   = costOf(treelet.leaves[leaf]);
+        bounds[subset] = boundsOf(treelet.leaves[leaf]);
+        count[subset]  = countOf(treelet.leaves[leaf]);
+      }
+      for (int subset=1;subset<numSubsets;subset++) {
+        if ((subset & (subset-1)) == 0) continue;
+        // (the lowest leaf, plus the rest)
+        const int lowest = subset & -subset;
+        bounds[subset] = bounds[lowest];
+        bounds[subset].extend(bounds[subset^lowest]);
+        count[subset]  = count[lowest]+count[subset^lowest];
+
+        float bestCost = std::numeric_limits<float>::infinity();
+        for (int part=(subset-1)&subset;part;part=(part-1)&subset) {
+          const float partCost = cost[part]+cost[subset^part];
+          if (partCost < bestCost) {
+            bestCost = partCost;
+            treelet.split[subset] = uint8_t(part);
+          }
+        }
+        const float subsetArea = area(bounds[subset]);
+        const float splitCost  = settings.traversalCost*subsetArea + bestCost;
+        const float leafCost   = settings.intersectionCost*subsetArea*blocksOf(count[subset],settings);
+        cost[subset] = (int)count[subset] <= settings.maxLeafSize
+          ? std::min(leafCost,splitCost) : splitCost;
+      }
+
+      // (with some slack, so rounding differences cannot make us
+      // shuffle equivalent trees)
+      if (!(cost[numSubsets-1] < .999f*nodes[rootID].cost)) return;
+      int nextInner = 1;
+      relinkTreelet(treelet,numSubsets-1,rootID,nextInner);
+    }
+
+    /*! collects the primitives of a subtree, left to right */
+    void gatherPrims(uint32_t nodeID, uint32_t *&out) const
+    {
+      if (isPrimLeaf(nodeID)) {
+        *out++ = primOf(nodeID);
+        return;
+      }
+      gatherPrims(nodes[nodeID].child[0],out);
+      gatherPrims(nodes[nodeID].child[1],out);
+    }
+
+    /*! writes the task's node; returns false for leaves, and
+        otherwise the tasks of its two children */
+    bool emit(const EmitTask &task, EmitTask &left, EmitTask &right)
+    {
+      const box3f &bounds = boundsOf(task.nodeID);
+      BVHNode &out = bvh.nodes[task.outID];
+      out.lower = bounds.lower;
+      out.upper = bounds.upper;
+      if (isPrimLeaf(task.nodeID) || nodes[task.nodeID].collapse) {
+        out.offset = task.primOffset;
+        out.count  = countOf(task.nodeID);
+        uint32_t *primIDs = bvh.primIDs.data()+task.primOffset;
+        gatherPrims(task.nodeID,primIDs);
+        return false;
+      }
+      const uint32_t leftID  = nodes[task.nodeID].child[0];
+      const uint32_t rightID = nodes[task.nodeID].child[1];
+      out.offset = task.childOffset;
+      out.count  = 0;
+      left  = { leftID, task.childOffset,
+                task.childOffset+2, task.primOffset };
+      right = { rightID, task.childOffset+1,
+                task.childOffset+2+descendantsOf(leftID), task.primOffset+countOf(leftID) };
+      return true;
+    }
+
+    /*! writes out the final bvh, in which every node knows where all
+        of its descendants go: the top few levels serially, and the
+        subtrees below them in parallel */
+    void emitBVH()
+    {
+      bvh.nodes.resize(1+descendantsOf(0));
+      bvh.primIDs.resize(numPrims);
+      std::vector<EmitTask> tasks = { { 0, 0, 1, 0 } };
+      for (int level=0;level<LBVH_SERIAL_EMIT_LEVELS && !tasks.empty();level++) {
+        std::vector<EmitTask> next;
+        for (auto &task : tasks) {
+          EmitTask left, right;
+          if (!emit(task,left,right)) continue;
+          next.push_back(left);
+          next.push_back(right);
+        }
+        tasks.swap(next);
+      }
+      parallel_for(tasks.size(),[&](size_t taskID){
+          std::vector<EmitTask> stack = { tasks[taskID] };
+          while (!stack.empty()) {
+            const EmitTask task = stack.back();
+            stack.pop_back();
+            EmitTask left, right;
+            if (!emit(task,left,right)) continue;
+            stack.push_back(right);
+            stack.push_back(left);
+          }
+        });
+    }
+
+    void build()
+    {
+      bvh.nodes.clear();
+      bvh.primIDs.clear();
+      if (numPrims == 0) {
+        const box3f empty;
+        BVHNode root;
+        root.lower  = empty.lower;
+        root.upper  = empty.upper;
+        root.offset = 0;
+        root.count  = 0;
+        bvh.nodes.push_back(root);
+        return;
+      }
+      computeCodes();
+      sortCodes();
+      buildHierarchy();
+      bottomUp([&](uint32_t nodeID){ refit(nodeID); });
+      for (int pass=0;pass<settings.treeletPasses;pass++)
+        bottomUp([&](uint32_t nodeID){
+            refit(nodeID);
+            if (nodes[nodeID].count > LBVH_TREELET_MIN_PRIMS)
+              optimizeTreelet(nodeID);
+          });
+      emitBVH();
+    }
+
+    BVH                     &bvh;
+    const box3f             *primBounds;
+    const size_t             numPrims;
+    const BVHBuildSettings   settings;
+    /*! morton codes, and the primIDs in the same order */
+    std::vector<uint64_t>    keys;
+    std::vector<uint32_t>    sortedIDs;
+    std::vector<Node>        nodes;
+    std::vector<uint32_t>    leafParents;
+  };
+
+  // ------------------------------------------------------------------
+  // spatial split builder
+  // ------------------------------------------------------------------
+
+  /*! bins per axis for finding spatial splits */
+  #define SBVH_SPATIAL_BINS 32
+
+  void splitTriangle(const vec3f &v0, const vec3f &v1, const vec3f &v2,
+                     int dim, float pos, box3f &left, box3f &right)
+  {
+    left = right = box3f();
+    const vec3f v[3] = { v0, v1, v2 };
+    for (int i=0;i<3;i++) {
+      const vec3f &a = v[i];
+      const vec3f &b = v[(i+1)%3];
+      if (a[dim] <= pos) left.extend(a);
+      if (a[dim] >= pos) right.extend(a);
+      if ((a[dim] < pos && b[dim] > pos) || (a[dim] > pos && b[dim] < pos)) {
+        // where the edge crosses the plane goes to both sides
+        vec3f p = a+((pos-a[dim])/(b[dim]-a[dim]))*(b-a);
+        p[dim] = pos;
+        left.extend(p);
+        right.extend(p);
+      }
+    }
+  }
+
+  struct SBVHBuilder {
+    /*! a primitive, or the part of it that lies within 'bounds' */
+    struct Reference {
+      box3f    bounds;
+      uint32_t primID;
+    };
+
+    struct BuildTask {
+      uint32_t               nodeID;
+      std::vector<Reference> refs;
+    };
+
+    /*! the best plane found along any axis, with what would end up
+        on either side of it */
+    struct Split {
+      float    cost { std::numeric_limits<float>::infinity() };
+      int      dim  { -1 };
+      /*! the first bin on the right */
+      int      bin  { 0 };
+      /*! spatial splits only: where the plane is */
+      float    pos  { 0.f };
+      box3f    leftBounds, rightBounds;
+      uint32_t leftCount { 0 }, rightCount { 0 };
+    };
+
+    SBVHBuilder(BVH &bvh, const box3f *primBounds, size_t numPrims,
+                const BVHBuildSettings &settings,
+                const BVHSplitPrimFunc &splitPrim)
+      : bvh(bvh), primBounds(primBounds), numPrims(numPrims),
+        settings(settings), splitPrim(splitPrim),
+        numBins(std::max(2,std::min(MAX_BINS,settings.numBins)))
+    {}
+
+    static inline box3f intersection(const box3f &a, const box3f &b)
+    { return box3f(max(a.lower,b.lower),min(a.upper,b.upper)); }
+
+    static box3f boundsOf(const std::vector<Reference> &refs)
+    {
+      box3f bounds;
+      for (auto &ref : refs) bounds.extend(ref.bounds);
+      return bounds;
+    }
+
+    /*! the parts of a reference on either side of a plane */
+    void splitReference(const Reference &ref, int dim, float pos,
+                        Reference &left, Reference &right) const
+    {
+      left  = ref;
+      right = ref;
+      if (splitPrim) {
+        box3f leftPart, rightPart;
+        splitPrim(ref.primID,dim,pos,leftPart,rightPart);
+        leftPart  = intersection(leftPart,ref.bounds);
+        rightPart = intersection(rightPart,ref.bounds);
+        // (rounding can leave a part empty; then we are back to
+        // splitting the reference's box)
+        if (!leftPart.empty())  left.bounds  = leftPart;
+        if (!rightPart.empty()) right.bounds = rightPart;
+      }
+      left.bounds.upper[dim]  = std::min(left.bounds.upper[dim],pos);
+      right.bounds.lower[dim] = std::max(right.bounds.lower[dim],pos);
+    }
+
+    /*! finds the cheapest of the planes between bins, given the
+        references that start ('enter') and end ('exit') in each bin;
+        for object splits, both are the references in the bin */
+    void sweep(const box3f *binBounds, const uint32_t *enter, const uint32_t *exit,
+               int numBins, int dim, Split &best) const
+    {
+      box3f    rightBounds[MAX_BINS];
+      uint32_t rightCount[MAX_BINS];
+      box3f    bounds;
+      uint32_t count = 0;
+      for (int b=numBins-1;b>0;--b) {
+        bounds.extend(binBounds[b]);
+        count += exit[b];
+        rightBounds[b] = bounds;
+        rightCount[b]  = count;
+      }
+      bounds = box3f();
+      count  = 0;
+      for (int b=1;b<numBins;b++) {
+        bounds.extend(binBounds[b-1]);
+        count += enter[b-1];
+        if (count == 0 || rightCount[b] == 0) continue;
+        const float cost = blocksOf(count,settings)*area(bounds)
+          + blocksOf(rightCount[b],settings)*area(rightBounds[b]);
+        if (cost < best.cost) {
+          best.cost        = cost;
+          best.dim         = dim;
+          best.bin         = b;
+          best.leftBounds  = bounds;
+          best.rightBounds = rightBounds[b];
+          best.leftCount   = count;
+          best.rightCount  = rightCount[b];
+        }
+      }
+    }
+
+    inline int objectBin(const Reference &ref, int dim,
+                         const box3f &centroidBounds, float scale) const
+    {
+      const int bin = int((ref.bounds.center()[dim]-centroidBounds.lower[dim])*scale);
+      return std::min(numBins-1,std::max(0,bin));
+    }
+
+    static inline int spatialBin(float x, float lower, float rcpWidth)
+    { return std::min(SBVH_SPATIAL_BINS-1,std::max(0,int((x-lower)*rcpWidth))); }
+
+    Split findObjectSplit(const std::vector<Reference> &refs,
+                          const box3f &centroidBounds) const
+    {
+      Split best;
+      const vec3f extent = centroidBounds.span();
+      for (int dim=0;dim<3;dim++) {
+        if (extent[dim] <= 0.f) continue;
+        const float scale = numBins/extent[dim];
+        box3f    binBounds[MAX_BINS];
+        uint32_t binCount[MAX_BINS] = { 0 };
+        for (auto &ref : refs) {
+          const int bin = objectBin(ref,dim,centroidBounds,scale);
+          binBounds[bin].extend(ref.bounds);
+          binCount[bin]++;
+        }
+        sweep(binBounds,binCount,binCount,numBins,dim,best);
+      }
+      return best;
+    }
+
+    /*! like findObjectSplit(), but with planes that cut through
+        references, each of which counts (and gets clipped) on both
+        sides of the plane */
+    Split findSpatialSplit(const std::vector<Reference> &refs,
+                           const box3f &nodeBounds) const
+    {
+      Split best;
+      const vec3f extent = nodeBounds.span();
+      for (int dim=0;dim<3;dim++) {
+        if (extent[dim] <= 0.f) continue;
+        const float lower    = nodeBounds.lower[dim];
+        const float width    = extent[dim]/SBVH_SPATIAL_BINS;
+        const float rcpWidth = 1.f/width;
+        box3f    binBounds[SBVH_SPATIAL_BINS];
+        uint32_t enter[SBVH_SPATIAL_BINS] = { 0 };
+        uint32_t exit[SBVH_SPATIAL_BINS]  = { 0 };
+        for (auto &ref : refs) {
+          const int first = spatialBin(ref.bounds.lower[dim],lower,rcpWidth);
+          const int last  = spatialBin(ref.bounds.upper[dim],lower,rcpWidth);
+          Reference rest = ref;
+          for (int bin=first;bin<last;bin++) {
+            Reference left, right;
+            splitReference(rest,dim,lower+(bin+1)*width,left,right);
+            binBounds[bin].extend(left.bounds);
+            rest = right;
+          }
+          binBounds[last].extend(rest.bounds);
+          enter[first]++;
+          exit[last]++;
+        }
+        const float costBefore = best.cost;
+        sweep(binBounds,enter,exit,SBVH_SPATIAL_BINS,dim,best);
+        if (best.cost < costBefore)
+          best.pos = lower+best.bin*width;
+      }
+      return best;
+    }
+
+    /*! distributes the references over the two sides of a spatial
+        split; a reference that straddles the plane gets split, unless
+        moving it entirely to one side is cheaper ("unsplitting") */
+    void performSpatialSplit(const std::vector<Reference> &refs, const box3f &nodeBounds,
+                             Split split, std::vector<Reference> &left,
+                             std::vector<Reference> &right) const
+    {
+      const int   dim      = split.dim;
+      const float lower    = nodeBounds.lower[dim];
+      const float rcpWidth = SBVH_SPATIAL_BINS/nodeBounds.span()[dim];
+      std::vector<Reference> straddling;
+      for (auto &ref : refs) {
+        // (same classification as in findSpatialSplit)
+        if (spatialBin(ref.bounds.upper[dim],lower,rcpWidth) < split.bin)
+          left.push_back(ref);
+        else if (spatialBin(ref.bounds.lower[dim],lower,rcpWidth) >= split.bin)
+          right.push_back(ref);
+        else
+          straddling.push_back(ref);
+      }
+      for (auto &ref : straddling) {
+        const box3f leftUnsplit  = box3f(split.leftBounds).extend(ref.bounds);
+        const box3f rightUnsplit = box3f(split.rightBounds).extend(ref.bounds);
+        const float leftArea  = area(split.leftBounds);
+        const float rightArea = area(split.rightBounds);
+        const float costSplit = leftArea*split.leftCount + rightArea*split.rightCount;
+        const float costLeft  = area(leftUnsplit)*split.leftCount + rightArea*(split.rightCount-1);
+        const float costRight = leftArea*(split.leftCount-1) + area(rightUnsplit)*split.rightCount;
+        if (costLeft < costSplit && costLeft <= costRight) {
+          left.push_back(ref);
+          split.leftBounds = leftUnsplit;
+          split.rightCount--;
+        } else if (costRight < costSplit) {
+          right.push_back(ref);
+          split.rightBounds = rightUnsplit;
+          split.leftCount--;
+        } else {
+          Reference leftPart, rightPart;
+          splitReference(ref,dim,split.pos,leftPart,rightPart);
+          left.push_back(leftPart);
+          right.push_back(rightPart);
+        }
+      }
+    }
+
+    /*! splits the task's references in two, into the two given
+        children tasks; returns false if it should rather become a
+        leaf */
+    bool split(BuildTask &task, BuildTask &left, BuildTask &right)
+    {
+      const uint32_t numRefsHere = (uint32_t)task.refs.size();
+      if (numRefsHere <= 1) return false;
+
+      const box3f nodeBounds = bvh.nodes[task.nodeID].bounds();
+      box3f centroidBounds;
+      for (auto &ref : task.refs) centroidBounds.extend(ref.bounds.center());
+      const Split object = findObjectSplit(task.refs,centroidBounds);
+
+      // spatial splits only where the object split's children would
+      // overlap, and as long as we are within the budget
+      Split spatial;
+      if (numRefs < maxRefs) {
+        const box3f overlap = intersection(object.leftBounds,object.rightBounds);
+        if (object.dim < 0
+            || (!overlap.empty() && area(overlap) > settings.splitAlpha*rootArea))
+          spatial = findSpatialSplit(task.refs,nodeBounds);
+      }
+      // (a spatial split can leave all references on both sides, for
+      // references that all cross the entire node; it is the budget
+      // that makes sure that cannot go on forever)
+      const bool trySpatial
+        =  spatial.cost < object.cost
+        && numRefs+(spatial.leftCount+spatial.rightCount-numRefsHere) <= maxRefs;
+
+      const float bestCost = trySpatial ? spatial.cost : object.cost;
+      const float nodeArea = area(nodeBounds);
+      const float leafCost = blocksOf(numRefsHere,settings)*settings.intersectionCost;
+      const float splitCost = nodeArea > 0.f
+        ? settings.traversalCost + settings.intersectionCost*bestCost/nodeArea
+        : leafCost;
+      if ((int)numRefsHere <= settings.maxLeafSize
+          && (bestCost == std::numeric_limits<float>::infinity() || splitCost >= leafCost))
+        return false;
+
+      left.refs.clear();
+      right.refs.clear();
+      if (trySpatial) {
+        performSpatialSplit(task.refs,nodeBounds,spatial,left.refs,right.refs);
+        if (left.refs.empty() || right.refs.empty()) {
+          left.refs.clear();
+          right.refs.clear();
+        } else
+          numRefs += left.refs.size()+right.refs.size()-numRefsHere;
+      }
+      if (left.refs.empty() && object.dim >= 0) {
+        const float scale = numBins/centroidBounds.span()[object.dim];
+        for (auto &ref : task.refs)
+          (objectBin(ref,object.dim,centroidBounds,scale) < object.bin
+           ? left.refs : right.refs).push_back(ref);
+      }
+      if (left.refs.empty() || right.refs.empty()) {
+        // all centroids in the same spot, and no spatial split
+        // either - split in the middle
+        left.refs.assign(task.refs.begin(),task.refs.begin()+numRefsHere/2);
+        right.refs.assign(task.refs.begin()+numRefsHere/2,task.refs.end());
+      }
+      task.refs = std::vector<Reference>();
+
+      const uint32_t childID = (uint32_t)bvh.nodes.size();
+      bvh.nodes.resize(bvh.nodes.size()+2);
+      bvh.nodes[task.nodeID].offset = childID;
+      bvh.nodes[task.nodeID].count  = 0;
+      left.nodeID  = childID;
+      right.nodeID = childID+1;
+      initNode(left);
+      initNode(right);
+      return true;
+    }
+
+    void initNode(const BuildTask &task)
+    {
+      const box3f bounds = boundsOf(task.refs);
+      BVHNode &node = bvh.nodes[task.nodeID];
+      node.lower  = bounds.lower;
+      node.upper  = bounds.upper;
+      node.offset = 0;
+      node.count  = 0;
+    }
+
+    void makeLeaf(const BuildTask &task)
+    {
+      BVHNode &node = bvh.nodes[task.nodeID];
+      node.offset = (uint32_t)bvh.primIDs.size();
+      node.count  = (uint32_t)task.refs.size();
+      for (auto &ref : task.refs)
+        bvh.primIDs.push_back(ref.primID);
+    }
+
+    void build()
+    {
+      bvh.nodes.clear();
+      bvh.primIDs.clear();
+      numRefs = numPrims;
+      maxRefs = numPrims+size_t(std::max(0.f,settings.splitBudget)*numPrims);
+
+      BuildTask root;
+      root.nodeID = 0;
+      root.refs.resize(numPrims);
+      for (size_t i=0;i<numPrims;i++)
+        root.refs[i] = { primBounds[i], uint32_t(i) };
+      bvh.nodes.push_back(BVHNode());
+      initNode(root);
+      if (numPrims == 0) return;
+      rootArea = area(bvh.nodes[0].bounds());
+      bvh.nodes.reserve(2*numPrims);
+      bvh.primIDs.reserve(maxRefs);
+
+      std::vector<BuildTask> stack;
+      stack.push_back(std::move(root));
+      while (!stack.empty()) {
+        BuildTask task = std::move(stack.back());
+        stack.pop_back();
+        BuildTask left, right;
+        if (!split(task,left,right)) {
+          makeLeaf(task);
+          continue;
+        }
+        stack.push_back(std::move(right));
+        stack.push_back(std::move(left));
+      }
+    }
+
+    BVH                     &bvh;
+    const box3f             *primBounds;
+    const size_t             numPrims;
+    const BVHBuildSettings   settings;
+    const BVHSplitPrimFunc  &splitPrim;
+    const int                numBins;
+    float                    rootArea { 0.f };
+    /*! references so far, and how many the budget allows */
+    size_t                   numRefs  { 0 };
+    size_t                   maxRefs  { 0 };
+  };
+
+  BVHBuildSettings bvhBuildSettingsFor(BVHBuildQuality quality)
+  {
+    BVHBuildSettings settings;
+    switch (quality) {
+    case BVH_BUILD_QUALITY_FAST:
+      settings.method        = BVH_BUILD_LBVH;
+      break;
+    case BVH_BUILD_QUALITY_MEDIUM:
+      settings.method        = BVH_BUILD_LBVH;
+      settings.treeletPasses = 1;
+      break;
+    case BVH_BUILD_QUALITY_HIGH:
+      settings.method        = BVH_BUILD_BINNED_SAH;
+      break;
+    case BVH_BUILD_QUALITY_OFFLINE:
+      settings.method        = BVH_BUILD_SBVH;
+      break;
+    default:
+      throw std::runtime_error("bvhBuildSettingsFor: unknown quality");
+    }
+    return settings;
+  }
+
+  void buildBVH(BVH &bvh,
+                const box3f *primBounds,
+                size_t numPrims,
+                const BVHBuildSettings &settings,
+                const BVHSplitPrimFunc &splitPrim)
+  {
+    if (numPrims >= (size_t(1) << 32))
+      throw std::runtime_error("buildBVH: too many primitives");
+    switch (settings.method) {
+    case BVH_BUILD_BINNED_SAH:
+      BinnedSAHBuilder(bvh,primBounds,numPrims,settings).build();
+      break;
+    case BVH_BUILD_LBVH:
+      LBVHBuilder(bvh,primBounds,numPrims,settings).build();
+      break;
+    case BVH_BUILD_SBVH:
+      SBVHBuilder(bvh,primBounds,numPrims,settings,splitPrim).build();
+      break;
+    default:
+      throw std::runtime_error("buildBVH: unknown build method");
+    }
+  }
+
+} // ::osc
@@ -0,0 +1,145 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/box.h"
+#include <functional>
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! one node of a binary bvh, 32 bytes. Inner nodes have count==0,
+      and their two children at nodes[offset] and nodes[offset+1];
+      leaves reference primIDs[offset..offset+count) */
+  struct BVHNode {
+    vec3f    lower;
+    uint32_t offset;
+    vec3f    upper;
+    uint32_t count;
+
+    inline bool  isLeaf() const { return count != 0; }
+    inline box3f bounds() const { return box3f(lower,upper); }
+  };
+
+  /*! a bvh over a set of primitives that are only known through
+      their bounding boxes; what a primitive is (and how to intersect
+      it) is up to the user. An empty bvh still has a (empty) root
+      node. Builders that split primitives (see BVH_BUILD_SBVH) can
+      reference the same primitive from several leaves */
+  struct BVH {
+    size_t sizeInBytes() const
+    { return nodes.size()*sizeof(BVHNode) + primIDs.size()*sizeof(uint32_t); }
+
+    /*! expected cost of a random ray, relative to intersecting one
+        primitive, according to the surface area heuristic */
+    float sahCost(float traversalCost = 1.f, float intersectionCost = 1.f) const;
+
+    std::vector<BVHNode>  nodes;
+    std::vector<uint32_t> primIDs;
+  };
+
+  /*! the builders we have */
+  enum BVHBuildMethod {
+    /*! top-down, binned surface area heuristic */
+    BVH_BUILD_BINNED_SAH=0,
+    /*! linear bvh: sorts the primitives along a morton curve, and
+        emits the hierarchy implied by the sorted codes (karras,
+        "maximizing parallelism in the construction of bvhs, octrees,
+        and k-d trees", 2012); optionally followed by treelet
+        restructuring (karras and aila, "fast parallel construction
+        of high-quality bvhs", 2013). Much faster to build than the
+        sah builder, at the price of somewhat worse trees */
+    BVH_BUILD_LBVH,
+    /*! binned sah, plus spatial splits that split primitives into
+        several leaves wherever their boxes would overlap badly
+        otherwise (stich et al., "spatial splits in bounding volume
+        hierarchies", 2009). Slower to build than the sah builder,
+        and bigger, but faster to traverse for scenes with long,
+        thin primitives */
+    BVH_BUILD_SBVH,
+    BVH_BUILD_METHOD_COUNT
+  };
+
+  struct BVHBuildSettings {
+    BVHBuildMethod method           = BVH_BUILD_BINNED_SAH;
+    /*! leaves never get larger than this */
+    int            maxLeafSize      = 8;
+    /*! bins per axis */
+    int            numBins          = 16;
+    /*! sah costs of traversing a node and intersecting a primitive */
+    float          traversalCost    = 1.f;
+    float          intersectionCost = 1.f;
+    /*! for leaves that get intersected this many primitives at a
+        time (eg, CPUScene's triangle groups): the sah then charges
+        intersectionCost per started block, rather than per
+        primitive */
+    int            leafBlockSize    = 1;
+    /*! lbvh only: morton code bits, 30 or 63. 63 bits cost twice
+        the sorting, but resolve scenes with small details in a large
+        bounding box */
+    int            mortonBits       = 30;
+    /*! lbvh only: rounds of treelet restructuring; 0 for none */
+    int            treeletPasses    = 0;
+    /*! sbvh only: max primitive references beyond one per
+        primitive, relative to the number of primitives */
+    float          splitBudget      = .25f;
+    /*! sbvh only: spatial splits get tried for nodes whose best
+        object split has children overlapping by more than this,
+        relative to the root's surface area */
+    float          splitAlpha       = 1e-5f;
+  };
+
+  /*! what to optimize a bvh for, from the cheapest build to the
+      fastest traversal */
+  enum BVHBuildQuality {
+    /*! plain lbvh, eg, for rebuilding dynamic content every frame */
+    BVH_BUILD_QUALITY_FAST=0,
+    /*! lbvh with treelet restructuring */
+    BVH_BUILD_QUALITY_MEDIUM,
+    /*! binned sah */
+    BVH_BUILD_QUALITY_HIGH,
+    /*! sbvh, for offline rendering */
+    BVH_BUILD_QUALITY_OFFLINE,
+    BVH_BUILD_QUALITY_COUNT
+  };
+
+  /*! the build settings we use for given quality */
+  BVHBuildSettings bvhBuildSettingsFor(BVHBuildQuality quality);
+
+  /*! computes the bounds of the parts of primitive primID on
+      either side of the plane at 'pos' along axis 'dim'; what lets
+      the sbvh builder split primitives */
+  typedef std::function<void(uint32_t primID, int dim, float pos,
+                             box3f &left, box3f &right)> BVHSplitPrimFunc;
+
+  /*! the split function for a triangle */
+  void splitTriangle(const vec3f &v0, const vec3f &v1, const vec3f &v2,
+                     int dim, float pos, box3f &left, box3f &right);
+
+  /*! (re-)builds 'bvh' over the given primitive bounds, with the
+      method selected in 'settings'. Without a 'splitPrim', the sbvh
+      builder can only split primitives' boxes, not the primitives
+      themselves */
+  void buildBVH(BVH &bvh,
+                const box3f *primBounds,
+                size_t numPrims,
+                const BVHBuildSettings &settings = BVHBuildSettings(),
+                const BVHSplitPrimFunc &splitPrim = BVHSplitPrimFunc());
+
+} // ::osc
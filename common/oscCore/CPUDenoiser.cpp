@@ -0,0 +1,141 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "CPUDenoiser.h"
+#include "gdt/parallel/parallel_for.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! rows per parallel task, for all passes */
+  static const size_t ROWS_PER_TASK = 4;
+
+  /*! albedo values below this are not divided out (there is no
+      meaningful irradiance to recover there) */
+  static const float MIN_DEMODULATION_ALBEDO = 1e-2f;
+
+  inline vec3f demodulationFactor(const vec3f &albedo)
+  {
+    return vec3f(albedo.x > MIN_DEMODULATION_ALBEDO ? albedo.x : 1.f,
+                 albedo.y > MIN_DEMODULATION_ALBEDO ? albedo.y : 1.f,
+                 albedo.z > MIN_DEMODULATION_ALBEDO ? albedo.z : 1.f);
+  }
+
+  void CPUDenoiser::filterPass(const vec2i &size, int iteration,
+                               const vec3f *in, vec3f *out)
+  {
+    // b3-spline kernel, separable weights
+    static const float kernel[5] = { 1.f/16.f, 1.f/4.f, 3.f/8.f, 1.f/4.f, 1.f/16.f };
+    const int   step = 1 << iteration;
+    // halving the color sigma every iteration, as in the paper
+    const float rcpColorVariance
+      = 1.f / (sigmaColor*sigmaColor * exp2f(-float(iteration)));
+    const float rcpAlbedoVariance = 1.f / (sigmaAlbedo*sigmaAlbedo);
+
+    parallel_for_blocked(0,size.y,ROWS_PER_TASK,[&](size_t yBegin, size_t yEnd){
+        for (int y=(int)yBegin;y<(int)yEnd;y++)
+          for (int x=0;x<size.x;x++) {
+            const size_t pixelID = x+size_t(y)*size.x;
+            const vec3f  c_p = in[pixelID];
+            const vec3f  n_p = normals[pixelID];
+            const vec3f  a_p = albedos[pixelID];
+            const float  norm_p = dot(c_p,c_p);
+
+            vec3f sum       = 0.f;
+            float sumWeight = 0.f;
+            for (int dy=-2;dy<=2;dy++) {
+              const int qy = y + dy*step;
+              if (qy < 0 || qy >= size.y) continue;
+              for (int dx=-2;dx<=2;dx++) {
+                const int qx = x + dx*step;
+                if (qx < 0 || qx >= size.x) continue;
+                const size_t q = qx+size_t(qy)*size.x;
+                const vec3f  c_q = in[q];
+
+                const vec3f dc = c_p - c_q;
+                const float colorDistance
+                  = dot(dc,dc) / (1e-4f + norm_p + dot(c_q,c_q));
+                const vec3f da = a_p - albedos[q];
+                // pow(cos,sigmaNormal) ~= exp(sigmaNormal*(cos-1)) for
+                // cos near 1, which lets us use a single exp per tap
+                const float cosNormal = dot(n_p,normals[q]);
+                const float weight
+                  = (cosNormal <= 0.f)
+                  ? 0.f
+                  : kernel[dx+2]*kernel[dy+2]
+                  * expf(-colorDistance*rcpColorVariance
+                         -dot(da,da)*rcpAlbedoVariance
+                         +sigmaNormal*(cosNormal-1.f));
+                sum       += weight*c_q;
+                sumWeight += weight;
+              }
+            }
+            // all weights are zero only if this pixel has no valid
+            // normal (eg, a miss) - leave such pixels unfiltered
+            out[pixelID] = sumWeight > 0.f ? sum/sumWeight : c_p;
+          }
+      });
+  }
+
+  void CPUDenoiser::reserve(size_t numPixels)
+  {
+    if (numPixels <= ping.capacity()) return;
+    normals.reserve(numPixels);
+    albedos.reserve(numPixels);
+    ping.reserve(numPixels);
+    pong.reserve(numPixels);
+    stats.numAllocations += 4;
+    stats.bytesAllocated += 4*numPixels*sizeof(vec3f);
+  }
+
+  void CPUDenoiser::denoise(const FrameBuffer &fb, void *output)
+  {
+    const vec2i  size      = fb.size;
+    const size_t numPixels = fb.numPixels();
+    if (numPixels == 0) return;
+
+    resizeWithCapacity(normals,numPixels,&stats);
+    resizeWithCapacity(albedos,numPixels,&stats);
+    resizeWithCapacity(ping,numPixels,&stats);
+    resizeWithCapacity(pong,numPixels,&stats);
+
+    // decode the guides once - every pixel gets read 25 times per
+    // iteration - and demodulate the color by the albedo
+    const FrameFormat format = fb.format;
+    parallel_for_blocked(0,numPixels,ROWS_PER_TASK*size.x,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const vec3f n = loadNormal(format.normal,fb.normal.data(),i);
+          const float len = length(n);
+          normals[i] = len > 0.f ? n/len : n;
+          albedos[i] = loadAlbedo(format.albedo,fb.albedo.data(),i);
+          ping[i]    = loadColor(format.color,fb.color.data(),i)
+            / demodulationFactor(albedos[i]);
+        }
+      });
+
+    for (int iteration=0;iteration<numIterations;iteration++) {
+      filterPass(size,iteration,ping.data(),pong.data());
+      std::swap(ping,pong);
+    }
+
+    parallel_for_blocked(0,numPixels,ROWS_PER_TASK*size.x,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          storeColor(format.color,output,i,
+                     ping[i]*demodulationFactor(albedos[i]));
+      });
+  }
+
+} // ::osc
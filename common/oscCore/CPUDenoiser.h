@@ -0,0 +1,86 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "FrameBuffer.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! a simple host-side denoiser, for when there is no optix
+      denoiser to use: an edge-avoiding a-trous wavelet filter
+      (Dammertz et al, HPG 2010), guided by the albedo and normal
+      layers. Texture detail is preserved by filtering color/albedo
+      (ie, irradiance) and re-modulating the result with the albedo.
+
+      The guide layers get read in whatever format the frame buffer
+      uses, and the output is written in the frame buffer's color
+      format */
+  class CPUDenoiser {
+  public:
+    /*! denoise the color layer of 'fb' into 'output' (which must hold
+        fb.numPixels() pixels in fb.format.color). 'output' may not
+        alias fb.color */
+    void denoise(const FrameBuffer &fb, void *output);
+
+    /*! number of pixels, in each direction, that can influence a
+        denoised pixel; anything further away than that does not
+        change the result */
+    int footprintRadius() const { return 2*((1<<numIterations)-1); }
+
+    /*! bytes of scratch memory per pixel that denoise() uses */
+    static size_t scratchBytesPerPixel() { return 4*sizeof(vec3f); }
+
+    /*! make sure the scratch memory can hold frames of 'numPixels'
+        pixels, allocating exactly that much if it can't yet */
+    void reserve(size_t numPixels);
+
+    /*! bytes of scratch memory currently held */
+    size_t scratchMemory() const
+    {
+      return (normals.capacity()+albedos.capacity()
+              +ping.capacity()+pong.capacity())*sizeof(vec3f);
+    }
+
+    /*! number of a-trous iterations; iteration i uses a 5x5 kernel
+        with a step width of 2^i pixels */
+    int   numIterations = 4;
+    /*! edge-stopping parameters for relative color difference,
+        normal deviation (as exponent on the cosine), and albedo
+        difference */
+    float sigmaColor    = 0.6f;
+    float sigmaNormal   = 64.f;
+    float sigmaAlbedo   = 0.1f;
+
+    /*! allocation counters for the scratch memory below, which only
+        ever grows (geometrically) across frame sizes */
+    ResourceStats stats;
+
+  private:
+    /*! one a-trous pass with given step width, from 'in' to 'out' */
+    void filterPass(const vec2i &size, int iteration,
+                    const vec3f *in, vec3f *out);
+
+    /*! @{ scratch memory, kept across frames */
+    std::vector<vec3f> normals;
+    std::vector<vec3f> albedos;
+    std::vector<vec3f> ping;
+    std::vector<vec3f> pong;
+    /*! @} */
+  };
+
+} // ::osc
@@ -0,0 +1,698 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "CPURenderer.h"
+#include "MeshLOD.h"
+#include "gdt/parallel/parallel_for.h"
+#include <algorithm>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! values of shadeHit()'s NORMALS, TEXTURE, and QUANTIZED template
+      arguments: the mesh is known to not have that attribute, known
+      to have it, or has to get checked for every hit */
+  enum { ATTRIBUTE_OFF=0, ATTRIBUTE_ON, ATTRIBUTE_PER_HIT };
+
+  /*! LIGHT_SAMPLES template argument for 'numLightSamples, as it is
+      at runtime' */
+  #define LIGHT_SAMPLES_PER_HIT -1
+
+  /*! rows per parallel task */
+  #define ROWS_PER_TASK 4
+
+  /*! rows per parallel task, and per wavefront, when rendering in
+      wavefronts; more rays per wavefront make for longer runs of hits
+      on the same mesh, but also for larger hit and shadow ray queues */
+  #define WAVEFRONT_ROWS_PER_TASK 16
+
+  CPURenderer::CPURenderer(const Model *model, const QuadLight &light,
+                           const BVHBuildSettings &bvhSettings)
+    : model(model),
+      light(light),
+      bvhSettings(bvhSettings),
+      scene(model,bvhSettings)
+  {
+    for (size_t meshID=0;meshID<scene.numMeshes();meshID++)
+      meshBounds.push_back(scene.getMeshBounds(int(meshID)));
+    lights.build(model,light);
+    quadLightOnly = lights.size() == 0 || (lights.size() == 1 && !lights.lights[0].isTriangle);
+  }
+
+  void CPURenderer::setCamera(const Camera &camera)
+  {
+    lastSetCamera = camera;
+    // reset accumulation
+    frameID = 0;
+    this->camera = computeCameraFrame(camera,
+                                      fb.size.y > 0
+                                      ? float(fb.size.x)/float(fb.size.y)
+                                      : 1.f);
+  }
+
+  void CPURenderer::setEnvironment(const EnvironmentMap *environment)
+  {
+    this->environment = environment;
+    // reset accumulation
+    frameID = 0;
+  }
+
+  void CPURenderer::resize(const vec2i &newSize)
+  {
+    fb.resize(newSize,frameFormat);
+    // and re-set the camera, since aspect may have changed
+    setCamera(lastSetCamera);
+  }
+
+  void CPURenderer::setFrameFormat(const FrameFormat &format)
+  {
+    if (format == frameFormat) return;
+    frameFormat = format;
+    if (fb.size.x > 0)
+      resize(fb.size);
+  }
+
+  vec3f CPURenderer::sampleTexture(const Texture &texture, const vec2f &tc) const
+  {
+    const vec2i res = texture.resolution;
+    const float fx  = tc.x*res.x-.5f;
+    const float fy  = tc.y*res.y-.5f;
+    const float x0f = floorf(fx);
+    const float y0f = floorf(fy);
+    const float ax  = fx-x0f;
+    const float ay  = fy-y0f;
+    auto wrap = [](int i, int n) { i %= n; return i < 0 ? i+n : i; };
+    const int x0 = wrap((int)x0f,res.x), x1 = wrap(x0+1,res.x);
+    const int y0 = wrap((int)y0f,res.y), y1 = wrap(y0+1,res.y);
+    auto texel = [&](int x, int y) {
+      const uint32_t rgba = texture.pixel[x+y*res.x];
+      return vec3f(float((rgba >>  0) & 0xff),
+                   float((rgba >>  8) & 0xff),
+                   float((rgba >> 16) & 0xff)) * (1.f/255.f);
+    };
+    return (1.f-ay)*((1.f-ax)*texel(x0,y0) + ax*texel(x1,y0))
+      +          ay*((1.f-ax)*texel(x0,y1) + ax*texel(x1,y1));
+  }
+
+  CPURenderer::ShadeResult CPURenderer::shade(const Ray &ray,
+                                              Random &random,
+                                              RayCounts &counts) const
+  {
+    if (pathTracing) return tracePath(ray,random,counts);
+
+    Hit hit;
+    counts.numRays++;
+    const bool found
+      = cullPrimaryRays ? scene.intersectPrimary(ray,hit) : scene.intersect(ray,hit);
+    if (!found) return missResult(ray);
+    counts.numHits++;
+    return (this->*meshShaders[hit.meshID])(ray,hit,random,counts,nullptr);
+  }
+
+  CPURenderer::ShadeResult CPURenderer::missResult(const Ray &ray) const
+  {
+    // the environment, or constant white as background color
+    ShadeResult result;
+    result.color  = environment ? environment->lookup(normalize(ray.dir)) : vec3f(1.f);
+    result.normal = vec3f(0.f);
+    result.albedo = vec3f(0.f);
+    return result;
+  }
+
+  /*! iterative rather than recursive, so all a path carries from one
+      vertex to the next is its throughput, and what it needs for
+      weighing the light that the next segment might hit: the
+      previous vertex, and the pdf of the bounce direction. Every
+      vertex does next event estimation with one light sample and one
+      environment sample, and bounces with a cosine distribution;
+      light that either strategy can find gets combined with the
+      power heuristic. Paths end when they leave the scene, at
+      maxPathDepth, once their throughput is zero, or through russian
+      roulette - whichever comes first */
+  CPURenderer::ShadeResult CPURenderer::tracePath(Ray ray,
+                                                  Random &random,
+                                                  RayCounts &counts) const
+  {
+    ShadeResult result;
+    result.color  = vec3f(0.f);
+    result.normal = vec3f(0.f);
+    result.albedo = vec3f(0.f);
+    vec3f throughput(1.f);
+    vec3f prevP, prevN;
+    float bouncePdf = 0.f;
+    for (int depth=0;;depth++) {
+      Hit hit;
+      counts.numRays++;
+      if (depth > 0) counts.numBounces++;
+      const bool found
+        = depth == 0 && cullPrimaryRays
+        ? scene.intersectPrimary(ray,hit)
+        : scene.intersect(ray,hit);
+      if (!found) {
+        if (depth == 0) return missResult(ray);
+        // (the environment's own samples could have found this, too)
+        const float weight
+          = environment ? powerHeuristic(bouncePdf,environment->pdf(ray.dir)) : 1.f;
+        result.color += throughput*weight
+          * (environment ? environment->lookup(ray.dir) : vec3f(1.f));
+        break;
+      }
+      if (depth == 0) counts.numHits++;
+
+      const SurfaceHit surface
+        = surfaceAt<ATTRIBUTE_PER_HIT,ATTRIBUTE_PER_HIT,ATTRIBUTE_PER_HIT>(ray,hit);
+      if (depth == 0) {
+        result.normal = surface.Ns;
+        result.albedo = surface.diffuse;
+      }
+
+      // emission: seen directly, all of it; after a bounce, weighed
+      // against the previous vertex' light sample having found the
+      // same triangle
+      if (reduce_max(surface.emission) > 0.f) {
+        float weight = 1.f;
+        const int lightID = depth > 0 ? lights.lightOf(hit.meshID,hit.primID) : -1;
+        if (lightID >= 0) {
+          const Light &hitLight = lights.lights[lightID];
+          const float area     = .5f*length(cross(hitLight.e1,hitLight.e2));
+          const float cosLight = fabsf(dot(surface.Ng,ray.dir));
+          const float lightPdf
+            = lights.pickPdf(lightSelection,prevP,prevN,lightID)
+            * hit.t*hit.t / (area*cosLight);
+          weight = powerHeuristic(bouncePdf,lightPdf);
+        }
+        result.color += throughput*surface.emission*weight;
+      }
+
+      // (the last vertex does not bounce, so light samples there are
+      // all there is, and get all the weight)
+      const bool bounces = depth+1 < maxPathDepth;
+      const vec3f org = surface.P + 1e-3f*surface.Ng;
+      auto unoccluded = [&](const vec3f &dir, float tmax) {
+        Ray shadowRay;
+        shadowRay.org  = org;
+        shadowRay.dir  = dir;
+        shadowRay.tmin = 1e-3f;
+        shadowRay.tmax = tmax;
+        counts.numRays++;
+        return !scene.occluded(shadowRay);
+      };
+
+      // one light sample; nothing but this finds the quad light
+      if (lights.size() > 0) {
+        LightSample lightSample;
+        vec3f lightPower;
+        float weight = 1.f;
+        bool  valid  = true;
+        if (quadLightOnly) {
+          const QuadLightSampler lightSampler(lightSampling,light.origin,light.du,light.dv,
+                                              surface.P,1,random);
+          lightSample = lightSampler.sample(0,random);
+          lightPower  = light.power;
+        } else {
+          float pdf;
+          const int lightID = lights.pick(lightSelection,surface.P,surface.Ns,random(),pdf);
+          valid = lightID >= 0;
+          if (valid) {
+            const vec2f uv(random(),random());
+            lightSample = lights.sample(lightID,surface.P,uv);
+            lightPower  = lights.lights[lightID].emission * (1.f/pdf);
+            if (bounces && lights.lights[lightID].isTriangle && lightSample.weight > 0.f)
+              weight = powerHeuristic(pdf/(float(M_PI)*lightSample.weight),
+                                      fmaxf(0.f,dot(lightSample.dir,surface.Ns))*float(1./M_PI));
+          }
+        }
+        const float NdotL = dot(lightSample.dir,surface.Ns);
+        if (valid && NdotL > 0.f && lightSample.weight > 0.f
+            && unoccluded(lightSample.dir,lightSample.dist*(1.f-1e-3f)))
+          result.color += throughput * lightPower * surface.diffuse
+            * (NdotL * lightSample.weight * weight);
+      }
+
+      // one environment sample, always by importance
+      if (environment) {
+        const vec2f uv(random(),random());
+        float pdf;
+        const vec3f dir = environment->sample(random(),uv,pdf);
+        const float NdotL = dot(dir,surface.Ns);
+        if (NdotL > 0.f && pdf > 0.f && unoccluded(dir,1e20f)) {
+          const float weight = bounces ? powerHeuristic(pdf,NdotL*float(1./M_PI)) : 1.f;
+          result.color += throughput * environment->lookup(dir) * surface.diffuse
+            * (NdotL * weight / (float(M_PI) * pdf));
+        }
+      }
+
+      // bounce: the lambertian brdf (diffuse/pi) times the cosine,
+      // over the cosine distribution's pdf, leaves just 'diffuse'
+      if (!bounces) break;
+      const vec3f dir = sampleCosineHemisphere(surface.Ns,vec2f(random(),random()));
+      const float cosBounce = dot(dir,surface.Ns);
+      if (cosBounce <= 0.f || dot(dir,surface.Ng) <= 0.f) break;
+      throughput *= surface.diffuse;
+      const float maxThroughput = reduce_max(throughput);
+      if (!(maxThroughput > 0.f)) break;
+      if (depth+1 >= rouletteDepth) {
+        const float survival = std::min(maxThroughput,.95f);
+        if (random() >= survival) break;
+        throughput *= 1.f/survival;
+      }
+
+      prevP     = surface.P;
+      prevN     = surface.Ns;
+      bouncePdf = cosBounce*float(1./M_PI);
+      ray.org   = org;
+      ray.dir   = dir;
+      ray.tmin  = 1e-3f;
+      ray.tmax  = 1e20f;
+    }
+    return result;
+  }
+
+  template<int NORMALS, int TEXTURE, int QUANTIZED>
+  CPURenderer::SurfaceHit CPURenderer::surfaceAt(const Ray &ray, const Hit &hit) const
+  {
+    const TriangleMesh &mesh = *model->meshes[hit.meshID];
+    const bool quantized
+      = QUANTIZED == ATTRIBUTE_PER_HIT ? mesh.isQuantized() : QUANTIZED == ATTRIBUTE_ON;
+    const bool hasNormals
+      = NORMALS == ATTRIBUTE_PER_HIT ? mesh.hasNormals() : NORMALS == ATTRIBUTE_ON;
+    const bool hasTexture
+      = TEXTURE == ATTRIBUTE_PER_HIT
+      ? mesh.diffuseTextureID >= 0 && mesh.hasTexcoords()
+      : TEXTURE == ATTRIBUTE_ON;
+
+    // (quantized meshes get decoded on the fly, right here)
+    auto vertex   = [&](int i) { return quantized ? mesh.quantized.getVertex(i)   : mesh.vertex[i]; };
+    auto normal   = [&](int i) { return quantized ? mesh.quantized.getNormal(i)   : mesh.normal[i]; };
+    auto texcoord = [&](int i) { return quantized ? mesh.quantized.getTexcoord(i) : mesh.texcoord[i]; };
+
+    const vec3i index = mesh.getIndex(hit.primID,scene.getMeshLOD(hit.meshID));
+    const float u = hit.u;
+    const float v = hit.v;
+
+    // ------------------------------------------------------------------
+    // compute normal, using either shading normal (if avail), or
+    // geometry normal (fallback)
+    // ------------------------------------------------------------------
+    const vec3f A = vertex(index.x);
+    const vec3f B = vertex(index.y);
+    const vec3f C = vertex(index.z);
+    vec3f Ng = cross(B-A,C-A);
+    vec3f Ns = hasNormals
+      ? ((1.f-u-v) * normal(index.x)
+         +       u * normal(index.y)
+         +       v * normal(index.z))
+      : Ng;
+
+    // face-forward and normalize normals
+    if (dot(ray.dir,Ng) > 0.f) Ng = -Ng;
+    Ng = normalize(Ng);
+    if (dot(Ng,Ns) < 0.f)
+      Ns -= 2.f*dot(Ng,Ns)*Ng;
+    Ns = normalize(Ns);
+
+    // diffuse material color, including diffuse texture, if available
+    vec3f diffuseColor = mesh.diffuse;
+    if (hasTexture) {
+      const vec2f tc
+        = (1.f-u-v) * texcoord(index.x)
+        +         u * texcoord(index.y)
+        +         v * texcoord(index.z);
+      diffuseColor *= sampleTexture(*model->textures[mesh.diffuseTextureID],tc);
+    }
+
+    SurfaceHit surface;
+    surface.P        = (1.f-u-v)*A + u*B + v*C;
+    surface.Ng       = Ng;
+    surface.Ns       = Ns;
+    surface.diffuse  = diffuseColor;
+    surface.emission = mesh.emission;
+    return surface;
+  }
+
+  /*! with all template arguments known, every attribute check (in
+      surfaceAt()) is a constant, and the light sample loop has a
+      fixed trip count - so the compiler removes the checks, and the
+      code for whatever the mesh does not have */
+  template<int NORMALS, int TEXTURE, int QUANTIZED, int LIGHT_SAMPLES>
+  CPURenderer::ShadeResult CPURenderer::shadeHit(const Ray &ray,
+                                                 const Hit &hit,
+                                                 Random &random,
+                                                 RayCounts &counts,
+                                                 ShadowQueue *shadows) const
+  {
+    const int numLightSamples
+      = LIGHT_SAMPLES == LIGHT_SAMPLES_PER_HIT ? this->numLightSamples : LIGHT_SAMPLES;
+    const SurfaceHit surface = surfaceAt<NORMALS,TEXTURE,QUANTIZED>(ray,hit);
+    const vec3f &Ng           = surface.Ng;
+    const vec3f &Ns           = surface.Ns;
+    const vec3f &diffuseColor = surface.diffuse;
+
+    // whatever the surface emits, plus some ambient term - unless
+    // the environment lights the scene (see below)
+    vec3f pixelColor = surface.emission;
+    if (!environment)
+      pixelColor += (0.1f + 0.2f*fabsf(dot(Ns,ray.dir)))*diffuseColor;
+
+    // shadow rays start just off the surface; each adds its
+    // contribution if it is not occluded
+    const vec3f &surfPos = surface.P;
+    auto addShadowRay = [&](const vec3f &dir, float tmax, const vec3f &contribution) {
+      Ray shadowRay;
+      shadowRay.org  = surfPos + 1e-3f*Ng;
+      shadowRay.dir  = dir;
+      shadowRay.tmin = 1e-3f;
+      shadowRay.tmax = tmax;
+      if (shadows)
+        shadows->entries.push_back({ shadowRay, contribution, shadows->sample });
+      else {
+        counts.numRays++;
+        if (!scene.occluded(shadowRay))
+          pixelColor += contribution;
+      }
+    };
+
+    // soft shadows from the quad light - or, with emissive meshes,
+    // from one picked light per light sample
+    const QuadLightSampler lightSampler(quadLightOnly ? lightSampling : LIGHT_SAMPLING_UNIFORM,
+                                        light.origin,light.du,light.dv,
+                                        surfPos,numLightSamples,random);
+    for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
+      LightSample lightSample;
+      vec3f lightPower;
+      if (quadLightOnly) {
+        lightSample = lightSampler.sample(lightSampleID,random);
+        lightPower  = light.power;
+      } else {
+        float pdf;
+        const int lightID = lights.pick(lightSelection,surfPos,Ns,random(),pdf);
+        if (lightID < 0) continue;
+        const vec2f uv(random(),random());
+        lightSample = lights.sample(lightID,surfPos,uv);
+        lightPower  = lights.lights[lightID].emission * (1.f/pdf);
+      }
+      const vec3f lightDir  = lightSample.dir;
+      const float lightDist = lightSample.dist;
+
+      const float NdotL = dot(lightDir,Ns);
+      if (NdotL >= 0.f)
+        addShadowRay(lightDir,lightDist*(1.f-1e-3f),
+                     lightPower
+                     * diffuseColor
+                     * (NdotL * lightSample.weight / numLightSamples));
+    }
+
+    // light from the environment: radiance times the lambertian brdf
+    // (diffuse/pi) and NdotL, over the pdf of the sampled direction
+    if (environment)
+      for (int envSampleID=0;envSampleID<numEnvironmentSamples;envSampleID++) {
+        const vec2f uv(random(),random());
+        vec3f dir;
+        float pdf;
+        if (environmentSampling == ENVIRONMENT_SAMPLING_UNIFORM) {
+          dir = sampleUniformHemisphere(Ns,uv);
+          pdf = float(.5/M_PI);
+        } else if (environmentSampling == ENVIRONMENT_SAMPLING_COSINE) {
+          dir = sampleCosineHemisphere(Ns,uv);
+          pdf = dot(dir,Ns)*float(1./M_PI);
+        } else
+          dir = environment->sample(random(),uv,pdf);
+        const float NdotL = dot(dir,Ns);
+        if (NdotL > 0.f && pdf > 0.f)
+          addShadowRay(dir,1e20f,
+                       environment->lookup(dir)
+                       * diffuseColor
+                       * (NdotL / (float(M_PI) * pdf * numEnvironmentSamples)));
+      }
+
+    ShadeResult result;
+    result.color  = pixelColor;
+    result.normal = Ns;
+    result.albedo = diffuseColor;
+    return result;
+  }
+
+  /*! light sample counts other than these (ambient only, one for
+      interactive use, and example 12's four) use the variant that
+      loops over numLightSamples; every count here is another eight
+      copies of shadeHit() */
+  template<int NORMALS, int TEXTURE, int QUANTIZED>
+  CPURenderer::ShadeFunc CPURenderer::specializedShader(int numLightSamples)
+  {
+    switch (numLightSamples) {
+    case 0:  return &CPURenderer::shadeHit<NORMALS,TEXTURE,QUANTIZED,0>;
+    case 1:  return &CPURenderer::shadeHit<NORMALS,TEXTURE,QUANTIZED,1>;
+    case 4:  return &CPURenderer::shadeHit<NORMALS,TEXTURE,QUANTIZED,4>;
+    default: return &CPURenderer::shadeHit<NORMALS,TEXTURE,QUANTIZED,LIGHT_SAMPLES_PER_HIT>;
+    }
+  }
+
+  void CPURenderer::selectShaders()
+  {
+    if (meshShaders.size() == model->meshes.size()
+        && shadersLightSamples == numLightSamples
+        && shadersSpecialized == specializedShading)
+      return;
+    shadersLightSamples = numLightSamples;
+    shadersSpecialized  = specializedShading;
+
+    typedef ShadeFunc (*SelectFunc)(int);
+    // [normals][texture][quantized]
+    static const SelectFunc select[2][2][2] = {
+      { { specializedShader<ATTRIBUTE_OFF,ATTRIBUTE_OFF,ATTRIBUTE_OFF>,
+          specializedShader<ATTRIBUTE_OFF,ATTRIBUTE_OFF,ATTRIBUTE_ON> },
+        { specializedShader<ATTRIBUTE_OFF,ATTRIBUTE_ON,ATTRIBUTE_OFF>,
+          specializedShader<ATTRIBUTE_OFF,ATTRIBUTE_ON,ATTRIBUTE_ON> } },
+      { { specializedShader<ATTRIBUTE_ON,ATTRIBUTE_OFF,ATTRIBUTE_OFF>,
+          specializedShader<ATTRIBUTE_ON,ATTRIBUTE_OFF,ATTRIBUTE_ON> },
+        { specializedShader<ATTRIBUTE_ON,ATTRIBUTE_ON,ATTRIBUTE_OFF>,
+          specializedShader<ATTRIBUTE_ON,ATTRIBUTE_ON,ATTRIBUTE_ON> } }
+    };
+    meshShaders.resize(model->meshes.size());
+    // (textured meshes first, grouped by texture, then the others)
+    std::vector<uint32_t> order(model->meshes.size());
+    for (size_t meshID=0;meshID<order.size();meshID++) order[meshID] = uint32_t(meshID);
+    std::stable_sort(order.begin(),order.end(),[&](uint32_t a, uint32_t b){
+        return uint32_t(model->meshes[a]->diffuseTextureID)
+          <    uint32_t(model->meshes[b]->diffuseTextureID);
+      });
+    meshShadeRank.resize(order.size());
+    for (size_t rank=0;rank<order.size();rank++) meshShadeRank[order[rank]] = uint32_t(rank);
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh &mesh = *model->meshes[meshID];
+      const bool hasTexture = mesh.diffuseTextureID >= 0 && mesh.hasTexcoords();
+      meshShaders[meshID]
+        = specializedShading
+        ? select[mesh.hasNormals()][hasTexture][mesh.isQuantized()](numLightSamples)
+        : &CPURenderer::shadeHit<ATTRIBUTE_PER_HIT,ATTRIBUTE_PER_HIT,ATTRIBUTE_PER_HIT,
+                                 LIGHT_SAMPLES_PER_HIT>;
+    }
+  }
+
+  Ray CPURenderer::primaryRay(int ix, int iy, Random &random) const
+  {
+    const vec2f screen(vec2f(ix+random(),iy+random()) / vec2f(fb.size));
+    Ray ray;
+    ray.org  = camera.position;
+    ray.dir  = normalize(camera.direction
+                         + (screen.x - 0.5f) * camera.horizontal
+                         + (screen.y - 0.5f) * camera.vertical);
+    ray.tmin = 0.f;
+    ray.tmax = 1e20f;
+    return ray;
+  }
+
+  void CPURenderer::storePixel(int ix, int iy, const ShadeResult &sum)
+  {
+    vec3f rgb(sum.color/numPixelSamples);
+    const vec3f albedo(sum.albedo/numPixelSamples);
+    const vec3f normal(sum.normal/numPixelSamples);
+
+    // and write/accumulate to frame buffer ...
+    const size_t fbIndex = ix+size_t(iy)*fb.size.x;
+    if (frameID > 0) {
+      rgb += float(frameID) * loadColor(fb.format.color,fb.color.data(),fbIndex);
+      rgb /= (frameID+1.f);
+    }
+    storeColor(fb.format.color,fb.color.data(),fbIndex,rgb);
+    storeAlbedo(fb.format.albedo,fb.albedo.data(),fbIndex,albedo);
+    storeNormal(fb.format.normal,fb.normal.data(),fbIndex,normal);
+  }
+
+  CPURenderer::RayCounts CPURenderer::renderRows(int yBegin, int yEnd)
+  {
+    RayCounts counts;
+    const vec2i size = fb.size;
+    for (int iy=yBegin;iy<yEnd;iy++)
+      for (int ix=0;ix<size.x;ix++) {
+        Random random;
+        random.init(ix+size.x*iy,frameID);
+
+        ShadeResult sum { vec3f(0.f), vec3f(0.f), vec3f(0.f) };
+        for (int sampleID=0;sampleID<numPixelSamples;sampleID++) {
+          const ShadeResult result = shade(primaryRay(ix,iy,random),random,counts);
+          sum.color  += result.color;
+          sum.normal += result.normal;
+          sum.albedo += result.albedo;
+        }
+        storePixel(ix,iy,sum);
+      }
+    return counts;
+  }
+
+  /*! each wavefront is one sample of every pixel in the rows, so each
+      pixel's random numbers get drawn in the same order as in
+      renderRows() - which makes for the exact same image */
+  CPURenderer::RayCounts CPURenderer::renderRowsWavefront(int yBegin, int yEnd)
+  {
+    RayCounts counts;
+    const vec2i size = fb.size;
+    const int   numPixels = (yEnd-yBegin)*size.x;
+    std::vector<Random>      random(numPixels);
+    std::vector<Ray>         rays(numPixels);
+    std::vector<ShadeResult> results(numPixels);
+    std::vector<ShadeResult> sums(numPixels,{ vec3f(0.f), vec3f(0.f), vec3f(0.f) });
+    std::vector<HitRecord>   hits, sortedHits;
+    std::vector<uint32_t>    binBegin(meshShadeRank.size()+1);
+    ShadowQueue              shadows;
+    for (int i=0;i<numPixels;i++)
+      random[i].init(i%size.x+size.x*(yBegin+i/size.x),frameID);
+
+    for (int sampleID=0;sampleID<numPixelSamples;sampleID++) {
+      // trace all primary rays, and record their hits
+      hits.clear();
+      for (int i=0;i<numPixels;i++) {
+        rays[i] = primaryRay(i%size.x,yBegin+i/size.x,random[i]);
+        counts.numRays++;
+        Hit hit;
+        const bool found
+          = cullPrimaryRays ? scene.intersectPrimary(rays[i],hit) : scene.intersect(rays[i],hit);
+        if (found)
+          hits.push_back({ hit, uint32_t(i) });
+        else
+          results[i] = missResult(rays[i]);
+      }
+
+      // counting sort by shading rank (stable, so within one mesh
+      // the hits stay in pixel order)
+      std::fill(binBegin.begin(),binBegin.end(),0);
+      for (auto &h : hits) binBegin[meshShadeRank[h.hit.meshID]+1]++;
+      for (size_t bin=1;bin<binBegin.size();bin++) binBegin[bin] += binBegin[bin-1];
+      sortedHits.resize(hits.size());
+      for (auto &h : hits) sortedHits[binBegin[meshShadeRank[h.hit.meshID]]++] = h;
+
+      // shade, queueing all shadow rays
+      shadows.entries.clear();
+      for (auto &h : sortedHits) {
+        counts.numHits++;
+        shadows.sample = h.sample;
+        results[h.sample]
+          = (this->*meshShaders[h.hit.meshID])(rays[h.sample],h.hit,random[h.sample],
+                                               counts,&shadows);
+      }
+
+      // trace the shadow rays; each pixel sample's entries are in the
+      // order shadeHit() would have added them up in
+      for (auto &shadow : shadows.entries) {
+        counts.numRays++;
+        if (!scene.occluded(shadow.ray))
+          results[shadow.sample].color += shadow.contribution;
+      }
+
+      for (int i=0;i<numPixels;i++) {
+        sums[i].color  += results[i].color;
+        sums[i].normal += results[i].normal;
+        sums[i].albedo += results[i].albedo;
+      }
+    }
+
+    for (int i=0;i<numPixels;i++)
+      storePixel(i%size.x,yBegin+i/size.x,sums[i]);
+    return counts;
+  }
+
+  void CPURenderer::updateLODs()
+  {
+    std::vector<int> meshLODs(model->meshes.size(),0);
+    bool anyLOD = false;
+    if (lodPixelError > 0.f)
+      for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+        // (emissive meshes stay at full detail, which is what the
+        // light list has their triangles of)
+        if (reduce_max(model->meshes[meshID]->emission) > 0.f) continue;
+        meshLODs[meshID] = selectLOD(*model->meshes[meshID],meshBounds[meshID],
+                                     camera,fb.size.y,lodPixelError);
+        anyLOD |= meshLODs[meshID] > 0;
+      }
+    // (an empty selection means 'everything at full detail')
+    if (!anyLOD) meshLODs.clear();
+    if (meshLODs != scene.getMeshLODs())
+      scene = CPUScene(model,bvhSettings,meshLODs);
+  }
+
+  void CPURenderer::render()
+  {
+    // sanity check: make sure we launch only after first resize is
+    // already done:
+    if (fb.size.x == 0) return;
+
+    const double t0 = getCurrentTime();
+    updateLODs();
+    selectShaders();
+    stats.numTriangles = scene.numTriangles();
+    cullPrimaryRays = frustumCulling;
+    if (cullPrimaryRays)
+      scene.cull(computeFrustum(camera));
+    stats.numVisibleMeshes
+      = cullPrimaryRays ? scene.numVisibleMeshes() : scene.numMeshes();
+    // (paths get traced one after the other; see tracePath())
+    const bool wavefronts = wavefront && !pathTracing;
+    const int rowsPerTask = wavefronts ? WAVEFRONT_ROWS_PER_TASK : ROWS_PER_TASK;
+    const size_t numTasks = divRoundUp(fb.size.y,rowsPerTask);
+    std::vector<RayCounts> counts(numTasks);
+    parallel_for(numTasks,[&](size_t taskID){
+        const int yBegin = int(taskID)*rowsPerTask;
+        const int yEnd   = std::min(fb.size.y,yBegin+rowsPerTask);
+        counts[taskID]
+          = wavefronts ? renderRowsWavefront(yBegin,yEnd) : renderRows(yBegin,yEnd);
+      });
+    stats.numRays = 0;
+    stats.numHits = 0;
+    stats.numBounces = 0;
+    for (auto &c : counts) {
+      stats.numRays    += c.numRays;
+      stats.numHits    += c.numHits;
+      stats.numBounces += c.numBounces;
+    }
+
+    lastFrameDenoised = denoiserOn;
+    if (denoiserOn) {
+      denoised.resize(fb.color.size());
+      denoiser.denoise(fb,denoised.data());
+    }
+    stats.seconds = getCurrentTime()-t0;
+
+    if (accumulate)
+      frameID++;
+  }
+
+  void CPURenderer::downloadPixels(uint32_t h_pixels[])
+  {
+    const void *color = lastFrameDenoised ? denoised.data() : fb.color.data();
+    osc::toneMap(toneMap,fb.format.color,color,h_pixels,fb.size);
+  }
+
+} // ::osc
@@ -0,0 +1,287 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Camera.h"
+#include "CPUDenoiser.h"
+#include "CPUScene.h"
+#include "EnvironmentMap.h"
+#include "LightList.h"
+#include "ToneMap.h"
+#include "gdt/random/random.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the host-side counterpart of example 12's SampleRenderer: same
+      model, light, camera conventions, shading, and frame buffer
+      layers, but traced on the cpu, through a CPUScene. Needs neither
+      cuda nor optix, so it also runs on machines without a gpu - and
+      is what the renderer benchmarks measure */
+  class CPURenderer {
+  public:
+    CPURenderer(const Model *model, const QuadLight &light,
+                const BVHBuildSettings &bvhSettings = BVHBuildSettings());
+
+    /*! render one frame (accumulating into the previous ones, if
+        enabled) */
+    void render();
+
+    /*! resize frame buffer to given resolution */
+    void resize(const vec2i &newSize);
+
+    /*! tone map the rendered (and, if enabled, denoised) color into
+        the given rgba8 pixels */
+    void downloadPixels(uint32_t h_pixels[]);
+
+    /*! select the storage format of the frame buffer layers;
+        restarts accumulation */
+    void setFrameFormat(const FrameFormat &format);
+
+    /*! set camera to render with */
+    void setCamera(const Camera &camera);
+
+    /*! light the scene with the given environment map (which is also
+        what rays that miss everything see), or go back to example
+        12's white background for nullptr; restarts accumulation. The
+        map has to stay around for as long as it is set */
+    void setEnvironment(const EnvironmentMap *environment);
+
+    const CPUScene    &getScene()       const { return scene; }
+    const FrameBuffer &getFrameBuffer() const { return fb; }
+    const LightList   &getLights()      const { return lights; }
+
+    bool denoiserOn      = false;
+    bool accumulate      = true;
+    int  numPixelSamples = 1;
+    /*! trace primary rays only against the meshes in the view
+        frustum (see CPUScene::cull()); same image, less traversal
+        work when much of the scene is out of view */
+    bool frustumCulling  = false;
+    /*! if > 0, render each mesh at the coarsest of its levels of
+        detail (see buildLODs()) whose geometric error stays below
+        this many pixels on screen. The scene gets rebuilt whenever
+        the selected levels change, so this is for when the camera
+        does not move much from frame to frame */
+    float lodPixelError  = 0.f;
+    /*! shadow rays to the quad light per hit, as NUM_LIGHT_SAMPLES
+        in example 12; 0 leaves only the ambient term. With emissive
+        meshes in the model, each of these goes to one light picked
+        from all of them (see LightList.h) */
+    int  numLightSamples = 4;
+    /*! how those light samples get placed on the light; all ways
+        converge to the same image (see LightSampling.h) */
+    LightSampling lightSampling = LIGHT_SAMPLING_STRATIFIED;
+    /*! how light samples pick their light, if there is more than the
+        quad light; all ways converge to the same image */
+    LightSelection lightSelection = LIGHT_SELECTION_TREE;
+    /*! with an environment map: directions per hit that the
+        environment gets sampled in, each with a shadow ray. These
+        replace the ambient term */
+    int  numEnvironmentSamples = 4;
+    EnvironmentSampling environmentSampling = ENVIRONMENT_SAMPLING_IMPORTANCE;
+    /*! shade each mesh with a variant of the shading code that got
+        compiled for that mesh's attributes (normals, texture,
+        quantization) and the light sample count, picked once per
+        mesh; otherwise, all meshes use one generic variant that
+        checks all of these for every hit. Same image either way */
+    bool specializedShading = true;
+    /*! render in wavefronts rather than shading each hit right away:
+        trace all primary rays of a block of rows, sort the hits by
+        material, shade them in that order while queueing their
+        shadow rays, and trace those in a second pass. Same image,
+        but each mesh's vertices and texture get touched in one go */
+    bool wavefront = false;
+    /*! trace full paths rather than shading only the primary hit:
+        at every vertex, sample one light, and the environment, for
+        direct light, then bounce off the (lambertian) surface. Light
+        that a bounce hits gets weighed against what light sampling
+        found with multiple importance sampling. Replaces the ambient
+        term and numLightSamples/numEnvironmentSamples; wavefront
+        gets ignored (see tracePath()) */
+    bool pathTracing   = false;
+    /*! segments per path, including the primary ray */
+    int  maxPathDepth  = 8;
+    /*! paths with at least this many segments continue only with a
+        probability that follows their throughput, ie, with what a
+        further bounce could still add to the pixel */
+    int  rouletteDepth = 3;
+
+    /*! tone mapping and output transform to use for the final
+        pixels */
+    ToneMapParams toneMap;
+
+    struct Stats {
+      /*! of the last render() */
+      double   seconds    { 0. };
+      /*! primary plus shadow rays of the last render() */
+      uint64_t numRays    { 0 };
+      /*! primary rays of the last render() that hit something, ie,
+          the number of times a mesh got shaded */
+      uint64_t numHits    { 0 };
+      /*! rays that continued a path after a bounce; paths average
+          1+numBounces/(pixel samples) segments */
+      uint64_t numBounces { 0 };
+      /*! meshes that primary rays got traced against in the last
+          render(); all of them without frustum culling */
+      size_t   numVisibleMeshes { 0 };
+      /*! triangles in the scene that the last render() traced */
+      size_t   numTriangles { 0 };
+    };
+    Stats stats;
+
+  protected:
+    typedef LCG<16> Random;
+
+    /*! what the closest hit program computes for one ray */
+    struct ShadeResult {
+      vec3f color;
+      vec3f normal;
+      vec3f albedo;
+    };
+
+    struct RayCounts {
+      uint64_t numRays { 0 };
+      uint64_t numHits { 0 };
+      uint64_t numBounces { 0 };
+    };
+
+    /*! the shading point of a hit, with its material */
+    struct SurfaceHit {
+      vec3f P;
+      /*! geometry and shading normal, both facing the ray */
+      vec3f Ng, Ns;
+      vec3f diffuse;
+      vec3f emission;
+    };
+
+    /*! the shadow rays of a wavefront's shading stage, each with what
+        it adds to its pixel sample's color if it is not occluded */
+    struct ShadowQueue {
+      struct Entry {
+        Ray      ray;
+        vec3f    contribution;
+        uint32_t sample;
+      };
+      std::vector<Entry> entries;
+      /*! the pixel sample that is being shaded */
+      uint32_t sample { 0 };
+    };
+
+    /*! a primary hit of a wavefront, and the pixel sample it is for */
+    struct HitRecord {
+      Hit      hit;
+      uint32_t sample;
+    };
+
+    /*! one variant of the closest hit program; traces its shadow rays
+        right away, unless given a queue to put them in */
+    typedef ShadeResult (CPURenderer::*ShadeFunc)(const Ray &ray, const Hit &hit,
+                                                  Random &random,
+                                                  RayCounts &counts,
+                                                  ShadowQueue *shadows) const;
+
+    /*! selects each mesh's level of detail for the current camera,
+        and rebuilds the scene if that changed anything */
+    void updateLODs();
+
+    /*! renders all pixels of rows [yBegin,yEnd); returns the number
+        of rays traced, and of hits shaded */
+    RayCounts renderRows(int yBegin, int yEnd);
+
+    /*! same, in wavefronts (see 'wavefront') */
+    RayCounts renderRowsWavefront(int yBegin, int yEnd);
+
+    /*! the camera ray through a random point in pixel (ix,iy) */
+    Ray primaryRay(int ix, int iy, Random &random) const;
+
+    /*! averages the given sums over all pixel samples, and writes (or
+        accumulates) them into the frame buffer */
+    void storePixel(int ix, int iy, const ShadeResult &sum);
+
+    /*! traces the ray, and calls the miss program, or the hit mesh's
+        closest hit program */
+    ShadeResult shade(const Ray &ray, Random &random, RayCounts &counts) const;
+
+    /*! the equivalent of the miss program */
+    ShadeResult missResult(const Ray &ray) const;
+
+    /*! the equivalent of the closest hit program. Each template
+        argument is either a compile time constant, or says to look
+        the mesh's attribute (or numLightSamples) up for every hit;
+        see CPURenderer.cpp */
+    template<int NORMALS, int TEXTURE, int QUANTIZED, int LIGHT_SAMPLES>
+    ShadeResult shadeHit(const Ray &ray, const Hit &hit,
+                         Random &random, RayCounts &counts,
+                         ShadowQueue *shadows) const;
+
+    /*! reconstructs the hit's surface point, normals, and material,
+        with the same template arguments as shadeHit() */
+    template<int NORMALS, int TEXTURE, int QUANTIZED>
+    SurfaceHit surfaceAt(const Ray &ray, const Hit &hit) const;
+
+    /*! the path tracer (see 'pathTracing'): follows the path that
+        starts with the given camera ray, iteratively, for as long as
+        the path's depth and russian roulette let it */
+    ShadeResult tracePath(Ray ray, Random &random, RayCounts &counts) const;
+
+    /*! (re-)picks the shadeHit() variant of each mesh, if anything it
+        depends on changed */
+    void selectShaders();
+
+    /*! the variant with the given attributes, for the given number
+        of light samples */
+    template<int NORMALS, int TEXTURE, int QUANTIZED>
+    static ShadeFunc specializedShader(int numLightSamples);
+
+    /*! bilinear, wrapping lookup, as a cuda texture object with
+        normalized coordinates would do it */
+    vec3f sampleTexture(const Texture &texture, const vec2f &tc) const;
+
+    const Model   *model;
+    QuadLight      light;
+    /*! the quad light and all emissive triangles */
+    LightList      lights;
+    /*! whether 'lights' is only the quad light, which then gets
+        sampled as in example 12, with 'lightSampling' */
+    bool           quadLightOnly { true };
+    const EnvironmentMap *environment { nullptr };
+    BVHBuildSettings bvhSettings;
+    CPUScene       scene;
+    /*! the bounds of each mesh at full detail, for picking lods */
+    std::vector<box3f> meshBounds;
+    FrameBuffer    fb;
+    FrameFormat    frameFormat { FrameFormat::full() };
+    Camera         lastSetCamera;
+    CameraFrame    camera;
+    int            frameID     { 0 };
+    CPUDenoiser    denoiser;
+    std::vector<uint8_t> denoised;
+    bool           lastFrameDenoised { false };
+    /*! whether this frame's primary rays go through the culled scene */
+    bool           cullPrimaryRays   { false };
+    /*! the shadeHit() variant for each mesh, and the settings they
+        were selected for */
+    std::vector<ShadeFunc> meshShaders;
+    int            shadersLightSamples { -1 };
+    bool           shadersSpecialized  { false };
+    /*! the order wavefronts shade meshes in: meshes that share a
+        texture are next to each other */
+    std::vector<uint32_t> meshShadeRank;
+  };
+
+} // ::osc
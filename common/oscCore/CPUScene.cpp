@@ -0,0 +1,458 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "CPUScene.h"
+#include "SceneCache.h"
+#include "gdt/parallel/parallel_for.h"
+#include "gdt/math/simd.h"
+#include <iostream>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! entries of the traversal stack that live on the (call) stack.
+      Enough for balanced and typical sah bvhs; deeper ones (lbvhs
+      with many morton bits, degenerate splits) spill to the heap */
+  #define TRAVERSAL_STACK_DEPTH 64
+
+  /*! assigns each of the bvh's leaves its first group, starting at
+      group 'firstGroup', in leafGroup[leaf.offset]; returns the
+      number of groups */
+  template<int W>
+  static uint32_t assignLeafGroups(const BVH &bvh, uint32_t firstGroup, uint32_t *leafGroup)
+  {
+    uint32_t numGroups = 0;
+    for (auto &node : bvh.nodes)
+      if (node.isLeaf()) {
+        leafGroup[node.offset] = firstGroup+numGroups;
+        numGroups += (node.count+W-1)/W;
+      }
+    return numGroups;
+  }
+
+  /*! fills the groups of the bvh's leaves (as assigned by
+      assignLeafGroups()); getTriangle(i,group,lane) puts the
+      triangle of bvh.primIDs[i] into given lane of given group */
+  template<int W, typename GetTriangle>
+  static void fillLeafGroups(const BVH &bvh, const uint32_t *leafGroup,
+                             TriangleGroup<W> *groups, const GetTriangle &getTriangle)
+  {
+    parallel_for_blocked(0,bvh.nodes.size(),4*1024,[&](size_t begin, size_t end){
+        for (size_t nodeID=begin;nodeID<end;nodeID++) {
+          const BVHNode &node = bvh.nodes[nodeID];
+          if (!node.isLeaf()) continue;
+          TriangleGroup<W> *group = groups+leafGroup[node.offset];
+          for (uint32_t i=0;i<node.count;i++) {
+            if (i % W == 0) group[i/W].clear();
+            getTriangle(node.offset+i,group[i/W],int(i % W));
+          }
+        }
+      });
+  }
+
+  /*! the settings we actually build with: our leaves get intersected
+      a group at a time */
+  static BVHBuildSettings groupedSettings(BVHBuildSettings settings)
+  {
+    settings.leafBlockSize = CPU_SCENE_GROUP_WIDTH;
+    return settings;
+  }
+
+  uint64_t CPUScene::bvhCacheKey(const Model *model,
+                                 const BVHBuildSettings &requested,
+                                 const std::vector<int> &meshLODs)
+  {
+    const BVHBuildSettings settings = groupedSettings(requested);
+    // (field by field, so padding can never get into the key)
+    const int32_t ints[] = { int32_t(sizeof(BVHNode)), int32_t(settings.method),
+                             settings.maxLeafSize, settings.numBins,
+                             settings.leafBlockSize, settings.mortonBits,
+                             settings.treeletPasses };
+    const float floats[] = { settings.traversalCost, settings.intersectionCost,
+                             settings.splitBudget, settings.splitAlpha };
+    uint64_t key = hashBytes(ints,sizeof(ints));
+    key = hashBytes(floats,sizeof(floats),key);
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh &mesh = *model->meshes[meshID];
+      const int32_t lod = meshLODs.empty() ? 0 : meshLODs[meshID];
+      key = hashBytes(&lod,sizeof(lod),key);
+      // everything that getVertex() and getIndex() read
+      key = hashBytes(mesh.vertex.data(),mesh.vertex.size()*sizeof(mesh.vertex[0]),key);
+      key = hashBytes(mesh.index.data(),mesh.index.size()*sizeof(mesh.index[0]),key);
+      const QuantizedMesh &q = mesh.quantized;
+      key = hashBytes(&q.bounds,sizeof(q.bounds),key);
+      key = hashBytes(&q.vertexScale,sizeof(q.vertexScale),key);
+      key = hashBytes(q.vertex.data(),q.vertex.size()*sizeof(q.vertex[0]),key);
+      key = hashBytes(q.index.data(),q.index.size()*sizeof(q.index[0]),key);
+      if (lod > 0) {
+        const std::vector<vec3i> &index = mesh.lods[lod-1].index;
+        key = hashBytes(index.data(),index.size()*sizeof(index[0]),key);
+      }
+    }
+    return key;
+  }
+
+  CPUScene::CPUScene(const Model *model,
+                     const BVHBuildSettings &settings,
+                     const std::vector<int> &meshLODs,
+                     BVH *prebuiltBVH)
+    : model(model),
+      settings(groupedSettings(settings)),
+      meshLODs(meshLODs)
+  {
+    struct TriangleRef { int meshID, primID; };
+    std::vector<TriangleRef> refs;
+    for (int meshID=0;meshID<(int)model->meshes.size();meshID++)
+      for (int primID=0;primID<model->meshes[meshID]->numTriangles(getMeshLOD(meshID));primID++)
+        refs.push_back({ meshID, primID });
+
+    std::vector<box3f> bounds(refs.size());
+    parallel_for_blocked(0,refs.size(),16*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const TriangleMesh &mesh = *model->meshes[refs[i].meshID];
+          const vec3i index = mesh.getIndex(refs[i].primID,getMeshLOD(refs[i].meshID));
+          const simd::vec3fa v0(mesh.getVertex(index.x));
+          const simd::vec3fa v1(mesh.getVertex(index.y));
+          const simd::vec3fa v2(mesh.getVertex(index.z));
+          bounds[i] = simd::toScalar(simd::box3fa(min(v0,min(v1,v2)),
+                                                  max(v0,max(v1,v2))));
+        }
+      });
+
+    meshBounds.resize(model->meshes.size());
+    for (size_t i=0;i<refs.size();i++)
+      meshBounds[refs[i].meshID].extend(bounds[i]);
+
+    // (lets the sbvh builder clip the triangles themselves)
+    const BVHSplitPrimFunc splitPrim
+      = [&](uint32_t primID, int dim, float pos, box3f &left, box3f &right) {
+      const TriangleMesh &mesh = *model->meshes[refs[primID].meshID];
+      const vec3i index = mesh.getIndex(refs[primID].primID,getMeshLOD(refs[primID].meshID));
+      splitTriangle(mesh.getVertex(index.x),mesh.getVertex(index.y),mesh.getVertex(index.z),
+                    dim,pos,left,right);
+    };
+    if (prebuiltBVH) {
+      // only what we need to traverse it safely: everything in
+      // bounds, a tree - each inner node's children come after it
+      // (which rules out cycles), and every node but the root has
+      // exactly one parent - and leaves whose primIDs ranges do not
+      // overlap, since each leaf gets groups of its own. A bvh of
+      // the right shape over other triangles would still pass
+      bvh = std::move(*prebuiltBVH);
+      bool valid = !bvh.nodes.empty() && (bvh.primIDs.empty() == refs.empty());
+      std::vector<uint8_t> numParents(bvh.nodes.size(),0);
+      std::vector<bool> inLeaf(bvh.primIDs.size(),false);
+      for (size_t nodeID=0;valid && nodeID<bvh.nodes.size();nodeID++) {
+        const BVHNode &node = bvh.nodes[nodeID];
+        if (node.isLeaf()) {
+          valid = uint64_t(node.offset)+node.count <= bvh.primIDs.size();
+          for (uint32_t i=0;valid && i<node.count;i++) {
+            valid = !inLeaf[node.offset+i];
+            inLeaf[node.offset+i] = true;
+          }
+          continue;
+        }
+        valid = node.offset > nodeID && uint64_t(node.offset)+2 <= bvh.nodes.size()
+          && numParents[node.offset]++ == 0 && numParents[node.offset+1]++ == 0;
+      }
+      for (size_t nodeID=1;valid && nodeID<bvh.nodes.size();nodeID++)
+        valid = numParents[nodeID] == 1;
+      for (auto primID : bvh.primIDs)
+        valid = valid && primID < refs.size();
+      if (valid)
+        buildSeconds = 0.;
+      else {
+        std::cerr << GDT_TERMINAL_RED << "#osc: prebuilt bvh does not fit the model, rebuilding it"
+                  << GDT_TERMINAL_DEFAULT << std::endl;
+        prebuiltBVH = nullptr;
+      }
+    }
+    if (!prebuiltBVH) {
+      const double t0 = getCurrentTime();
+      buildBVH(bvh,bounds.data(),bounds.size(),this->settings,splitPrim);
+      buildSeconds = getCurrentTime()-t0;
+    }
+
+    numSceneTriangles = refs.size();
+    leafGroup.resize(bvh.primIDs.size());
+    groups.resize(assignLeafGroups<CPU_SCENE_GROUP_WIDTH>(bvh,0,leafGroup.data()));
+    fillLeafGroups(bvh,leafGroup.data(),groups.data(),
+                   [&](uint32_t i, LeafGroup &group, int lane) {
+                     const TriangleRef ref = refs[bvh.primIDs[i]];
+                     const TriangleMesh &mesh = *model->meshes[ref.meshID];
+                     const vec3i index = mesh.getIndex(ref.primID,getMeshLOD(ref.meshID));
+                     group.set(lane,mesh.getVertex(index.x),mesh.getVertex(index.y),
+                               mesh.getVertex(index.z),ref.meshID,ref.primID);
+                   });
+  }
+
+  /*! slab test; returns the entry distance, or infinity for a miss */
+  static inline float intersectBox(const BVHNode &node,
+                                   const vec3f &orgTimesRcp,
+                                   const vec3f &rcpDir,
+                                   float tmin, float tmax)
+  {
+    const vec3f t0 = node.lower*rcpDir - orgTimesRcp;
+    const vec3f t1 = node.upper*rcpDir - orgTimesRcp;
+    const float tNear = max(tmin,reduce_max(min(t0,t1)));
+    const float tFar  = min(tmax,reduce_min(max(t0,t1)));
+    return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+  }
+
+  /*! the traversal loop that all our bvhs share: visits the nodes
+      that the ray overlaps, closer child first, and hands leaves to
+      intersectLeaf(offset,count,tmax), which returns true if it found
+      a hit - in which case it has also updated tmax. Returns whether
+      any leaf found a hit */
+  template<bool anyHit, typename IntersectLeaf>
+  static inline bool traverseBVH(const BVH &bvh,
+                                 const vec3f &orgTimesRcp,
+                                 const vec3f &rcpDir,
+                                 const float tmin,
+                                 float &tmax,
+                                 uint64_t &nodeVisits,
+                                 const IntersectLeaf &intersectLeaf)
+  {
+    // (the root of an empty bvh is an empty inner node)
+    if (bvh.primIDs.empty()) return false;
+    bool found = false;
+
+    // note the root's own box never gets tested; that only costs us
+    // something for rays that miss the entire bvh.
+    // The stack holds nodes together with their entry distance, so
+    // we can skip those that are behind a hit found in the meantime
+    struct StackEntry { uint32_t nodeID; float tNear; };
+    StackEntry localStack[TRAVERSAL_STACK_DEPTH];
+    std::vector<StackEntry> heapStack;
+    StackEntry *stack = localStack;
+    int stackSize = TRAVERSAL_STACK_DEPTH;
+    int stackTop  = 0;
+    uint32_t nodeID = 0;
+    while (true) {
+      const BVHNode &node = bvh.nodes[nodeID];
+      nodeVisits++;
+      if (!node.isLeaf()) {
+        const float tLeft  = intersectBox(bvh.nodes[node.offset],  orgTimesRcp,rcpDir,tmin,tmax);
+        const float tRight = intersectBox(bvh.nodes[node.offset+1],orgTimesRcp,rcpDir,tmin,tmax);
+        const bool hitLeft  = tLeft  != std::numeric_limits<float>::infinity();
+        const bool hitRight = tRight != std::numeric_limits<float>::infinity();
+        if (hitLeft && hitRight) {
+          // visit the closer one first
+          const bool leftFirst = tLeft <= tRight;
+          if (stackTop == stackSize) {
+            if (heapStack.empty())
+              heapStack.assign(localStack,localStack+stackTop);
+            stackSize *= 2;
+            heapStack.resize(stackSize);
+            stack = heapStack.data();
+          }
+          stack[stackTop++] = { node.offset+(leftFirst?1:0), leftFirst?tRight:tLeft };
+          nodeID = node.offset+(leftFirst?0:1);
+          continue;
+        }
+        if (hitLeft)  { nodeID = node.offset;   continue; }
+        if (hitRight) { nodeID = node.offset+1; continue; }
+      } else if (intersectLeaf(node.offset,node.count,tmax)) {
+        found = true;
+        if (anyHit) return true;
+      }
+      // pop the next node that is still in front of the closest hit
+      while (stackTop > 0 && stack[stackTop-1].tNear > tmax)
+        --stackTop;
+      if (stackTop == 0) break;
+      nodeID = stack[--stackTop].nodeID;
+    }
+    return found;
+  }
+
+  static inline vec3f safeRcp(const vec3f &dir)
+  {
+    return vec3f(fabsf(dir.x) > 1e-20f ? 1.f/dir.x : copysignf(1e20f,dir.x),
+                 fabsf(dir.y) > 1e-20f ? 1.f/dir.y : copysignf(1e20f,dir.y),
+                 fabsf(dir.z) > 1e-20f ? 1.f/dir.z : copysignf(1e20f,dir.z));
+  }
+
+  template<bool anyHit>
+  bool CPUScene::traverse(const Ray &ray, Hit &hit, TraversalStats *stats) const
+  {
+    const vec3f rcpDir = safeRcp(ray.dir);
+    const vec3f orgTimesRcp = ray.org*rcpDir;
+    const WatertightRay watertight(ray.org,ray.dir,ray.tmin);
+    float tmax = ray.tmax;
+    uint64_t nodeVisits = 0, primTests = 0;
+    const bool found = traverseBVH<anyHit>
+      (bvh,orgTimesRcp,rcpDir,ray.tmin,tmax,nodeVisits,
+       [&](uint32_t offset, uint32_t count, float &tmax) {
+        bool found = false;
+        const LeafGroup *group = groups.data()+leafGroup[offset];
+        for (uint32_t i=0;i<count;i+=CPU_SCENE_GROUP_WIDTH,group++) {
+          primTests += std::min(count-i,uint32_t(CPU_SCENE_GROUP_WIDTH));
+          const int lane = intersectGroup(*group,watertight,tmax,hit.u,hit.v);
+          if (lane < 0) continue;
+          found = true;
+          if (anyHit) break;
+          hit.t      = tmax;
+          hit.meshID = group->meshID[lane];
+          hit.primID = group->primID[lane];
+        }
+        return found;
+      });
+    if (stats) {
+      stats->numRays++;
+      stats->nodeVisits += nodeVisits;
+      stats->primTests  += primTests;
+    }
+    return found;
+  }
+
+  bool CPUScene::intersect(const Ray &ray, Hit &hit, TraversalStats *stats) const
+  {
+    Hit closest = hit;
+    if (!traverse<false>(ray,closest,stats)) return false;
+    hit = closest;
+    return true;
+  }
+
+  bool CPUScene::occluded(const Ray &ray, TraversalStats *stats) const
+  {
+    Hit dummy;
+    return traverse<true>(ray,dummy,stats);
+  }
+
+  // ------------------------------------------------------------------
+  // primary visibility
+  // ------------------------------------------------------------------
+
+  void CPUScene::buildMeshBVHs()
+  {
+    const size_t numMeshes = model->meshes.size();
+    meshBVHs.resize(numMeshes);
+    parallel_for(numMeshes,[&](size_t meshID){
+        const TriangleMesh &mesh = *model->meshes[meshID];
+        const int lod = getMeshLOD(int(meshID));
+        const int numTriangles = mesh.numTriangles(lod);
+        std::vector<box3f> bounds(numTriangles);
+        for (int primID=0;primID<numTriangles;primID++) {
+          const vec3i index = mesh.getIndex(primID,lod);
+          bounds[primID] = box3f(mesh.getVertex(index.x))
+            .including(mesh.getVertex(index.y))
+            .including(mesh.getVertex(index.z));
+        }
+        const BVHSplitPrimFunc splitPrim
+          = [&](uint32_t primID, int dim, float pos, box3f &left, box3f &right) {
+          const vec3i index = mesh.getIndex(primID,lod);
+          splitTriangle(mesh.getVertex(index.x),mesh.getVertex(index.y),mesh.getVertex(index.z),
+                        dim,pos,left,right);
+        };
+        buildBVH(meshBVHs[meshID],bounds.data(),bounds.size(),settings,splitPrim);
+      });
+
+    // (with spatial splits, a mesh's bvh can reference triangles
+    // more than once, so we only know where each mesh's triangles go
+    // once all of them are built)
+    meshTriangleOffset.resize(numMeshes+1);
+    meshTriangleOffset[0] = 0;
+    for (size_t meshID=0;meshID<numMeshes;meshID++)
+      meshTriangleOffset[meshID+1]
+        = meshTriangleOffset[meshID] + (uint32_t)meshBVHs[meshID].primIDs.size();
+    meshLeafGroup.resize(meshTriangleOffset[numMeshes]);
+    uint32_t numGroups = 0;
+    for (size_t meshID=0;meshID<numMeshes;meshID++)
+      numGroups += assignLeafGroups<CPU_SCENE_GROUP_WIDTH>
+        (meshBVHs[meshID],numGroups,meshLeafGroup.data()+meshTriangleOffset[meshID]);
+    meshGroups.resize(numGroups);
+
+    parallel_for(numMeshes,[&](size_t meshID){
+        const TriangleMesh &mesh = *model->meshes[meshID];
+        const int lod = getMeshLOD(int(meshID));
+        const BVH &meshBVH = meshBVHs[meshID];
+        fillLeafGroups(meshBVH,meshLeafGroup.data()+meshTriangleOffset[meshID],meshGroups.data(),
+                       [&](uint32_t i, LeafGroup &group, int lane) {
+                         const int primID = meshBVH.primIDs[i];
+                         const vec3i index = mesh.getIndex(primID,lod);
+                         group.set(lane,mesh.getVertex(index.x),mesh.getVertex(index.y),
+                                   mesh.getVertex(index.z),int(meshID),primID);
+                       });
+      });
+  }
+
+  void CPUScene::cull(const Frustum &frustum)
+  {
+    if (meshBVHs.size() != meshBounds.size())
+      buildMeshBVHs();
+    visibleMeshes.clear();
+    std::vector<box3f> visibleBounds;
+    for (int meshID=0;meshID<(int)meshBounds.size();meshID++)
+      if (overlaps(frustum,meshBounds[meshID])) {
+        visibleMeshes.push_back(meshID);
+        visibleBounds.push_back(meshBounds[meshID]);
+      }
+    // one mesh per leaf: a leaf with several meshes would have to
+    // traverse all of them, rather than the closest one first. And
+    // no spatial splits, which would only make us traverse some
+    // meshes twice
+    BVHBuildSettings topSettings = settings;
+    topSettings.maxLeafSize = 1;
+    if (topSettings.method == BVH_BUILD_SBVH)
+      topSettings.method = BVH_BUILD_BINNED_SAH;
+    buildBVH(visibleBVH,visibleBounds.data(),visibleBounds.size(),topSettings);
+  }
+
+  bool CPUScene::intersectPrimary(const Ray &ray, Hit &hit, TraversalStats *stats) const
+  {
+    const vec3f rcpDir = safeRcp(ray.dir);
+    const vec3f orgTimesRcp = ray.org*rcpDir;
+    const WatertightRay watertight(ray.org,ray.dir,ray.tmin);
+    float tmax = ray.tmax;
+    Hit closest = hit;
+    uint64_t nodeVisits = 0, primTests = 0;
+    const bool found = traverseBVH<false>
+      (visibleBVH,orgTimesRcp,rcpDir,ray.tmin,tmax,nodeVisits,
+       [&](uint32_t offset, uint32_t count, float &tmax) {
+        bool found = false;
+        for (uint32_t i=offset;i<offset+count;i++) {
+          const int meshID = visibleMeshes[visibleBVH.primIDs[i]];
+          const uint32_t *leafGroup = meshLeafGroup.data()+meshTriangleOffset[meshID];
+          found |= traverseBVH<false>
+            (meshBVHs[meshID],orgTimesRcp,rcpDir,ray.tmin,tmax,nodeVisits,
+             [&](uint32_t offset, uint32_t count, float &tmax) {
+              bool found = false;
+              const LeafGroup *group = meshGroups.data()+leafGroup[offset];
+              for (uint32_t j=0;j<count;j+=CPU_SCENE_GROUP_WIDTH,group++) {
+                primTests += std::min(count-j,uint32_t(CPU_SCENE_GROUP_WIDTH));
+                const int lane = intersectGroup(*group,watertight,tmax,closest.u,closest.v);
+                if (lane < 0) continue;
+                found = true;
+                closest.t      = tmax;
+                closest.meshID = group->meshID[lane];
+                closest.primID = group->primID[lane];
+              }
+              return found;
+            });
+        }
+        return found;
+      });
+    if (stats) {
+      stats->numRays++;
+      stats->nodeVisits += nodeVisits;
+      stats->primTests  += primTests;
+    }
+    if (!found) return false;
+    hit = closest;
+    return true;
+  }
+
+} // ::osc
@@ -0,0 +1,172 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "BVH.h"
+#include "Camera.h"
+#include "Model.h"
+#include "TriangleGroup.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  struct Ray {
+    vec3f org;
+    float tmin;
+    vec3f dir;
+    float tmax;
+  };
+
+  /*! what optix would report to a closest hit program: distance,
+      barycentrics, and which triangle of which mesh got hit */
+  struct Hit {
+    float t;
+    float u, v;
+    int   meshID { -1 };
+    int   primID { -1 };
+
+    inline bool valid() const { return primID >= 0; }
+  };
+
+  /*! triangles per leaf group: eight where the compiler lets us
+      intersect eight at once, four otherwise */
+#if defined(__AVX__)
+  #define CPU_SCENE_GROUP_WIDTH 8
+#else
+  #define CPU_SCENE_GROUP_WIDTH 4
+#endif
+
+  /*! optional counters for what traversal does */
+  struct TraversalStats {
+    uint64_t numRays      { 0 };
+    uint64_t nodeVisits   { 0 };
+    uint64_t primTests    { 0 };
+  };
+
+  /*! the cpu counterpart of the examples' optix acceleration
+      structure: all triangles of all meshes in a single bvh, with
+      closest-hit and any-hit (occlusion) queries. The triangles get
+      stored in bvh leaf order, in TriangleGroups with their mesh and
+      primitive IDs, so the leaves need no indirection */
+  class CPUScene {
+  public:
+    /*! 'meshLODs' optionally selects a level of detail per mesh (see
+        MeshLOD.h); hits then report primIDs of that level. The bvh
+        gets built with the settings' leafBlockSize set to the group
+        width, whatever it is in 'settings'.
+        'prebuiltBVH', if given, is the bvh to use (and move from)
+        rather than building one - eg, one from a scene cache; it
+        has to be one built for the same bvhCacheKey(). If it is not
+        a well-formed bvh over this many triangles (eg, a corrupt
+        cache), the bvh gets built after all */
+    CPUScene(const Model *model,
+             const BVHBuildSettings &settings = BVHBuildSettings(),
+             const std::vector<int> &meshLODs = std::vector<int>(),
+             BVH *prebuiltBVH = nullptr);
+
+    /*! identifies the bvh this builds for given model, settings and
+        lods, by hashing all of that - for storing bvhs in a scene
+        cache (see SceneCache.h) */
+    static uint64_t bvhCacheKey(const Model *model,
+                                const BVHBuildSettings &settings,
+                                const std::vector<int> &meshLODs = std::vector<int>());
+
+    /*! finds the closest hit in [ray.tmin,ray.tmax]; returns false
+        (and leaves 'hit' alone) if there is none */
+    bool intersect(const Ray &ray, Hit &hit,
+                   TraversalStats *stats = nullptr) const;
+
+    /*! true if there is any hit in [ray.tmin,ray.tmax] */
+    bool occluded(const Ray &ray,
+                  TraversalStats *stats = nullptr) const;
+
+    /*! @{ primary visibility: cull() selects the meshes whose bounds
+        overlap the view frustum, and intersectPrimary() then only
+        traces against those - through a small per-frame bvh over the
+        visible meshes, with one bvh per mesh below it. That is only
+        valid for rays inside the frustum, ie, primary rays. The
+        per-mesh bvhs (and their own copy of the triangles) get built
+        on the first call to cull() */
+    void cull(const Frustum &frustum);
+    bool intersectPrimary(const Ray &ray, Hit &hit,
+                          TraversalStats *stats = nullptr) const;
+    /*! meshes that passed the last cull() */
+    size_t numVisibleMeshes() const { return visibleMeshes.size(); }
+    /*! @} */
+
+    size_t numTriangles() const { return numSceneTriangles; }
+    size_t numMeshes() const { return meshBounds.size(); }
+    const BVH &getBVH() const { return bvh; }
+    const box3f &getMeshBounds(int meshID) const { return meshBounds[meshID]; }
+    int getMeshLOD(int meshID) const { return meshLODs.empty() ? 0 : meshLODs[meshID]; }
+    const std::vector<int> &getMeshLODs() const { return meshLODs; }
+    size_t sizeInBytes() const
+    {
+      size_t bytes = bvh.sizeInBytes() + triangleBytes();
+      for (auto &mesh : meshBVHs) bytes += mesh.sizeInBytes();
+      return bytes + meshGroups.size()*sizeof(LeafGroup)
+        + meshLeafGroup.size()*sizeof(uint32_t);
+    }
+    /*! bytes of the (top-level bvh's) leaf triangles, including the
+        unused lanes of partly filled groups */
+    size_t triangleBytes() const
+    { return groups.size()*sizeof(LeafGroup) + leafGroup.size()*sizeof(uint32_t); }
+    /*! the fraction of group lanes that hold a triangle */
+    float groupFill() const
+    {
+      return groups.empty() ? 1.f
+        : bvh.primIDs.size()/float(groups.size()*CPU_SCENE_GROUP_WIDTH);
+    }
+
+    /*! seconds the last bvh build took; 0 with a prebuilt bvh */
+    double buildSeconds { 0. };
+
+  private:
+    typedef TriangleGroup<CPU_SCENE_GROUP_WIDTH> LeafGroup;
+
+    template<bool anyHit>
+    bool traverse(const Ray &ray, Hit &hit, TraversalStats *stats) const;
+
+    void buildMeshBVHs();
+
+    const Model           *model;
+    BVHBuildSettings       settings;
+    std::vector<int>       meshLODs;
+    BVH                    bvh;
+    /*! the triangles, in bvh leaf order, each leaf starting a new
+        group; with spatial splits, some triangles are in here more
+        than once. A leaf's first group is leafGroup[leaf.offset]
+        (the other entries are unused) */
+    std::vector<LeafGroup> groups;
+    std::vector<uint32_t>  leafGroup;
+    size_t                 numSceneTriangles { 0 };
+    std::vector<box3f>     meshBounds;
+
+    /*! @{ for primary visibility: one bvh per mesh. The leaves of
+        mesh meshID's bvh start at group
+        meshLeafGroup[meshTriangleOffset[meshID]+leaf.offset] */
+    std::vector<BVH>       meshBVHs;
+    std::vector<uint32_t>  meshTriangleOffset;
+    std::vector<LeafGroup> meshGroups;
+    std::vector<uint32_t>  meshLeafGroup;
+    /*! the meshes that passed cull(), and a bvh over their bounds */
+    std::vector<int>       visibleMeshes;
+    BVH                    visibleBVH;
+    /*! @} */
+  };
+
+} // ::osc
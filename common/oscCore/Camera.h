@@ -0,0 +1,107 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/box.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  struct Camera {
+    /*! camera position - *from* where we are looking */
+    vec3f from;
+    /*! which point we are looking *at* */
+    vec3f at;
+    /*! general up-vector */
+    vec3f up;
+  };
+
+  /*! the screen-space setup that rays get generated from: a ray
+      through normalized screen position (sx,sy) in [0,1]^2 has
+      direction normalize(direction + (sx-.5)*horizontal +
+      (sy-.5)*vertical). This is what the examples keep in their
+      launch params */
+  struct CameraFrame {
+    vec3f position;
+    vec3f direction;
+    vec3f horizontal;
+    vec3f vertical;
+  };
+
+  /*! the frame the examples use for given camera and aspect ratio */
+  inline CameraFrame computeCameraFrame(const Camera &camera, const float aspect)
+  {
+    const float cosFovy = 0.66f;
+    CameraFrame frame;
+    frame.position   = camera.from;
+    frame.direction  = normalize(camera.at-camera.from);
+    frame.horizontal = cosFovy * aspect * normalize(cross(frame.direction,camera.up));
+    frame.vertical   = cosFovy * normalize(cross(frame.horizontal,frame.direction));
+    return frame;
+  }
+
+  /*! the (infinite) pyramid that all rays of a camera frame lie in:
+      four planes through the camera position, with outward-facing
+      normals. There is no near or far plane; behind the camera is
+      outside of the side planes already */
+  struct Frustum {
+    vec3f origin;
+    vec3f normal[4];
+  };
+
+  /*! the frustum of all rays through screen positions in [0,1]^2, ie,
+      of all primary rays, including pixel-jittered ones. 'margin'
+      widens it by that fraction of the screen in each direction */
+  inline Frustum computeFrustum(const CameraFrame &frame, const float margin = 1e-3f)
+  {
+    const float s = .5f+margin;
+    const vec3f lowerLeft  = frame.direction - s*frame.horizontal - s*frame.vertical;
+    const vec3f lowerRight = frame.direction + s*frame.horizontal - s*frame.vertical;
+    const vec3f upperLeft  = frame.direction - s*frame.horizontal + s*frame.vertical;
+    const vec3f upperRight = frame.direction + s*frame.horizontal + s*frame.vertical;
+    Frustum frustum;
+    frustum.origin    = frame.position;
+    frustum.normal[0] = normalize(cross(upperLeft,lowerLeft));
+    frustum.normal[1] = normalize(cross(lowerRight,upperRight));
+    frustum.normal[2] = normalize(cross(lowerLeft,lowerRight));
+    frustum.normal[3] = normalize(cross(upperRight,upperLeft));
+    // (make them face outwards, whichever way the frame is handed)
+    for (int i=0;i<4;i++)
+      if (dot(frustum.normal[i],frame.direction) > 0.f)
+        frustum.normal[i] = -frustum.normal[i];
+    return frustum;
+  }
+
+  /*! false only if the box is entirely outside the frustum; this is
+      conservative, ie, some boxes near the frustum's edges that do
+      not actually overlap it still return true */
+  inline bool overlaps(const Frustum &frustum, const box3f &box)
+  {
+    if (box.empty()) return false;
+    for (int i=0;i<4;i++) {
+      const vec3f n = frustum.normal[i];
+      // the box corner that is furthest inside this plane
+      const vec3f inner(n.x > 0.f ? box.lower.x : box.upper.x,
+                        n.y > 0.f ? box.lower.y : box.upper.y,
+                        n.z > 0.f ? box.lower.z : box.upper.z);
+      if (dot(inner-frustum.origin,n) > 0.f) return false;
+    }
+    return true;
+  }
+
+} // ::osc
@@ -0,0 +1,182 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "CameraPath.h"
+#include <fstream>
+#include <sstream>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the first line of every path file */
+  static const char *cameraPathHeader = "# osc camera path, version 1";
+
+  CameraKeyframe CameraKeyframe::fromCamera(const Camera &camera, float time)
+  {
+    // the same frame the glfWindow camera manipulators use: z points
+    // backwards (away from the point of interest)
+    const vec3f toPOI = camera.at-camera.from;
+    const float poiDistance = length(toPOI);
+    const vec3f vz = poiDistance > 0.f ? -toPOI/poiDistance : vec3f(0.f,0.f,1.f);
+    vec3f vx = cross(camera.up,vz);
+    vx = dot(vx,vx) < 1e-8f ? vec3f(0.f,1.f,0.f) : normalize(vx);
+    const vec3f vy = normalize(cross(vz,vx));
+
+    CameraKeyframe keyframe;
+    keyframe.time        = time;
+    keyframe.position    = camera.from;
+    keyframe.orientation = normalize(Quaternion3f(vx,vy,vz));
+    keyframe.poiDistance = poiDistance > 0.f ? poiDistance : 1.f;
+    return keyframe;
+  }
+
+  Camera CameraKeyframe::toCamera() const
+  {
+    const vec3f vy = orientation*vec3f(0.f,1.f,0.f);
+    const vec3f vz = orientation*vec3f(0.f,0.f,1.f);
+    return Camera{ position, position-poiDistance*vz, vy };
+  }
+
+  void CameraPath::addKeyframe(const Camera &camera, float time)
+  {
+    if (!keyframes.empty() && time <= keyframes.back().time)
+      throw std::runtime_error("CameraPath: keyframe times have to be increasing");
+    keyframes.push_back(CameraKeyframe::fromCamera(camera,time));
+  }
+
+  /*! the position tangent (per second) at keyframe i, as in a
+      catmull-rom spline, but with the actual (possibly uneven) time
+      between keyframes; one-sided at the ends */
+  static vec3f tangent(const std::vector<CameraKeyframe> &keys, size_t i)
+  {
+    const size_t prev = i > 0 ? i-1 : i;
+    const size_t next = std::min(i+1,keys.size()-1);
+    const float  dt   = keys[next].time-keys[prev].time;
+    return dt > 0.f ? (keys[next].position-keys[prev].position)/dt : vec3f(0.f);
+  }
+
+  Camera CameraPath::cameraAt(float time) const
+  {
+    if (keyframes.empty())
+      throw std::runtime_error("CameraPath: cannot evaluate an empty path");
+    if (time <= keyframes.front().time) return keyframes.front().toCamera();
+    if (time >= keyframes.back().time)  return keyframes.back().toCamera();
+
+    // the segment [k0,k1] that contains 'time'
+    const size_t i1 = std::upper_bound(keyframes.begin(),keyframes.end(),time,
+                                       [](float t, const CameraKeyframe &k)
+                                       { return t < k.time; }) - keyframes.begin();
+    const size_t i0 = i1-1;
+    const CameraKeyframe &k0 = keyframes[i0];
+    const CameraKeyframe &k1 = keyframes[i1];
+    const float dt = k1.time-k0.time;
+    const float t  = (time-k0.time)/dt;
+
+    // cubic hermite for the position, with catmull-rom tangents
+    const float t2 = t*t, t3 = t2*t;
+    const float h00 = 2.f*t3-3.f*t2+1.f;
+    const float h10 = t3-2.f*t2+t;
+    const float h01 = -2.f*t3+3.f*t2;
+    const float h11 = t3-t2;
+
+    CameraKeyframe key;
+    key.position
+      = h00*k0.position + (h10*dt)*tangent(keyframes,i0)
+      + h01*k1.position + (h11*dt)*tangent(keyframes,i1);
+    key.orientation = slerp(k0.orientation,k1.orientation,t);
+    key.poiDistance = (1.f-t)*k0.poiDistance + t*k1.poiDistance;
+    return key.toCamera();
+  }
+
+  Camera CameraPath::frameCamera(int frameID, int numFrames) const
+  {
+    if (keyframes.empty())
+      throw std::runtime_error("CameraPath: cannot evaluate an empty path");
+    const float f = numFrames > 1 ? frameID/float(numFrames-1) : 0.f;
+    return cameraAt(keyframes.front().time + f*duration());
+  }
+
+  void CameraPath::save(const std::string &fileName) const
+  {
+    std::ofstream out(fileName);
+    if (!out)
+      throw std::runtime_error("could not open camera path file '"+fileName+"' for writing");
+    out.precision(9);
+    out << cameraPathHeader << "\n";
+    for (auto &k : keyframes)
+      out << k.time << " "
+          << k.position.x << " " << k.position.y << " " << k.position.z << " "
+          << k.orientation.r << " " << k.orientation.i << " "
+          << k.orientation.j << " " << k.orientation.k << " "
+          << k.poiDistance << "\n";
+    if (!out)
+      throw std::runtime_error("error writing camera path file '"+fileName+"'");
+  }
+
+  CameraPath CameraPath::load(const std::string &fileName)
+  {
+    std::ifstream in(fileName);
+    if (!in)
+      throw std::runtime_error("could not open camera path file '"+fileName+"'");
+    std::string line;
+    if (!std::getline(in,line) || line != cameraPathHeader)
+      throw std::runtime_error("'"+fileName+"' is not a camera path file");
+
+    CameraPath path;
+    int lineNo = 1;
+    while (std::getline(in,line)) {
+      lineNo++;
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream fields(line);
+      CameraKeyframe k;
+      if (!(fields >> k.time
+            >> k.position.x >> k.position.y >> k.position.z
+            >> k.orientation.r >> k.orientation.i
+            >> k.orientation.j >> k.orientation.k
+            >> k.poiDistance))
+        throw std::runtime_error("malformed keyframe in '"+fileName+"', line "
+                                 +std::to_string(lineNo));
+      if (!path.keyframes.empty() && k.time <= path.keyframes.back().time)
+        throw std::runtime_error("keyframe times in '"+fileName+"' are not increasing, line "
+                                 +std::to_string(lineNo));
+      // (only hand-edited files need this; re-normalizing what we
+      // saved ourselves would change the last bits)
+      if (fabsf(dot(k.orientation,k.orientation)-1.f) > 1e-6f)
+        k.orientation = normalize(k.orientation);
+      path.keyframes.push_back(k);
+    }
+    return path;
+  }
+
+  double FrameTimes::percentile(double p) const
+  {
+    if (seconds.empty()) return 0.;
+    std::vector<double> sorted = seconds;
+    std::sort(sorted.begin(),sorted.end());
+    const size_t rank = size_t(ceil(p/100.*sorted.size()));
+    return sorted[std::min(sorted.size()-1,rank > 0 ? rank-1 : 0)];
+  }
+
+  double FrameTimes::mean() const
+  {
+    if (seconds.empty()) return 0.;
+    double sum = 0.;
+    for (auto s : seconds) sum += s;
+    return sum/seconds.size();
+  }
+
+} // ::osc
@@ -0,0 +1,109 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Camera.h"
+#include "gdt/math/Quaternion.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! one recorded camera: where it is, how it is oriented (as a
+      rotation from the canonical frame - x right, y up, looking down
+      -z - into the camera's frame), and how far in front of it the
+      point of interest is */
+  struct CameraKeyframe {
+    /*! seconds since the start of the path */
+    float        time        { 0.f };
+    vec3f        position;
+    Quaternion3f orientation { one };
+    float        poiDistance { 1.f };
+
+    static CameraKeyframe fromCamera(const Camera &camera, float time);
+    Camera toCamera() const;
+  };
+
+  /*! a camera fly-through, as keyframes that get interpolated with a
+      spline (positions), slerp (orientations), and linearly (poi
+      distance). Paths can be recorded interactively (eg, from the
+      examples' fly mode), saved, and played back later - with a
+      fixed number of frames, so two playbacks render exactly the
+      same sequence of images */
+  class CameraPath {
+  public:
+    /*! appends a keyframe; times have to be increasing */
+    void addKeyframe(const Camera &camera, float time);
+
+    /*! the interpolated camera at given time; times outside the path
+        get clamped to its first or last keyframe */
+    Camera cameraAt(float time) const;
+
+    /*! the camera for frame 'frameID' of a playback with 'numFrames'
+        frames, spread evenly over the path */
+    Camera frameCamera(int frameID, int numFrames) const;
+
+    float duration() const
+    { return keyframes.empty() ? 0.f : keyframes.back().time-keyframes.front().time; }
+    bool empty() const { return keyframes.empty(); }
+
+    /*! text format, one keyframe per line: time, position,
+        orientation (r,i,j,k), poi distance. Both throw a
+        std::runtime_error if that fails */
+    void save(const std::string &fileName) const;
+    static CameraPath load(const std::string &fileName);
+
+    std::vector<CameraKeyframe> keyframes;
+  };
+
+  /*! per-frame times of a playback, and their distribution */
+  struct FrameTimes {
+    /*! the p-th percentile (p in [0,100]) of the frame times, in
+        seconds, using the nearest-rank method */
+    double percentile(double p) const;
+    double mean() const;
+
+    std::vector<double> seconds;
+  };
+
+  /*! renders the path headless, with a fixed number of frames: for
+      every frame, sets the camera, renders, and downloads the pixels
+      (which, for the gpu renderers, is what waits for the frame to
+      be done). Works with any renderer that has the examples'
+      setCamera()/render()/downloadPixels() interface; 'pixels' needs
+      to be as large as the renderer's frame buffer */
+  template<typename Renderer>
+  FrameTimes playCameraPath(Renderer &renderer,
+                            const CameraPath &path,
+                            int numFrames,
+                            uint32_t *pixels)
+  {
+    FrameTimes times;
+    for (int frameID=0;frameID<numFrames;frameID++) {
+      const double t0 = getCurrentTime();
+      renderer.setCamera(path.frameCamera(frameID,numFrames));
+      renderer.render();
+      renderer.downloadPixels(pixels);
+      times.seconds.push_back(getCurrentTime()-t0);
+    }
+    return times;
+  }
+
+} // ::osc
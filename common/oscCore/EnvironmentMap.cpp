@@ -0,0 +1,120 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "EnvironmentMap.h"
+#include "ToneMap.h"
+#include "3rdParty/stb_image.h"
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  EnvironmentMap::EnvironmentMap(const vec2i &resolution, std::vector<vec3f> pixels)
+    : resolution(resolution),
+      pixels(std::move(pixels))
+  {
+    if (resolution.x < 1 || resolution.y < 1
+        || this->pixels.size() != size_t(resolution.x)*resolution.y)
+      throw std::runtime_error("environment map pixels do not match its resolution");
+
+    // lookup() filters, so radiance of a pixel bleeds into its
+    // neighbors; each pixel gets sampled by the brightest of its 3x3
+    // neighborhood, so that there is no direction with radiance but
+    // no samples. Times sin(theta), for the pixel's solid angle
+    std::vector<float> weights(this->pixels.size());
+    double sum = 0.;
+    for (int y=0;y<resolution.y;y++) {
+      const float sinTheta = sinf(float(M_PI)*(y+.5f)/resolution.y);
+      for (int x=0;x<resolution.x;x++) {
+        float brightest = 0.f;
+        for (int dy=-1;dy<=1;dy++)
+          for (int dx=-1;dx<=1;dx++) {
+            const int nx = (x+dx+resolution.x) % resolution.x;
+            const int ny = std::max(0,std::min(resolution.y-1,y+dy));
+            brightest = std::max(brightest,luminance(this->pixels[pixelIndex(nx,ny)]));
+          }
+        weights[pixelIndex(x,y)] = brightest*sinTheta;
+        sum += weights[pixelIndex(x,y)];
+      }
+    }
+    if (!(sum > 0.))
+      // all black: any pdf will do
+      for (int y=0;y<resolution.y;y++)
+        for (int x=0;x<resolution.x;x++)
+          weights[pixelIndex(x,y)] = sinf(float(M_PI)*(y+.5f)/resolution.y);
+    distribution.build(weights);
+  }
+
+  vec3f EnvironmentMap::lookup(const vec3f &dir) const
+  {
+    const vec2f uv  = environmentUV(dir);
+    const float fx  = uv.x*resolution.x-.5f;
+    const float fy  = uv.y*resolution.y-.5f;
+    const float x0f = floorf(fx);
+    const float y0f = floorf(fy);
+    const float ax  = fx-x0f;
+    const float ay  = fy-y0f;
+    int x0 = int(x0f) % resolution.x;
+    if (x0 < 0) x0 += resolution.x;
+    const int x1 = x0+1 == resolution.x ? 0 : x0+1;
+    const int y0 = std::max(0,std::min(resolution.y-1,int(y0f)));
+    const int y1 = std::min(resolution.y-1,int(y0f)+1);
+    return (1.f-ay)*((1.f-ax)*pixels[pixelIndex(x0,y0)] + ax*pixels[pixelIndex(x1,y0)])
+      +          ay*((1.f-ax)*pixels[pixelIndex(x0,y1)] + ax*pixels[pixelIndex(x1,y1)]);
+  }
+
+  vec3f EnvironmentMap::sample(float uPixel, const vec2f &uInPixel, float &pdf) const
+  {
+    float pixelPdf;
+    const int i = distribution.sample(uPixel,pixelPdf);
+    const int x = i % resolution.x;
+    const int y = i / resolution.x;
+    const vec2f uv((x+uInPixel.x)/resolution.x,(y+uInPixel.y)/resolution.y);
+    // uniform in the pixel's (u,v) rectangle, which covers
+    // 2pi^2*sin(theta)*du*dv of solid angle
+    const float sinTheta = sinf(float(M_PI)*uv.y);
+    pdf = sinTheta > 0.f
+      ? pixelPdf*(float(resolution.x)*resolution.y)/(float(2.*M_PI*M_PI)*sinTheta)
+      : 0.f;
+    return environmentDirection(uv);
+  }
+
+  float EnvironmentMap::pdf(const vec3f &dir) const
+  {
+    const vec2f uv = environmentUV(dir);
+    const int x = std::min(resolution.x-1,int(uv.x*resolution.x));
+    const int y = std::min(resolution.y-1,int(uv.y*resolution.y));
+    const float sinTheta = sqrtf(std::max(0.f,1.f-dir.y*dir.y));
+    return sinTheta > 0.f
+      ? distribution.probability[pixelIndex(x,y)]
+      * (float(resolution.x)*resolution.y)/(float(2.*M_PI*M_PI)*sinTheta)
+      : 0.f;
+  }
+
+  EnvironmentMap *loadEnvironmentMap(const std::string &fileName)
+  {
+    vec2i res;
+    int   comp;
+    float *data = stbi_loadf(fileName.c_str(),&res.x,&res.y,&comp,3);
+    if (!data)
+      throw std::runtime_error("could not load environment map '"+fileName+"'");
+    const vec3f *begin = (const vec3f *)data;
+    std::vector<vec3f> pixels(begin,begin+size_t(res.x)*res.y);
+    stbi_image_free(data);
+    return new EnvironmentMap(res,std::move(pixels));
+  }
+
+} // ::osc
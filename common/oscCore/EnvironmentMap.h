@@ -0,0 +1,111 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* image based lighting: an hdr environment map, in equirectangular
+   (latitude-longitude) layout with +y up. The mapping between
+   directions and texture coordinates is shared with the device
+   programs, which look the map up through a cuda texture; the map
+   itself - loading, filtered lookups, and importance sampling - is
+   host-only */
+#include "gdt/math/vec.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! texture coordinates of a (normalized) direction: u goes once
+      around the y axis, starting and ending at -z, and v from +y
+      (v=0) down to -y (v=1) */
+  inline __both__ vec2f environmentUV(const vec3f &dir)
+  {
+    const float u = atan2f(dir.x,-dir.z)*float(.5/M_PI) + .5f;
+    const float v = acosf(fmaxf(-1.f,fminf(1.f,dir.y)))*float(1./M_PI);
+    return vec2f(u,v);
+  }
+
+  /*! the inverse of environmentUV() */
+  inline __both__ vec3f environmentDirection(const vec2f &uv)
+  {
+    const float phi      = float(2.*M_PI)*(uv.x-.5f);
+    const float theta    = float(M_PI)*uv.y;
+    const float sinTheta = sinf(theta);
+    return vec3f(sinTheta*sinf(phi),cosf(theta),-sinTheta*cosf(phi));
+  }
+
+  /*! how shading picks the directions it looks up the environment
+      in; all ways converge to the same image */
+  enum EnvironmentSampling {
+    /*! uniform in the hemisphere above the shaded point: brute force */
+    ENVIRONMENT_SAMPLING_UNIFORM=0,
+    /*! proportional to the cosine with the normal, as a diffuse
+        bounce would */
+    ENVIRONMENT_SAMPLING_COSINE,
+    /*! proportional to the map's radiance (and independent of the
+        shaded point), from a precomputed table */
+    ENVIRONMENT_SAMPLING_IMPORTANCE,
+    ENVIRONMENT_SAMPLING_COUNT
+  };
+
+} // ::osc
+
+#ifndef __CUDA_ARCH__
+#include "LightList.h"
+#include <string>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  class EnvironmentMap {
+  public:
+    /*! takes linear rgb radiance, row by row from the top (+y) row;
+        throws if the pixel count does not match the resolution */
+    EnvironmentMap(const vec2i &resolution, std::vector<vec3f> pixels);
+
+    /*! radiance arriving from (normalized) direction dir, filtered
+        bilinearly: wrapping around in u, and clamped at the poles */
+    vec3f lookup(const vec3f &dir) const;
+
+    /*! a direction picked with probability proportional to the
+        radiance of the map's pixels (weighted by their solid angle),
+        and uniformly within the pixel; returns the direction, and its
+        pdf per solid angle. uPixel picks the pixel, uInPixel the spot
+        in it */
+    vec3f sample(float uPixel, const vec2f &uInPixel, float &pdf) const;
+
+    /*! the pdf that sample() has for direction dir */
+    float pdf(const vec3f &dir) const;
+
+    const vec2i              &getResolution() const { return resolution; }
+    const std::vector<vec3f> &getPixels()     const { return pixels; }
+
+  private:
+    inline int pixelIndex(int x, int y) const { return x+y*resolution.x; }
+
+    vec2i              resolution;
+    std::vector<vec3f> pixels;
+    /*! what sample() picks pixels from */
+    AliasTable         distribution;
+  };
+
+  /*! loads an equirectangular environment map: a radiance (.hdr)
+      file, or anything else stb_image can read (ldr images get
+      linearized). Throws if the file cannot be read */
+  EnvironmentMap *loadEnvironmentMap(const std::string &fileName);
+
+} // ::osc
+#endif // __CUDA_ARCH__
@@ -0,0 +1,56 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "FrameFormat.h"
+#include "FrameResources.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! host-side frame buffer: the color, normal and albedo layers
+      that a renderer writes and a denoiser reads, each stored as raw
+      bytes in the format given by 'format'. Use loadColor()/
+      storeColor() etc from FrameFormat.h to access pixels. Layers
+      only ever grow (geometrically), so resizing back and forth
+      does not re-allocate */
+  struct FrameBuffer {
+    void resize(const vec2i &newSize, const FrameFormat &newFormat)
+    {
+      const size_t numPixels = size_t(newSize.x)*newSize.y;
+      size   = newSize;
+      format = newFormat;
+      resizeWithCapacity(color,numPixels*bytesPerPixel(format.color),&stats);
+      resizeWithCapacity(normal,numPixels*bytesPerPixel(format.normal),&stats);
+      resizeWithCapacity(albedo,numPixels*bytesPerPixel(format.albedo),&stats);
+    }
+
+    size_t numPixels() const { return size_t(size.x)*size.y; }
+
+    /*! bytes of all layers together */
+    size_t sizeInBytes() const
+    { return color.size()+normal.size()+albedo.size(); }
+
+    vec2i                size { 0 };
+    FrameFormat          format;
+    std::vector<uint8_t> color;
+    std::vector<uint8_t> normal;
+    std::vector<uint8_t> albedo;
+    ResourceStats        stats;
+  };
+
+} // ::osc
@@ -0,0 +1,325 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* storage formats for the per-pixel AOVs (color, normal, albedo) of
+   the frame buffer. This header gets included by both host code and
+   device programs, so the renderers, denoisers and tone mappers on
+   either side read and write exactly the same bits */
+#include "gdt/math/vec.h"
+#ifndef __CUDA_ARCH__
+#  include <string.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  enum ColorFormat {
+    /*! rgb + unused w, 16 bytes/pixel - what the examples always used */
+    COLOR_FORMAT_FLOAT4=0,
+    /*! rgb as ieee half floats, 6 bytes/pixel */
+    COLOR_FORMAT_HALF3,
+    COLOR_FORMAT_COUNT
+  };
+
+  enum NormalFormat {
+    /*! xyz + unused w, 16 bytes/pixel */
+    NORMAL_FORMAT_FLOAT4=0,
+    /*! octahedral encoding, 2x16 bits/pixel; stores the direction
+        only, so decoded normals are always unit length */
+    NORMAL_FORMAT_OCT32,
+    NORMAL_FORMAT_COUNT
+  };
+
+  enum AlbedoFormat {
+    /*! rgb + unused w, 16 bytes/pixel */
+    ALBEDO_FORMAT_FLOAT4=0,
+    /*! rgb in [0,1], 8 bits each (plus unused alpha), 4 bytes/pixel */
+    ALBEDO_FORMAT_RGBA8,
+    ALBEDO_FORMAT_COUNT
+  };
+
+  /*! the formats of all frame buffer layers */
+  struct FrameFormat {
+    ColorFormat  color  = COLOR_FORMAT_FLOAT4;
+    NormalFormat normal = NORMAL_FORMAT_FLOAT4;
+    AlbedoFormat albedo = ALBEDO_FORMAT_FLOAT4;
+
+    /*! all layers in full float4, 48 bytes/pixel */
+    static inline FrameFormat full() { return FrameFormat(); }
+
+    /*! half color, oct32 normal, rgba8 albedo, 14 bytes/pixel */
+    static inline FrameFormat packed()
+    {
+      FrameFormat format;
+      format.color  = COLOR_FORMAT_HALF3;
+      format.normal = NORMAL_FORMAT_OCT32;
+      format.albedo = ALBEDO_FORMAT_RGBA8;
+      return format;
+    }
+
+    inline bool operator==(const FrameFormat &other) const
+    {
+      return color == other.color
+        &&   normal == other.normal
+        &&   albedo == other.albedo;
+    }
+    inline bool operator!=(const FrameFormat &other) const
+    { return !(*this == other); }
+  };
+
+  /*! three half floats; plain storage, no arithmetic */
+  struct Half3 { uint16_t x, y, z; };
+
+  inline __both__ size_t bytesPerPixel(const ColorFormat format)
+  { return format == COLOR_FORMAT_HALF3 ? sizeof(Half3) : sizeof(vec4f); }
+
+  inline __both__ size_t bytesPerPixel(const NormalFormat format)
+  { return format == NORMAL_FORMAT_OCT32 ? sizeof(uint32_t) : sizeof(vec4f); }
+
+  inline __both__ size_t bytesPerPixel(const AlbedoFormat format)
+  { return format == ALBEDO_FORMAT_RGBA8 ? sizeof(uint32_t) : sizeof(vec4f); }
+
+  // ------------------------------------------------------------------
+  // scalar conversions
+  // ------------------------------------------------------------------
+
+  inline __both__ uint32_t floatAsBits(const float f)
+  {
+#ifdef __CUDA_ARCH__
+    return __float_as_uint(f);
+#else
+    uint32_t bits;
+    memcpy(&bits,&f,sizeof(bits));
+    return bits;
+#endif
+  }
+
+  inline __both__ float bitsAsFloat(const uint32_t bits)
+  {
+#ifdef __CUDA_ARCH__
+    return __uint_as_float(bits);
+#else
+    float f;
+    memcpy(&f,&bits,sizeof(f));
+    return f;
+#endif
+  }
+
+  /*! float to ieee half, with round-to-nearest-even; values too large
+      for a half become inf, nan stays nan, and tiny values become
+      half denormals */
+  inline __both__ uint16_t floatToHalf(const float f)
+  {
+    const uint32_t bits = floatAsBits(f);
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t absBits = bits & 0x7fffffff;
+
+    if (absBits >= 0x7f800000)
+      // inf or nan
+      return (uint16_t)(sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0));
+    if (absBits >= 0x477ff000)
+      // rounds to something larger than the largest half
+      return (uint16_t)(sign | 0x7c00);
+    if (absBits < 0x38800000) {
+      // half denormal (or zero): let the fpu do the rounding, by
+      // adding a value that pushes the mantissa bits to the bottom
+      const float denormal = bitsAsFloat(absBits) + 0.5f;
+      return (uint16_t)(sign | (floatAsBits(denormal) - 0x3f000000));
+    }
+    const uint32_t mantissaOdd = (absBits >> 13) & 1;
+    const uint32_t rounded = absBits + 0xc8000fff + mantissaOdd;
+    return (uint16_t)(sign | (rounded >> 13));
+  }
+
+  inline __both__ float halfToFloat(const uint16_t h)
+  {
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0x1f)
+      return bitsAsFloat(sign | 0x7f800000 | (mantissa << 13));
+    if (exponent == 0)
+      // zero or denormal: mantissa * 2^-24
+      return bitsAsFloat(sign | floatAsBits(mantissa * (1.f/16777216.f)));
+    return bitsAsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+  }
+
+  inline __both__ float signNotZero(const float f)
+  { return f < 0.f ? -1.f : 1.f; }
+
+  inline __both__ uint32_t encodeSnorm16(const float f)
+  {
+    const float clamped = min(1.f,max(-1.f,f));
+    return (uint32_t)(int)(clamped * 32767.f + signNotZero(clamped)*.5f) & 0xffff;
+  }
+
+  inline __both__ float decodeSnorm16(const uint32_t bits)
+  { return max(-1.f,(float)(int16_t)(uint16_t)bits * (1.f/32767.f)); }
+
+  /*! octahedral encoding of a direction, after Meyer et al, 'On
+      floating-point normal vectors'. A zero vector encodes as +z */
+  inline __both__ uint32_t encodeOct32(const vec3f &n)
+  {
+    const float l1 = fabsf(n.x)+fabsf(n.y)+fabsf(n.z);
+    if (l1 == 0.f) return 0;
+    float u = n.x / l1;
+    float v = n.y / l1;
+    if (n.z < 0.f) {
+      const float uu = (1.f - fabsf(v)) * signNotZero(u);
+      const float vv = (1.f - fabsf(u)) * signNotZero(v);
+      u = uu; v = vv;
+    }
+    return encodeSnorm16(u) | (encodeSnorm16(v) << 16);
+  }
+
+  inline __both__ vec3f decodeOct32(const uint32_t bits)
+  {
+    vec3f n(decodeSnorm16(bits & 0xffff), decodeSnorm16(bits >> 16), 0.f);
+    n.z = 1.f - fabsf(n.x) - fabsf(n.y);
+    if (n.z < 0.f) {
+      const float x = (1.f - fabsf(n.y)) * signNotZero(n.x);
+      const float y = (1.f - fabsf(n.x)) * signNotZero(n.y);
+      n.x = x; n.y = y;
+    }
+    return normalize(n);
+  }
+
+  inline __both__ uint32_t encodeUnorm8(const float f)
+  { return (uint32_t)(min(1.f,max(0.f,f)) * 255.f + .5f); }
+
+  inline __both__ uint32_t encodeRGBA8(const vec3f &c)
+  {
+    return encodeUnorm8(c.x)
+      | (encodeUnorm8(c.y) <<  8)
+      | (encodeUnorm8(c.z) << 16)
+      | (255u << 24);
+  }
+
+  inline __both__ vec3f decodeRGBA8(const uint32_t bits)
+  {
+    return vec3f((bits       & 0xff) * (1.f/255.f),
+                 ((bits>> 8) & 0xff) * (1.f/255.f),
+                 ((bits>>16) & 0xff) * (1.f/255.f));
+  }
+
+  // ------------------------------------------------------------------
+  // format-aware per-pixel access; the format is the same for all
+  // pixels, so on the gpu these switches never diverge
+  // ------------------------------------------------------------------
+
+  inline __both__ vec3f loadColor(const ColorFormat format,
+                                  const void *buffer, const size_t pixelID)
+  {
+    if (format == COLOR_FORMAT_HALF3) {
+      const Half3 h = ((const Half3*)buffer)[pixelID];
+      return vec3f(halfToFloat(h.x),halfToFloat(h.y),halfToFloat(h.z));
+    }
+    const vec4f f = ((const vec4f*)buffer)[pixelID];
+    return vec3f(f.x,f.y,f.z);
+  }
+
+  inline __both__ void storeColor(const ColorFormat format,
+                                  void *buffer, const size_t pixelID,
+                                  const vec3f &c)
+  {
+    if (format == COLOR_FORMAT_HALF3) {
+      Half3 h;
+      h.x = floatToHalf(c.x);
+      h.y = floatToHalf(c.y);
+      h.z = floatToHalf(c.z);
+      ((Half3*)buffer)[pixelID] = h;
+    } else
+      ((vec4f*)buffer)[pixelID] = vec4f(c,1.f);
+  }
+
+  inline __both__ vec3f loadNormal(const NormalFormat format,
+                                   const void *buffer, const size_t pixelID)
+  {
+    if (format == NORMAL_FORMAT_OCT32)
+      return decodeOct32(((const uint32_t*)buffer)[pixelID]);
+    const vec4f f = ((const vec4f*)buffer)[pixelID];
+    return vec3f(f.x,f.y,f.z);
+  }
+
+  inline __both__ void storeNormal(const NormalFormat format,
+                                   void *buffer, const size_t pixelID,
+                                   const vec3f &n)
+  {
+    if (format == NORMAL_FORMAT_OCT32)
+      ((uint32_t*)buffer)[pixelID] = encodeOct32(n);
+    else
+      ((vec4f*)buffer)[pixelID] = vec4f(n,1.f);
+  }
+
+  inline __both__ vec3f loadAlbedo(const AlbedoFormat format,
+                                   const void *buffer, const size_t pixelID)
+  {
+    if (format == ALBEDO_FORMAT_RGBA8)
+      return decodeRGBA8(((const uint32_t*)buffer)[pixelID]);
+    const vec4f f = ((const vec4f*)buffer)[pixelID];
+    return vec3f(f.x,f.y,f.z);
+  }
+
+  inline __both__ void storeAlbedo(const AlbedoFormat format,
+                                   void *buffer, const size_t pixelID,
+                                   const vec3f &a)
+  {
+    if (format == ALBEDO_FORMAT_RGBA8)
+      ((uint32_t*)buffer)[pixelID] = encodeRGBA8(a);
+    else
+      ((vec4f*)buffer)[pixelID] = vec4f(a,1.f);
+  }
+
+  // ------------------------------------------------------------------
+  // memory traffic estimate
+  // ------------------------------------------------------------------
+
+  /*! bytes per frame each stage reads and writes from/to the frame
+      buffer layers; this counts only the frame buffer accesses, not
+      the scene data or the denoiser's internal traffic */
+  struct FrameTraffic {
+    /*! raygen: color (read+write when accumulating), normal, albedo */
+    size_t render   = 0;
+    /*! denoiser: reads color+guides, writes output (or copies
+        color to output when off) */
+    size_t denoise  = 0;
+    /*! tone mapper: reads denoised color, writes rgba8 */
+    size_t toneMap  = 0;
+
+    size_t total() const { return render + denoise + toneMap; }
+  };
+
+  /*! the frame buffer traffic of one frame, in the given formats */
+  inline FrameTraffic computeFrameTraffic(const FrameFormat &format,
+                                          const vec2i &size,
+                                          const bool accumulate,
+                                          const bool denoise)
+  {
+    const size_t numPixels = size_t(size.x)*size.y;
+    const size_t color     = bytesPerPixel(format.color);
+    const size_t guides    = bytesPerPixel(format.normal) + bytesPerPixel(format.albedo);
+
+    FrameTraffic traffic;
+    traffic.render  = numPixels * ((accumulate ? 2 : 1)*color + guides);
+    traffic.denoise = numPixels * (denoise ? (2*color + guides) : 2*color);
+    traffic.toneMap = numPixels * (color + sizeof(uint32_t));
+    return traffic;
+  }
+
+} // ::osc
@@ -0,0 +1,118 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* policies for buffers whose size follows the frame size, shared by
+   the host-side frame buffer and denoiser and by the cuda buffers of
+   the optix renderers: while the user drags a window border we get a
+   resize event every frame, and we do not want to free and
+   re-allocate everything - or re-run the denoiser setup - for every
+   single one of them */
+#include "gdt/math/vec.h"
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! counters for how often frame-size dependent resources had to be
+      (re-)created */
+  struct ResourceStats {
+    /*! number of actual allocations */
+    size_t numAllocations    = 0;
+    /*! number of resizes that fit into an existing allocation */
+    size_t numReuses         = 0;
+    /*! number of times the denoiser had to be set up */
+    size_t numDenoiserSetups = 0;
+    /*! sum of all allocation sizes */
+    size_t bytesAllocated    = 0;
+  };
+
+  /*! the capacity to allocate when 'capacity' is too small for
+      'required': at least 1.5x the old capacity, so a series of
+      growing resizes only re-allocates O(log n) times */
+  inline size_t grownCapacity(const size_t capacity, const size_t required)
+  {
+    return std::max(required, capacity + capacity/2);
+  }
+
+  /*! resizes a std::vector, growing its capacity geometrically and
+      never giving back memory when shrinking; returns true if it had
+      to re-allocate */
+  template<typename T>
+  inline bool resizeWithCapacity(std::vector<T> &v, const size_t count,
+                                 ResourceStats *stats = nullptr)
+  {
+    const bool realloc = count > v.capacity();
+    if (realloc) {
+      const size_t capacity = grownCapacity(v.capacity(),count);
+      // don't copy the old contents, they get overwritten anyway
+      std::vector<T>().swap(v);
+      v.reserve(capacity);
+      if (stats) {
+        stats->numAllocations++;
+        stats->bytesAllocated += capacity*sizeof(T);
+      }
+    } else if (stats)
+      stats->numReuses++;
+    v.resize(count);
+    return realloc;
+  }
+
+  /*! decides when a series of resize events has 'settled', ie, when
+      it is worth running expensive per-size setup (like the
+      denoiser's). Call resized() on every resize event, and run the
+      setup once needsSetup() says so (then call setupDone()) */
+  struct ResizeSettler {
+    ResizeSettler(const double settleTime = 0.25) : settleTime(settleTime) {}
+
+    void resized(const vec2i &newSize, const double now = getCurrentTime())
+    {
+      if (newSize == size) return;
+      size           = newSize;
+      lastResizeTime = now;
+    }
+
+    /*! true if the current size has not been set up for yet, and it
+        has not changed for 'settleTime' seconds - or if nothing was
+        ever set up, in which case there is no point in waiting */
+    bool needsSetup(const double now = getCurrentTime()) const
+    {
+      if (isSetUp()) return false;
+      return !everSetUp || (now - lastResizeTime) >= settleTime;
+    }
+
+    void setupDone()
+    {
+      setupSize = size;
+      everSetUp = true;
+    }
+
+    /*! forget the last setup, eg, because what we set up is gone */
+    void invalidate() { setupSize = vec2i(-1); }
+
+    /*! true if the last setup was for the current size */
+    bool isSetUp() const { return setupSize == size; }
+
+    double settleTime;
+    vec2i  size           { 0 };
+    vec2i  setupSize      { -1 };
+    double lastResizeTime { 0. };
+    bool   everSetUp      { false };
+  };
+
+} // ::osc
@@ -0,0 +1,441 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "ImageOutput.h"
+// std
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "3rdParty/stb_image_write.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  // ------------------------------------------------------------------
+  // OutputImage
+  // ------------------------------------------------------------------
+
+  OutputImage::OutputImage(const std::string &fileName,
+                           const vec2i &size,
+                           PixelType type,
+                           const void *pixels,
+                           bool bottomUp)
+    : fileName(fileName),
+      fileFormat(fileFormatFromName(fileName)),
+      size(size),
+      type(type),
+      bottomUp(bottomUp)
+  {
+    this->pixels.resize(sizeInBytes());
+    if (pixels)
+      memcpy(this->pixels.data(),pixels,this->pixels.size());
+  }
+
+  size_t OutputImage::bytesPerPixel() const
+  {
+    switch (type) {
+    case FLOAT3: return 3*sizeof(float);
+    case FLOAT4: return 4*sizeof(float);
+    default:     return sizeof(uint32_t);
+    }
+  }
+
+  ImageFileFormat fileFormatFromName(const std::string &fileName)
+  {
+    const size_t dot = fileName.rfind('.');
+    if (dot == std::string::npos) return IMAGE_FILE_RAW;
+    std::string ext = fileName.substr(dot+1);
+    for (auto &c : ext) c = (char)tolower(c);
+    if (ext == "png") return IMAGE_FILE_PNG;
+    if (ext == "exr") return IMAGE_FILE_EXR;
+    if (ext == "pfm") return IMAGE_FILE_PFM;
+    return IMAGE_FILE_RAW;
+  }
+
+  // ------------------------------------------------------------------
+  // encoders; each one produces the complete file in memory, which
+  // then gets written with a single fwrite
+  // ------------------------------------------------------------------
+
+  /*! the rows of an image in top-to-bottom order */
+  static const uint8_t *topDownRow(const OutputImage &image, int y)
+  {
+    const int row = image.bottomUp ? image.size.y-1-y : y;
+    return image.pixels.data() + size_t(row)*image.size.x*image.bytesPerPixel();
+  }
+
+  /*! channel c (in r,g,b,a order) of pixel x of given row, as float */
+  static float channelAsFloat(const OutputImage &image,
+                              const uint8_t *row, int x, int c)
+  {
+    switch (image.type) {
+    case OutputImage::FLOAT3:
+      return c < 3 ? ((const float *)row)[3*x+c] : 1.f;
+    case OutputImage::FLOAT4:
+      return ((const float *)row)[4*x+c];
+    default:
+      return row[4*x+c] * (1.f/255.f);
+    }
+  }
+
+  static void encodePNG(const OutputImage &image, std::vector<uint8_t> &out)
+  {
+    if (image.type != OutputImage::RGBA8)
+      throw std::runtime_error("can only write rgba8 images to png (tone map first)");
+    const int stride = image.size.x*sizeof(uint32_t);
+    // stb walks the rows with the given stride, so a negative one
+    // flips the image without an extra copy (and without touching
+    // stb's global flip flag, which other threads may be using)
+    const uint8_t *firstRow = topDownRow(image,0);
+    const int rowStep = image.bottomUp ? -stride : stride;
+    auto append = [](void *context, void *data, int size) {
+      std::vector<uint8_t> &out = *(std::vector<uint8_t> *)context;
+      out.insert(out.end(),(const uint8_t *)data,(const uint8_t *)data+size);
+    };
+    if (!stbi_write_png_to_func(append,&out,image.size.x,image.size.y,4,
+                                firstRow,rowStep))
+      throw std::runtime_error("png encoding failed");
+  }
+
+  /*! portable float map: rgb floats, rows bottom to top, and a
+      negative scale to indicate little endian */
+  static void encodePFM(const OutputImage &image, std::vector<uint8_t> &out)
+  {
+    char header[64];
+    snprintf(header,sizeof(header),"PF\n%i %i\n-1.0\n",image.size.x,image.size.y);
+    out.assign(header,header+strlen(header));
+    const size_t headerSize = out.size();
+    out.resize(headerSize+3*sizeof(float)*size_t(image.size.x)*image.size.y);
+    float *dst = (float *)(out.data()+headerSize);
+    for (int y=image.size.y-1;y>=0;--y) {
+      const uint8_t *row = topDownRow(image,y);
+      if (image.type == OutputImage::FLOAT3) {
+        memcpy(dst,row,3*sizeof(float)*image.size.x);
+        dst += 3*image.size.x;
+      } else
+        for (int x=0;x<image.size.x;x++)
+          for (int c=0;c<3;c++)
+            *dst++ = channelAsFloat(image,row,x,c);
+    }
+  }
+
+  template<typename T>
+  static void appendBytes(std::vector<uint8_t> &out, const T &value)
+  {
+    const uint8_t *bytes = (const uint8_t *)&value;
+    out.insert(out.end(),bytes,bytes+sizeof(T));
+  }
+
+  static void appendString(std::vector<uint8_t> &out, const char *s)
+  {
+    out.insert(out.end(),(const uint8_t *)s,(const uint8_t *)s+strlen(s)+1);
+  }
+
+  /*! starts an exr header attribute (name, type, and size of value) */
+  static void appendAttribute(std::vector<uint8_t> &out,
+                              const char *name, const char *type,
+                              int32_t size)
+  {
+    appendString(out,name);
+    appendString(out,type);
+    appendBytes(out,size);
+  }
+
+  /*! the run-length encoding that exr's RLE_COMPRESSION specifies:
+      a stream of (signed) count bytes, where a count c<0 is followed
+      by -c bytes to copy, and a count c>=0 by one byte to repeat c+1
+      times. Repeats of three or more bytes become runs, everything
+      else literals; returns the encoded size, which is at most
+      n+ceil(n/127) */
+  static size_t encodeRuns(const uint8_t *in, size_t n, uint8_t *out)
+  {
+    // (runs of up to 128 bytes; literals only up to 127, which every
+    // reader takes)
+    const size_t maxRun = 128, maxLiterals = 127;
+    size_t size = 0;
+    size_t begin = 0;
+    while (begin < n) {
+      size_t end = begin+1;
+      while (end < n && end-begin < maxRun && in[end] == in[begin])
+        end++;
+      if (end-begin >= 3) {
+        out[size++] = uint8_t(end-begin-1);
+        out[size++] = in[begin];
+      } else {
+        // literals up to where the next run starts
+        end = begin+1;
+        while (end < n && end-begin < maxLiterals
+               && !(end+2 < n && in[end] == in[end+1] && in[end] == in[end+2]))
+          end++;
+        out[size++] = uint8_t(-int(end-begin));
+        memcpy(out+size,in+begin,end-begin);
+        size += end-begin;
+      }
+      begin = end;
+    }
+    return size;
+  }
+
+  /*! exr's RLE_COMPRESSION of one block: the bytes at even offsets
+      go first, then those at odd ones (which puts the - usually
+      similar - high bytes of neighboring values next to each other);
+      then every byte but the first becomes its difference to the one
+      before, plus 128; and that gets run-length encoded. Returns the
+      compressed size, or 0 if compression would not save anything,
+      in which case the file has to store the block uncompressed */
+  static size_t exrCompressRLE(const std::vector<uint8_t> &in,
+                               std::vector<uint8_t> &tmp,
+                               std::vector<uint8_t> &out)
+  {
+    const size_t n = in.size();
+    const size_t half = (n+1)/2;
+    tmp.resize(n);
+    for (size_t i=0;i<n;i++)
+      tmp[(i & 1) ? half+i/2 : i/2] = in[i];
+    // (back to front, so each byte still sees its predecessor)
+    for (size_t i=n;i-- > 1;)
+      tmp[i] = uint8_t(tmp[i]-tmp[i-1]+128);
+
+    out.resize(n + n/127 + 2);
+    const size_t size = encodeRuns(tmp.data(),n,out.data());
+    return size < n ? size : 0;
+  }
+
+  /*! a single-part scanline exr, with one scanline per block (which
+      is what both NO_COMPRESSION and RLE_COMPRESSION require) and
+      FLOAT channels. We assume a little-endian host, which is what
+      the file format uses */
+  static void encodeEXR(const OutputImage &image,
+                        ExrCompression compression,
+                        std::vector<uint8_t> &out)
+  {
+    const vec2i size = image.size;
+    const bool  hasAlpha = image.type != OutputImage::FLOAT3;
+    // channels have to be sorted by name; values are r,g,b,a indices
+    const int   numChannels = hasAlpha ? 4 : 3;
+    const char *channelNames[4] = { "A","B","G","R" };
+    const int   channelIndex[4] = { 3,2,1,0 };
+    const int   firstChannel = hasAlpha ? 0 : 1;
+
+    out.clear();
+    const uint8_t magic[4] = { 0x76, 0x2f, 0x31, 0x01 };
+    out.insert(out.end(),magic,magic+4);
+    appendBytes(out,int32_t(2));
+
+    appendAttribute(out,"channels","chlist",numChannels*18+1);
+    for (int c=firstChannel;c<4;c++) {
+      appendString(out,channelNames[c]);
+      appendBytes(out,int32_t(2)); // FLOAT
+      appendBytes(out,int32_t(0)); // pLinear + reserved
+      appendBytes(out,int32_t(1)); // x sampling
+      appendBytes(out,int32_t(1)); // y sampling
+    }
+    out.push_back(0);
+    appendAttribute(out,"compression","compression",1);
+    out.push_back(compression == EXR_COMPRESSION_RLE ? 1 : 0);
+    const int32_t window[4] = { 0, 0, size.x-1, size.y-1 };
+    appendAttribute(out,"dataWindow","box2i",16);
+    for (int i=0;i<4;i++) appendBytes(out,window[i]);
+    appendAttribute(out,"displayWindow","box2i",16);
+    for (int i=0;i<4;i++) appendBytes(out,window[i]);
+    appendAttribute(out,"lineOrder","lineOrder",1);
+    out.push_back(0); // INCREASING_Y
+    appendAttribute(out,"pixelAspectRatio","float",4);
+    appendBytes(out,1.f);
+    appendAttribute(out,"screenWindowCenter","v2f",8);
+    appendBytes(out,0.f);
+    appendBytes(out,0.f);
+    appendAttribute(out,"screenWindowWidth","float",4);
+    appendBytes(out,1.f);
+    out.push_back(0);
+
+    // offset table, filled in as we go
+    const size_t offsetTable = out.size();
+    out.resize(offsetTable+size.y*sizeof(uint64_t));
+
+    std::vector<uint8_t> line(numChannels*sizeof(float)*size.x);
+    std::vector<uint8_t> tmp, compressed;
+    for (int y=0;y<size.y;y++) {
+      const uint64_t offset = out.size();
+      memcpy(out.data()+offsetTable+y*sizeof(uint64_t),&offset,sizeof(offset));
+
+      const uint8_t *row = topDownRow(image,y);
+      float *dst = (float *)line.data();
+      for (int c=firstChannel;c<4;c++)
+        for (int x=0;x<size.x;x++)
+          *dst++ = channelAsFloat(image,row,x,channelIndex[c]);
+
+      const size_t compressedSize
+        = compression == EXR_COMPRESSION_RLE
+        ? exrCompressRLE(line,tmp,compressed)
+        : 0;
+      appendBytes(out,int32_t(y));
+      if (compressedSize) {
+        appendBytes(out,int32_t(compressedSize));
+        out.insert(out.end(),compressed.begin(),compressed.begin()+compressedSize);
+      } else {
+        appendBytes(out,int32_t(line.size()));
+        out.insert(out.end(),line.begin(),line.end());
+      }
+    }
+  }
+
+  size_t writeImage(const OutputImage &image, ExrCompression exrCompression)
+  {
+    if (image.size.x <= 0 || image.size.y <= 0
+        || image.pixels.size() != image.sizeInBytes())
+      throw std::runtime_error("invalid image for '"+image.fileName+"'");
+
+    std::vector<uint8_t> encoded;
+    const std::vector<uint8_t> *data = &encoded;
+    switch (image.fileFormat) {
+    case IMAGE_FILE_PNG: encodePNG(image,encoded); break;
+    case IMAGE_FILE_EXR: encodeEXR(image,exrCompression,encoded); break;
+    case IMAGE_FILE_PFM: encodePFM(image,encoded); break;
+    default:             data = &image.pixels; break;
+    }
+
+    FILE *file = fopen(image.fileName.c_str(),"wb");
+    if (!file)
+      throw std::runtime_error("could not open '"+image.fileName+"' for writing");
+    const size_t written = fwrite(data->data(),1,data->size(),file);
+    const bool   closed  = fclose(file) == 0;
+    if (written != data->size() || !closed)
+      throw std::runtime_error("error writing '"+image.fileName+"'");
+    return written;
+  }
+
+  // ------------------------------------------------------------------
+  // ImageOutput
+  // ------------------------------------------------------------------
+
+  ImageOutput::ImageOutput(int numWorkers, size_t maxQueueDepth)
+    : maxQueueDepth(std::max(size_t(1),maxQueueDepth))
+  {
+    for (int i=0;i<std::max(1,numWorkers);i++)
+      workers.push_back(std::thread([this](){ workerLoop(); }));
+  }
+
+  ImageOutput::~ImageOutput()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    workAvailable.notify_all();
+    for (auto &worker : workers) worker.join();
+  }
+
+  void ImageOutput::push(OutputImage &&image)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size()+numInFlight >= maxQueueDepth) {
+      const double t0 = getCurrentTime();
+      spaceAvailable.wait(lock,[this](){
+          return queue.size()+numInFlight < maxQueueDepth;
+        });
+      metrics.numStalls++;
+      metrics.stallSeconds += getCurrentTime()-t0;
+    }
+    queue.push_back(std::move(image));
+    metrics.queueDepth    = queue.size()+numInFlight;
+    metrics.maxQueueDepth = std::max(metrics.maxQueueDepth,metrics.queueDepth);
+    lock.unlock();
+    workAvailable.notify_one();
+  }
+
+  bool ImageOutput::tryPush(OutputImage &&image)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size()+numInFlight >= maxQueueDepth)
+      return false;
+    queue.push_back(std::move(image));
+    metrics.queueDepth    = queue.size()+numInFlight;
+    metrics.maxQueueDepth = std::max(metrics.maxQueueDepth,metrics.queueDepth);
+    lock.unlock();
+    workAvailable.notify_one();
+    return true;
+  }
+
+  void ImageOutput::flush()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock,[this](){ return queue.empty() && numInFlight == 0; });
+  }
+
+  ImageOutput::Metrics ImageOutput::getMetrics() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return metrics;
+  }
+
+  void ImageOutput::resetMetrics()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t queueDepth = metrics.queueDepth;
+    metrics = Metrics();
+    metrics.queueDepth    = queueDepth;
+    metrics.maxQueueDepth = queueDepth;
+  }
+
+  void ImageOutput::workerLoop()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      workAvailable.wait(lock,[this](){ return stop || !queue.empty(); });
+      // on shutdown we still drain the queue, so nothing gets lost
+      if (queue.empty()) return;
+
+      OutputImage image = std::move(queue.front());
+      queue.pop_front();
+      numInFlight++;
+      const ExrCompression compression = exrCompression;
+      lock.unlock();
+
+      const double t0 = getCurrentTime();
+      size_t bytes = 0;
+      bool   ok    = true;
+      try {
+        bytes = writeImage(image,compression);
+      } catch (const std::exception &e) {
+        std::cerr << GDT_TERMINAL_RED << "#osc: could not write image: "
+                  << e.what() << GDT_TERMINAL_DEFAULT << std::endl;
+        ok = false;
+      }
+      const double seconds = getCurrentTime()-t0;
+
+      lock.lock();
+      numInFlight--;
+      if (ok) {
+        metrics.numWritten++;
+        metrics.bytesWritten    += bytes;
+        metrics.encodeSeconds   += seconds;
+        metrics.maxEncodeSeconds = std::max(metrics.maxEncodeSeconds,seconds);
+      } else
+        metrics.numFailed++;
+      metrics.queueDepth = queue.size()+numInFlight;
+      spaceAvailable.notify_one();
+      if (queue.empty() && numInFlight == 0)
+        allDone.notify_all();
+    }
+  }
+
+} // ::osc
@@ -0,0 +1,164 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/vec.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! the file formats we can write */
+  enum ImageFileFormat {
+    /*! 8-bit rgba png, through stb_image_write */
+    IMAGE_FILE_PNG=0,
+    /*! openexr, single-part scanline file with 32-bit float channels */
+    IMAGE_FILE_EXR,
+    /*! portable float map, rgb, little-endian */
+    IMAGE_FILE_PFM,
+    /*! the plain pixel bytes, no header at all */
+    IMAGE_FILE_RAW,
+    IMAGE_FILE_FORMAT_COUNT
+  };
+
+  /*! compression of exr files; we only implement the two (lossless)
+      schemes that are cheap enough to not hold up the queue */
+  enum ExrCompression {
+    EXR_COMPRESSION_NONE=0,
+    EXR_COMPRESSION_RLE,
+    EXR_COMPRESSION_COUNT
+  };
+
+  /*! one image to be written, with its own copy of the pixels (so the
+      renderer can go ahead and overwrite its frame buffer as soon as
+      it has handed the image over) */
+  struct OutputImage {
+    enum PixelType {
+      /*! one uint32_t per pixel, as in the examples' 'pixels' arrays */
+      RGBA8=0,
+      /*! three floats per pixel - eg, a linear color or normal AOV */
+      FLOAT3,
+      /*! four floats per pixel (vec4f) */
+      FLOAT4
+    };
+
+    OutputImage() = default;
+    OutputImage(const std::string &fileName,
+                const vec2i &size,
+                PixelType type,
+                const void *pixels,
+                bool bottomUp = true);
+
+    size_t bytesPerPixel() const;
+    size_t sizeInBytes() const { return bytesPerPixel()*size_t(size.x)*size.y; }
+
+    std::string          fileName;
+    ImageFileFormat      fileFormat { IMAGE_FILE_PNG };
+    vec2i                size       { 0 };
+    PixelType            type       { RGBA8 };
+    /*! row 0 is the bottom row of the image - that is how all the
+        examples' frame buffers are laid out (it is what opengl
+        expects) */
+    bool                 bottomUp   { true };
+    std::vector<uint8_t> pixels;
+  };
+
+  /*! derives the file format from the file name's extension (.png,
+      .exr, .pfm, anything else is raw) */
+  ImageFileFormat fileFormatFromName(const std::string &fileName);
+
+  /*! writes the given image right away, on the calling thread; throws
+      a std::runtime_error if that fails. Returns the number of bytes
+      written */
+  size_t writeImage(const OutputImage &image,
+                    ExrCompression exrCompression = EXR_COMPRESSION_RLE);
+
+  /*! an asynchronous image writer: images get pushed into a bounded
+      queue, and a small pool of worker threads encodes and writes
+      them in the background, so a renderer (in particular one that
+      renders a whole sequence of frames) does not have to wait for
+      png compression or disk i/o.
+
+      If the encoders cannot keep up, the queue fills up, and push()
+      blocks until a slot frees up; this backpressure bounds the
+      memory the queue can hold to maxQueueDepth images. Errors during
+      writing do not throw (there is no one to catch them) but get
+      reported on the console, and counted in the metrics */
+  class ImageOutput {
+  public:
+    struct Metrics {
+      /*! images currently waiting or being written */
+      size_t queueDepth         = 0;
+      /*! largest queueDepth seen so far */
+      size_t maxQueueDepth      = 0;
+      size_t numWritten         = 0;
+      size_t numFailed          = 0;
+      size_t bytesWritten       = 0;
+      /*! number of push()es that had to wait for the queue to drain */
+      size_t numStalls          = 0;
+      /*! total time the producer spent waiting in push() */
+      double stallSeconds       = 0.;
+      /*! total and worst-case time to encode and write one image */
+      double encodeSeconds      = 0.;
+      double maxEncodeSeconds   = 0.;
+
+      double avgEncodeSeconds() const
+      { return numWritten ? encodeSeconds/numWritten : 0.; }
+    };
+
+    ImageOutput(int numWorkers = 2, size_t maxQueueDepth = 8);
+    /*! writes out everything that is still in the queue */
+    ~ImageOutput();
+
+    /*! hands the image over to the writer threads; blocks while the
+        queue is full */
+    void push(OutputImage &&image);
+    /*! same, but returns false (and does not take the image) instead
+        of blocking when the queue is full */
+    bool tryPush(OutputImage &&image);
+    /*! waits until all images pushed so far have been written */
+    void flush();
+
+    Metrics getMetrics() const;
+    void    resetMetrics();
+
+    /*! compression used for all exr files */
+    ExrCompression exrCompression { EXR_COMPRESSION_RLE };
+
+  private:
+    void workerLoop();
+
+    const size_t             maxQueueDepth;
+    std::deque<OutputImage>  queue;
+    /*! images taken from the queue, but not written yet */
+    size_t                   numInFlight { 0 };
+    Metrics                  metrics;
+    bool                     stop        { false };
+    mutable std::mutex       mutex;
+    std::condition_variable  workAvailable;
+    std::condition_variable  spaceAvailable;
+    std::condition_variable  allDone;
+    std::vector<std::thread> workers;
+  };
+
+} // ::osc
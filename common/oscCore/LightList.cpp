@@ -0,0 +1,222 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "LightList.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  void AliasTable::build(const std::vector<float> &weights)
+  {
+    const size_t n = weights.size();
+    double sum = 0.;
+    for (auto w : weights) sum += w;
+    probability.resize(n);
+    entries.resize(n);
+    // each weight in units of the average bucket; buckets below one
+    // get topped up from buckets above one, with the latter as their
+    // alias
+    std::vector<double>   scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i=0;i<n;i++) {
+      probability[i] = float(weights[i]/sum);
+      scaled[i] = weights[i]*n/sum;
+      (scaled[i] < 1. ? small : large).push_back(uint32_t(i));
+    }
+    while (!small.empty() && !large.empty()) {
+      const uint32_t s = small.back(); small.pop_back();
+      const uint32_t l = large.back();
+      entries[s] = { float(scaled[s]), l };
+      scaled[l] -= 1.-scaled[s];
+      if (scaled[l] < 1.) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // what is left is (up to rounding) exactly one bucket each
+    for (auto i : large) entries[i] = { 1.f, i };
+    for (auto i : small) entries[i] = { 1.f, i };
+  }
+
+  static inline float average(const vec3f &v)
+  { return (v.x+v.y+v.z)*(1.f/3.f); }
+
+  void LightList::build(const Model *model, const QuadLight &quad)
+  {
+    lights.clear();
+    power.clear();
+    meshFirstLight.assign(model->meshes.size(),-1);
+    if (average(quad.power) > 0.f) {
+      lights.push_back({ quad.origin, quad.du, quad.dv, quad.power, false });
+      power.push_back(average(quad.power));
+    }
+    for (size_t meshID=0;meshID<model->meshes.size();meshID++) {
+      const TriangleMesh *mesh = model->meshes[meshID];
+      if (!(average(mesh->emission) > 0.f)) continue;
+      meshFirstLight[meshID] = int(lights.size());
+      for (int primID=0;primID<mesh->numTriangles();primID++) {
+        const vec3i index = mesh->getIndex(primID);
+        const vec3f A = mesh->getVertex(index.x);
+        const vec3f B = mesh->getVertex(index.y);
+        const vec3f C = mesh->getVertex(index.z);
+        const float area = .5f*length(cross(B-A,C-A));
+        lights.push_back({ A, B-A, C-A, mesh->emission, true });
+        power.push_back(average(mesh->emission)*area*float(1./M_PI));
+      }
+    }
+
+    tree = BVH();
+    nodePower.clear();
+    lightLeaf.clear();
+    nodeParent.clear();
+    double totalPower = 0.;
+    for (auto p : power) totalPower += p;
+    if (!(totalPower > 0.)) {
+      // (nothing but degenerate triangles)
+      lights.clear();
+      power.clear();
+      meshFirstLight.assign(model->meshes.size(),-1);
+      return;
+    }
+    powerTable.build(power);
+
+    // the binned sah builder, with one light per leaf: the area of a
+    // light's box is not what matters for picking lights, but it
+    // keeps lights that are close to each other in the same subtrees
+    std::vector<box3f> bounds(lights.size());
+    for (size_t i=0;i<lights.size();i++) {
+      const Light &light = lights[i];
+      bounds[i].extend(light.p);
+      bounds[i].extend(light.p+light.e1);
+      bounds[i].extend(light.p+light.e2);
+      if (!light.isTriangle) bounds[i].extend(light.p+light.e1+light.e2);
+    }
+    BVHBuildSettings settings;
+    settings.method      = BVH_BUILD_BINNED_SAH;
+    settings.maxLeafSize = 1;
+    buildBVH(tree,bounds.data(),bounds.size(),settings);
+
+    // (the builder puts children after their parents, so one
+    // backwards pass sums up the whole tree)
+    nodePower.resize(tree.nodes.size());
+    nodeParent.assign(tree.nodes.size(),-1);
+    lightLeaf.resize(lights.size());
+    for (int nodeID=int(tree.nodes.size())-1;nodeID>=0;--nodeID) {
+      const BVHNode &node = tree.nodes[nodeID];
+      float sum = 0.f;
+      if (node.isLeaf())
+        for (uint32_t i=0;i<node.count;i++) {
+          sum += power[tree.primIDs[node.offset+i]];
+          lightLeaf[tree.primIDs[node.offset+i]] = nodeID;
+        }
+      else {
+        sum = nodePower[node.offset]+nodePower[node.offset+1];
+        nodeParent[node.offset]   = nodeID;
+        nodeParent[node.offset+1] = nodeID;
+      }
+      nodePower[nodeID] = sum;
+    }
+  }
+
+  float LightList::importance(int nodeID, const vec3f &P, const vec3f &N) const
+  {
+    const BVHNode &node = tree.nodes[nodeID];
+    const vec3f center   = .5f*(node.lower+node.upper);
+    const vec3f halfSpan = .5f*(node.upper-node.lower);
+    // nothing in the box is in front of P's tangent plane
+    if (dot(center-P,N) + dot(halfSpan,abs(N)) <= 0.f) return 0.f;
+    // within the box, distance to its center says little; clamping
+    // to its radius keeps a box that P is in (or next to) from taking
+    // all the samples
+    const float dist2 = std::max(std::max(dot(center-P,center-P),dot(halfSpan,halfSpan)),
+                                 1e-20f);
+    return nodePower[nodeID]/dist2;
+  }
+
+  int LightList::pick(LightSelection selection, const vec3f &P, const vec3f &N,
+                      float u, float &pdf) const
+  {
+    if (lights.empty()) return -1;
+    if (selection == LIGHT_SELECTION_UNIFORM) {
+      pdf = 1.f/lights.size();
+      return std::min(int(u*lights.size()),int(lights.size())-1);
+    }
+    if (selection == LIGHT_SELECTION_POWER)
+      return powerTable.sample(u,pdf);
+
+    pdf = 1.f;
+    int nodeID = 0;
+    while (!tree.nodes[nodeID].isLeaf()) {
+      const int child = tree.nodes[nodeID].offset;
+      const float left  = importance(child,  P,N);
+      const float right = importance(child+1,P,N);
+      if (!(left+right > 0.f)) return -1;
+      // (and re-use what is left of u for the next level)
+      const float pLeft = left/(left+right);
+      if (u < pLeft) {
+        nodeID = child;
+        pdf   *= pLeft;
+        u      = u/pLeft;
+      } else {
+        nodeID = child+1;
+        pdf   *= 1.f-pLeft;
+        u      = (u-pLeft)/(1.f-pLeft);
+      }
+      u = std::min(u,.99999994f);
+    }
+
+    // in the leaf, by power (leaves only have more than one light if
+    // those are all in the same spot)
+    const BVHNode &leaf = tree.nodes[nodeID];
+    const float leafPower = nodePower[nodeID];
+    if (!(leafPower > 0.f)) return -1;
+    float target = u*leafPower;
+    for (uint32_t i=0;i<leaf.count;i++) {
+      const uint32_t lightID = tree.primIDs[leaf.offset+i];
+      if (target < power[lightID] || i == leaf.count-1) {
+        pdf *= power[lightID]/leafPower;
+        return int(lightID);
+      }
+      target -= power[lightID];
+    }
+    return -1;
+  }
+
+  float LightList::pickPdf(LightSelection selection, const vec3f &P, const vec3f &N,
+                           int lightID) const
+  {
+    if (selection == LIGHT_SELECTION_UNIFORM)
+      return 1.f/lights.size();
+    if (selection == LIGHT_SELECTION_POWER)
+      return powerTable.probability[lightID];
+
+    // the same decisions as in pick(), from the light's leaf up
+    int nodeID = lightLeaf[lightID];
+    const float leafPower = nodePower[nodeID];
+    if (!(leafPower > 0.f)) return 0.f;
+    float pdf = power[lightID]/leafPower;
+    for (int parentID=nodeParent[nodeID];parentID>=0;
+         nodeID=parentID, parentID=nodeParent[nodeID]) {
+      const int child = tree.nodes[parentID].offset;
+      const float left  = importance(child,  P,N);
+      const float right = importance(child+1,P,N);
+      if (!(left+right > 0.f)) return 0.f;
+      pdf *= (nodeID == child ? left : right)/(left+right);
+    }
+    return pdf;
+  }
+
+} // ::osc
@@ -0,0 +1,168 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* many lights, for the cpu renderer: the examples' quad light, plus
+   every triangle of every mesh with an emissive material (the mtl's
+   Ke). Rather than tracing a shadow ray to each of them, shading
+   picks one light per light sample, and divides by the probability
+   of having picked it - so a hit costs numLightSamples shadow rays
+   no matter how many lights there are, and only the noise depends
+   on how well the picks match what the lights actually contribute */
+#include "BVH.h"
+#include "LightSampling.h"
+#include "Model.h"
+#include <algorithm>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! how a shaded point picks the light for a light sample */
+  enum LightSelection {
+    /*! all lights equally likely */
+    LIGHT_SELECTION_UNIFORM=0,
+    /*! proportional to the lights' power, through an alias table: one
+        random number and O(1) per pick, but blind to where the
+        shaded point is */
+    LIGHT_SELECTION_POWER,
+    /*! walking down a bvh over the lights (a "light tree"), into
+        either child with a probability proportional to its power
+        over its squared distance to the shaded point (conty estevez
+        and kulla, "importance sampling of many lights with adaptive
+        tree splitting", 2018, minus the orientation bounds and the
+        splitting). O(log n) per pick, but nearby lights get most of
+        the samples, and lights behind the shaded point none */
+    LIGHT_SELECTION_TREE,
+    LIGHT_SELECTION_COUNT
+  };
+
+  struct Light {
+    /*! quad lights: the corner, and the two edges; triangles: the
+        first vertex, and the edges to the other two */
+    vec3f p, e1, e2;
+    /*! quad lights: QuadLight::power (an intensity); triangles: the
+        emitted radiance */
+    vec3f emission;
+    bool  isTriangle;
+  };
+
+  /*! picks index i with probability weights[i]/sum(weights), from a
+      single random number in O(1): walker's alias method, with vose's
+      construction */
+  struct AliasTable {
+    /*! weights have to be >= 0, and not all 0 */
+    void build(const std::vector<float> &weights);
+
+    /*! the index for u in [0,1), and its probability */
+    inline int sample(float u, float &pdf) const
+    {
+      const float scaled = u*entries.size();
+      int i = std::min(int(scaled),int(entries.size())-1);
+      if (scaled-i >= entries[i].threshold) i = entries[i].alias;
+      pdf = probability[i];
+      return i;
+    }
+
+    struct Entry {
+      /*! the part of this bucket that picks its own index, rather
+          than 'alias' */
+      float    threshold;
+      uint32_t alias;
+    };
+    std::vector<Entry> entries;
+    std::vector<float> probability;
+  };
+
+  class LightList {
+  public:
+    /*! the quad light (unless its power is 0), plus all emissive
+        triangles of the model, at full detail */
+    void build(const Model *model, const QuadLight &quad);
+
+    inline size_t size() const { return lights.size(); }
+
+    /*! picks the light for a light sample at P (with shading normal
+        N), with u in [0,1), and returns it and the probability of
+        having picked it; -1 if there is no light that could light P
+        (in which case the sample contributes nothing) */
+    int pick(LightSelection selection, const vec3f &P, const vec3f &N,
+             float u, float &pdf) const;
+
+    /*! the probability that pick() has for picking the given light
+        at P, eg, for weighing a light sample against a ray that hit
+        the light by other means */
+    float pickPdf(LightSelection selection, const vec3f &P, const vec3f &N,
+                  int lightID) const;
+
+    /*! the light of a triangle of the model, or -1 if that triangle
+        is not emissive */
+    inline int lightOf(int meshID, int primID) const
+    { return meshFirstLight[meshID] < 0 ? -1 : meshFirstLight[meshID]+primID; }
+
+    /*! a point distributed uniformly in the area of the given light,
+        as seen from P: the weight is what the light's emission and
+        NdotL get scaled by - 1/dist^2 for quads, as in
+        LightSampling.h, and area*cos/(pi*dist^2) for triangles. The
+        pi makes a triangle with emitted radiance Ke light a diffuse
+        surface as it physically would; for the quad light, it has
+        always been part of its 'power' */
+    inline LightSample sample(int lightID, const vec3f &P, const vec2f &uv) const
+    {
+      const Light &light = lights[lightID];
+      vec3f onLight;
+      if (light.isTriangle) {
+        const float su = sqrtf(uv.x);
+        onLight = light.p + (1.f-su)*light.e1 + (uv.y*su)*light.e2;
+      } else
+        onLight = light.p + uv.x*light.e1 + uv.y*light.e2;
+      const vec3f toLight = onLight - P;
+      LightSample s;
+      s.dist   = length(toLight);
+      s.dir    = toLight * (1.f/s.dist);
+      s.weight = 1.f/(s.dist*s.dist);
+      if (light.isTriangle) {
+        const vec3f areaNormal = cross(light.e1,light.e2);
+        s.weight *= float(.5/M_PI)*fabsf(dot(areaNormal,s.dir));
+      }
+      return s;
+    }
+
+    std::vector<Light> lights;
+    /*! what selection goes by: the average of a light's emission,
+        times its area over pi for triangles */
+    std::vector<float> power;
+    AliasTable         powerTable;
+    /*! the light tree, and the summed power of each of its nodes */
+    BVH                tree;
+    std::vector<float> nodePower;
+    /*! @{ each light's leaf, and each node's parent (-1 for the
+        root), for pickPdf() */
+    std::vector<int>   lightLeaf;
+    std::vector<int>   nodeParent;
+    /*! @} */
+    /*! the light of each mesh's first triangle, or -1 for meshes
+        without emission. All triangles of an emissive mesh are
+        lights, in order (degenerate ones with zero power) */
+    std::vector<int>   meshFirstLight;
+
+  private:
+    /*! how much a subtree (probably) contributes to P, relative to
+        its sibling */
+    float importance(int nodeID, const vec3f &P, const vec3f &N) const;
+  };
+
+} // ::osc
@@ -0,0 +1,238 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+/* sampling the examples' quad light, for soft shadows. This header
+   gets included by both host code and device programs, so the cpu
+   renderer and the optix examples sample the light the same way.
+
+   All strategies estimate what the examples always did - the average
+   of NdotL/dist^2 over the quad - so they all converge to the same
+   image, and only differ in how noisy they get there */
+#include "gdt/math/vec.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  enum LightSampling {
+    /*! independent, uniformly distributed points on the quad, as the
+        examples did it; two random numbers per sample */
+    LIGHT_SAMPLING_UNIFORM=0,
+    /*! a hit's samples are a randomly shifted hammersley set on the
+        quad, so they cover it evenly; two random numbers per hit */
+    LIGHT_SAMPLING_STRATIFIED,
+    /*! same, but mapped such that the samples are uniform in the
+        solid angle the quad covers, as seen from the hit (Urena et
+        al., "An Area-Preserving Parametrization for Spherical
+        Rectangles", EGSR 2013); no more variance from 1/dist^2 */
+    LIGHT_SAMPLING_SOLID_ANGLE,
+    LIGHT_SAMPLING_COUNT
+  };
+
+  /*! one point on the light, as seen from the shaded point */
+  struct LightSample {
+    /*! normalized direction to the point */
+    vec3f dir;
+    float dist;
+    /*! what NdotL gets scaled by: 1/dist^2 for points uniform on the
+        quad; solid angle over area, divided by the cosine at the
+        light, for points uniform in solid angle */
+    float weight;
+  };
+
+  /*! van der corput radical inverse in base 2, in [0,1) */
+  inline __both__ float radicalInverse2(uint32_t i)
+  {
+    i = (i << 16) | (i >> 16);
+    i = ((i & 0x00ff00ffu) << 8) | ((i & 0xff00ff00u) >> 8);
+    i = ((i & 0x0f0f0f0fu) << 4) | ((i & 0xf0f0f0f0u) >> 4);
+    i = ((i & 0x33333333u) << 2) | ((i & 0xccccccccu) >> 2);
+    i = ((i & 0x55555555u) << 1) | ((i & 0xaaaaaaaau) >> 1);
+    return float(i >> 8) * (1.f/16777216.f);
+  }
+
+  /*! two tangents that make an orthonormal frame with (normalized)
+      n, without branches or a division by a small number (duff et
+      al., "building an orthonormal basis, revisited", jcgt 2017) */
+  inline __both__ void makeFrame(const vec3f &n, vec3f &t, vec3f &b)
+  {
+    const float sign = copysignf(1.f,n.z);
+    const float a    = -1.f/(sign+n.z);
+    const float c    = n.x*n.y*a;
+    t = vec3f(1.f+sign*n.x*n.x*a,sign*c,-sign*n.x);
+    b = vec3f(c,sign+n.y*n.y*a,-n.y);
+  }
+
+  /*! a direction in the hemisphere around N, uniform in solid angle
+      (ie, with a pdf of 1/(2pi)) */
+  inline __both__ vec3f sampleUniformHemisphere(const vec3f &N, const vec2f &u)
+  {
+    const float z   = u.x;
+    const float r   = sqrtf(fmaxf(0.f,1.f-z*z));
+    const float phi = float(2.*M_PI)*u.y;
+    vec3f t, b;
+    makeFrame(N,t,b);
+    return (r*cosf(phi))*t + (r*sinf(phi))*b + z*N;
+  }
+
+  /*! a direction in the hemisphere around N, with a pdf of
+      cos(theta)/pi */
+  inline __both__ vec3f sampleCosineHemisphere(const vec3f &N, const vec2f &u)
+  {
+    const float r   = sqrtf(u.x);
+    const float z   = sqrtf(fmaxf(0.f,1.f-u.x));
+    const float phi = float(2.*M_PI)*u.y;
+    vec3f t, b;
+    makeFrame(N,t,b);
+    return (r*cosf(phi))*t + (r*sinf(phi))*b + z*N;
+  }
+
+  /*! power heuristic weight of a sample that one strategy drew with
+      the given pdf, when another strategy could have drawn the same
+      sample with otherPdf (both in solid angle) */
+  inline __both__ float powerHeuristic(float pdf, float otherPdf)
+  {
+    const float a = pdf*pdf, b = otherPdf*otherPdf;
+    return a > 0.f ? a/(a+b) : 0.f;
+  }
+
+  /*! draws the light samples for one shaded point; du and dv have to
+      be orthogonal for solid angle sampling (otherwise that falls
+      back to stratified sampling on the quad, as it does for points
+      that see the light at a tiny or grazing angle) */
+  struct QuadLightSampler {
+    template<typename Random>
+    inline __both__ QuadLightSampler(LightSampling mode,
+                                     const vec3f &origin,
+                                     const vec3f &du,
+                                     const vec3f &dv,
+                                     const vec3f &P,
+                                     int numSamples,
+                                     Random &random)
+      : mode(mode), P(P), origin(origin), du(du), dv(dv),
+        numSamples(numSamples), solidAngle(false)
+    {
+      if (mode == LIGHT_SAMPLING_UNIFORM) return;
+      shift.x = random();
+      shift.y = random();
+      if (mode == LIGHT_SAMPLING_SOLID_ANGLE) initSolidAngle();
+    }
+
+    /*! the i'th of the numSamples samples */
+    template<typename Random>
+    inline __both__ LightSample sample(int i, Random &random) const
+    {
+      vec2f uv;
+      if (mode == LIGHT_SAMPLING_UNIFORM) {
+        uv.x = random();
+        uv.y = random();
+      } else {
+        uv.x = wrap((i+.5f)/numSamples + shift.x);
+        uv.y = wrap(radicalInverse2(uint32_t(i)) + shift.y);
+      }
+      return solidAngle ? sampleSolidAngle(uv) : sampleArea(uv);
+    }
+
+  private:
+    static inline __both__ float wrap(float f)
+    { return f >= 1.f ? f-1.f : f; }
+
+    inline __both__ LightSample sampleArea(const vec2f &uv) const
+    {
+      const vec3f toLight = origin + uv.x*du + uv.y*dv - P;
+      LightSample s;
+      s.dist   = length(toLight);
+      s.dir    = toLight * (1.f/s.dist);
+      s.weight = 1.f/(s.dist*s.dist);
+      return s;
+    }
+
+    /*! sets up the spherical rectangle (in the paper's notation), in
+        a frame with the quad's edges as x and y axes, and the quad in
+        the z=z0<0 plane */
+    inline __both__ void initSolidAngle()
+    {
+      const float width  = length(du);
+      const float height = length(dv);
+      x = du * (1.f/width);
+      y = dv * (1.f/height);
+      if (fabsf(dot(x,y)) > 1e-3f) return;
+      z = cross(x,y);
+      area = width*height;
+      const vec3f d = origin - P;
+      z0 = dot(d,z);
+      if (z0 > 0.f) { z0 = -z0; z = -z; }
+      // (in, or almost in, the plane of the light)
+      if (z0 > -1e-4f*(width+height)) return;
+      x0 = dot(d,x); x1 = x0+width;
+      y0 = dot(d,y); y1 = y0+height;
+      const vec3f v00(x0,y0,z0), v01(x0,y1,z0), v10(x1,y0,z0), v11(x1,y1,z0);
+      const vec3f n0 = normalize(cross(v00,v10));
+      const vec3f n1 = normalize(cross(v10,v11));
+      const vec3f n2 = normalize(cross(v11,v01));
+      const vec3f n3 = normalize(cross(v01,v00));
+      const float g0 = acosf(fmaxf(-1.f,fminf(1.f,-dot(n0,n1))));
+      const float g1 = acosf(fmaxf(-1.f,fminf(1.f,-dot(n1,n2))));
+      const float g2 = acosf(fmaxf(-1.f,fminf(1.f,-dot(n2,n3))));
+      const float g3 = acosf(fmaxf(-1.f,fminf(1.f,-dot(n3,n0))));
+      b0 = n0.z;
+      b1 = n2.z;
+      k  = 2.f*float(M_PI) - g2 - g3;
+      S  = g0 + g1 - k;
+      // below ~1e-3 sr, S is mostly float cancellation - but then the
+      // light looks the same from everywhere on it anyway
+      solidAngle = S > 1e-3f;
+    }
+
+    inline __both__ LightSample sampleSolidAngle(const vec2f &uv) const
+    {
+      // pick the x coordinate such that the part of the rectangle
+      // left of it has the wanted solid angle ...
+      const float au = uv.x*S + k;
+      const float fu = (cosf(au)*b0 - b1)/sinf(au);
+      float cu = (fu > 0.f ? 1.f : -1.f)/sqrtf(fu*fu + b0*b0);
+      cu = fmaxf(-1.f,fminf(1.f,cu));
+      float xu = -(cu*z0)/sqrtf(fmaxf(1e-12f,1.f-cu*cu));
+      xu = fmaxf(x0,fminf(x1,xu));
+      // ... then y, uniformly in the solid angle of that column
+      const float dd  = sqrtf(xu*xu + z0*z0);
+      const float h0  = y0/sqrtf(dd*dd + y0*y0);
+      const float h1  = y1/sqrtf(dd*dd + y1*y1);
+      const float hv  = h0 + uv.y*(h1-h0);
+      const float hv2 = hv*hv;
+      const float yv  = hv2 < 1.f-1e-6f ? (hv*dd)/sqrtf(1.f-hv2) : y1;
+
+      LightSample s;
+      s.dist   = sqrtf(xu*xu + yv*yv + z0*z0);
+      s.dir    = (xu*x + yv*y + z0*z) * (1.f/s.dist);
+      s.weight = S*s.dist/(area*(-z0));
+      return s;
+    }
+
+    LightSampling mode;
+    vec3f P, origin, du, dv;
+    int   numSamples;
+    vec2f shift;
+    bool  solidAngle;
+    // the spherical rectangle, for solid angle sampling
+    vec3f x, y, z;
+    float area, x0, x1, y0, y1, z0, b0, b1, k, S;
+  };
+
+} // ::osc
@@ -0,0 +1,75 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "MappedFile.h"
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  MappedFile::MappedFile(const std::string &fileName)
+  {
+#ifndef _WIN32
+    const int fd = open(fileName.c_str(),O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("could not open '"+fileName+"'");
+    struct stat st;
+    if (fstat(fd,&st) == 0 && st.st_size > 0) {
+      void *mem = mmap(nullptr,size_t(st.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+      if (mem != MAP_FAILED) {
+        begin    = (const uint8_t *)mem;
+        numBytes = size_t(st.st_size);
+        mapped   = true;
+      }
+    }
+    close(fd);
+    if (mapped) return;
+#endif
+    // no mmap (or it failed, or the file is empty): read the whole
+    // file
+    std::ifstream in(fileName,std::ios::binary|std::ios::ate);
+    if (!in)
+      throw std::runtime_error("could not open '"+fileName+"'");
+    numBytes = size_t(in.tellg());
+    in.seekg(0);
+    uint8_t *mem = new uint8_t[numBytes > 0 ? numBytes : 1];
+    if (!in.read((char *)mem,numBytes)) {
+      delete[] mem;
+      throw std::runtime_error("could not read '"+fileName+"'");
+    }
+    begin = mem;
+  }
+
+  MappedFile::~MappedFile()
+  {
+#ifndef _WIN32
+    if (mapped) {
+      munmap((void *)begin,numBytes);
+      return;
+    }
+#endif
+    delete[] begin;
+  }
+
+} // ::osc
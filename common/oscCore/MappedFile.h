@@ -0,0 +1,49 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! read-only access to the entire contents of a file: memory
+      mapped where the platform supports it (so only the parts that
+      actually get touched get read from disk), and read into memory
+      in one go otherwise */
+  class MappedFile {
+  public:
+    /*! throws if the file cannot be opened */
+    MappedFile(const std::string &fileName);
+    ~MappedFile();
+
+    const uint8_t *data() const { return begin; }
+    size_t         size() const { return numBytes; }
+
+  private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *begin    { nullptr };
+    size_t         numBytes { 0 };
+    /*! whether 'begin' is a mapping, or memory we allocated */
+    bool           mapped   { false };
+  };
+
+} // ::osc
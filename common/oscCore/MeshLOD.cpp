@@ -0,0 +1,338 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "MeshLOD.h"
+#include "gdt/parallel/parallel_for.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the sum of squared distances to a set of (area-weighted) planes,
+      as a symmetric 4x4 matrix; 'weight' is the sum of the weights,
+      so that sqrt(eval(p)/weight) is an rms distance */
+  struct Quadric {
+    Quadric() { std::fill(m,m+10,0.); }
+
+    /*! the plane through triangle (a,b,c), weighted by its area */
+    static Quadric plane(const vec3f &a, const vec3f &b, const vec3f &c)
+    {
+      Quadric q;
+      const vec3f  N    = cross(b-a,c-a);
+      const double len  = length(N);
+      if (len == 0.) return q;
+      const double area = .5*len;
+      const double nx = N.x/len, ny = N.y/len, nz = N.z/len;
+      const double d  = -(nx*a.x+ny*a.y+nz*a.z);
+      q.m[0] = area*nx*nx; q.m[1] = area*nx*ny; q.m[2] = area*nx*nz; q.m[3] = area*nx*d;
+      q.m[4] = area*ny*ny; q.m[5] = area*ny*nz; q.m[6] = area*ny*d;
+      q.m[7] = area*nz*nz; q.m[8] = area*nz*d;
+      q.m[9] = area*d*d;
+      q.weight = area;
+      return q;
+    }
+
+    Quadric &operator+=(const Quadric &other)
+    {
+      for (int i=0;i<10;i++) m[i] += other.m[i];
+      weight += other.weight;
+      return *this;
+    }
+
+    double eval(const vec3f &p) const
+    {
+      const double x = p.x, y = p.y, z = p.z;
+      return x*x*m[0] + 2.*x*y*m[1] + 2.*x*z*m[2] + 2.*x*m[3]
+        +    y*y*m[4] + 2.*y*z*m[5] + 2.*y*m[6]
+        +    z*z*m[7] + 2.*z*m[8]
+        +    m[9];
+    }
+
+    /*! xx, xy, xz, xw, yy, yz, yw, zz, zw, ww */
+    double m[10];
+    double weight { 0. };
+  };
+
+  /*! collapsing vertex 'from' onto vertex 'to'. Among collapses of
+      the same cost - all those within flat regions, which cost
+      nothing - shorter edges go first, which keeps the triangles
+      from degenerating into long slivers */
+  struct Collapse {
+    float cost;
+    float edgeLength;
+    int   from, to;
+    /*! (inverted, for a min-heap) */
+    bool operator<(const Collapse &other) const
+    {
+      return cost != other.cost ? cost > other.cost : edgeLength > other.edgeLength;
+    }
+  };
+
+  /*! simplifies a triangle mesh through a sequence of half-edge
+      collapses, cheapest first. Costs in the queue may be out of
+      date (lower than the actual cost), so every collapse gets
+      re-evaluated when it comes out of the queue, and goes back in
+      if it got more expensive in the meantime */
+  class Simplifier {
+  public:
+    Simplifier(const TriangleMesh &mesh)
+    {
+      const int numVertices = int(mesh.isQuantized() ? mesh.quantized.vertex.size() : mesh.vertex.size());
+      position.resize(numVertices);
+      for (int i=0;i<numVertices;i++)
+        position[i] = mesh.getVertex(i);
+      triangle.resize(mesh.numTriangles());
+      for (int i=0;i<(int)triangle.size();i++)
+        triangle[i] = mesh.getIndex(i);
+      alive.assign(triangle.size(),true);
+      numAlive = int(triangle.size());
+
+      quadric.resize(numVertices);
+      vertexTriangles.resize(numVertices);
+      for (int i=0;i<(int)triangle.size();i++) {
+        const vec3i t = triangle[i];
+        const Quadric q = Quadric::plane(position[t.x],position[t.y],position[t.z]);
+        for (int j=0;j<3;j++) {
+          quadric[t[j]] += q;
+          vertexTriangles[t[j]].push_back(i);
+        }
+      }
+      collapsed.assign(numVertices,false);
+      lockVertices();
+
+      for (auto &t : triangle)
+        for (int j=0;j<3;j++) {
+          pushCollapse(t[j],t[(j+1)%3]);
+          pushCollapse(t[(j+1)%3],t[j]);
+        }
+    }
+
+    /*! collapses edges until at most 'targetTriangles' are left, or
+        the cheapest remaining collapse would cost more than
+        'maxError' */
+    void simplify(int targetTriangles, float maxError)
+    {
+      while (numAlive > targetTriangles && !queue.empty()) {
+        const Collapse c = queue.top();
+        if (c.cost > maxError) break;
+        queue.pop();
+        if (collapsed[c.from] || collapsed[c.to] || !connected(c.from,c.to))
+          continue;
+        const float cost = collapseCost(c.from,c.to);
+        if (cost > c.cost) {
+          queue.push({ cost, c.edgeLength, c.from, c.to });
+          continue;
+        }
+        if (flips(c.from,c.to))
+          continue;
+        collapse(c.from,c.to);
+        error = std::max(error,cost);
+      }
+    }
+
+    std::vector<vec3i> aliveTriangles() const
+    {
+      std::vector<vec3i> result;
+      result.reserve(numAlive);
+      for (size_t i=0;i<triangle.size();i++)
+        if (alive[i]) result.push_back(triangle[i]);
+      return result;
+    }
+
+    int   numAlive;
+    /*! the largest cost of any collapse so far */
+    float error { 0.f };
+
+  private:
+    /*! vertices that share their position with other vertices sit on
+        a seam - they only differ in normal or texcoord - and ones on
+        an edge with only one (or more than two) triangles sit on a
+        border; neither may move. They can still be collapsed onto */
+    void lockVertices()
+    {
+      locked.assign(position.size(),false);
+      std::unordered_map<vec3f,int,PositionHash> firstWithPosition;
+      for (int i=0;i<(int)position.size();i++) {
+        if (vertexTriangles[i].empty()) continue;
+        auto it = firstWithPosition.find(position[i]);
+        if (it == firstWithPosition.end())
+          firstWithPosition[position[i]] = i;
+        else
+          locked[i] = locked[it->second] = true;
+      }
+
+      std::unordered_map<uint64_t,int> edgeCount;
+      for (auto &t : triangle)
+        for (int j=0;j<3;j++)
+          edgeCount[edgeKey(t[j],t[(j+1)%3])]++;
+      for (auto &t : triangle)
+        for (int j=0;j<3;j++)
+          if (edgeCount[edgeKey(t[j],t[(j+1)%3])] != 2)
+            locked[t[j]] = locked[t[(j+1)%3]] = true;
+    }
+
+    struct PositionHash {
+      size_t operator()(const vec3f &p) const
+      {
+        // (+0.f, so that -0 and 0 hash the same)
+        const vec3f q = p+vec3f(0.f);
+        uint32_t bits[3];
+        memcpy(bits,&q,sizeof(bits));
+        return size_t(bits[0]*73856093u ^ bits[1]*19349663u ^ bits[2]*83492791u);
+      }
+    };
+
+    static uint64_t edgeKey(int a, int b)
+    { return (uint64_t(std::min(a,b)) << 32) | uint64_t(std::max(a,b)); }
+
+    float collapseCost(int from, int to) const
+    {
+      Quadric q = quadric[from];
+      q += quadric[to];
+      return float(sqrt(std::max(0.,q.eval(position[to]))/std::max(q.weight,1e-30)));
+    }
+
+    void pushCollapse(int from, int to)
+    {
+      if (locked[from]) return;
+      queue.push({ collapseCost(from,to),length(position[to]-position[from]),from,to });
+    }
+
+    bool connected(int a, int b) const
+    {
+      for (int t : vertexTriangles[a])
+        if (alive[t] && (triangle[t].x == b || triangle[t].y == b || triangle[t].z == b))
+          return true;
+      return false;
+    }
+
+    /*! whether moving 'from' to 'to' would flip (or nearly collapse)
+        any of the triangles that survive the collapse */
+    bool flips(int from, int to) const
+    {
+      for (int t : vertexTriangles[from]) {
+        if (!alive[t]) continue;
+        const vec3i tri = triangle[t];
+        if (tri.x == to || tri.y == to || tri.z == to) continue;
+        vec3f v[3] = { position[tri.x], position[tri.y], position[tri.z] };
+        const vec3f before = cross(v[1]-v[0],v[2]-v[0]);
+        for (int j=0;j<3;j++)
+          if (tri[j] == from) v[j] = position[to];
+        const vec3f after = cross(v[1]-v[0],v[2]-v[0]);
+        if (dot(before,after) <= .25f*length(before)*length(after))
+          return true;
+      }
+      return false;
+    }
+
+    void collapse(int from, int to)
+    {
+      for (int t : vertexTriangles[from]) {
+        if (!alive[t]) continue;
+        vec3i &tri = triangle[t];
+        if (tri.x == to || tri.y == to || tri.z == to) {
+          alive[t] = false;
+          numAlive--;
+          continue;
+        }
+        for (int j=0;j<3;j++)
+          if (tri[j] == from) tri[j] = to;
+        vertexTriangles[to].push_back(t);
+      }
+      std::vector<int>().swap(vertexTriangles[from]);
+      collapsed[from] = true;
+      quadric[to] += quadric[from];
+
+      std::vector<int> &around = vertexTriangles[to];
+      around.erase(std::remove_if(around.begin(),around.end(),
+                                  [&](int t){ return !alive[t]; }),
+                   around.end());
+      for (int t : around)
+        for (int j=0;j<3;j++) {
+          const int other = triangle[t][j];
+          if (other == to) continue;
+          pushCollapse(other,to);
+          pushCollapse(to,other);
+        }
+    }
+
+    std::vector<vec3f>            position;
+    std::vector<vec3i>            triangle;
+    std::vector<bool>             alive;
+    std::vector<Quadric>          quadric;
+    std::vector<std::vector<int>> vertexTriangles;
+    std::vector<bool>             collapsed;
+    std::vector<bool>             locked;
+    std::priority_queue<Collapse> queue;
+  };
+
+  void buildLODs(TriangleMesh *mesh, const LODSettings &settings)
+  {
+    mesh->lods.clear();
+    if (mesh->numTriangles() == 0) return;
+
+    Simplifier simplifier(*mesh);
+    box3f bounds;
+    for (int i=0;i<mesh->numTriangles();i++) {
+      const vec3i index = mesh->getIndex(i);
+      for (int j=0;j<3;j++) bounds.extend(mesh->getVertex(index[j]));
+    }
+    const float maxError = settings.maxError*length(bounds.span());
+    int numTriangles = mesh->numTriangles();
+    for (int level=1;level<=settings.numLevels;level++) {
+      simplifier.simplify(int(numTriangles*settings.reduction),maxError);
+      // stop once simplification got stuck half-way to the target
+      if (simplifier.numAlive > numTriangles*(1.f+settings.reduction)*.5f)
+        break;
+      numTriangles = simplifier.numAlive;
+      MeshLODLevel lod;
+      lod.index = simplifier.aliveTriangles();
+      lod.error = simplifier.error;
+      mesh->lods.push_back(std::move(lod));
+    }
+  }
+
+  void buildLODs(Model *model, const LODSettings &settings)
+  {
+    parallel_for(model->meshes.size(),[&](size_t meshID){
+        buildLODs(model->meshes[meshID],settings);
+      });
+  }
+
+  int selectLOD(const TriangleMesh &mesh,
+                const box3f &meshBounds,
+                const CameraFrame &camera,
+                int screenHeight,
+                float maxPixelError)
+  {
+    const vec3f p = camera.position;
+    const float distance
+      = length(max(vec3f(0.f),max(meshBounds.lower-p,p-meshBounds.upper)));
+    if (distance == 0.f) return 0;
+    // the screen is length(vertical) high at distance 1
+    const float pixelsPerUnit = screenHeight/(length(camera.vertical)*distance);
+    int lod = 0;
+    while (lod+1 < mesh.numLODs()
+           && mesh.lods[lod].error*pixelsPerUnit <= maxPixelError)
+      lod++;
+    return lod;
+  }
+
+} // ::osc
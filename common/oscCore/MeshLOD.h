@@ -0,0 +1,65 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+/* levels of detail for triangle meshes: quadric error (garland &
+   heckbert) edge-collapse simplification, and picking a level per
+   mesh from how large its error would be on screen */
+#include "Camera.h"
+#include "Model.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  struct LODSettings {
+    /*! how many levels to build on top of the full mesh; fewer get
+        built if simplification runs out of collapses (or into
+        'maxError') before */
+    int   numLevels { 4 };
+    /*! the triangle count of each level, relative to the previous
+        one */
+    float reduction { .5f };
+    /*! no collapse may cause more geometric error than this, relative
+        to the diagonal of the mesh's bounding box */
+    float maxError  { .05f };
+  };
+
+  /*! builds the mesh's coarser levels of detail, replacing whatever
+      levels it had. Every level is a half-edge collapse of the
+      previous one, ie, it only uses the mesh's own vertices, and
+      thus its attributes. Vertices on a uv or normal seam (where the
+      loader had to split a position into several vertices), and on
+      open borders, never move, so seams and borders stay exactly
+      where they are. Works on quantized meshes, too */
+  void buildLODs(TriangleMesh *mesh, const LODSettings &settings = LODSettings());
+
+  /*! buildLODs() for all meshes of the model, in parallel */
+  void buildLODs(Model *model, const LODSettings &settings = LODSettings());
+
+  /*! the coarsest level of the mesh whose geometric error, projected
+      onto the screen at the distance of the closest point of
+      'meshBounds' to the camera, is at most 'maxPixelError' pixels
+      on a screen that is 'screenHeight' pixels high. Level 0 if the
+      camera is inside the bounds */
+  int selectLOD(const TriangleMesh &mesh,
+                const box3f &meshBounds,
+                const CameraFrame &camera,
+                int screenHeight,
+                float maxPixelError);
+
+} // ::osc
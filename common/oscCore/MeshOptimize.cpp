@@ -0,0 +1,224 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "MeshOptimize.h"
+#include "gdt/math/morton.h"
+#include "gdt/parallel/parallel_for.h"
+#include <algorithm>
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! the size of the lru cache that the vertex cache order optimizes
+      for; the exact value matters little, as long as it is not
+      smaller than the actual cache */
+  #define FORSYTH_CACHE_SIZE 32
+
+  /*! forsyth's vertex score: vertices of the last triangle score a
+      fixed 0.75 (so the next triangle does not strictly have to
+      share an edge with it), others the more the more recently they
+      got used; plus a bonus for vertices with few triangles left, so
+      those get finished rather than left behind */
+  static float forsythScore(int cachePosition, int remainingValence)
+  {
+    if (remainingValence == 0) return -1.f;
+    float score = 0.f;
+    if (cachePosition >= 0)
+      score = cachePosition < 3
+        ? .75f
+        : powf(1.f-float(cachePosition-3)/(FORSYTH_CACHE_SIZE-3),1.5f);
+    return score + 2.f*powf(float(remainingValence),-.5f);
+  }
+
+  /*! the order in which to emit the triangles, for a vertex cache */
+  static std::vector<int> vertexCacheOrder(const std::vector<vec3i> &index,
+                                           int numVertices)
+  {
+    const int numTriangles = int(index.size());
+    // triangles of each vertex; the first 'valence' of each vertex's
+    // range are the ones not emitted yet
+    std::vector<int> valence(numVertices,0);
+    for (auto &tri : index)
+      for (int j=0;j<3;j++) valence[tri[j]]++;
+    std::vector<int> offset(numVertices+1,0);
+    for (int i=0;i<numVertices;i++) offset[i+1] = offset[i]+valence[i];
+    std::vector<int> vertexTriangles(offset[numVertices]);
+    {
+      std::vector<int> fill(offset.begin(),offset.end()-1);
+      for (int t=0;t<numTriangles;t++)
+        for (int j=0;j<3;j++) vertexTriangles[fill[index[t][j]]++] = t;
+    }
+
+    std::vector<float> vertexScore(numVertices);
+    for (int i=0;i<numVertices;i++)
+      vertexScore[i] = forsythScore(-1,valence[i]);
+    std::vector<bool> emitted(numTriangles,false);
+
+    // the lru cache, most recent first; it can temporarily hold up
+    // to three more vertices than its size
+    std::vector<int> cache, newCache;
+    std::vector<int> order;
+    order.reserve(numTriangles);
+    int nextUnemitted = 0;
+    int best = -1;
+    while ((int)order.size() < numTriangles) {
+      if (best < 0) {
+        // nothing in the cache is left to emit (or we just started):
+        // continue with the next triangle in the original order
+        while (emitted[nextUnemitted]) nextUnemitted++;
+        best = nextUnemitted;
+      }
+      const vec3i tri = index[best];
+      emitted[best] = true;
+      order.push_back(best);
+
+      // no longer a remaining triangle of its vertices
+      for (int j=0;j<3;j++) {
+        const int v = tri[j];
+        int *begin = vertexTriangles.data()+offset[v];
+        int *end   = begin+valence[v];
+        *std::find(begin,end,best) = end[-1];
+        valence[v]--;
+      }
+
+      // move its vertices to the front of the cache
+      newCache.assign(&tri.x,&tri.x+3);
+      for (int v : cache)
+        if (v != tri.x && v != tri.y && v != tri.z)
+          newCache.push_back(v);
+      for (size_t i=FORSYTH_CACHE_SIZE;i<newCache.size();i++)
+        vertexScore[newCache[i]] = forsythScore(-1,valence[newCache[i]]);
+      newCache.resize(std::min(newCache.size(),size_t(FORSYTH_CACHE_SIZE)));
+      cache.swap(newCache);
+
+      // re-score everything in the cache, and pick the best of the
+      // triangles around it
+      for (int i=0;i<(int)cache.size();i++)
+        vertexScore[cache[i]] = forsythScore(i,valence[cache[i]]);
+      best = -1;
+      float bestScore = -1.f;
+      for (int v : cache)
+        for (int k=offset[v];k<offset[v]+valence[v];k++) {
+          const int t = vertexTriangles[k];
+          const vec3i other = index[t];
+          const float score = vertexScore[other.x]+vertexScore[other.y]+vertexScore[other.z];
+          if (score > bestScore) { bestScore = score; best = t; }
+        }
+    }
+    return order;
+  }
+
+  /*! the order in which to emit the triangles, sorted by the morton
+      code of their centroids */
+  static std::vector<int> mortonOrder(const std::vector<vec3i> &index,
+                                      const std::vector<vec3f> &vertex)
+  {
+    box3f bounds;
+    for (auto &v : vertex) bounds.extend(v);
+    const vec3f scale = rcp(max(bounds.span(),vec3f(1e-20f)));
+    std::vector<std::pair<uint32_t,int>> codes(index.size());
+    for (size_t t=0;t<index.size();t++) {
+      const vec3f centroid
+        = (vertex[index[t].x]+vertex[index[t].y]+vertex[index[t].z])*(1.f/3.f);
+      codes[t] = std::make_pair(mortonCode((centroid-bounds.lower)*scale),int(t));
+    }
+    std::sort(codes.begin(),codes.end());
+    std::vector<int> order(index.size());
+    for (size_t t=0;t<index.size();t++) order[t] = codes[t].second;
+    return order;
+  }
+
+  template<typename T>
+  static void reorder(std::vector<T> &v, const std::vector<int> &order)
+  {
+    std::vector<T> reordered(order.size());
+    for (size_t i=0;i<order.size();i++) reordered[i] = v[order[i]];
+    v.swap(reordered);
+  }
+
+  /*! puts each vertex array entry i at newID[i] */
+  template<typename T>
+  static void renumber(std::vector<T> &v, const std::vector<int> &newID)
+  {
+    if (v.empty()) return;
+    std::vector<T> renumbered(v.size());
+    for (size_t i=0;i<v.size();i++) renumbered[newID[i]] = v[i];
+    v.swap(renumbered);
+  }
+
+  static std::vector<int> triangleOrder(const std::vector<vec3i> &index,
+                                        const std::vector<vec3f> &vertex,
+                                        TriangleOrder order)
+  {
+    return order == TRIANGLE_ORDER_MORTON
+      ? mortonOrder(index,vertex)
+      : vertexCacheOrder(index,int(vertex.size()));
+  }
+
+  void optimizeMesh(TriangleMesh *mesh, TriangleOrder order)
+  {
+    if (mesh->isQuantized())
+      throw std::runtime_error("optimizeMesh: cannot optimize a quantized mesh");
+
+    reorder(mesh->index,triangleOrder(mesh->index,mesh->vertex,order));
+    for (auto &lod : mesh->lods)
+      reorder(lod.index,triangleOrder(lod.index,mesh->vertex,order));
+
+    // vertices in order of first use by the (full) mesh
+    const int numVertices = int(mesh->vertex.size());
+    std::vector<int> newID(numVertices,-1);
+    int nextID = 0;
+    for (auto &tri : mesh->index)
+      for (int j=0;j<3;j++)
+        if (newID[tri[j]] < 0) newID[tri[j]] = nextID++;
+    for (auto &id : newID)
+      if (id < 0) id = nextID++;
+
+    renumber(mesh->vertex,newID);
+    renumber(mesh->normal,newID);
+    renumber(mesh->texcoord,newID);
+    for (auto &tri : mesh->index)
+      tri = vec3i(newID[tri.x],newID[tri.y],newID[tri.z]);
+    for (auto &lod : mesh->lods)
+      for (auto &tri : lod.index)
+        tri = vec3i(newID[tri.x],newID[tri.y],newID[tri.z]);
+  }
+
+  void optimizeModel(Model *model, TriangleOrder order)
+  {
+    parallel_for(model->meshes.size(),[&](size_t meshID){
+        optimizeMesh(model->meshes[meshID],order);
+      });
+  }
+
+  float averageCacheMissRatio(const std::vector<vec3i> &index,
+                              int numVertices,
+                              int cacheSize)
+  {
+    if (index.empty()) return 0.f;
+    // the time each vertex last got into the cache
+    std::vector<int64_t> insertedAt(numVertices,-int64_t(cacheSize)-1);
+    int64_t numMisses = 0;
+    for (auto &tri : index)
+      for (int j=0;j<3;j++)
+        if (insertedAt[tri[j]] < numMisses-cacheSize)
+          insertedAt[tri[j]] = numMisses++;
+    return float(numMisses)/float(index.size());
+  }
+
+} // ::osc
@@ -0,0 +1,61 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+/* memory locality passes for triangle meshes: the loader numbers
+   vertices in the order it first sees them, and leaves triangles in
+   file order, which - depending on the exporter - can be all over
+   the place. These reorder the triangles (either for a post-transform
+   vertex cache, or spatially), and then renumber the vertices in the
+   order the triangles first use them, so that consecutive triangles
+   share vertices, and those are close together in memory */
+#include "Model.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  enum TriangleOrder {
+    /*! tom forsyth's "linear-speed vertex cache optimisation": greedily
+        picks the next triangle whose vertices are most recently
+        used, for a (simulated) lru cache of 32 vertices */
+    TRIANGLE_ORDER_VERTEX_CACHE=0,
+    /*! triangles sorted by the morton code of their centroid */
+    TRIANGLE_ORDER_MORTON,
+    TRIANGLE_ORDER_COUNT
+  };
+
+  /*! reorders the mesh's triangles, and then its vertices by first
+      use (vertices that no triangle uses go last). Levels of detail
+      get the same treatment, so they stay valid. Neither changes
+      what the mesh looks like - only its primIDs and vertex IDs.
+      Throws for quantized meshes; optimize before quantizing */
+  void optimizeMesh(TriangleMesh *mesh,
+                    TriangleOrder order = TRIANGLE_ORDER_VERTEX_CACHE);
+
+  /*! optimizeMesh() for all meshes of the model, in parallel */
+  void optimizeModel(Model *model,
+                     TriangleOrder order = TRIANGLE_ORDER_VERTEX_CACHE);
+
+  /*! average cache miss ratio: vertex cache misses per triangle, for
+      a fifo cache of given size; 3 is as bad as it gets, and 0.5 is
+      about as good as it gets for a regular mesh */
+  float averageCacheMissRatio(const std::vector<vec3i> &index,
+                              int numVertices,
+                              int cacheSize = 16);
+
+} // ::osc
@@ -0,0 +1,330 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "ModelLoader.h"
+#include "gdt/math/xfmBatch.h"
+// (ModelLoader.h already included tiny_obj_loader.h, but only its
+// declarations; including it again with this defined adds the
+// implementation)
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "3rdParty/tiny_obj_loader.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "3rdParty/stb_image.h"
+
+//std
+#include <cstring>
+#include <fstream>
+#include <set>
+
+// in tinyobj's namespace (rather than std's), so std::map's less<>
+// finds it through argument-dependent lookup
+namespace tinyobj {
+  inline bool operator<(const tinyobj::index_t &a,
+                        const tinyobj::index_t &b)
+  {
+    if (a.vertex_index < b.vertex_index) return true;
+    if (a.vertex_index > b.vertex_index) return false;
+    
+    if (a.normal_index < b.normal_index) return true;
+    if (a.normal_index > b.normal_index) return false;
+    
+    if (a.texcoord_index < b.texcoord_index) return true;
+    if (a.texcoord_index > b.texcoord_index) return false;
+    
+    return false;
+  }
+}
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  
+
+
+  /*! find vertex with given position, normal, texcoord, and return
+      its vertex ID, or, if it doesn't exit, add it to the mesh, and
+      its just-created index */
+  int addVertex(TriangleMesh *mesh,
+                const tinyobj::attrib_t &attributes,
+                const tinyobj::index_t &idx,
+                std::map<tinyobj::index_t,int> &knownVertices)
+  {
+    if (knownVertices.find(idx) != knownVertices.end())
+      return knownVertices[idx];
+
+    const vec3f *vertex_array   = (const vec3f*)attributes.vertices.data();
+    const vec3f *normal_array   = (const vec3f*)attributes.normals.data();
+    const vec2f *texcoord_array = (const vec2f*)attributes.texcoords.data();
+    
+    int newID = (int)mesh->vertex.size();
+    knownVertices[idx] = newID;
+
+    mesh->vertex.push_back(vertex_array[idx.vertex_index]);
+    if (idx.normal_index >= 0) {
+      while (mesh->normal.size() < mesh->vertex.size())
+        mesh->normal.push_back(normal_array[idx.normal_index]);
+    }
+    if (idx.texcoord_index >= 0) {
+      while (mesh->texcoord.size() < mesh->vertex.size())
+        mesh->texcoord.push_back(texcoord_array[idx.texcoord_index]);
+    }
+
+    // just for sanity's sake:
+    if (mesh->texcoord.size() > 0)
+      mesh->texcoord.resize(mesh->vertex.size());
+    // just for sanity's sake:
+    if (mesh->normal.size() > 0)
+      mesh->normal.resize(mesh->vertex.size());
+    
+    return newID;
+  }
+
+  Texture *createTexture(const uint32_t *topDownPixels, const vec2i &res)
+  {
+    Texture *texture = new Texture;
+    texture->resolution = res;
+    texture->pixel      = new uint32_t[size_t(res.x)*res.y];
+    /* iw - actually, it seems that stbi loads the pictures
+       mirrored along the y axis - mirror them here (while copying
+       them into memory that ~Texture can delete[]) */
+    for (int y=0;y<res.y;y++)
+      memcpy(texture->pixel + size_t(res.y-1-y)*res.x,
+             topDownPixels + size_t(y)*res.x,
+             res.x*sizeof(uint32_t));
+    return texture;
+  }
+
+  Texture *decodeTexture(const void *fileData, size_t fileSize)
+  {
+    vec2i res;
+    int   comp;
+    unsigned char* image
+      = stbi_load_from_memory((const stbi_uc*)fileData,(int)fileSize,
+                              &res.x, &res.y, &comp, STBI_rgb_alpha);
+    if (!image) return nullptr;
+    Texture *texture = createTexture((const uint32_t*)image,res);
+    stbi_image_free(image);
+    return texture;
+  }
+
+  /*! load a texture (if not already loaded), and return its ID in the
+      model's textures[] vector. Textures that could not get loaded
+      return -1 */
+  int loadTexture(Model *model,
+                  std::map<std::string,int> &knownTextures,
+                  const std::string &inFileName,
+                  const std::string &modelPath)
+  {
+    if (inFileName == "")
+      return -1;
+    
+    if (knownTextures.find(inFileName) != knownTextures.end())
+      return knownTextures[inFileName];
+
+    std::string fileName = inFileName;
+    // first, fix backspaces:
+    for (auto &c : fileName)
+      if (c == '\\') c = '/';
+    fileName = modelPath+"/"+fileName;
+
+    std::ifstream file(fileName,std::ios::binary);
+    const std::vector<char> fileData((std::istreambuf_iterator<char>(file)),
+                                     std::istreambuf_iterator<char>());
+    Texture *texture = fileData.empty()
+      ? nullptr
+      : decodeTexture(fileData.data(),fileData.size());
+    int textureID = -1;
+    if (texture) {
+      textureID = (int)model->textures.size();
+      model->textures.push_back(texture);
+    } else {
+      std::cout << GDT_TERMINAL_RED
+                << "Could not load texture from " << fileName << "!"
+                << GDT_TERMINAL_DEFAULT << std::endl;
+    }
+    
+    knownTextures[inFileName] = textureID;
+    return textureID;
+  }
+
+  void parseOBJ(const std::string &objFile, OBJData &obj)
+  {
+    obj.modelDir = objFile.substr(0,objFile.rfind('/')+1);
+    std::string err = "";
+
+    bool readOK
+      = tinyobj::LoadObj(&obj.attributes,
+                         &obj.shapes,
+                         &obj.materials,
+                         &err,
+                         &err,
+                         objFile.c_str(),
+                         obj.modelDir.c_str(),
+                         /* triangulate */true);
+    if (!readOK) {
+      throw std::runtime_error("Could not read OBJ model from "+objFile+" : "+err);
+    }
+
+    if (obj.materials.empty())
+      throw std::runtime_error("could not parse materials ...");
+  }
+
+  void buildMeshes(Model *model, const OBJData &obj)
+  {
+    const auto &shapes    = obj.shapes;
+    const auto &materials = obj.materials;
+    std::map<std::string, int>      knownTextures;
+    for (int shapeID=0;shapeID<(int)shapes.size();shapeID++) {
+      const tinyobj::shape_t &shape = shapes[shapeID];
+
+      std::set<int> materialIDs;
+      for (auto faceMatID : shape.mesh.material_ids)
+        materialIDs.insert(faceMatID);
+      
+      for (int materialID : materialIDs) {
+        std::map<tinyobj::index_t,int> knownVertices;
+        TriangleMesh *mesh = new TriangleMesh;
+        
+        for (int faceID=0;faceID<(int)shape.mesh.material_ids.size();faceID++) {
+          if (shape.mesh.material_ids[faceID] != materialID) continue;
+          tinyobj::index_t idx0 = shape.mesh.indices[3*faceID+0];
+          tinyobj::index_t idx1 = shape.mesh.indices[3*faceID+1];
+          tinyobj::index_t idx2 = shape.mesh.indices[3*faceID+2];
+          
+          vec3i idx(addVertex(mesh, obj.attributes, idx0, knownVertices),
+                    addVertex(mesh, obj.attributes, idx1, knownVertices),
+                    addVertex(mesh, obj.attributes, idx2, knownVertices));
+          mesh->index.push_back(idx);
+        }
+
+        if (mesh->vertex.empty()) {
+          delete mesh;
+          continue;
+        }
+        // faces without a material (-1) keep the mesh defaults
+        if (materialID >= 0 && materialID < (int)materials.size()) {
+          mesh->diffuse  = (const vec3f&)materials[materialID].diffuse;
+          mesh->emission = (const vec3f&)materials[materialID].emission;
+          mesh->diffuseTextureID = loadTexture(model,
+                                               knownTextures,
+                                               materials[materialID].diffuse_texname,
+                                               obj.modelDir);
+        }
+        model->meshes.push_back(mesh);
+      }
+    }
+  }
+
+  void computeBounds(Model *model)
+  {
+    simd::box3fa bounds;
+    for (auto mesh : model->meshes)
+      for (auto &vtx : mesh->vertex)
+        bounds.extend(simd::vec3fa(vtx));
+    model->bounds = simd::toScalar(bounds);
+  }
+  
+  void transformMesh(TriangleMesh *mesh, const affine3f &xfm)
+  {
+    if (mesh->isQuantized())
+      throw std::runtime_error("transformMesh: cannot transform a quantized mesh");
+    xfmPoints(xfm,mesh->vertex);
+    xfmNormals(xfm,mesh->normal);
+    parallel_for_blocked(0,mesh->normal.size(),GDT_XFM_BATCH_BLOCK_SIZE,
+                         [&](size_t begin, size_t end){
+                           for (size_t i=begin;i<end;i++)
+                             mesh->normal[i] = vec3f(simd::normalize(simd::vec3fa(mesh->normal[i])));
+                         });
+  }
+
+  /*! the scale that maps [0,maxBits] onto [lower,upper]; zero for
+      empty dimensions (which then all decode to 'lower') */
+  template<typename vec_t>
+  static vec_t quantizationScale(const box_t<vec_t> &bounds)
+  { return bounds.size() * (1.f/unorm16::maxBits()); }
+
+  /*! f, relative to [lower,lower+size], as a unorm16 */
+  static inline uint16_t quantize(float f, float lower, float size)
+  { return unorm16::encode(size > 0.f ? (f-lower)/size : 0.f); }
+
+  void quantizeMesh(TriangleMesh *mesh)
+  {
+    if (mesh->isQuantized()) return;
+    QuantizedMesh &q = mesh->quantized;
+
+    q.bounds = box3f();
+    for (auto &v : mesh->vertex) q.bounds.extend(v);
+    q.vertexScale = mesh->vertex.empty() ? vec3f(0.f) : quantizationScale(q.bounds);
+    const vec3f size = mesh->vertex.empty() ? vec3f(0.f) : q.bounds.size();
+    q.vertex.resize(mesh->vertex.size());
+    for (size_t i=0;i<mesh->vertex.size();i++) {
+      const vec3f p = mesh->vertex[i];
+      q.vertex[i] = vec3us(quantize(p.x,q.bounds.lower.x,size.x),
+                           quantize(p.y,q.bounds.lower.y,size.y),
+                           quantize(p.z,q.bounds.lower.z,size.z));
+    }
+
+    q.normal.resize(mesh->normal.size());
+    for (size_t i=0;i<mesh->normal.size();i++)
+      q.normal[i] = octEncode(mesh->normal[i]);
+
+    q.texcoordBounds = box2f();
+    for (auto &t : mesh->texcoord) q.texcoordBounds.extend(t);
+    q.texcoordScale = mesh->texcoord.empty() ? vec2f(0.f) : quantizationScale(q.texcoordBounds);
+    const vec2f tsize = mesh->texcoord.empty() ? vec2f(0.f) : q.texcoordBounds.size();
+    q.texcoord.resize(mesh->texcoord.size());
+    for (size_t i=0;i<mesh->texcoord.size();i++) {
+      const vec2f t = mesh->texcoord[i];
+      q.texcoord[i] = vec2us(quantize(t.x,q.texcoordBounds.lower.x,tsize.x),
+                             quantize(t.y,q.texcoordBounds.lower.y,tsize.y));
+    }
+
+    if (mesh->vertex.size() <= (1<<16)) {
+      q.index.resize(mesh->index.size());
+      for (size_t i=0;i<mesh->index.size();i++)
+        q.index[i] = vec3us(mesh->index[i]);
+      std::vector<vec3i>().swap(mesh->index);
+    }
+    std::vector<vec3f>().swap(mesh->vertex);
+    std::vector<vec3f>().swap(mesh->normal);
+    std::vector<vec2f>().swap(mesh->texcoord);
+  }
+
+  void quantizeModel(Model *model)
+  {
+    parallel_for(model->meshes.size(),[&](size_t meshID){
+        quantizeMesh(model->meshes[meshID]);
+      });
+  }
+
+  Model *loadOBJ(const std::string &objFile)
+  {
+    Model *model = new Model;
+    try {
+      OBJData obj;
+      parseOBJ(objFile,obj);
+      std::cout << "Done loading obj file - found " << obj.shapes.size() << " shapes with " << obj.materials.size() << " materials" << std::endl;
+      buildMeshes(model,obj);
+    } catch (...) {
+      delete model;
+      throw;
+    }
+    computeBounds(model);
+    
+    std::cout << "created a total of " << model->meshes.size() << " meshes" << std::endl;
+    return model;
+  }
+}
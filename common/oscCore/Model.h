@@ -0,0 +1,239 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "gdt/math/AffineSpace.h"
+#include "gdt/math/fixedpoint.h"
+#include <limits>
+#include <vector>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+  
+  /*! octahedral normal encoding: maps the unit sphere onto the
+      [-1,1]^2 square (upper hemisphere in the center diamond, lower
+      one folded over into the corners), which stores a normal in two
+      snorm16s with a worst-case error of ~0.003 degrees */
+  inline __both__ vec2s octEncode(const vec3f &n)
+  {
+    const float l1 = fabsf(n.x)+fabsf(n.y)+fabsf(n.z);
+    if (l1 == 0.f) return vec2s(int16_t(0));
+    float x = n.x/l1, y = n.y/l1;
+    if (n.z < 0.f) {
+      const float fx = (1.f-fabsf(y))*(x < 0.f ? -1.f : 1.f);
+      const float fy = (1.f-fabsf(x))*(y < 0.f ? -1.f : 1.f);
+      x = fx; y = fy;
+    }
+    return vec2s(snorm16::encode(x),snorm16::encode(y));
+  }
+
+  inline __both__ vec3f octDecode(const vec2s &e)
+  {
+    float x = snorm16::decode(e.x), y = snorm16::decode(e.y);
+    const float z = 1.f-fabsf(x)-fabsf(y);
+    // unfolding the lower hemisphere, without a branch (which would
+    // be a coin flip for the shading path): for z<0 this is the same
+    // as the fold in octEncode()
+    const float t = std::max(-z,0.f);
+    x += x >= 0.f ? -t : t;
+    y += y >= 0.f ? -t : t;
+    // (one division rather than gdt::normalize()'s three)
+    return vec3f(x,y,z) * (1.f/sqrtf(x*x+y*y+z*z));
+  }
+
+  /*! the compressed vertex data of a triangle mesh: positions as
+      unorm16s relative to the mesh's bounding box, normals
+      octahedral-encoded in two snorm16s, and texcoords as unorm16s
+      relative to the bounding box of all texcoords. Meshes with at
+      most 64K vertices also get 16-bit indices. Together, that is 14
+      rather than 32 bytes per vertex, and 6 rather than 12 per
+      triangle */
+  struct QuantizedMesh {
+    inline __both__ vec3f getVertex(int i) const
+    { return bounds.lower + vec3f(vertex[i])*vertexScale; }
+    inline __both__ vec3f getNormal(int i) const
+    { return octDecode(normal[i]); }
+    inline __both__ vec2f getTexcoord(int i) const
+    { return texcoordBounds.lower + vec2f(texcoord[i])*texcoordScale; }
+
+    /*! the largest (per-dimension) difference between an original
+        vertex and its decoded one: half a quantization step (plus
+        float rounding in the decode) */
+    vec3f vertexErrorBound() const
+    { return .5f*vertexScale + 2.f*ulp(max(abs(bounds.lower),abs(bounds.upper))); }
+    vec2f texcoordErrorBound() const
+    { return .5f*texcoordScale + 2.f*ulp(max(abs(texcoordBounds.lower),abs(texcoordBounds.upper))); }
+    /*! the largest angle (in radians) between an original normal
+        and its decoded one */
+    static float normalErrorBound() { return 1e-4f; }
+
+    size_t sizeInBytes() const
+    {
+      return vertex.size()*sizeof(vertex[0]) + normal.size()*sizeof(normal[0])
+        + texcoord.size()*sizeof(texcoord[0]) + index.size()*sizeof(index[0]);
+    }
+
+    box3f               bounds;
+    vec3f               vertexScale { 0.f };
+    box2f               texcoordBounds;
+    vec2f               texcoordScale { 0.f };
+    std::vector<vec3us> vertex;
+    std::vector<vec2s>  normal;
+    std::vector<vec2us> texcoord;
+    /*! 16-bit indices; empty if the mesh has more than 64K vertices,
+        in which case the mesh's regular indices stay in place */
+    std::vector<vec3us> index;
+
+  private:
+    static inline vec3f ulp(const vec3f &v)
+    { return v*std::numeric_limits<float>::epsilon(); }
+    static inline vec2f ulp(const vec2f &v)
+    { return v*std::numeric_limits<float>::epsilon(); }
+  };
+
+  /*! one coarser level of detail of a triangle mesh (see MeshLOD.h):
+      simplification only ever moves a vertex onto another one, so a
+      level can share the mesh's vertex arrays, and only needs its own
+      index buffer */
+  struct MeshLODLevel {
+    std::vector<vec3i> index;
+    /*! the (quadric) geometric error of this level, in object space
+        units; see selectLOD() */
+    float              error { 0.f };
+  };
+
+  /*! a simple indexed triangle mesh that our sample renderer will
+      render */
+  struct TriangleMesh {
+    /*! @{ vertex data accessors, which work for both regular and
+        quantized meshes (see quantizeMesh()); code that may see
+        quantized meshes has to go through these, rather than the
+        arrays */
+    inline bool isQuantized() const { return !quantized.vertex.empty(); }
+    inline int numTriangles() const
+    { return int(isQuantized() && !quantized.index.empty() ? quantized.index.size() : index.size()); }
+    inline bool hasNormals() const
+    { return isQuantized() ? !quantized.normal.empty() : !normal.empty(); }
+    inline bool hasTexcoords() const
+    { return isQuantized() ? !quantized.texcoord.empty() : !texcoord.empty(); }
+    inline vec3i getIndex(int primID) const
+    {
+      return isQuantized() && !quantized.index.empty()
+        ? vec3i(quantized.index[primID]) : index[primID];
+    }
+    inline vec3f getVertex(int i) const
+    { return isQuantized() ? quantized.getVertex(i) : vertex[i]; }
+    inline vec3f getNormal(int i) const
+    { return isQuantized() ? quantized.getNormal(i) : normal[i]; }
+    inline vec2f getTexcoord(int i) const
+    { return isQuantized() ? quantized.getTexcoord(i) : texcoord[i]; }
+    /*! @} */
+
+    /*! @{ level of detail accessors; level 0 is the full mesh, and
+        levels 1..numLODs()-1 are the ones in 'lods' */
+    inline int numLODs() const { return 1+int(lods.size()); }
+    inline int numTriangles(int lod) const
+    { return lod == 0 ? numTriangles() : int(lods[lod-1].index.size()); }
+    inline vec3i getIndex(int primID, int lod) const
+    { return lod == 0 ? getIndex(primID) : lods[lod-1].index[primID]; }
+    /*! @} */
+
+    /*! bytes of vertex and index data, in whichever form the mesh is */
+    size_t sizeInBytes() const
+    {
+      return vertex.size()*sizeof(vertex[0]) + normal.size()*sizeof(normal[0])
+        + texcoord.size()*sizeof(texcoord[0]) + index.size()*sizeof(index[0])
+        + quantized.sizeInBytes() + lodSizeInBytes();
+    }
+
+    /*! bytes of the lods' index buffers */
+    size_t lodSizeInBytes() const
+    {
+      size_t bytes = 0;
+      for (auto &lod : lods) bytes += lod.index.size()*sizeof(lod.index[0]);
+      return bytes;
+    }
+
+    std::vector<vec3f> vertex;
+    std::vector<vec3f> normal;
+    std::vector<vec2f> texcoord;
+    std::vector<vec3i> index;
+    /*! the compressed vertex data, if the mesh got quantized - in
+        which case the arrays above are empty (except for 'index', for
+        meshes with more than 64K vertices) */
+    QuantizedMesh      quantized;
+    /*! coarser levels of detail, if any got built (see buildLODs()),
+        coarsest last */
+    std::vector<MeshLODLevel> lods;
+
+    // material data:
+    vec3f              diffuse          { .8f };
+    int                diffuseTextureID { -1 };
+    /*! emitted radiance (the mtl's Ke); meshes with any emission
+        are lights for the cpu renderer (see LightList.h) */
+    vec3f              emission         { 0.f };
+  };
+
+  struct QuadLight {
+    vec3f origin, du, dv, power;
+  };
+  
+  struct Texture {
+    ~Texture()
+    { if (pixel) delete[] pixel; }
+    
+    uint32_t *pixel      { nullptr };
+    vec2i     resolution { -1 };
+  };
+  
+  struct Model {
+    ~Model()
+    {
+      for (auto mesh : meshes) delete mesh;
+      for (auto texture : textures) delete texture;
+    }
+    
+    std::vector<TriangleMesh *> meshes;
+    std::vector<Texture *>      textures;
+    //! bounding box of all vertices in the model
+    box3f bounds;
+  };
+
+  Model *loadOBJ(const std::string &objFile);
+
+  /*! loads a ply file, as a model with a single mesh (and, since ply
+      has no materials, the default material). Binary little-endian
+      files whose faces are plain index lists get read straight out
+      of the memory-mapped file; everything else goes through the ply
+      library */
+  Model *loadPLY(const std::string &plyFile);
+
+  /*! bakes the given (eg, instance) transform into a mesh: vertices
+      get transformed as points, and normals - if any - with the
+      inverse transpose, and re-normalized */
+  void transformMesh(TriangleMesh *mesh, const affine3f &xfm);
+
+  /*! replaces the mesh's vertex data with a QuantizedMesh, and frees
+      the original arrays. This is lossy (see the error bounds in
+      QuantizedMesh), and only the cpu renderer (through the
+      TriangleMesh accessors) can render quantized meshes */
+  void quantizeMesh(TriangleMesh *mesh);
+
+  /*! quantizes all meshes of the model, in parallel */
+  void quantizeModel(Model *model);
+}
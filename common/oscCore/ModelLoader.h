@@ -0,0 +1,71 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* the individual stages of loadOBJ(), for code that wants to run (or
+   time) them separately - the benchmarks, for example. Everybody
+   else should just use loadOBJ() from Model.h */
+#include "Model.h"
+#include "3rdParty/tiny_obj_loader.h"
+#include <map>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! an obj file as tinyobj parsed it */
+  struct OBJData {
+    tinyobj::attrib_t                attributes;
+    std::vector<tinyobj::shape_t>    shapes;
+    std::vector<tinyobj::material_t> materials;
+    /*! directory of the obj file, that textures are relative to */
+    std::string                      modelDir;
+  };
+
+  /*! stage 1: parse the obj (and mtl) file; throws on error */
+  void parseOBJ(const std::string &objFile, OBJData &obj);
+
+  /*! stage 2: create one mesh per shape and material, with vertices
+      de-duplicated across the faces that share them; loads (and
+      decodes) all textures the materials reference */
+  void buildMeshes(Model *model, const OBJData &obj);
+
+  /*! stage 3: the model's bounding box */
+  void computeBounds(Model *model);
+
+  /*! the fast path of loadPLY(), for binary little-endian files:
+      the vertex and face blocks get copied out of the memory-mapped
+      file without any parsing. Returns false (leaving the mesh
+      alone) if the file is not one it can handle, and throws if the
+      file is broken */
+  bool loadPLYBinary(const std::string &plyFile, TriangleMesh &mesh);
+
+  /*! the general path of loadPLY(), through greg turk's ply library
+      and its property callbacks; handles ascii and big-endian files,
+      and any vertex property types. Note the library itself exits
+      the process on a truncated file */
+  void loadPLYGeneric(const std::string &plyFile, TriangleMesh &mesh);
+
+  /*! decodes an image file (png, jpg, ...) that is already in memory
+      into a texture; returns nullptr if that fails */
+  Texture *decodeTexture(const void *fileData, size_t fileSize);
+
+  /*! creates a texture from top-down rgba8 pixels (what image decoders
+      produce), flipping it so that row 0 is the bottom row - which is
+      what the models' texture coordinates expect */
+  Texture *createTexture(const uint32_t *topDownPixels, const vec2i &resolution);
+
+} // ::osc
@@ -0,0 +1,446 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "ModelLoader.h"
+#include "MappedFile.h"
+#include "3rdParty/ply.h"
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  // ------------------------------------------------------------------
+  // fast path: binary little-endian files, straight from the mapped
+  // file
+  // ------------------------------------------------------------------
+
+  /*! the parts of a ply header that the fast path needs; types are
+      the PLY_CHAR..PLY_DOUBLE of ply.h */
+  struct PLYProperty {
+    std::string name;
+    int         type      { 0 };
+    bool        isList    { false };
+    int         countType { 0 };
+  };
+
+  struct PLYElement {
+    std::string              name;
+    size_t                   count { 0 };
+    std::vector<PLYProperty> properties;
+  };
+
+  struct PLYHeader {
+    std::string             format;
+    std::vector<PLYElement> elements;
+    /*! where the data after 'end_header' starts */
+    size_t                  dataOffset { 0 };
+  };
+
+  static int plyType(const std::string &name)
+  {
+    static const char *names[][2] = {
+      { "char",  "int8"    }, { "short",  "int16"  }, { "int",   "int32"   },
+      { "uchar", "uint8"   }, { "ushort", "uint16" }, { "uint",  "uint32"  },
+      { "float", "float32" }, { "double", "float64" }
+    };
+    for (int i=0;i<8;i++)
+      if (name == names[i][0] || name == names[i][1]) return PLY_CHAR+i;
+    return 0;
+  }
+
+  static size_t plyTypeSize(int type)
+  {
+    static const size_t size[PLY_END_TYPE] = { 0, 1, 2, 4, 1, 2, 4, 4, 8 };
+    return type > PLY_START_TYPE && type < PLY_END_TYPE ? size[type] : 0;
+  }
+
+  static bool plyTypeIsInteger(int type)
+  {
+    return type >= PLY_CHAR && type <= PLY_UINT;
+  }
+
+  /*! returns false if this does not look like a (complete) ply
+      header */
+  static bool parsePLYHeader(const uint8_t *data, size_t size, PLYHeader &header)
+  {
+    size_t pos = 0;
+    bool first = true;
+    while (pos < size) {
+      const uint8_t *eol = (const uint8_t *)memchr(data+pos,'\n',size-pos);
+      if (!eol) return false;
+      std::string line((const char *)data+pos,eol-(data+pos));
+      pos = eol-data+1;
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+
+      std::istringstream words(line);
+      std::string keyword;
+      words >> keyword;
+      if (first) {
+        if (keyword != "ply") return false;
+        first = false;
+      } else if (keyword == "format") {
+        words >> header.format;
+      } else if (keyword == "element") {
+        PLYElement element;
+        words >> element.name >> element.count;
+        header.elements.push_back(element);
+      } else if (keyword == "property") {
+        if (header.elements.empty()) return false;
+        PLYProperty property;
+        std::string type;
+        words >> type;
+        if (type == "list") {
+          property.isList = true;
+          words >> type;
+          property.countType = plyType(type);
+          words >> type;
+        }
+        property.type = plyType(type);
+        words >> property.name;
+        if (!property.type || (property.isList && !property.countType)) return false;
+        header.elements.back().properties.push_back(property);
+      } else if (keyword == "end_header") {
+        header.dataOffset = pos;
+        return true;
+      }
+      // (anything else - comments, obj_info - we do not care about)
+    }
+    return false;
+  }
+
+  /*! byte offset of the named property in the element's (fixed-size)
+      records, if it is there, and a float */
+  static bool floatOffset(const PLYElement &element, const char *name, size_t &offset)
+  {
+    size_t o = 0;
+    for (auto &property : element.properties) {
+      if (property.name == name) {
+        offset = o;
+        return property.type == PLY_FLOAT;
+      }
+      o += plyTypeSize(property.type);
+    }
+    return false;
+  }
+
+  static uint32_t readCount(const uint8_t *ptr, int type)
+  {
+    switch (plyTypeSize(type)) {
+    case 1: return *ptr;
+    case 2: { uint16_t c; memcpy(&c,ptr,2); return c; }
+    default: { uint32_t c; memcpy(&c,ptr,4); return c; }
+    }
+  }
+
+  static void truncated(const std::string &plyFile)
+  {
+    throw std::runtime_error("ply file '"+plyFile+"' is truncated");
+  }
+
+  /*! the vertex element's positions, and normals and texcoords if it
+      has them (as floats) */
+  static bool readPLYVertices(const PLYElement &element, const uint8_t *ptr, size_t stride,
+                              std::vector<vec3f> &vertex,
+                              std::vector<vec3f> &normal,
+                              std::vector<vec2f> &texcoord)
+  {
+    size_t ox, oy, oz;
+    if (!floatOffset(element,"x",ox) || !floatOffset(element,"y",oy) || !floatOffset(element,"z",oz))
+      return false;
+    vertex.resize(element.count);
+    if (stride == sizeof(vec3f) && ox == 0 && oy == 4 && oz == 8)
+      // nothing but positions: one bulk copy
+      memcpy(&vertex[0].x,ptr,element.count*sizeof(vec3f));
+    else
+      for (size_t i=0;i<element.count;i++) {
+        const uint8_t *v = ptr+i*stride;
+        memcpy(&vertex[i].x,v+ox,4);
+        memcpy(&vertex[i].y,v+oy,4);
+        memcpy(&vertex[i].z,v+oz,4);
+      }
+
+    size_t onx, ony, onz;
+    if (floatOffset(element,"nx",onx) && floatOffset(element,"ny",ony) && floatOffset(element,"nz",onz)) {
+      normal.resize(element.count);
+      for (size_t i=0;i<element.count;i++) {
+        const uint8_t *v = ptr+i*stride;
+        memcpy(&normal[i].x,v+onx,4);
+        memcpy(&normal[i].y,v+ony,4);
+        memcpy(&normal[i].z,v+onz,4);
+      }
+    }
+
+    static const char *texcoordNames[][2] = {
+      { "u", "v" }, { "s", "t" }, { "texture_u", "texture_v" }, { "texture_s", "texture_t" }
+    };
+    for (auto &names : texcoordNames) {
+      size_t ou, ov;
+      if (!floatOffset(element,names[0],ou) || !floatOffset(element,names[1],ov)) continue;
+      texcoord.resize(element.count);
+      for (size_t i=0;i<element.count;i++) {
+        const uint8_t *v = ptr+i*stride;
+        memcpy(&texcoord[i].x,v+ou,4);
+        memcpy(&texcoord[i].y,v+ov,4);
+      }
+      break;
+    }
+    return true;
+  }
+
+  /*! the face element's vertex index lists, triangulated as fans;
+      returns false if the element has a layout we do not handle
+      here, and throws on a broken file. On success, 'ptr' points
+      past the element */
+  static bool readPLYFaces(const std::string &plyFile,
+                           const PLYElement &element,
+                           const uint8_t *&ptr, const uint8_t *end,
+                           size_t numVertices,
+                           std::vector<vec3i> &index)
+  {
+    // the index list, and the (scalar) properties before and after
+    // it, which we skip
+    int list = -1;
+    size_t before = 0, after = 0;
+    for (int i=0;i<(int)element.properties.size();i++) {
+      const PLYProperty &property = element.properties[i];
+      if (property.name == "vertex_indices" || property.name == "vertex_index") {
+        // (32-bit integer indices only; the reader below would take
+        // the bits of, say, floats for indices)
+        if (list >= 0 || !property.isList || plyTypeSize(property.type) != 4
+            || !plyTypeIsInteger(property.type) || !plyTypeIsInteger(property.countType))
+          return false;
+        list = i;
+      } else if (property.isList) {
+        return false;
+      } else {
+        (list < 0 ? before : after) += plyTypeSize(property.type);
+      }
+    }
+    if (list < 0) return false;
+    const int    countType = element.properties[list].countType;
+    const size_t countSize = plyTypeSize(countType);
+
+    index.reserve(element.count);
+    for (size_t f=0;f<element.count;f++) {
+      if (size_t(end-ptr) < before+countSize) truncated(plyFile);
+      ptr += before;
+      const uint32_t n = readCount(ptr,countType);
+      ptr += countSize;
+      if (size_t(end-ptr) < size_t(n)*4+after) truncated(plyFile);
+      if (n == 3) {
+        vec3i tri;
+        memcpy(&tri.x,ptr,sizeof(tri));
+        index.push_back(tri);
+      } else
+        for (uint32_t k=1;k+1<n;k++) {
+          vec3i tri;
+          memcpy(&tri.x,ptr,4);
+          memcpy(&tri.y,ptr+4*k,4);
+          memcpy(&tri.z,ptr+4*k+4,4);
+          index.push_back(tri);
+        }
+      ptr += size_t(n)*4+after;
+    }
+    // (unsigned, so negative indices are out of range, too)
+    for (auto &tri : index)
+      if (uint32_t(tri.x) >= numVertices || uint32_t(tri.y) >= numVertices
+          || uint32_t(tri.z) >= numVertices)
+        throw std::runtime_error("ply file '"+plyFile+"' has out-of-range vertex indices");
+    return true;
+  }
+
+  bool loadPLYBinary(const std::string &plyFile, TriangleMesh &mesh)
+  {
+    // (we copy the file's little-endian data as is)
+    const uint32_t one = 1;
+    if (*(const uint8_t *)&one != 1) return false;
+
+    MappedFile file(plyFile);
+    PLYHeader header;
+    if (!parsePLYHeader(file.data(),file.size(),header)
+        || header.format != "binary_little_endian")
+      return false;
+
+    const uint8_t *ptr = file.data()+header.dataOffset;
+    const uint8_t *end = file.data()+file.size();
+    std::vector<vec3f> vertex, normal;
+    std::vector<vec2f> texcoord;
+    std::vector<vec3i> index;
+    bool haveVertices = false, haveFaces = false;
+    for (auto &element : header.elements) {
+      if (haveVertices && haveFaces) break;
+      if (element.name == "face") {
+        if (!haveVertices
+            || !readPLYFaces(plyFile,element,ptr,end,vertex.size(),index))
+          return false;
+        haveFaces = true;
+        continue;
+      }
+      // anything else has to have fixed-size records, for us to know
+      // where it ends
+      size_t stride = 0;
+      for (auto &property : element.properties) {
+        if (property.isList) return false;
+        stride += plyTypeSize(property.type);
+      }
+      if (size_t(end-ptr)/std::max(stride,size_t(1)) < element.count) truncated(plyFile);
+      if (element.name == "vertex") {
+        if (!readPLYVertices(element,ptr,stride,vertex,normal,texcoord))
+          return false;
+        haveVertices = true;
+      }
+      ptr += element.count*stride;
+    }
+    if (!haveVertices) return false;
+
+    mesh.vertex.swap(vertex);
+    mesh.normal.swap(normal);
+    mesh.texcoord.swap(texcoord);
+    mesh.index.swap(index);
+    return true;
+  }
+
+  // ------------------------------------------------------------------
+  // general path, through the ply library
+  // ------------------------------------------------------------------
+
+  /*! what we have the ply library store for each vertex and face */
+  struct PLYVertex {
+    float x, y, z;
+    float nx, ny, nz;
+    float u, v;
+  };
+
+  struct PLYFace {
+    unsigned char numVertices;
+    int          *vertices;
+  };
+
+  void loadPLYGeneric(const std::string &plyFile, TriangleMesh &mesh)
+  {
+    FILE *fp = fopen(plyFile.c_str(),"rb");
+    if (!fp)
+      throw std::runtime_error("could not open ply file '"+plyFile+"'");
+    int numElements;
+    char **elementNames;
+    PlyFile *ply = ply_read(fp,&numElements,&elementNames);
+    if (!ply) {
+      fclose(fp);
+      throw std::runtime_error("'"+plyFile+"' is not a ply file");
+    }
+
+    std::vector<vec3f> vertex, normal;
+    std::vector<vec2f> texcoord;
+    std::vector<vec3i> index;
+    bool haveVertices = false, haveFaces = false;
+    for (int e=0;e<numElements && !(haveVertices && haveFaces);e++) {
+      char *name = elementNames[e];
+      int count, numProperties;
+      PlyProperty **properties
+        = ply_get_element_description(ply,name,&count,&numProperties);
+      auto has = [&](const char *propertyName) {
+        for (int i=0;i<numProperties;i++)
+          if (equal_strings(properties[i]->name,propertyName)) return true;
+        return false;
+      };
+      auto request = [&](const char *propertyName, size_t offset) {
+        PlyProperty property = { (char *)propertyName, PLY_FLOAT, PLY_FLOAT, int(offset), 0, 0, 0, 0 };
+        ply_get_property(ply,name,&property);
+      };
+
+      if (equal_strings(name,"vertex")) {
+        if (!has("x") || !has("y") || !has("z")) break;
+        request("x",offsetof(PLYVertex,x));
+        request("y",offsetof(PLYVertex,y));
+        request("z",offsetof(PLYVertex,z));
+        const bool hasNormals = has("nx") && has("ny") && has("nz");
+        if (hasNormals) {
+          request("nx",offsetof(PLYVertex,nx));
+          request("ny",offsetof(PLYVertex,ny));
+          request("nz",offsetof(PLYVertex,nz));
+        }
+        static const char *texcoordNames[][2] = {
+          { "u", "v" }, { "s", "t" }, { "texture_u", "texture_v" }, { "texture_s", "texture_t" }
+        };
+        bool hasTexcoords = false;
+        for (auto &names : texcoordNames)
+          if (has(names[0]) && has(names[1])) {
+            request(names[0],offsetof(PLYVertex,u));
+            request(names[1],offsetof(PLYVertex,v));
+            hasTexcoords = true;
+            break;
+          }
+        for (int i=0;i<count;i++) {
+          PLYVertex v;
+          ply_get_element(ply,&v);
+          vertex.push_back(vec3f(v.x,v.y,v.z));
+          if (hasNormals)   normal.push_back(vec3f(v.nx,v.ny,v.nz));
+          if (hasTexcoords) texcoord.push_back(vec2f(v.u,v.v));
+        }
+        haveVertices = true;
+      } else if (equal_strings(name,"face")) {
+        const char *listName
+          = has("vertex_indices") ? "vertex_indices"
+          : has("vertex_index")   ? "vertex_index"
+          : nullptr;
+        if (!listName) break;
+        PlyProperty list = { (char *)listName, PLY_INT, PLY_INT, offsetof(PLYFace,vertices),
+                             1, PLY_UCHAR, PLY_UCHAR, offsetof(PLYFace,numVertices) };
+        ply_get_property(ply,name,&list);
+        for (int i=0;i<count;i++) {
+          PLYFace face;
+          ply_get_element(ply,&face);
+          for (int k=1;k+1<face.numVertices;k++)
+            index.push_back(vec3i(face.vertices[0],face.vertices[k],face.vertices[k+1]));
+          free(face.vertices);
+        }
+        haveFaces = true;
+      } else {
+        // not interested, but still have to read past it
+        ply_get_other_element(ply,name,count);
+      }
+    }
+    ply_close(ply);
+
+    if (!haveVertices)
+      throw std::runtime_error("ply file '"+plyFile+"' has no vertex positions");
+    for (auto &tri : index)
+      if (uint32_t(tri.x) >= vertex.size() || uint32_t(tri.y) >= vertex.size()
+          || uint32_t(tri.z) >= vertex.size())
+        throw std::runtime_error("ply file '"+plyFile+"' has out-of-range vertex indices");
+    mesh.vertex.swap(vertex);
+    mesh.normal.swap(normal);
+    mesh.texcoord.swap(texcoord);
+    mesh.index.swap(index);
+  }
+
+  Model *loadPLY(const std::string &plyFile)
+  {
+    std::unique_ptr<TriangleMesh> mesh(new TriangleMesh);
+    if (!loadPLYBinary(plyFile,*mesh))
+      loadPLYGeneric(plyFile,*mesh);
+    Model *model = new Model;
+    model->meshes.push_back(mesh.release());
+    computeBounds(model);
+    return model;
+  }
+
+} // ::osc
@@ -0,0 +1,386 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const char sceneCacheMagic[8] = { 'o','s','c','s','c','e','n','e' };
+
+  /*! the bvh section, which follows the model: each bvh's nodes and
+      primIDs, aligned to this (so they could also get used right
+      where they are mapped - bvhs only hold offsets, no pointers),
+      then a directory of them, and finally the offset of that
+      directory, as the last eight bytes of the file */
+  #define SCENE_CACHE_BVH_ALIGNMENT 64
+
+  struct BVHDirectoryEntry {
+    uint64_t key;
+    uint64_t nodesOffset,   numNodes;
+    uint64_t primIDsOffset, numPrimIDs;
+  };
+
+  static_assert(sizeof(BVHNode) == 32,
+                "the scene cache stores bvh nodes as they are in memory; "
+                "bump OSC_SCENE_CACHE_VERSION when changing them");
+
+  /*! plain writes of trivially copyable values and arrays of them */
+  class CacheWriter {
+  public:
+    CacheWriter(const std::string &fileName)
+      : fileName(fileName),
+        out(fileName,std::ios::binary)
+    {
+      if (!out)
+        throw std::runtime_error("could not create scene cache '"+fileName+"'");
+    }
+
+    void write(const void *data, size_t bytes)
+    {
+      out.write((const char *)data,bytes);
+      if (!out)
+        throw std::runtime_error("error writing scene cache '"+fileName+"'");
+    }
+
+    template<typename T>
+    void write(const T &t) { write(&t,sizeof(t)); }
+
+    uint64_t tell() { return uint64_t(out.tellp()); }
+
+    /*! pads with zeros, up to the next multiple of 'alignment' */
+    void align(size_t alignment)
+    {
+      static const char zeros[SCENE_CACHE_BVH_ALIGNMENT] = { 0 };
+      write(zeros,size_t((alignment-tell()%alignment)%alignment));
+    }
+
+    template<typename T>
+    void write(const std::vector<T> &v)
+    {
+      write(uint64_t(v.size()));
+      write(v.data(),v.size()*sizeof(T));
+    }
+
+  private:
+    const std::string fileName;
+    std::ofstream     out;
+  };
+
+  /*! the reading counterpart of CacheWriter; every read checks that
+      the file actually had that many bytes left */
+  class CacheReader {
+  public:
+    CacheReader(const std::string &fileName)
+      : fileName(fileName),
+        in(fileName,std::ios::binary)
+    {
+      if (!in)
+        throw std::runtime_error("could not open scene cache '"+fileName+"'");
+    }
+
+    void read(void *data, size_t bytes)
+    {
+      in.read((char *)data,bytes);
+      if (size_t(in.gcount()) != bytes)
+        throw std::runtime_error("scene cache '"+fileName+"' is truncated");
+    }
+
+    template<typename T>
+    void read(T &t) { read(&t,sizeof(t)); }
+
+    template<typename T>
+    void read(std::vector<T> &v)
+    {
+      uint64_t size;
+      read(size);
+      v.resize(size);
+      read(v.data(),size*sizeof(T));
+    }
+
+  private:
+    const std::string fileName;
+    std::ifstream     in;
+  };
+
+  static void writeMesh(CacheWriter &out, const TriangleMesh &mesh)
+  {
+    out.write(mesh.vertex);
+    out.write(mesh.normal);
+    out.write(mesh.texcoord);
+    out.write(mesh.index);
+
+    const QuantizedMesh &q = mesh.quantized;
+    out.write(q.bounds);
+    out.write(q.vertexScale);
+    out.write(q.texcoordBounds);
+    out.write(q.texcoordScale);
+    out.write(q.vertex);
+    out.write(q.normal);
+    out.write(q.texcoord);
+    out.write(q.index);
+
+    out.write(mesh.diffuse);
+    out.write(int32_t(mesh.diffuseTextureID));
+    out.write(mesh.emission);
+
+    out.write(uint32_t(mesh.lods.size()));
+    for (auto &lod : mesh.lods) {
+      out.write(lod.error);
+      out.write(lod.index);
+    }
+  }
+
+  static void readMesh(CacheReader &in, TriangleMesh &mesh)
+  {
+    in.read(mesh.vertex);
+    in.read(mesh.normal);
+    in.read(mesh.texcoord);
+    in.read(mesh.index);
+
+    QuantizedMesh &q = mesh.quantized;
+    in.read(q.bounds);
+    in.read(q.vertexScale);
+    in.read(q.texcoordBounds);
+    in.read(q.texcoordScale);
+    in.read(q.vertex);
+    in.read(q.normal);
+    in.read(q.texcoord);
+    in.read(q.index);
+
+    in.read(mesh.diffuse);
+    int32_t textureID;
+    in.read(textureID);
+    mesh.diffuseTextureID = textureID;
+    in.read(mesh.emission);
+
+    uint32_t numLODs;
+    in.read(numLODs);
+    mesh.lods.resize(numLODs);
+    for (auto &lod : mesh.lods) {
+      in.read(lod.error);
+      in.read(lod.index);
+    }
+  }
+
+  /*! true if all of the index buffer's indices are in [0,numVertices) */
+  template<typename Index>
+  static bool indicesInRange(const std::vector<Index> &index, size_t numVertices)
+  {
+    for (auto &i : index)
+      if (i.x < 0 || size_t(i.x) >= numVertices
+          || i.y < 0 || size_t(i.y) >= numVertices
+          || i.z < 0 || size_t(i.z) >= numVertices)
+        return false;
+    return true;
+  }
+
+  /*! true if everything that getIndex() can return is a valid
+      vertex for getVertex() (and getNormal() and getTexcoord(), if
+      the mesh has those) - which is all that a file of the right
+      size but with damaged or stale contents could get wrong */
+  static bool meshIsConsistent(const TriangleMesh &mesh)
+  {
+    const QuantizedMesh &q = mesh.quantized;
+    const size_t numVertices = mesh.isQuantized() ? q.vertex.size() : mesh.vertex.size();
+    const size_t numNormals   = mesh.isQuantized() ? q.normal.size()   : mesh.normal.size();
+    const size_t numTexcoords = mesh.isQuantized() ? q.texcoord.size() : mesh.texcoord.size();
+    if ((numNormals && numNormals < numVertices)
+        || (numTexcoords && numTexcoords < numVertices))
+      return false;
+    if (!indicesInRange(mesh.index,numVertices) || !indicesInRange(q.index,numVertices))
+      return false;
+    for (auto &lod : mesh.lods)
+      if (!indicesInRange(lod.index,numVertices))
+        return false;
+    return true;
+  }
+
+  static void checkVersion(const std::string &fileName,
+                           const char *magic, uint32_t version)
+  {
+    if (memcmp(magic,sceneCacheMagic,sizeof(sceneCacheMagic)))
+      throw std::runtime_error("'"+fileName+"' is not a scene cache");
+    if (version != OSC_SCENE_CACHE_VERSION)
+      throw std::runtime_error("scene cache '"+fileName+"' is of version "
+                               +std::to_string(version)+", expected "
+                               +std::to_string(OSC_SCENE_CACHE_VERSION));
+  }
+
+  void saveSceneCache(const Model *model, const std::string &fileName,
+                      const std::vector<CachedBVH> &bvhs)
+  {
+    CacheWriter out(fileName);
+    out.write(sceneCacheMagic,sizeof(sceneCacheMagic));
+    out.write(uint32_t(OSC_SCENE_CACHE_VERSION));
+    out.write(model->bounds);
+
+    out.write(uint64_t(model->meshes.size()));
+    for (auto mesh : model->meshes)
+      writeMesh(out,*mesh);
+
+    out.write(uint64_t(model->textures.size()));
+    for (auto texture : model->textures) {
+      const vec2i res = texture->pixel ? texture->resolution : vec2i(-1);
+      out.write(res);
+      if (texture->pixel)
+        out.write(texture->pixel,size_t(res.x)*res.y*sizeof(uint32_t));
+    }
+
+    std::vector<BVHDirectoryEntry> directory;
+    for (auto &cached : bvhs) {
+      const BVH &bvh = *cached.bvh;
+      BVHDirectoryEntry entry;
+      entry.key = cached.key;
+      out.align(SCENE_CACHE_BVH_ALIGNMENT);
+      entry.nodesOffset = out.tell();
+      entry.numNodes    = bvh.nodes.size();
+      out.write(bvh.nodes.data(),bvh.nodes.size()*sizeof(BVHNode));
+      out.align(SCENE_CACHE_BVH_ALIGNMENT);
+      entry.primIDsOffset = out.tell();
+      entry.numPrimIDs    = bvh.primIDs.size();
+      out.write(bvh.primIDs.data(),bvh.primIDs.size()*sizeof(uint32_t));
+      directory.push_back(entry);
+    }
+    const uint64_t directoryOffset = out.tell();
+    out.write(directory);
+    out.write(directoryOffset);
+  }
+
+  Model *loadSceneCache(const std::string &fileName)
+  {
+    CacheReader in(fileName);
+    char magic[sizeof(sceneCacheMagic)];
+    in.read(magic,sizeof(magic));
+    uint32_t version;
+    in.read(version);
+    checkVersion(fileName,magic,version);
+
+    std::unique_ptr<Model> model(new Model);
+    in.read(model->bounds);
+
+    // (the sizes of the arrays get checked against the file while
+    // reading them; what they contain only gets checked here)
+    const std::runtime_error corrupt("scene cache '"+fileName+"' is corrupt");
+    uint64_t numMeshes;
+    in.read(numMeshes);
+    for (uint64_t i=0;i<numMeshes;i++) {
+      model->meshes.push_back(new TriangleMesh);
+      readMesh(in,*model->meshes.back());
+      if (!meshIsConsistent(*model->meshes.back()))
+        throw corrupt;
+    }
+
+    uint64_t numTextures;
+    in.read(numTextures);
+    for (uint64_t i=0;i<numTextures;i++) {
+      model->textures.push_back(new Texture);
+      Texture *texture = model->textures.back();
+      in.read(texture->resolution);
+      if (texture->resolution.x > 0 && texture->resolution.y > 0) {
+        const size_t numPixels = size_t(texture->resolution.x)*texture->resolution.y;
+        texture->pixel = new uint32_t[numPixels];
+        in.read(texture->pixel,numPixels*sizeof(uint32_t));
+      }
+    }
+    for (auto mesh : model->meshes)
+      if (mesh->diffuseTextureID < -1
+          || mesh->diffuseTextureID >= int64_t(model->textures.size()))
+        throw corrupt;
+    return model.release();
+  }
+
+  bool loadSceneCacheBVH(const std::string &fileName, uint64_t key, BVH &bvh)
+  {
+    MappedFile file(fileName);
+    const uint8_t *data = file.data();
+    const size_t   size = file.size();
+    const size_t headerSize = sizeof(sceneCacheMagic)+sizeof(uint32_t);
+    if (size < headerSize+2*sizeof(uint64_t))
+      throw std::runtime_error("scene cache '"+fileName+"' is truncated");
+    uint32_t version;
+    memcpy(&version,data+sizeof(sceneCacheMagic),sizeof(version));
+    checkVersion(fileName,(const char *)data,version);
+
+    // (everything from here on gets checked against the file size,
+    // so a damaged file throws rather than reading out of bounds)
+    const std::runtime_error corrupt("scene cache '"+fileName+"' is corrupt");
+    uint64_t directoryOffset, numEntries;
+    memcpy(&directoryOffset,data+size-sizeof(uint64_t),sizeof(uint64_t));
+    const uint64_t directoryEnd = size-sizeof(uint64_t);
+    if (directoryOffset < headerSize || directoryOffset+sizeof(uint64_t) > directoryEnd)
+      throw corrupt;
+    memcpy(&numEntries,data+directoryOffset,sizeof(uint64_t));
+    const uint64_t entriesOffset = directoryOffset+sizeof(uint64_t);
+    if (numEntries > (directoryEnd-entriesOffset)/sizeof(BVHDirectoryEntry))
+      throw corrupt;
+
+    for (uint64_t i=0;i<numEntries;i++) {
+      BVHDirectoryEntry entry;
+      memcpy(&entry,data+entriesOffset+i*sizeof(entry),sizeof(entry));
+      if (entry.key != key) continue;
+      if (entry.nodesOffset   > directoryOffset
+          || entry.numNodes   > (directoryOffset-entry.nodesOffset)/sizeof(BVHNode)
+          || entry.primIDsOffset > directoryOffset
+          || entry.numPrimIDs > (directoryOffset-entry.primIDsOffset)/sizeof(uint32_t))
+        throw corrupt;
+      const BVHNode  *nodes   = (const BVHNode *)(data+entry.nodesOffset);
+      const uint32_t *primIDs = (const uint32_t *)(data+entry.primIDsOffset);
+      bvh.nodes.assign(nodes,nodes+entry.numNodes);
+      bvh.primIDs.assign(primIDs,primIDs+entry.numPrimIDs);
+      return true;
+    }
+    return false;
+  }
+
+  /*! splitmix64's finalizer */
+  static inline uint64_t mix64(uint64_t h)
+  {
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27; h *= 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+  }
+
+  uint64_t hashBytes(const void *data, size_t bytes, uint64_t seed)
+  {
+    // four independent lanes of eight-byte words, so the multiplies
+    // of one lane do not have to wait for those of the others
+    const uint64_t prime = 0x9e3779b97f4a7c15ull;
+    uint64_t lane[4] = { seed, seed+prime, seed+2*prime, seed+3*prime };
+    const uint8_t *in = (const uint8_t *)data;
+    size_t i = 0;
+    for (;i+32<=bytes;i+=32)
+      for (int l=0;l<4;l++) {
+        uint64_t word;
+        memcpy(&word,in+i+8*l,sizeof(word));
+        lane[l] = (lane[l]^word)*prime;
+        lane[l] ^= lane[l] >> 29;
+      }
+    uint64_t tail[4] = { 0, 0, 0, 0 };
+    if (bytes > i) memcpy(tail,in+i,bytes-i);
+    uint64_t h = mix64(bytes);
+    for (int l=0;l<4;l++)
+      h = mix64(h ^ lane[l] ^ mix64(tail[l]+l));
+    return h;
+  }
+
+} // ::osc
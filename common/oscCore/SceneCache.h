@@ -0,0 +1,66 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+/* a binary cache of a model: everything loadOBJ() produced -
+   meshes, textures, bounds - plus whatever got computed on top of
+   that afterwards and is expensive to recompute, such as levels of
+   detail, or quantized vertex data. Reading it back is little more
+   than a few large reads, rather than parsing text and decoding
+   images. The format is native-endian, and versioned: a file of any
+   other version simply does not load, and has to be re-created.
+
+   A cache can also hold bvhs built over the model, each under a key
+   that says what exactly it got built over, and how (see
+   CPUScene::bvhCacheKey()). Those get looked up through a memory
+   mapping of the file, so a warm start only reads the one bvh it
+   asked for */
+#include "Model.h"
+#include "BVH.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! bump whenever the layout of the file changes */
+  #define OSC_SCENE_CACHE_VERSION 3
+
+  /*! a bvh to store along with the model, under given key */
+  struct CachedBVH {
+    uint64_t   key;
+    const BVH *bvh;
+  };
+
+  /*! writes the model (and given bvhs) to given file; throws on
+      error */
+  void saveSceneCache(const Model *model, const std::string &fileName,
+                      const std::vector<CachedBVH> &bvhs = std::vector<CachedBVH>());
+
+  /*! reads a model that saveSceneCache() wrote; throws if the file
+      cannot be read, is not a scene cache, is of another version,
+      or holds meshes with indices outside their vertex arrays */
+  Model *loadSceneCache(const std::string &fileName);
+
+  /*! reads the bvh of given key from a scene cache; returns false if
+      the cache has no such bvh. Throws like loadSceneCache() */
+  bool loadSceneCacheBVH(const std::string &fileName, uint64_t key, BVH &bvh);
+
+  /*! a fast, non-cryptographic 64-bit hash, for keying cached data
+      by what it got computed from; chain calls through 'seed' */
+  uint64_t hashBytes(const void *data, size_t bytes, uint64_t seed = 0);
+
+} // ::osc
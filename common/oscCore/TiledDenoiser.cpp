@@ -0,0 +1,155 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "TiledDenoiser.h"
+#include "gdt/parallel/parallel_for.h"
+#include <atomic>
+#include <string.h>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  size_t TiledDenoiser::slotMemory(const FrameFormat &format,
+                                   const vec2i &paddedSize) const
+  {
+    const size_t numPixels = size_t(paddedSize.x)*paddedSize.y;
+    return numPixels * (bytesPerPixel(format.color)
+                        + bytesPerPixel(format.normal)
+                        + bytesPerPixel(format.albedo)
+                        + bytesPerPixel(format.color)
+                        + CPUDenoiser::scratchBytesPerPixel());
+  }
+
+  /*! copies the rectangle [begin,begin+size) of one layer to the
+      (dense) layer 'dst' */
+  static void copyRect(uint8_t *dst, const uint8_t *src,
+                       const size_t bytesPerPixel,
+                       const int srcWidth,
+                       const vec2i &begin, const vec2i &size)
+  {
+    for (int y=0;y<size.y;y++)
+      memcpy(dst + size_t(y)*size.x*bytesPerPixel,
+             src + (size_t(begin.y+y)*srcWidth + begin.x)*bytesPerPixel,
+             size.x*bytesPerPixel);
+  }
+
+  void TiledDenoiser::denoiseTile(Slot &slot, const FrameBuffer &fb, void *output,
+                                  const vec2i &numTiles, int overlap, size_t tileID)
+  {
+    const FrameFormat &format = fb.format;
+    const vec2i tileIdx(int(tileID % numTiles.x), int(tileID / numTiles.x));
+    const vec2i coreBegin = tileIdx*tileSize;
+    const vec2i coreEnd   = min(coreBegin+tileSize,fb.size);
+    const vec2i padBegin  = max(coreBegin-vec2i(overlap),vec2i(0));
+    const vec2i padEnd    = min(coreEnd+vec2i(overlap),fb.size);
+    const vec2i padSize   = padEnd-padBegin;
+
+    // gather the padded input tile, in the frame buffer's format
+    slot.tile.resize(padSize,format);
+    copyRect(slot.tile.color.data(),fb.color.data(),
+             bytesPerPixel(format.color),fb.size.x,padBegin,padSize);
+    copyRect(slot.tile.normal.data(),fb.normal.data(),
+             bytesPerPixel(format.normal),fb.size.x,padBegin,padSize);
+    copyRect(slot.tile.albedo.data(),fb.albedo.data(),
+             bytesPerPixel(format.albedo),fb.size.x,padBegin,padSize);
+
+    resizeWithCapacity(slot.denoised,slot.tile.color.size());
+    slot.denoiser.denoise(slot.tile,slot.denoised.data());
+
+    // scatter the core - cores don't overlap, so no two tiles ever
+    // write the same output pixel
+    const size_t colorBytes = bytesPerPixel(format.color);
+    const vec2i  coreSize   = coreEnd-coreBegin;
+    const vec2i  coreInTile = coreBegin-padBegin;
+    for (int y=0;y<coreSize.y;y++)
+      memcpy((uint8_t*)output
+             + (size_t(coreBegin.y+y)*fb.size.x + coreBegin.x)*colorBytes,
+             slot.denoised.data()
+             + (size_t(coreInTile.y+y)*padSize.x + coreInTile.x)*colorBytes,
+             coreSize.x*colorBytes);
+  }
+
+  void TiledDenoiser::denoise(const FrameBuffer &fb, void *output)
+  {
+    const double t0 = getCurrentTime();
+    if (fb.numPixels() == 0) return;
+    if (tileSize.x <= 0 || tileSize.y <= 0)
+      throw std::runtime_error("TiledDenoiser: invalid tile size");
+
+    const int   overlap  = this->overlap < 0 ? filter.footprintRadius() : this->overlap;
+    const vec2i numTiles = divRoundUp(fb.size,tileSize);
+    const size_t totalTiles = size_t(numTiles.x)*numTiles.y;
+
+    // as many slots as we have threads, tiles, and budget for - but
+    // at least one, even if a single tile exceeds the budget
+    const size_t memoryPerSlot
+      = slotMemory(fb.format,min(tileSize+vec2i(2*overlap),fb.size));
+
+    const int numSlots
+      = (int)std::max(size_t(1),
+                      std::min(std::min(size_t(ThreadPool::get().numThreads()),totalTiles),
+                               memoryBudget/memoryPerSlot));
+
+    if ((int)slots.size() != numSlots)
+      slots.resize(numSlots);
+    // size all slots for the largest tile right away, so tiles of
+    // different sizes don't make them grow past the budget
+    const vec2i  maxPaddedSize   = min(tileSize+vec2i(2*overlap),fb.size);
+    const size_t maxPaddedPixels = size_t(maxPaddedSize.x)*maxPaddedSize.y;
+    for (auto &slot : slots) {
+      slot.tile.resize(maxPaddedSize,fb.format);
+      resizeWithCapacity(slot.denoised,maxPaddedPixels*bytesPerPixel(fb.format.color));
+      slot.denoiser.reserve(maxPaddedPixels);
+      slot.denoiser.numIterations = filter.numIterations;
+      slot.denoiser.sigmaColor    = filter.sigmaColor;
+      slot.denoiser.sigmaNormal   = filter.sigmaNormal;
+      slot.denoiser.sigmaAlbedo   = filter.sigmaAlbedo;
+    }
+
+    if (numSlots == 1) {
+      // no parallelism across tiles - let the denoiser parallelize
+      // within each tile instead
+      for (size_t tileID=0;tileID<totalTiles;tileID++)
+        denoiseTile(slots[0],fb,output,numTiles,overlap,tileID);
+    } else {
+      // every slot is a worker that pulls tiles until none are left;
+      // the denoiser's own parallel_for runs serially inside these
+      std::atomic<size_t> nextTile(0);
+      parallel_for(numSlots,[&](size_t slotID){
+          while (true) {
+            const size_t tileID = nextTile++;
+            if (tileID >= totalTiles) break;
+            denoiseTile(slots[slotID],fb,output,numTiles,overlap,tileID);
+          }
+        });
+    }
+
+    size_t poolMemory = 0;
+    for (auto &slot : slots)
+      poolMemory
+        += slot.tile.color.capacity()
+        +  slot.tile.normal.capacity()
+        +  slot.tile.albedo.capacity()
+        +  slot.denoised.capacity()
+        +  slot.denoiser.scratchMemory();
+
+    stats.numSlots          = numSlots;
+    stats.numTiles          = totalTiles;
+    stats.peakMemoryInBytes = std::max(stats.peakMemoryInBytes,poolMemory);
+    stats.seconds           = getCurrentTime()-t0;
+  }
+
+} // ::osc
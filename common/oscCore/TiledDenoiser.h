@@ -0,0 +1,84 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "CPUDenoiser.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! denoises arbitrarily large frames in a fixed memory budget, by
+      running the CPUDenoiser over overlapping tiles.
+
+      Each tile gets denoised with 'overlap' pixels of context on
+      every side, and only its (non-overlapping) core gets written to
+      the output. As long as the overlap is at least the filter's
+      footprintRadius() - which is the default - every output pixel
+      sees exactly the same neighborhood as in an un-tiled denoise,
+      so the result is identical to that, and there are no seams.
+
+      Tiles stream through a pool of per-worker slots (padded input
+      tile, output tile, and denoiser scratch); the number of slots
+      is limited by both the number of threads and the memory
+      budget */
+  class TiledDenoiser {
+  public:
+    struct Stats {
+      /*! number of pool slots (ie, tiles in flight) of the last run */
+      int    numSlots           = 0;
+      size_t numTiles           = 0;
+      /*! memory held by the pool, at its peak */
+      size_t peakMemoryInBytes  = 0;
+      double seconds            = 0.;
+    };
+    
+    /*! denoise the color layer of 'fb' into 'output' (which must hold
+        fb.numPixels() pixels in fb.format.color, and may not alias
+        fb.color) */
+    void denoise(const FrameBuffer &fb, void *output);
+
+    /*! size of a tile's core, ie, what it contributes to the output */
+    vec2i  tileSize         { 256 };
+    /*! context pixels on each side of a tile; -1 means 'use the
+        denoiser's footprint radius', which gives seam-free results */
+    int    overlap          = -1;
+    /*! upper bound for the memory of the tile pool */
+    size_t memoryBudget     = size_t(256) << 20;
+    /*! filter settings; every pool slot denoises with a copy of this */
+    CPUDenoiser filter;
+
+    Stats  stats;
+
+  private:
+    /*! one slot of the tile pool */
+    struct Slot {
+      FrameBuffer          tile;
+      std::vector<uint8_t> denoised;
+      CPUDenoiser          denoiser;
+    };
+
+    /*! bytes one slot needs for tiles of given (padded) size */
+    size_t slotMemory(const FrameFormat &format, const vec2i &paddedSize) const;
+
+    /*! denoises tile 'tileID' of 'fb', using given slot */
+    void denoiseTile(Slot &slot, const FrameBuffer &fb, void *output,
+                     const vec2i &numTiles, int overlap, size_t tileID);
+
+    std::vector<Slot> slots;
+  };
+
+} // ::osc
@@ -0,0 +1,373 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "ToneMap.h"
+#include "gdt/parallel/parallel_for.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define OSC_TONEMAP_SSE 1
+#  include <emmintrin.h>
+#endif
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! number of pixels each task of the log-luminance reduction
+      works on; fixed, so the summation order (and thus the result)
+      is the same for any number of threads */
+  static const size_t LOG_LUMINANCE_CHUNK_SIZE = 16*1024;
+
+  /*! number of rows each task of the tone mapping pass works on */
+  static const size_t TONE_MAP_ROWS_PER_TASK = 8;
+
+#if OSC_TONEMAP_SSE
+  // ------------------------------------------------------------------
+  // 4-wide helpers. log2/exp2 use the polynomial approximations from
+  // J. Fonseca's "fast sse2 pow"; relative error is well below one
+  // 8-bit lsb over the full [0,1] range we use them for
+  // ------------------------------------------------------------------
+  static inline __m128 poly5(__m128 x,
+                             float c0, float c1, float c2,
+                             float c3, float c4, float c5)
+  {
+    __m128 p = _mm_set1_ps(c5);
+    p = _mm_add_ps(_mm_mul_ps(p,x),_mm_set1_ps(c4));
+    p = _mm_add_ps(_mm_mul_ps(p,x),_mm_set1_ps(c3));
+    p = _mm_add_ps(_mm_mul_ps(p,x),_mm_set1_ps(c2));
+    p = _mm_add_ps(_mm_mul_ps(p,x),_mm_set1_ps(c1));
+    return _mm_add_ps(_mm_mul_ps(p,x),_mm_set1_ps(c0));
+  }
+
+  static inline __m128 log2_4(__m128 x)
+  {
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128  e
+      = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits,23),_mm_set1_epi32(127)));
+    const __m128  m
+      = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits,_mm_set1_epi32(0x007FFFFF)),
+                                      _mm_set1_epi32(0x3F800000)));
+    const __m128 p = poly5(m,
+                           3.1157899f, -3.3241990f, 2.5988452f,
+                           -1.2315303f, 3.1821337e-1f, -3.4436006e-2f);
+    return _mm_add_ps(_mm_mul_ps(p,_mm_sub_ps(m,_mm_set1_ps(1.f))),e);
+  }
+
+  static inline __m128 exp2_4(__m128 x)
+  {
+    x = _mm_min_ps(x,_mm_set1_ps(129.f));
+    x = _mm_max_ps(x,_mm_set1_ps(-126.99999f));
+    const __m128i ipart = _mm_cvtps_epi32(_mm_sub_ps(x,_mm_set1_ps(.5f)));
+    const __m128  fpart = _mm_sub_ps(x,_mm_cvtepi32_ps(ipart));
+    const __m128  expi
+      = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(ipart,_mm_set1_epi32(127)),23));
+    const __m128  expf = poly5(fpart,
+                               9.9999994e-1f, 6.9315308e-1f, 2.4015361e-1f,
+                               5.5826318e-2f, 8.9893397e-3f, 1.8775767e-3f);
+    return _mm_mul_ps(expi,expf);
+  }
+
+  /*! pow for x in [0,1]; returns exactly 0 for x == 0 */
+  static inline __m128 pow4(__m128 x, float e)
+  {
+    const __m128 r = exp2_4(_mm_mul_ps(_mm_set1_ps(e),log2_4(x)));
+    return _mm_and_ps(r,_mm_cmpgt_ps(x,_mm_setzero_ps()));
+  }
+
+  static inline __m128 saturate4(__m128 x)
+  { return _mm_min_ps(_mm_set1_ps(1.f),_mm_max_ps(_mm_setzero_ps(),x)); }
+
+  static inline __m128 filmicCurve4(__m128 x)
+  {
+    const __m128 A = _mm_set1_ps(0.15f), B = _mm_set1_ps(0.50f);
+    const __m128 CB = _mm_set1_ps(0.10f*0.50f), DE = _mm_set1_ps(0.20f*0.02f);
+    const __m128 DF = _mm_set1_ps(0.20f*0.30f), EF = _mm_set1_ps(0.02f/0.30f);
+    const __m128 num = _mm_add_ps(_mm_mul_ps(x,_mm_add_ps(_mm_mul_ps(A,x),CB)),DE);
+    const __m128 den = _mm_add_ps(_mm_mul_ps(x,_mm_add_ps(_mm_mul_ps(A,x),B)),DF);
+    return _mm_sub_ps(_mm_div_ps(num,den),EF);
+  }
+
+  /*! 4-wide version of applyToneCurve() */
+  static inline __m128 applyToneCurve4(const ToneMapParams &params, __m128 x)
+  {
+    const __m128 one = _mm_set1_ps(1.f);
+    x = _mm_max_ps(_mm_setzero_ps(),x);
+    switch (params.op) {
+    case TONE_MAP_REINHARD: {
+      const __m128 rcpW2 = _mm_set1_ps(1.f/(params.whitePoint*params.whitePoint));
+      return _mm_div_ps(_mm_mul_ps(x,_mm_add_ps(one,_mm_mul_ps(x,rcpW2))),
+                        _mm_add_ps(one,x));
+    }
+    case TONE_MAP_ACES: {
+      const __m128 num = _mm_mul_ps(x,_mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f),x),
+                                                 _mm_set1_ps(0.03f)));
+      const __m128 den = _mm_add_ps(_mm_mul_ps(x,_mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f),x),
+                                                            _mm_set1_ps(0.59f))),
+                                    _mm_set1_ps(0.14f));
+      return _mm_div_ps(num,den);
+    }
+    case TONE_MAP_FILMIC:
+      return _mm_mul_ps(filmicCurve4(_mm_add_ps(x,x)),
+                        _mm_set1_ps(1.f/filmicCurve(params.whitePoint)));
+    default:
+      return x;
+    }
+  }
+
+  /*! 4-wide version of applyOutputTransform() */
+  static inline __m128 applyOutputTransform4(const ToneMapParams &params, __m128 x)
+  {
+    x = saturate4(x);
+    switch (params.transfer) {
+    case OUTPUT_GAMMA:
+      return pow4(x,1.f/params.gamma);
+    case OUTPUT_SRGB: {
+      const __m128 lin = _mm_mul_ps(x,_mm_set1_ps(12.92f));
+      const __m128 pw  = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.055f),pow4(x,1.f/2.4f)),
+                                    _mm_set1_ps(0.055f));
+      const __m128 useLinear = _mm_cmple_ps(x,_mm_set1_ps(0.0031308f));
+      return _mm_or_ps(_mm_and_ps(useLinear,lin),_mm_andnot_ps(useLinear,pw));
+    }
+    case OUTPUT_LINEAR:
+      return x;
+    default:
+      return _mm_sqrt_ps(x);
+    }
+  }
+
+  /*! 4-wide version of quantizeTo8Bits(), for four horizontally
+      adjacent pixels starting at (x,y) */
+  static inline __m128i quantize4(const ToneMapParams &params, __m128 v,
+                                  const int x, const int y)
+  {
+    if (!params.dither)
+      return _mm_cvttps_epi32(_mm_mul_ps(v,_mm_set1_ps(255.9f)));
+    const __m128 threshold
+      = _mm_set_ps((bayer4x4(x+3,y)+.5f)*(1.f/16.f),
+                   (bayer4x4(x+2,y)+.5f)*(1.f/16.f),
+                   (bayer4x4(x+1,y)+.5f)*(1.f/16.f),
+                   (bayer4x4(x+0,y)+.5f)*(1.f/16.f));
+    const __m128 q = _mm_add_ps(_mm_mul_ps(v,_mm_set1_ps(255.f)),threshold);
+    return _mm_cvttps_epi32(_mm_min_ps(_mm_set1_ps(255.f),q));
+  }
+
+  /*! tone maps four horizontally adjacent pixels, starting at pixel
+      (x,y), by transposing them to SoA form so all four lanes do
+      useful work */
+  static inline void toneMap4(const ToneMapParams &params,
+                              const __m128 exposure,
+                              const vec4f *in, uint32_t *out,
+                              const int x, const int y)
+  {
+    __m128 r = _mm_loadu_ps(&in[0].x);
+    __m128 g = _mm_loadu_ps(&in[1].x);
+    __m128 b = _mm_loadu_ps(&in[2].x);
+    __m128 a = _mm_loadu_ps(&in[3].x);
+    _MM_TRANSPOSE4_PS(r,g,b,a);
+
+    r = applyOutputTransform4(params,applyToneCurve4(params,_mm_mul_ps(exposure,r)));
+    g = applyOutputTransform4(params,applyToneCurve4(params,_mm_mul_ps(exposure,g)));
+    b = applyOutputTransform4(params,applyToneCurve4(params,_mm_mul_ps(exposure,b)));
+
+    __m128i rgba = _mm_set1_epi32((int)0xff000000);
+    rgba = _mm_or_si128(rgba,quantize4(params,r,x,y));
+    rgba = _mm_or_si128(rgba,_mm_slli_epi32(quantize4(params,g,x,y), 8));
+    rgba = _mm_or_si128(rgba,_mm_slli_epi32(quantize4(params,b,x,y),16));
+    _mm_storeu_si128((__m128i*)out,rgba);
+  }
+#endif
+
+  /*! sum of logLuminance() over one chunk of pixels */
+  static float logLuminanceSumOfChunk(const vec4f *pixels, size_t count)
+  {
+    size_t i = 0;
+    float  sum = 0.f;
+#if OSC_TONEMAP_SSE
+    __m128 sum4 = _mm_setzero_ps();
+    for (;i+4<=count;i+=4) {
+      __m128 r = _mm_loadu_ps(&pixels[i+0].x);
+      __m128 g = _mm_loadu_ps(&pixels[i+1].x);
+      __m128 b = _mm_loadu_ps(&pixels[i+2].x);
+      __m128 a = _mm_loadu_ps(&pixels[i+3].x);
+      _MM_TRANSPOSE4_PS(r,g,b,a);
+      const __m128 lum
+        = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.2126f),r),
+                                _mm_mul_ps(_mm_set1_ps(0.7152f),g)),
+                     _mm_mul_ps(_mm_set1_ps(0.0722f),b));
+      sum4 = _mm_add_ps(sum4,log2_4(_mm_add_ps(_mm_set1_ps(1e-4f),
+                                               _mm_max_ps(_mm_setzero_ps(),lum))));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes,sum4);
+    sum = (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+#endif
+    for (;i<count;i++)
+      sum += logLuminance(vec3f(pixels[i].x,pixels[i].y,pixels[i].z));
+    return sum;
+  }
+
+  /*! number of half pixels we convert to float4 at a time, on the
+      stack, before running the float4 code on them */
+  static const size_t HALF_CONVERSION_BATCH = 256;
+
+#if OSC_TONEMAP_SSE
+  /*! converts four halfs (in the lower 16 bits of each lane) to
+      float; same results as halfToFloat(), including denormals, inf
+      and nan */
+  static inline __m128 halfToFloat4(const __m128i h)
+  {
+    const __m128i sign     = _mm_slli_epi32(_mm_and_si128(h,_mm_set1_epi32(0x8000)),16);
+    __m128i       bits     = _mm_slli_epi32(_mm_and_si128(h,_mm_set1_epi32(0x7fff)),13);
+    const __m128i exponent = _mm_and_si128(bits,_mm_set1_epi32(0x0f800000));
+    // re-bias the exponent, and once more for inf/nan
+    bits = _mm_add_epi32(bits,_mm_set1_epi32(0x38000000));
+    const __m128i isInfNan = _mm_cmpeq_epi32(exponent,_mm_set1_epi32(0x0f800000));
+    bits = _mm_add_epi32(bits,_mm_and_si128(isInfNan,_mm_set1_epi32(0x38000000)));
+    // denormals: let the fpu renormalize
+    const __m128i isDenormal = _mm_cmpeq_epi32(exponent,_mm_setzero_si128());
+    const __m128  denormal
+      = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(bits,_mm_set1_epi32(1<<23))),
+                   _mm_castsi128_ps(_mm_set1_epi32(113<<23)));
+    bits = _mm_or_si128(_mm_andnot_si128(isDenormal,bits),
+                        _mm_and_si128(isDenormal,_mm_castps_si128(denormal)));
+    return _mm_castsi128_ps(_mm_or_si128(bits,sign));
+  }
+#endif
+
+  /*! converts 'count' half3 pixels to float4 (with w=1) */
+  static inline void halfsToFloat4s(const Half3 *in, vec4f *out, const size_t count)
+  {
+    size_t i = 0;
+#if OSC_TONEMAP_SSE
+    // four pixels are twelve halfs, ie, three 4-wide conversions
+    const uint16_t *h = &in[0].x;
+    for (;i+4<=count;i+=4,h+=12) {
+      float f[12];
+      for (int j=0;j<12;j+=4)
+        _mm_storeu_ps(f+j,halfToFloat4(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(h+j)),
+                                                          _mm_setzero_si128())));
+      for (int j=0;j<4;j++)
+        out[i+j] = vec4f(f[3*j+0],f[3*j+1],f[3*j+2],1.f);
+    }
+#endif
+    for (;i<count;i++)
+      out[i] = vec4f(loadColor(COLOR_FORMAT_HALF3,in,i),1.f);
+  }
+
+  /*! calls func(const vec4f *pixels, size_t count, size_t firstPixel)
+      over the given range of pixels in the given format, converting
+      to float4 in small batches where required */
+  template<typename Lambda>
+  static inline void forEachFloat4Batch(const ColorFormat format,
+                                        const void *pixels,
+                                        const size_t begin,
+                                        const size_t end,
+                                        const Lambda &func)
+  {
+    if (format == COLOR_FORMAT_FLOAT4) {
+      func((const vec4f*)pixels+begin,end-begin,begin);
+      return;
+    }
+    vec4f batch[HALF_CONVERSION_BATCH];
+    for (size_t batchBegin=begin;batchBegin<end;batchBegin+=HALF_CONVERSION_BATCH) {
+      const size_t count = std::min(end-batchBegin,HALF_CONVERSION_BATCH);
+      halfsToFloat4s((const Half3*)pixels+batchBegin,batch,count);
+      func(batch,count,batchBegin);
+    }
+  }
+
+  float computeLogLuminanceSum(const ColorFormat format,
+                               const void *pixels, size_t numPixels)
+  {
+    const size_t numChunks
+      = divRoundUp(uint64_t(numPixels),uint64_t(LOG_LUMINANCE_CHUNK_SIZE));
+    std::vector<float> partialSums(numChunks);
+    parallel_for(numChunks,[&](size_t chunkID){
+        const size_t begin = chunkID*LOG_LUMINANCE_CHUNK_SIZE;
+        const size_t end   = std::min(numPixels,begin+LOG_LUMINANCE_CHUNK_SIZE);
+        float sum = 0.f;
+        forEachFloat4Batch(format,pixels,begin,end,
+                           [&](const vec4f *batch, size_t count, size_t){
+                             sum += logLuminanceSumOfChunk(batch,count);
+                           });
+        partialSums[chunkID] = sum;
+      });
+    // sum up in double, in fixed order, so we neither lose precision
+    // on large frames nor depend on the thread count
+    double sum = 0.;
+    for (auto partialSum : partialSums) sum += partialSum;
+    return (float)sum;
+  }
+
+  float computeLogLuminanceSum(const vec4f *pixels, size_t numPixels)
+  {
+    return computeLogLuminanceSum(COLOR_FORMAT_FLOAT4,pixels,numPixels);
+  }
+
+  /*! tone maps 'count' pixels of row y, starting at pixel xBegin */
+  static inline void toneMapSpan(const ToneMapParams &params,
+                                 const float exposure,
+                                 const vec4f *in, uint32_t *out,
+                                 const int xBegin, const int count,
+                                 const int y)
+  {
+    int i = 0;
+#if OSC_TONEMAP_SSE
+    const __m128 exposure4 = _mm_set1_ps(exposure);
+    for (;i+4<=count;i+=4)
+      toneMap4(params,exposure4,in+i,out+i,xBegin+i,y);
+#endif
+    for (;i<count;i++)
+      out[i] = toneMapPixel(params,vec3f(in[i]),exposure,xBegin+i,y);
+  }
+
+  void toneMap(const ToneMapParams &params,
+               const ColorFormat format,
+               const void  *in,
+               uint32_t    *out,
+               const vec2i &size)
+  {
+    const int numPixels = size.x*size.y;
+    if (numPixels <= 0) return;
+
+    const float exposure
+      = computeExposure(params,
+                        params.autoExposure
+                        ? computeLogLuminanceSum(format,in,numPixels)
+                        : 0.f,
+                        numPixels);
+
+    parallel_for_blocked(0,size.y,TONE_MAP_ROWS_PER_TASK,
+                         [&](size_t yBegin, size_t yEnd){
+        for (int y=(int)yBegin;y<(int)yEnd;y++) {
+          const size_t lineBegin = size_t(y)*size.x;
+          forEachFloat4Batch(format,in,lineBegin,lineBegin+size.x,
+                             [&](const vec4f *batch, size_t count, size_t first){
+                               toneMapSpan(params,exposure,batch,out+first,
+                                           int(first-lineBegin),int(count),y);
+                             });
+        }
+      });
+  }
+
+  void toneMap(const ToneMapParams &params,
+               const vec4f *in,
+               uint32_t    *out,
+               const vec2i &size)
+  {
+    toneMap(params,COLOR_FORMAT_FLOAT4,in,out,size);
+  }
+
+} // ::osc
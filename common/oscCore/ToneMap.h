@@ -0,0 +1,207 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* this header gets included by both host code and cuda kernels: all
+   per-pixel math lives in __both__ functions in here, so the cpu
+   implementation in ToneMap.cpp and the kernel in toneMap.cu are
+   guaranteed to use the same curves */
+#include "FrameFormat.h"
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! the tone curve that maps (exposed) linear radiance to [0,1] */
+  enum ToneMapOperator {
+    /*! plain clamp to [0,1] - what the examples always did */
+    TONE_MAP_CLAMP=0,
+    /*! extended reinhard, x*(1+x/w^2)/(1+x), with w the white point */
+    TONE_MAP_REINHARD,
+    /*! Narkowicz' fit of the ACES reference rendering transform */
+    TONE_MAP_ACES,
+    /*! Hable's filmic curve, normalized to the white point */
+    TONE_MAP_FILMIC,
+    TONE_MAP_OPERATOR_COUNT
+  };
+
+  /*! the transfer function that encodes tone-mapped values for display */
+  enum OutputTransform {
+    /*! sqrt, ie, gamma 2.0 - what the examples always did */
+    OUTPUT_SQRT=0,
+    /*! pow(x,1/gamma) */
+    OUTPUT_GAMMA,
+    /*! the piece-wise sRGB OETF */
+    OUTPUT_SRGB,
+    /*! no encoding at all */
+    OUTPUT_LINEAR,
+    OUTPUT_TRANSFORM_COUNT
+  };
+
+  /*! all parameters of the tone mapping and output transform stage;
+      the defaults reproduce the old clamp(sqrt(x)) behavior bit by
+      bit */
+  struct ToneMapParams {
+    ToneMapOperator op       = TONE_MAP_CLAMP;
+    OutputTransform transfer = OUTPUT_SQRT;
+    /*! linear exposure multiplier; with auto exposure enabled this
+        acts as an exposure compensation on top of the computed
+        exposure */
+    float exposure     = 1.f;
+    /*! compute exposure from the log-average luminance of the frame */
+    bool  autoExposure = false;
+    /*! the 'middle gray' value that the log-average luminance gets
+        mapped to when auto exposure is on */
+    float keyValue     = 0.18f;
+    /*! smallest linear value that maps to white, for reinhard and
+        filmic */
+    float whitePoint   = 11.2f;
+    /*! only used for OUTPUT_GAMMA */
+    float gamma        = 2.2f;
+    /*! add an ordered (4x4 bayer) dither before quantizing to 8 bits */
+    bool  dither       = false;
+  };
+
+  inline __both__ float toneMapSaturate(const float f)
+  { return min(1.f,max(0.f,f)); }
+
+  /*! Rec.709 luminance of a linear rgb color */
+  inline __both__ float luminance(const vec3f &c)
+  { return 0.2126f*c.x + 0.7152f*c.y + 0.0722f*c.z; }
+
+  /*! the per-pixel term that auto exposure averages over; the small
+      delta keeps black pixels from sending the average to -inf */
+  inline __both__ float logLuminance(const vec3f &c)
+  { return log2f(1e-4f + max(0.f,luminance(c))); }
+
+  /*! the exposure to use for a frame, given the sum of
+      logLuminance() over all of its pixels */
+  inline __both__ float computeExposure(const ToneMapParams &params,
+                                        const float logLuminanceSum,
+                                        const int   numPixels)
+  {
+    if (!params.autoExposure || numPixels <= 0)
+      return params.exposure;
+    const float logAverage = logLuminanceSum / float(numPixels);
+    return params.exposure * params.keyValue / exp2f(logAverage);
+  }
+
+  inline __both__ float filmicCurve(const float x)
+  {
+    const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+    return ((x*(A*x+C*B)+D*E)/(x*(A*x+B)+D*F))-E/F;
+  }
+
+  /*! maps one (already exposed) linear channel value to [0,1] */
+  inline __both__ float applyToneCurve(const ToneMapParams &params, float x)
+  {
+    x = max(0.f,x);
+    switch (params.op) {
+    case TONE_MAP_REINHARD:
+      return x*(1.f+x/(params.whitePoint*params.whitePoint))/(1.f+x);
+    case TONE_MAP_ACES:
+      return (x*(2.51f*x+0.03f))/(x*(2.43f*x+0.59f)+0.14f);
+    case TONE_MAP_FILMIC:
+      return filmicCurve(2.f*x)/filmicCurve(params.whitePoint);
+    default:
+      return x;
+    }
+  }
+
+  /*! encodes one tone-mapped channel value for display */
+  inline __both__ float applyOutputTransform(const ToneMapParams &params, float x)
+  {
+    x = toneMapSaturate(x);
+    switch (params.transfer) {
+    case OUTPUT_GAMMA:
+      return powf(x,1.f/params.gamma);
+    case OUTPUT_SRGB:
+      return (x <= 0.0031308f) ? 12.92f*x : 1.055f*powf(x,1.f/2.4f)-0.055f;
+    case OUTPUT_LINEAR:
+      return x;
+    default:
+      return sqrtf(x);
+    }
+  }
+
+  /*! 4x4 bayer matrix entry for given pixel, in [0,16) */
+  inline __both__ int bayer4x4(const int x, const int y)
+  {
+    const int xy = x ^ y;
+    return ((xy & 1) << 3) | ((y & 1) << 2) | (xy & 2) | ((y & 2) >> 1);
+  }
+
+  /*! quantizes an encoded [0,1] value to 8 bits. Without dithering
+      this is the same truncation the examples always used; with
+      dithering we add a per-pixel threshold in (0,1) lsb, which
+      turns the truncation into an ordered-dithered rounding */
+  inline __both__ uint32_t quantizeTo8Bits(const ToneMapParams &params,
+                                           const float v,
+                                           const int x, const int y)
+  {
+    if (!params.dither)
+      return (uint32_t)(v * 255.9f);
+    const float threshold = (bayer4x4(x,y)+.5f)*(1.f/16.f);
+    return (uint32_t)min(255.f,v * 255.f + threshold);
+  }
+
+  /*! the full output transform for one pixel: expose, tone map,
+      encode, and pack to rgba8 (with alpha always set to 255) */
+  inline __both__ uint32_t toneMapPixel(const ToneMapParams &params,
+                                        const vec3f &rgb,
+                                        const float exposure,
+                                        const int x, const int y)
+  {
+    uint32_t rgba = 0;
+    rgba |= quantizeTo8Bits(params,applyOutputTransform(params,applyToneCurve(params,exposure*rgb.x)),x,y) <<  0;
+    rgba |= quantizeTo8Bits(params,applyOutputTransform(params,applyToneCurve(params,exposure*rgb.y)),x,y) <<  8;
+    rgba |= quantizeTo8Bits(params,applyOutputTransform(params,applyToneCurve(params,exposure*rgb.z)),x,y) << 16;
+    rgba |= (uint32_t)255 << 24;
+    return rgba;
+  }
+
+  // ------------------------------------------------------------------
+  // host-side (cpu) implementation, see ToneMap.cpp
+  // ------------------------------------------------------------------
+
+  /*! sum of logLuminance() over all pixels, computed as a parallel
+      reduction over fixed-size chunks (so the result does not depend
+      on the number of threads) */
+  float computeLogLuminanceSum(const vec4f *pixels, size_t numPixels);
+
+  /*! tone maps the given linear pixels into rgba8, with the same
+      semantics as the cuda kernel. 'out' can be any host memory the
+      caller owns - including pinned or mapped memory that is
+      directly used for display or upload - so no extra copy is
+      required. Uses sse where available, and all threads */
+  void toneMap(const ToneMapParams &params,
+               const vec4f *in,
+               uint32_t    *out,
+               const vec2i &size);
+
+  /*! @{ same as above, for color buffers in any ColorFormat; packed
+      formats get converted to float4 in small on-the-fly batches */
+  float computeLogLuminanceSum(const ColorFormat format,
+                               const void *pixels, size_t numPixels);
+  void toneMap(const ToneMapParams &params,
+               const ColorFormat format,
+               const void  *in,
+               uint32_t    *out,
+               const vec2i &size);
+  /*! @} */
+
+} // ::osc
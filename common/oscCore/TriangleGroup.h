@@ -0,0 +1,172 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+/* the triangle layout of the cpu traverser's bvh leaves: triangles
+   gathered up front (so a leaf needs no index or vertex lookups),
+   and packed in SoA groups of four or eight that get intersected all
+   at once. The intersector is the watertight one from woop et al.,
+   "watertight ray/triangle intersection" (jcgt, 2013): a ray can not
+   slip through between two triangles that share an edge, which
+   moeller-trumbore does not guarantee. Host-only, like simd.h */
+#include "gdt/math/simd.h"
+#include <algorithm>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+  using namespace gdt;
+
+  /*! the simd types for W lanes */
+  template<int W> struct TriangleGroupSIMD;
+  template<> struct TriangleGroupSIMD<4>
+  { typedef simd::vfloat4 vfloat; typedef simd::vbool4 vbool; };
+  template<> struct TriangleGroupSIMD<8>
+  { typedef simd::vfloat8 vfloat; typedef simd::vbool8 vbool; };
+
+  /*! W triangles: their vertices' x, y, and z coordinates, W floats
+      each, plus the IDs a hit gets reported with. Unused lanes hold
+      a degenerate triangle, which never gets hit */
+  template<int W>
+  struct TriangleGroup {
+    enum { width = W };
+
+    inline void clear()
+    {
+      std::fill(&vertex[0][0][0],&vertex[0][0][0]+3*3*W,0.f);
+      std::fill(meshID,meshID+W,-1);
+      std::fill(primID,primID+W,-1);
+    }
+
+    inline void set(int lane, const vec3f &v0, const vec3f &v1, const vec3f &v2,
+                    int meshID, int primID)
+    {
+      const vec3f v[3] = { v0, v1, v2 };
+      for (int i=0;i<3;i++)
+        for (int dim=0;dim<3;dim++)
+          vertex[i][dim][lane] = v[i][dim];
+      this->meshID[lane] = meshID;
+      this->primID[lane] = primID;
+    }
+
+    /*! [vertex][dimension][lane] */
+    float   vertex[3][3][W];
+    int32_t meshID[W];
+    int32_t primID[W];
+  };
+
+  /*! the per-ray part of the watertight test, computed once per ray:
+      the ray's dominant axis becomes 'z', and the shear that maps
+      the ray direction to (0,0,1) */
+  struct WatertightRay {
+    WatertightRay(const vec3f &org, const vec3f &dir, float tmin)
+      : org(org), tmin(tmin)
+    {
+      const vec3f absDir(fabsf(dir.x),fabsf(dir.y),fabsf(dir.z));
+      kz = absDir.x > absDir.y
+        ? (absDir.x > absDir.z ? 0 : 2)
+        : (absDir.y > absDir.z ? 1 : 2);
+      kx = (kz+1) % 3;
+      ky = (kx+1) % 3;
+      // (keeps the winding, so the edge functions' signs mean the
+      // same for all rays)
+      if (dir[kz] < 0.f) std::swap(kx,ky);
+      Sx = dir[kx]/dir[kz];
+      Sy = dir[ky]/dir[kz];
+      Sz = 1.f/dir[kz];
+    }
+
+    vec3f org;
+    float tmin;
+    int   kx, ky, kz;
+    float Sx, Sy, Sz;
+  };
+
+  /*! intersects all triangles of the group; returns the lane of the
+      closest hit in [ray.tmin,tmax] - after setting tmax, u, and v
+      to that hit - or -1 if there is none */
+  template<int W>
+  inline int intersectGroup(const TriangleGroup<W> &group, const WatertightRay &ray,
+                            float &tmax, float &u, float &v)
+  {
+    typedef typename TriangleGroupSIMD<W>::vfloat vfloat;
+    typedef typename TriangleGroupSIMD<W>::vbool  vbool;
+
+    // the vertices relative to the ray origin, sheared and scaled
+    // such that the ray is the +z axis
+    const vfloat Sx(ray.Sx), Sy(ray.Sy), Sz(ray.Sz);
+    vfloat x[3], y[3], z[3];
+    for (int i=0;i<3;i++) {
+      const vfloat px = vfloat::loadu(group.vertex[i][ray.kx]) - vfloat(ray.org[ray.kx]);
+      const vfloat py = vfloat::loadu(group.vertex[i][ray.ky]) - vfloat(ray.org[ray.ky]);
+      const vfloat pz = vfloat::loadu(group.vertex[i][ray.kz]) - vfloat(ray.org[ray.kz]);
+      x[i] = px - Sx*pz;
+      y[i] = py - Sy*pz;
+      z[i] = Sz*pz;
+    }
+
+    // the 2d edge functions; the ray hits a triangle if all three
+    // have the same sign. An edge shared by two triangles gets the
+    // exact same value (up to sign) in both, which is what makes
+    // this watertight
+    const vfloat U  = x[2]*y[1] - y[2]*x[1];
+    const vfloat V  = x[0]*y[2] - y[0]*x[2];
+    const vfloat Wt = x[1]*y[0] - y[1]*x[0];
+    const vfloat zero(0.f);
+    const vfloat det = U+V+Wt;
+    vbool valid
+      = (((U >= zero) & (V >= zero) & (Wt >= zero))
+         | ((U <= zero) & (V <= zero) & (Wt <= zero)))
+      & (det != zero);
+    if (!valid.mask()) return -1;
+
+    // the distance test without dividing by det (which only the
+    // closest hit ever needs): compare T*sign(det) against the
+    // ray's interval scaled by |det|
+    const vfloat T = U*z[0] + V*z[1] + Wt*z[2];
+    const vfloat absDet = abs(det);
+    const vfloat signedT = select(det < zero,-T,T);
+    valid = valid
+      & (signedT >= vfloat(ray.tmin)*absDet)
+      & (signedT <= vfloat(tmax)*absDet);
+    const int mask = valid.mask();
+    if (!mask) return -1;
+
+    float laneT[W], laneDet[W];
+    T.storeu(laneT);
+    det.storeu(laneDet);
+    int closest = -1;
+    float closestT = tmax;
+    for (int lane=0;lane<W;lane++) {
+      if (!(mask & (1<<lane))) continue;
+      const float t = laneT[lane]/laneDet[lane];
+      if (closest < 0 || t < closestT) {
+        closest  = lane;
+        closestT = t;
+      }
+    }
+    float laneU[W], laneV[W];
+    V.storeu(laneU);
+    Wt.storeu(laneV);
+    const float rcpDet = 1.f/laneDet[closest];
+    tmax = closestT;
+    u    = laneU[closest]*rcpDet;
+    v    = laneV[closest]*rcpDet;
+    return closest;
+  }
+
+} // ::osc
@@ -15,9 +15,7 @@
 // ======================================================================== //
 
 #include "SampleRenderer.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "3rdParty/stb_image_write.h"
+#include "oscCore/ImageOutput.h"
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
@@ -36,9 +34,15 @@ namespace osc {
       std::vector<uint32_t> pixels(fbSize.x*fbSize.y);
       sample.downloadPixels(pixels.data());
 
-      const std::string fileName = "osc_example2.png";
-      stbi_write_png(fileName.c_str(),fbSize.x,fbSize.y,4,
-                     pixels.data(),fbSize.x*sizeof(uint32_t));
+      // the file format follows the extension; anything that is not
+      // png, exr, or pfm gets the raw pixels
+      const std::string fileName = (ac > 1) ? av[1] : "osc_example2.png";
+      ImageOutput output;
+      output.push(OutputImage(fileName,fbSize,OutputImage::RGBA8,
+                              pixels.data(),/*bottomUp:*/false));
+      output.flush();
+      if (output.getMetrics().numFailed)
+        throw std::runtime_error("could not save image to "+fileName);
       std::cout << GDT_TERMINAL_GREEN
                 << std::endl
                 << "Image rendered, and saved to " << fileName << " ... done." << std::endl
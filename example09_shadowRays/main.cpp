@@ -15,6 +15,7 @@
 // ======================================================================== //
 
 #include "SampleRenderer.h"
+#include "gdt/math/xfmBatch.h"
 
 // our helper library for window handling
 #include "glfWindow/GLFWindow.h"
@@ -175,15 +176,8 @@ extern "C" int main(int ac, char** av)
     Model* model2 = loadOBJ("C:/Users/mayeg/Documents/U-TAD/Master/Practicas/Anyverse/apple_sapling-objs/"
                             "Apple_Sapling_Autumn_High.mxs.obj");
     // std::cout << model2->meshes[0]->vertex.at(0) << std::endl;
-    std::for_each(model2->meshes.begin(),
-                  model2->meshes.end(),
-                  [](auto& mesh)
-                  {
-                    std::for_each(mesh->vertex.begin(),
-                                  mesh->vertex.end(),
-                                  [](auto& vertex)
-                                  { vertex = xfmPoint(affine3f::translate(vec3f(-5.f, 0.f, -5.f)), vertex); });
-                  });
+    for (auto mesh : model2->meshes)
+      xfmPoints(affine3f::translate(vec3f(-5.f, 0.f, -5.f)), mesh->vertex);
     // std::cout << model2->meshes[0]->vertex.at(0) << std::endl;
     model->meshes.insert(model->meshes.end(), model2->meshes.begin(), model2->meshes.end());
 
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "gdt/math/vec.h"
+#include "oscCore/LightSampling.h"
 #include "optix7.h"
 
 namespace osc {
@@ -52,6 +53,9 @@ namespace osc {
 
     struct {
       vec3f origin, du, dv, power;
+      /*! shadow rays per hit */
+      int           numSamples = 1;
+      LightSampling sampling   = LIGHT_SAMPLING_STRATIFIED;
     } light;
     
     OptixTraversableHandle traversable;
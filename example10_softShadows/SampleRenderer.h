@@ -129,7 +129,9 @@ namespace osc {
 
     /*! @{ our launch parameters, on the host, and the buffer to store
         them on the device */
+  public:
     LaunchParams launchParams;
+  protected:
     CUDABuffer   launchParamsBuffer;
     /*! @} */
 
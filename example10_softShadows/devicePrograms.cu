@@ -22,7 +22,6 @@
 
 using namespace osc;
 
-#define NUM_LIGHT_SAMPLES 1
 #define NUM_PIXEL_SAMPLES 16
 
 namespace osc {
@@ -146,16 +145,17 @@ namespace osc {
       +         u * sbtData.vertex[index.y]
       +         v * sbtData.vertex[index.z];
 
-    const int numLightSamples = NUM_LIGHT_SAMPLES;
+    const int numLightSamples = optixLaunchParams.light.numSamples;
+    const QuadLightSampler lightSampler(optixLaunchParams.light.sampling,
+                                        optixLaunchParams.light.origin,
+                                        optixLaunchParams.light.du,
+                                        optixLaunchParams.light.dv,
+                                        surfPos,numLightSamples,prd.random);
     for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
-      // produce random light sample
-      const vec3f lightPos
-        = optixLaunchParams.light.origin
-        + prd.random() * optixLaunchParams.light.du
-        + prd.random() * optixLaunchParams.light.dv;
-      vec3f lightDir = lightPos - surfPos;
-      float lightDist = gdt::length(lightDir);
-      lightDir = normalize(lightDir);
+      // produce light sample (see oscCore/LightSampling.h)
+      const LightSample lightSample = lightSampler.sample(lightSampleID,prd.random);
+      const vec3f lightDir  = lightSample.dir;
+      const float lightDist = lightSample.dist;
     
       // trace shadow ray:
       const float NdotL = dot(lightDir,Ns);
@@ -185,7 +185,7 @@ namespace osc {
           += lightVisibility
           *  optixLaunchParams.light.power
           *  diffuseColor
-          *  (NdotL / (lightDist*lightDist*numLightSamples));
+          *  (NdotL * lightSample.weight / numLightSamples);
       }
     }
     
@@ -95,6 +95,33 @@ namespace osc {
       glEnd();
     }
     
+    virtual void key(int key, int mods) override
+    {
+      if (key == 'S' || key == 's') {
+        static const char *names[] = { "uniform", "stratified", "solid angle" };
+        sample.launchParams.light.sampling
+          = (LightSampling)((sample.launchParams.light.sampling+1) % LIGHT_SAMPLING_COUNT);
+        std::cout << "light sampling now " << names[sample.launchParams.light.sampling] << std::endl;
+      }
+      if (key == 'N' || key == 'n') {
+        sample.launchParams.light.numSamples
+          = std::max(1,sample.launchParams.light.numSamples-1);
+        std::cout << "num light samples now "
+                  << sample.launchParams.light.numSamples << std::endl;
+      }
+      if (key == 'M' || key == 'm') {
+        sample.launchParams.light.numSamples
+          = std::max(1,sample.launchParams.light.numSamples+1);
+        std::cout << "num light samples now "
+                  << sample.launchParams.light.numSamples << std::endl;
+      }
+      // the camera keys (+/-, C, x/y/z) are the manipulator's, as in
+      // example 9
+      GLFCameraWindow::key(key,mods);
+      if (cameraFrameManip)
+        cameraFrameManip->key(key,mods);
+    }
+
     virtual void resize(const vec2i &newSize) 
     {
       fbSize = newSize;
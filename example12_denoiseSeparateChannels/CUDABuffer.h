@@ -17,6 +17,7 @@
 #pragma once
 
 #include "optix7.h"
+#include "oscCore/FrameResources.h"
 // common std stuff
 #include <vector>
 #include <assert.h>
@@ -37,11 +38,30 @@ namespace osc {
       alloc(size);
     }
     
+    /*! re-size buffer to given number of bytes, but keep the
+        current allocation if it is large enough; if not, grow it
+        geometrically (see oscCore/FrameResources.h). Returns true if
+        it had to re-allocate. Note the old contents are NOT
+        preserved when re-allocating */
+    bool resizeWithCapacity(size_t size)
+    {
+      if (d_ptr && size <= capacityInBytes) {
+        sizeInBytes = size;
+        return false;
+      }
+      const size_t capacity = grownCapacity(capacityInBytes,size);
+      if (d_ptr) free();
+      alloc(capacity);
+      sizeInBytes = size;
+      return true;
+    }
+    
     //! allocate to given number of bytes
     void alloc(size_t size)
     {
       assert(d_ptr == nullptr);
       this->sizeInBytes = size;
+      this->capacityInBytes = size;
       CUDA_CHECK(Malloc( (void**)&d_ptr, sizeInBytes));
     }
 
@@ -51,6 +71,7 @@ namespace osc {
       CUDA_CHECK(Free(d_ptr));
       d_ptr = nullptr;
       sizeInBytes = 0;
+      capacityInBytes = 0;
     }
 
     template<typename T>
@@ -80,6 +101,9 @@ namespace osc {
 
     inline size_t size() const { return sizeInBytes; }
     size_t sizeInBytes { 0 };
+    /*! actually allocated bytes; can be more than sizeInBytes when
+        using resizeWithCapacity() */
+    size_t capacityInBytes { 0 };
     void  *d_ptr { nullptr };
   };
 
@@ -17,6 +17,9 @@
 #pragma once
 
 #include "gdt/math/vec.h"
+#include "oscCore/EnvironmentMap.h"
+#include "oscCore/FrameFormat.h"
+#include "oscCore/LightSampling.h"
 #include "optix7.h"
 
 namespace osc {
@@ -27,6 +30,7 @@ namespace osc {
 
   struct TriangleMeshSBTData {
     vec3f  color;
+    vec3f  emission;
     vec3f *vertex;
     vec3f *normal;
     vec2f *texcoord;
@@ -40,9 +44,12 @@ namespace osc {
     int numPixelSamples = 1;
     struct {
       int       frameID = 0;
-      float4   *colorBuffer;
-      float4   *normalBuffer;
-      float4   *albedoBuffer;
+      /*! the frame buffer layers, each in the format specified in
+          'format' - use loadColor()/storeColor() etc to access */
+      void     *colorBuffer;
+      void     *normalBuffer;
+      void     *albedoBuffer;
+      FrameFormat format;
       
       /*! the size of the frame buffer to render */
       vec2i     size;
@@ -57,7 +64,28 @@ namespace osc {
 
     struct {
       vec3f origin, du, dv, power;
+      /*! shadow rays per hit */
+      int           numSamples = 4;
+      LightSampling sampling   = LIGHT_SAMPLING_STRATIFIED;
     } light;
+
+    /*! the environment map, as a float4 texture that wraps around in
+        u; if set, it is what rays that miss everything see */
+    struct {
+      cudaTextureObject_t texture;
+      bool                valid = false;
+    } environment;
+
+    /*! trace paths of up to maxDepth segments, with the quad light
+        sampled at every vertex, rather than shading only the first
+        hit (see CPURenderer::pathTracing) */
+    struct {
+      bool enabled       = false;
+      int  maxDepth      = 8;
+      /*! paths this long continue with a probability that follows
+          their throughput (russian roulette) */
+      int  rouletteDepth = 3;
+    } pathTracing;
     
     OptixTraversableHandle traversable;
   };
@@ -18,6 +18,9 @@
 #include "LaunchParams.h"
 // this include may only appear in a single source file:
 #include <optix_function_table_definition.h>
+#if OPTIX_VERSION >= 70300
+#  include <optix_denoiser_tiling.h>
+#endif
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
@@ -580,7 +583,8 @@ namespace osc {
       
         HitgroupRecord rec;
         OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[rayID],&rec));
-        rec.data.color   = mesh->diffuse;
+        rec.data.color    = mesh->diffuse;
+        rec.data.emission = mesh->emission;
         if (mesh->diffuseTextureID >= 0 && mesh->diffuseTextureID < textureObjects.size()) {
           rec.data.hasTexture = true;
           rec.data.texture    = textureObjects[mesh->diffuseTextureID];
@@ -626,15 +630,18 @@ namespace osc {
                             1
                             ));
 
-    denoiserIntensity.resize(sizeof(float));
+    if (!denoiserIntensity.d_ptr)
+      denoiserIntensity.alloc(sizeof(float));
+
+    // (re-)set up the denoiser once the frame size has settled; until
+    // then we simply show the un-denoised frame
+    if (denoiserOn && resizeSettler.needsSetup())
+      setupDenoiser();
+    const bool denoiseThisFrame = denoiserOn && resizeSettler.isSetUp();
 
     OptixDenoiserParams denoiserParams;
 #if OPTIX_VERSION > 70500
     denoiserParams.denoiseAlpha = OPTIX_DENOISER_ALPHA_MODE_ALPHA_AS_AOV;
-#endif
-#if OPTIX_VERSION >= 70300
-    if (denoiserIntensity.sizeInBytes != sizeof(float))
-        denoiserIntensity.alloc(sizeof(float));
 #endif
     denoiserParams.hdrIntensity = denoiserIntensity.d_pointer();
     if(accumulate)
@@ -643,6 +650,20 @@ namespace osc {
         denoiserParams.blendFactor = 0.0f;
 
     // -------------------------------------------------------
+    // the denoiser reads and writes color in whatever format we
+    // render in; packed guide layers (that optix cannot read) get
+    // expanded to half3 first
+    const FrameFormat &format = launchParams.frame.format;
+    const OptixPixelFormat colorFormat
+      = format.color == COLOR_FORMAT_HALF3
+      ? OPTIX_PIXEL_FORMAT_HALF3
+      : OPTIX_PIXEL_FORMAT_FLOAT4;
+    const size_t colorStride = bytesPerPixel(format.color);
+    const bool   packedNormal = format.normal != NORMAL_FORMAT_FLOAT4;
+    const bool   packedAlbedo = format.albedo != ALBEDO_FORMAT_FLOAT4;
+    if (denoiseThisFrame && (packedNormal || packedAlbedo))
+      unpackDenoiserGuides();
+    
     OptixImage2D inputLayer[3];
     inputLayer[0].data = fbColor.d_pointer();
     /// Width of the image (in pixels)
@@ -650,40 +671,40 @@ namespace osc {
     /// Height of the image (in pixels)
     inputLayer[0].height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    inputLayer[0].rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    inputLayer[0].rowStrideInBytes = launchParams.frame.size.x * colorStride;
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    inputLayer[0].pixelStrideInBytes = sizeof(float4);
+    inputLayer[0].pixelStrideInBytes = colorStride;
     /// Pixel format.
-    inputLayer[0].format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    inputLayer[0].format = colorFormat;
 
     // ..................................................................
-    inputLayer[2].data = fbNormal.d_pointer();
+    inputLayer[2].data = packedNormal ? denoiserGuideNormal.d_pointer() : fbNormal.d_pointer();
     /// Width of the image (in pixels)
     inputLayer[2].width = launchParams.frame.size.x;
     /// Height of the image (in pixels)
     inputLayer[2].height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    inputLayer[2].rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    inputLayer[2].rowStrideInBytes = launchParams.frame.size.x * (packedNormal ? sizeof(Half3) : sizeof(float4));
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    inputLayer[2].pixelStrideInBytes = sizeof(float4);
+    inputLayer[2].pixelStrideInBytes = packedNormal ? sizeof(Half3) : sizeof(float4);
     /// Pixel format.
-    inputLayer[2].format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    inputLayer[2].format = packedNormal ? OPTIX_PIXEL_FORMAT_HALF3 : OPTIX_PIXEL_FORMAT_FLOAT4;
 
     // ..................................................................
-    inputLayer[1].data = fbAlbedo.d_pointer();
+    inputLayer[1].data = packedAlbedo ? denoiserGuideAlbedo.d_pointer() : fbAlbedo.d_pointer();
     /// Width of the image (in pixels)
     inputLayer[1].width = launchParams.frame.size.x;
     /// Height of the image (in pixels)
     inputLayer[1].height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    inputLayer[1].rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    inputLayer[1].rowStrideInBytes = launchParams.frame.size.x * (packedAlbedo ? sizeof(Half3) : sizeof(float4));
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    inputLayer[1].pixelStrideInBytes = sizeof(float4);
+    inputLayer[1].pixelStrideInBytes = packedAlbedo ? sizeof(Half3) : sizeof(float4);
     /// Pixel format.
-    inputLayer[1].format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    inputLayer[1].format = packedAlbedo ? OPTIX_PIXEL_FORMAT_HALF3 : OPTIX_PIXEL_FORMAT_FLOAT4;
 
     // -------------------------------------------------------
     OptixImage2D outputLayer;
@@ -693,15 +714,15 @@ namespace osc {
     /// Height of the image (in pixels)
     outputLayer.height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    outputLayer.rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    outputLayer.rowStrideInBytes = launchParams.frame.size.x * colorStride;
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    outputLayer.pixelStrideInBytes = sizeof(float4);
+    outputLayer.pixelStrideInBytes = colorStride;
     /// Pixel format.
-    outputLayer.format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    outputLayer.format = colorFormat;
 
     // -------------------------------------------------------
-    if (denoiserOn) {
+    if (denoiseThisFrame) {
       OPTIX_CHECK(optixDenoiserComputeIntensity
                   (denoiser,
                    /*stream*/0,
@@ -719,6 +740,22 @@ namespace osc {
     denoiserLayer.input = inputLayer[0];
     denoiserLayer.output = outputLayer;
 
+    if (denoiserTiled())
+      // scratch and state are only sized for one (overlapping) tile,
+      // the util helper walks the tiles for us
+      OPTIX_CHECK(optixUtilDenoiserInvokeTiled(denoiser,
+                                               /*stream*/0,
+                                               &denoiserParams,
+                                               denoiserState.d_pointer(),
+                                               denoiserState.size(),
+                                               &denoiserGuideLayer,
+                                               &denoiserLayer,1,
+                                               denoiserScratch.d_pointer(),
+                                               denoiserScratch.size(),
+                                               denoiserOverlap,
+                                               denoiserTileSize.x,
+                                               denoiserTileSize.y));
+    else
       OPTIX_CHECK(optixDenoiserInvoke(denoiser,
                                       /*stream*/0,
                                       &denoiserParams,
@@ -745,10 +782,19 @@ namespace osc {
 #endif
     } else {
       cudaMemcpy((void*)outputLayer.data,(void*)inputLayer[0].data,
-                 outputLayer.width*outputLayer.height*sizeof(float4),
+                 outputLayer.width*outputLayer.height*colorStride,
                  cudaMemcpyDeviceToDevice);
     }
     computeFinalPixelColors();
+
+    // pinned (but not mapped) host memory: copy the final pixels
+    // there asynchronously, while we are still waiting for the sync
+    if (hostPixels && !hostPixelsOnDevice)
+      CUDA_CHECK(MemcpyAsync(hostPixels,
+                             (void*)finalColorBuffer.d_pointer(),
+                             finalColorBuffer.sizeInBytes,
+                             cudaMemcpyDeviceToHost,
+                             stream));
     
     // sync - make sure the frame is rendered before we download and
     // display (obviously, for a high-performance application you
@@ -777,16 +823,68 @@ namespace osc {
                                   launchParams.camera.direction));
   }
   
-  /*! resize frame buffer to given resolution */
-  void SampleRenderer::resize(const vec2i &newSize)
+  void SampleRenderer::setEnvironment(const EnvironmentMap *environment)
   {
-    if (denoiser) {
-      OPTIX_CHECK(optixDenoiserDestroy(denoiser));
-    };
+    // reset accumulation
+    launchParams.frame.frameID = 0;
+    if (environmentTexture) {
+      CUDA_CHECK(DestroyTextureObject(environmentTexture));
+      CUDA_CHECK(FreeArray(environmentArray));
+      environmentTexture = 0;
+      environmentArray   = nullptr;
+    }
+    launchParams.environment.valid = environment != nullptr;
+    if (!environment) return;
+
+    // float4, since there are no three-channel cuda arrays
+    const vec2i res = environment->getResolution();
+    std::vector<vec4f> pixels;
+    pixels.reserve(environment->getPixels().size());
+    for (auto &p : environment->getPixels())
+      pixels.push_back(vec4f(p.x,p.y,p.z,1.f));
+
+    cudaChannelFormatDesc channel_desc = cudaCreateChannelDesc<float4>();
+    CUDA_CHECK(MallocArray(&environmentArray,&channel_desc,res.x,res.y));
+    const size_t pitch = res.x*sizeof(vec4f);
+    CUDA_CHECK(Memcpy2DToArray(environmentArray,
+                               /* offset */0,0,
+                               pixels.data(),
+                               pitch,pitch,res.y,
+                               cudaMemcpyHostToDevice));
+
+    cudaResourceDesc res_desc = {};
+    res_desc.resType         = cudaResourceTypeArray;
+    res_desc.res.array.array = environmentArray;
+
+    // wrapping around the y axis, but not over the poles
+    cudaTextureDesc tex_desc  = {};
+    tex_desc.addressMode[0]   = cudaAddressModeWrap;
+    tex_desc.addressMode[1]   = cudaAddressModeClamp;
+    tex_desc.filterMode       = cudaFilterModeLinear;
+    tex_desc.readMode         = cudaReadModeElementType;
+    tex_desc.normalizedCoords = 1;
+    tex_desc.maxAnisotropy    = 1;
+    tex_desc.sRGB             = 0;
+    CUDA_CHECK(CreateTextureObject(&environmentTexture,&res_desc,&tex_desc,nullptr));
+    launchParams.environment.texture = environmentTexture;
+  }
 
+  /*! (re-)size a frame-size dependent buffer, keeping track of how
+      often that actually allocates */
+  void SampleRenderer::resizeFrameResource(CUDABuffer &buffer, size_t sizeInBytes)
+  {
+    if (buffer.resizeWithCapacity(sizeInBytes)) {
+      resourceStats.numAllocations++;
+      resourceStats.bytesAllocated += buffer.capacityInBytes;
+    } else
+      resourceStats.numReuses++;
+  }
 
-    // ------------------------------------------------------------------
-    // create the denoiser:
+  /*! creates the denoiser object; this does not depend on the frame
+      size, so we only do this once (or when the color format
+      changes, which the 7.0 api wants to know about) */
+  void SampleRenderer::createDenoiser()
+  {
     OptixDenoiserOptions denoiserOptions = {};
 #if OPTIX_VERSION >= 70300
     OPTIX_CHECK(optixDenoiserCreate(optixContext,OPTIX_DENOISER_MODEL_KIND_LDR,&denoiserOptions,&denoiser));
@@ -794,58 +892,189 @@ namespace osc {
     denoiserOptions.inputKind = OPTIX_DENOISER_INPUT_RGB_ALBEDO;
 #if OPTIX_VERSION < 70100
     // these only exist in 7.0, not 7.1
-    denoiserOptions.pixelFormat = OPTIX_PIXEL_FORMAT_FLOAT4;
+    denoiserOptions.pixelFormat
+      = frameFormat.color == COLOR_FORMAT_HALF3
+      ? OPTIX_PIXEL_FORMAT_HALF3
+      : OPTIX_PIXEL_FORMAT_FLOAT4;
 #endif
 
     OPTIX_CHECK(optixDenoiserCreate(optixContext,&denoiserOptions,&denoiser));
     OPTIX_CHECK(optixDenoiserSetModel(denoiser,OPTIX_DENOISER_MODEL_KIND_LDR,NULL,0));
 #endif
+  }
 
-    // .. then compute and allocate memory resources for the denoiser
-    OptixDenoiserSizes denoiserReturnSizes;
-    OPTIX_CHECK(optixDenoiserComputeMemoryResources(denoiser,newSize.x,newSize.y,
-                                                    &denoiserReturnSizes));
+  /*! computes memory resources for, and sets up, the denoiser for
+      the current frame size. This is what is expensive about a
+      resize, so we only do this once the size has settled */
+  void SampleRenderer::setupDenoiser()
+  {
+    if (!denoiser)
+      createDenoiser();
+    
+    vec2i size = launchParams.frame.size;
+#if OPTIX_VERSION >= 70300
+    if (denoiserTiled()) {
+      // memory for one tile, plus the overlap the denoiser wants
+      OptixDenoiserSizes denoiserReturnSizes;
+      OPTIX_CHECK(optixDenoiserComputeMemoryResources(denoiser,
+                                                      denoiserTileSize.x,
+                                                      denoiserTileSize.y,
+                                                      &denoiserReturnSizes));
+      denoiserOverlap = denoiserReturnSizes.overlapWindowSizeInPixels;
+      resizeFrameResource(denoiserScratch,
+                          std::max(denoiserReturnSizes.withOverlapScratchSizeInBytes,
+                                   denoiserReturnSizes.computeIntensitySizeInBytes));
+      resizeFrameResource(denoiserState,denoiserReturnSizes.stateSizeInBytes);
+      size = denoiserTileSize + vec2i(2*(int)denoiserOverlap);
+    } else
+#endif
+    {
+      OptixDenoiserSizes denoiserReturnSizes;
+      OPTIX_CHECK(optixDenoiserComputeMemoryResources(denoiser,size.x,size.y,
+                                                      &denoiserReturnSizes));
 
 #if OPTIX_VERSION < 70100
-    denoiserScratch.resize(denoiserReturnSizes.recommendedScratchSizeInBytes);
+      resizeFrameResource(denoiserScratch,denoiserReturnSizes.recommendedScratchSizeInBytes);
 #else
-    denoiserScratch.resize(std::max(denoiserReturnSizes.withOverlapScratchSizeInBytes,
-                                    denoiserReturnSizes.withoutOverlapScratchSizeInBytes));
+      resizeFrameResource(denoiserScratch,
+                          std::max(denoiserReturnSizes.withOverlapScratchSizeInBytes,
+                                   denoiserReturnSizes.withoutOverlapScratchSizeInBytes));
 #endif
-    denoiserState.resize(denoiserReturnSizes.stateSizeInBytes);
+      resizeFrameResource(denoiserState,denoiserReturnSizes.stateSizeInBytes);
+    }
     
+    OPTIX_CHECK(optixDenoiserSetup(denoiser,0,
+                                   size.x,size.y,
+                                   denoiserState.d_pointer(),
+                                   denoiserState.size(),
+                                   denoiserScratch.d_pointer(),
+                                   denoiserScratch.size()));
+    resizeSettler.setupDone();
+    resourceStats.numDenoiserSetups++;
+  }
+  
+  /*! resize frame buffer to given resolution. While a window gets
+      dragged this happens every frame, so we only touch the frame
+      buffers here (re-using their memory where possible), and leave
+      the denoiser setup to render() once the size has settled */
+  void SampleRenderer::resize(const vec2i &newSize)
+  {
     // ------------------------------------------------------------------
     // resize our cuda frame buffer
-    denoisedBuffer.resize(newSize.x*newSize.y*sizeof(float4));
-    fbColor.resize(newSize.x*newSize.y*sizeof(float4));
-    fbNormal.resize(newSize.x*newSize.y*sizeof(float4));
-    fbAlbedo.resize(newSize.x*newSize.y*sizeof(float4));
-    finalColorBuffer.resize(newSize.x*newSize.y*sizeof(uint32_t));
+    const size_t numPixels = size_t(newSize.x)*newSize.y;
+    resizeFrameResource(denoisedBuffer,numPixels*bytesPerPixel(frameFormat.color));
+    resizeFrameResource(fbColor,numPixels*bytesPerPixel(frameFormat.color));
+    resizeFrameResource(fbNormal,numPixels*bytesPerPixel(frameFormat.normal));
+    resizeFrameResource(fbAlbedo,numPixels*bytesPerPixel(frameFormat.albedo));
+    // optix can't read oct32 normals or rgba8 albedo, those get
+    // expanded to half3 right before denoising
+    if (frameFormat.normal != NORMAL_FORMAT_FLOAT4)
+      resizeFrameResource(denoiserGuideNormal,numPixels*sizeof(Half3));
+    if (frameFormat.albedo != ALBEDO_FORMAT_FLOAT4)
+      resizeFrameResource(denoiserGuideAlbedo,numPixels*sizeof(Half3));
+    resizeFrameResource(finalColorBuffer,numPixels*sizeof(uint32_t));
+    if (!logLuminanceSum.d_ptr)
+      logLuminanceSum.alloc(sizeof(float));
     
     // update the launch parameters that we'll pass to the optix
     // launch:
     launchParams.frame.size          = newSize;
-    launchParams.frame.colorBuffer   = (float4*)fbColor.d_pointer();
-    launchParams.frame.normalBuffer  = (float4*)fbNormal.d_pointer();
-    launchParams.frame.albedoBuffer  = (float4*)fbAlbedo.d_pointer();
+    launchParams.frame.colorBuffer   = (void*)fbColor.d_pointer();
+    launchParams.frame.normalBuffer  = (void*)fbNormal.d_pointer();
+    launchParams.frame.albedoBuffer  = (void*)fbAlbedo.d_pointer();
+    launchParams.frame.format        = frameFormat;
 
     // and re-set the camera, since aspect may have changed
     setCamera(lastSetCamera);
 
-    // ------------------------------------------------------------------
-    OPTIX_CHECK(optixDenoiserSetup(denoiser,0,
-                                   newSize.x,newSize.y,
-                                   denoiserState.d_pointer(),
-                                   denoiserState.size(),
-                                   denoiserScratch.d_pointer(),
-                                   denoiserScratch.size()));
+    resizeSettler.resized(newSize);
   }
   
   /*! download the rendered color buffer */
   void SampleRenderer::downloadPixels(uint32_t h_pixels[])
   {
+    // already written (or copied) there during render()
+    if (h_pixels == hostPixels) return;
+    
     finalColorBuffer.download(h_pixels,
                               launchParams.frame.size.x*launchParams.frame.size.y);
   }
+
+  /*! download the color buffer before tone mapping */
+  void SampleRenderer::downloadLinearColor(std::vector<vec3f> &h_color)
+  {
+    const size_t numPixels
+      = size_t(launchParams.frame.size.x)*launchParams.frame.size.y;
+    std::vector<uint8_t> stored(numPixels*bytesPerPixel(frameFormat.color));
+    CUDA_CHECK(Memcpy(stored.data(),(void*)denoisedBuffer.d_pointer(),
+                      stored.size(),cudaMemcpyDeviceToHost));
+    h_color.resize(numPixels);
+    for (size_t i=0;i<numPixels;i++)
+      h_color[i] = loadColor(frameFormat.color,stored.data(),i);
+  }
+
+  /*! select the storage format of the frame buffer layers */
+  void SampleRenderer::setFrameFormat(const FrameFormat &format)
+  {
+    if (format == frameFormat) return;
+#if OPTIX_VERSION < 70100
+    // the 7.0 denoiser gets created for a specific pixel format
+    if (denoiser && format.color != frameFormat.color) {
+      OPTIX_CHECK(optixDenoiserDestroy(denoiser));
+      denoiser = nullptr;
+    }
+#endif
+    frameFormat = format;
+    resizeSettler.invalidate();
+    // re-allocate everything in the new format (the accumulated
+    // frame gets lost, but resize() also restarts accumulation)
+    if (launchParams.frame.size.x > 0)
+      resize(launchParams.frame.size);
+  }
+
+  /*! denoise in tiles of given size (or in one go, for a zero size) */
+  void SampleRenderer::setDenoiserTileSize(const vec2i &tileSize)
+  {
+#if OPTIX_VERSION >= 70300
+    if (tileSize == denoiserTileSize) return;
+    denoiserTileSize = tileSize;
+    resizeSettler.invalidate();
+#else
+    std::cout << "#osc: tiled denoising requires optix 7.3 or newer" << std::endl;
+#endif
+  }
+
+  /*! true if we denoise in tiles - ie, if a tile size is set and the
+      frame is actually larger than one tile */
+  bool SampleRenderer::denoiserTiled() const
+  {
+    return denoiserTileSize.x > 0 && denoiserTileSize.y > 0
+      && (launchParams.frame.size.x > denoiserTileSize.x
+          || launchParams.frame.size.y > denoiserTileSize.y);
+  }
+
+  /*! frame buffer memory traffic of one frame with current settings */
+  FrameTraffic SampleRenderer::getFrameTraffic() const
+  {
+    return computeFrameTraffic(frameFormat,launchParams.frame.size,
+                               accumulate,denoiserOn);
+  }
+
+  /*! set the host array the app displays from */
+  void SampleRenderer::setHostPixels(uint32_t h_pixels[])
+  {
+    hostPixels         = h_pixels;
+    hostPixelsOnDevice = nullptr;
+    if (!h_pixels) return;
+
+    cudaPointerAttributes attributes = {};
+    if (cudaPointerGetAttributes(&attributes,h_pixels) == cudaSuccess
+        && attributes.type == cudaMemoryTypeHost
+        && attributes.devicePointer)
+      hostPixelsOnDevice = (uint32_t*)attributes.devicePointer;
+    // older cuda versions report plain (unregistered) host memory as
+    // an error - that is fine, we just use the copy path then
+    cudaGetLastError();
+  }
   
 } // ::osc
@@ -19,20 +19,13 @@
 // our own classes, partly shared between host and device
 #include "CUDABuffer.h"
 #include "LaunchParams.h"
-#include "Model.h"
+#include "oscCore/Camera.h"
+#include "oscCore/Model.h"
+#include "oscCore/ToneMap.h"
 
 /*! \namespace osc - Optix Siggraph Course */
 namespace osc {
 
-  struct Camera {
-    /*! camera position - *from* where we are looking */
-    vec3f from;
-    /*! which point we are looking *at* */
-    vec3f at;
-    /*! general up-vector */
-    vec3f up;
-  };
-  
   /*! a sample OptiX-7 renderer that demonstrates how to set up
       context, module, programs, pipeline, SBT, etc, and perform a
       valid launch that renders some pixel (using a simple test
@@ -56,12 +49,53 @@ namespace osc {
     /*! download the rendered color buffer */
     void downloadPixels(uint32_t h_pixels[]);
 
+    /*! download the linear (and, if enabled, denoised) color of the
+        last frame, ie, what went into tone mapping - eg, to save it
+        as a float image */
+    void downloadLinearColor(std::vector<vec3f> &h_color);
+
+    /*! select the storage format of the color, normal and albedo
+        layers (and of the denoised buffer, which uses the color
+        format); takes effect immediately, restarting accumulation */
+    void setFrameFormat(const FrameFormat &format);
+
+    /*! frame buffer memory traffic of one frame, with the current
+        size, format and settings */
+    FrameTraffic getFrameTraffic() const;
+
+    /*! denoise in tiles of the given size, with scratch and state
+        memory sized for a single tile - so the denoiser's memory no
+        longer grows with the frame size. A zero size turns tiling
+        off. Requires optix 7.3+ */
+    void setDenoiserTileSize(const vec2i &tileSize);
+
+    /*! how often frame-size dependent resources got (re-)allocated
+        and the denoiser got set up so far */
+    const ResourceStats &getResourceStats() const { return resourceStats; }
+
+    /*! tell the renderer which host array the app is going to
+        display from (or nullptr to go back to explicitly downloading
+        pixels). If that memory is mapped (cudaHostAllocMapped), the
+        tone mapper writes the final pixels directly into it; if it is
+        only pinned, the final pixels get copied asynchronously at the
+        end of render(). Either way, downloadPixels() for this array
+        becomes a no-op */
+    void setHostPixels(uint32_t h_pixels[]);
+
     /*! set camera to render with */
     void setCamera(const Camera &camera);
 
+    /*! upload the given environment map as what rays that miss
+        everything see, or go back to a white background for
+        nullptr; restarts accumulation */
+    void setEnvironment(const EnvironmentMap *environment);
     
     bool denoiserOn = true;
     bool accumulate = true;
+
+    /*! tone mapping and output transform to use for the final
+        pixels; the defaults match what the earlier examples did */
+    ToneMapParams toneMap;
   protected:
 
 
@@ -69,7 +103,24 @@ namespace osc {
     // internal helper functions
     // ------------------------------------------------------------------
 
-    /*! runs a cuda kernel that performs gamma correction and float4-to-rgba conversion */
+    /*! (re-)size a frame-size dependent buffer, re-using its memory
+        if possible */
+    void resizeFrameResource(CUDABuffer &buffer, size_t sizeInBytes);
+
+    /*! creates the denoiser object */
+    void createDenoiser();
+
+    /*! sizes the denoiser's memory for, and sets it up for, the
+        current frame size */
+    void setupDenoiser();
+
+    /*! runs a cuda kernel that expands packed normal/albedo layers
+        to half3, which is what the optix denoiser can read */
+    void unpackDenoiserGuides();
+
+    /*! runs a cuda kernel that performs tone mapping, gamma
+        correction and float4-to-rgba conversion (plus, with auto
+        exposure on, a reduction kernel to compute the exposure) */
     void computeFinalPixelColors();
     
     /*! helper function that initializes optix and checks for errors */
@@ -147,22 +198,50 @@ namespace osc {
 
     /*! the color buffer we use during _rendering_, which is a bit
         larger than the actual displayed frame buffer (to account for
-        the border), and in float4 format (the denoiser requires
-        floats) */
+        the border); layers are in the formats given by
+        'frameFormat' */
     CUDABuffer fbColor;
     CUDABuffer fbNormal;
     CUDABuffer fbAlbedo;
+    FrameFormat frameFormat;
+
+    /*! @{ half3 copies of packed normal/albedo layers, for the
+        denoiser; only allocated for packed formats */
+    CUDABuffer denoiserGuideNormal;
+    CUDABuffer denoiserGuideAlbedo;
+    /*! @} */
     
-    /*! output of the denoiser pass, in float4 */
+    /*! output of the denoiser pass, in frameFormat.color */
     CUDABuffer denoisedBuffer;
     
     /* the actual final color buffer used for display, in rgba8 */
     CUDABuffer finalColorBuffer;
 
+    /*! @{ host array set through setHostPixels(), and its device
+        address if that array is mapped (else nullptr) */
+    uint32_t *hostPixels         = nullptr;
+    uint32_t *hostPixelsOnDevice = nullptr;
+    /*! @} */
+
+    /*! single float, sum of log luminance for auto exposure */
+    CUDABuffer logLuminanceSum;
+
     OptixDenoiser denoiser = nullptr;
     CUDABuffer    denoiserScratch;
     CUDABuffer    denoiserState;
     CUDABuffer    denoiserIntensity;
+
+    /*! @{ tile size (zero for un-tiled) and the overlap the denoiser
+        asked for */
+    vec2i         denoiserTileSize { 0 };
+    unsigned int  denoiserOverlap  { 0 };
+    bool denoiserTiled() const;
+    /*! @} */
+
+    /*! tracks when resizing has settled enough to re-run
+        setupDenoiser() */
+    ResizeSettler resizeSettler;
+    ResourceStats resourceStats;
     
     /*! the camera we are to render with. */
     Camera lastSetCamera;
@@ -184,6 +263,12 @@ namespace osc {
     std::vector<cudaArray_t>         textureArrays;
     std::vector<cudaTextureObject_t> textureObjects;
     /*! @} */
+
+    /*! @{ the environment map's texture object and pixel array, if
+        one got set */
+    cudaArray_t         environmentArray   = nullptr;
+    cudaTextureObject_t environmentTexture = 0;
+    /*! @} */
   };
 
 } // ::osc
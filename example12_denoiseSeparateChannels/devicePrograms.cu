@@ -22,7 +22,6 @@
 
 using namespace osc;
 
-#define NUM_LIGHT_SAMPLES 4
 
 namespace osc {
 
@@ -40,6 +39,11 @@ namespace osc {
     vec3f  pixelColor;
     vec3f  pixelNormal;
     vec3f  pixelAlbedo;
+    /*! with path tracing: where the path continues, if it does (the
+        closest hit program samples the bounce, raygen traces it) */
+    bool   bounced;
+    vec3f  bounceOrigin;
+    vec3f  bounceDir;
   };
   
   static __forceinline__ __device__
@@ -136,8 +140,13 @@ namespace osc {
       diffuseColor *= (vec3f)fromTexture;
     }
 
-    // start with some ambient term
-    vec3f pixelColor = (0.1f + 0.2f*fabsf(dot(Ns,rayDir)))*diffuseColor;
+    // start with whatever the surface emits, and some ambient term -
+    // unless paths get traced, which find the light that this
+    // stands in for
+    const bool pathTracing = optixLaunchParams.pathTracing.enabled;
+    vec3f pixelColor = sbtData.emission;
+    if (!pathTracing)
+      pixelColor += (0.1f + 0.2f*fabsf(dot(Ns,rayDir)))*diffuseColor;
     
     // ------------------------------------------------------------------
     // compute shadow
@@ -147,16 +156,19 @@ namespace osc {
       +         u * sbtData.vertex[index.y]
       +         v * sbtData.vertex[index.z];
 
-    const int numLightSamples = NUM_LIGHT_SAMPLES;
+    // (paths sample the light once per vertex, as the cpu renderer's
+    // do)
+    const int numLightSamples = pathTracing ? 1 : optixLaunchParams.light.numSamples;
+    const QuadLightSampler lightSampler(optixLaunchParams.light.sampling,
+                                        optixLaunchParams.light.origin,
+                                        optixLaunchParams.light.du,
+                                        optixLaunchParams.light.dv,
+                                        surfPos,numLightSamples,prd.random);
     for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
-      // produce random light sample
-      const vec3f lightPos
-        = optixLaunchParams.light.origin
-        + prd.random() * optixLaunchParams.light.du
-        + prd.random() * optixLaunchParams.light.dv;
-      vec3f lightDir = lightPos - surfPos;
-      float lightDist = gdt::length(lightDir);
-      lightDir = normalize(lightDir);
+      // produce light sample (see oscCore/LightSampling.h)
+      const LightSample lightSample = lightSampler.sample(lightSampleID,prd.random);
+      const vec3f lightDir  = lightSample.dir;
+      const float lightDist = lightSample.dist;
     
       // trace shadow ray:
       const float NdotL = dot(lightDir,Ns);
@@ -186,7 +198,25 @@ namespace osc {
           += lightVisibility
           *  optixLaunchParams.light.power
           *  diffuseColor
-          *  (NdotL / (lightDist*lightDist*numLightSamples));
+          *  (NdotL * lightSample.weight / numLightSamples);
+      }
+    }
+
+    // ------------------------------------------------------------------
+    // with path tracing: sample the bounce (cosine distributed, so
+    // the path's throughput just gets multiplied with the albedo).
+    // The quad light is not geometry that a bounce could hit, and the
+    // environment does not get sampled here, so unlike in the cpu
+    // renderer, all light has only one way to be found, and needs no
+    // multiple importance sampling
+    // ------------------------------------------------------------------
+    prd.bounced = false;
+    if (pathTracing) {
+      const vec3f dir = sampleCosineHemisphere(Ns,vec2f(prd.random(),prd.random()));
+      if (dot(dir,Ns) > 0.f && dot(dir,Ng) > 0.f) {
+        prd.bounced      = true;
+        prd.bounceOrigin = surfPos + 1e-3f * Ng;
+        prd.bounceDir    = dir;
       }
     }
 
@@ -212,8 +242,15 @@ namespace osc {
   extern "C" __global__ void __miss__radiance()
   {
     PRD &prd = *getPRD<PRD>();
-    // set to constant white as background color
-    prd.pixelColor = vec3f(1.f);
+    prd.bounced = false;
+    if (optixLaunchParams.environment.valid) {
+      // filtered by the texture unit
+      const vec2f uv = environmentUV(normalize(vec3f(optixGetWorldRayDirection())));
+      vec4f fromTexture = tex2D<float4>(optixLaunchParams.environment.texture,uv.x,uv.y);
+      prd.pixelColor = (vec3f)fromTexture;
+    } else
+      // set to constant white as background color
+      prd.pixelColor = vec3f(1.f);
   }
 
   extern "C" __global__ void __miss__shadow()
@@ -243,6 +280,9 @@ namespace osc {
     packPointer( &prd, u0, u1 );
 
     int numPixelSamples = optixLaunchParams.numPixelSamples;
+    // (without path tracing, a path is just the primary ray)
+    const auto &pathTracing = optixLaunchParams.pathTracing;
+    const int maxDepth = pathTracing.enabled ? pathTracing.maxDepth : 1;
 
     vec3f pixelColor = 0.f;
     vec3f pixelNormal = 0.f;
@@ -270,38 +310,64 @@ namespace osc {
                                + (screen.x - 0.5f) * camera.horizontal
                                + (screen.y - 0.5f) * camera.vertical);
 
-      optixTrace(optixLaunchParams.traversable,
-                 camera.position,
-                 rayDir,
-                 0.f,    // tmin
-                 1e20f,  // tmax
-                 0.0f,   // rayTime
-                 OptixVisibilityMask( 255 ),
-                 OPTIX_RAY_FLAG_DISABLE_ANYHIT,//OPTIX_RAY_FLAG_NONE,
-                 RADIANCE_RAY_TYPE,            // SBT offset
-                 RAY_TYPE_COUNT,               // SBT stride
-                 RADIANCE_RAY_TYPE,            // missSBTIndex 
-                 u0, u1 );
-      pixelColor  += prd.pixelColor;
-      pixelNormal += prd.pixelNormal;
-      pixelAlbedo += prd.pixelAlbedo;
+      // follow the path iteratively: each segment adds what its hit
+      // emits and gets from the light, times the throughput so far
+      vec3f rayOrg     = camera.position;
+      float rayTMin    = 0.f;
+      vec3f throughput = 1.f;
+      for (int depth=0;;depth++) {
+        optixTrace(optixLaunchParams.traversable,
+                   rayOrg,
+                   rayDir,
+                   rayTMin,  // tmin
+                   1e20f,    // tmax
+                   0.0f,     // rayTime
+                   OptixVisibilityMask( 255 ),
+                   OPTIX_RAY_FLAG_DISABLE_ANYHIT,//OPTIX_RAY_FLAG_NONE,
+                   RADIANCE_RAY_TYPE,            // SBT offset
+                   RAY_TYPE_COUNT,               // SBT stride
+                   RADIANCE_RAY_TYPE,            // missSBTIndex 
+                   u0, u1 );
+        pixelColor += throughput * prd.pixelColor;
+        if (depth == 0) {
+          pixelNormal += prd.pixelNormal;
+          pixelAlbedo += prd.pixelAlbedo;
+        }
+
+        // end the path as early as possible: when it leaves the
+        // scene, at its maximum depth, once it carries nothing, or
+        // through russian roulette
+        if (!prd.bounced || depth+1 >= maxDepth) break;
+        throughput *= prd.pixelAlbedo;
+        const float maxThroughput = reduce_max(throughput);
+        if (!(maxThroughput > 0.f)) break;
+        if (depth+1 >= pathTracing.rouletteDepth) {
+          const float survival = fminf(maxThroughput,.95f);
+          if (prd.random() >= survival) break;
+          throughput *= 1.f/survival;
+        }
+        rayOrg  = prd.bounceOrigin;
+        rayDir  = prd.bounceDir;
+        rayTMin = 1e-3f;
+      }
     }
 
-    vec4f rgba(pixelColor/numPixelSamples,1.f);
-    vec4f albedo(pixelAlbedo/numPixelSamples,1.f);
-    vec4f normal(pixelNormal/numPixelSamples,1.f);
+    vec3f rgb(pixelColor/numPixelSamples);
+    vec3f albedo(pixelAlbedo/numPixelSamples);
+    vec3f normal(pixelNormal/numPixelSamples);
 
     // and write/accumulate to frame buffer ...
-    const uint32_t fbIndex = ix+iy*optixLaunchParams.frame.size.x;
-    if (optixLaunchParams.frame.frameID > 0) {
-      rgba
-        += float(optixLaunchParams.frame.frameID)
-        *  vec4f(optixLaunchParams.frame.colorBuffer[fbIndex]);
-      rgba /= (optixLaunchParams.frame.frameID+1.f);
+    const auto &fb = optixLaunchParams.frame;
+    const uint32_t fbIndex = ix+iy*fb.size.x;
+    if (fb.frameID > 0) {
+      rgb
+        += float(fb.frameID)
+        *  loadColor(fb.format.color,fb.colorBuffer,fbIndex);
+      rgb /= (fb.frameID+1.f);
     }
-    optixLaunchParams.frame.colorBuffer[fbIndex] = (float4)rgba;
-    optixLaunchParams.frame.albedoBuffer[fbIndex] = (float4)albedo;
-    optixLaunchParams.frame.normalBuffer[fbIndex] = (float4)normal;
+    storeColor(fb.format.color,fb.colorBuffer,fbIndex,rgb);
+    storeAlbedo(fb.format.albedo,fb.albedoBuffer,fbIndex,albedo);
+    storeNormal(fb.format.normal,fb.normalBuffer,fbIndex,normal);
   }
   
 } // ::osc
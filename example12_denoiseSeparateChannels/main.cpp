@@ -15,6 +15,8 @@
 // ======================================================================== //
 
 #include "SampleRenderer.h"
+#include "oscCore/CameraPath.h"
+#include "oscCore/ImageOutput.h"
 
 // our helper library for window handling
 #include "glfWindow/GLFWindow.h"
@@ -45,11 +47,28 @@ namespace osc {
         cameraFrame.modified = false;
       }
       sample.render();
+
+      const ResourceStats &stats = sample.getResourceStats();
+      if (stats.numDenoiserSetups != reportedDenoiserSetups) {
+        reportedDenoiserSetups = stats.numDenoiserSetups;
+        std::cout << "denoiser set up for " << fbSize
+                  << " (so far: " << stats.numDenoiserSetups << " setups, "
+                  << stats.numAllocations << " allocations, "
+                  << stats.numReuses << " re-used buffers)" << std::endl;
+      }
     }
     
     virtual void draw() override
     {
-      sample.downloadPixels(pixels.data());
+      sample.downloadPixels(pixels);
+      if (recording) {
+        // the frame gets copied into the queue, and written in the
+        // background; we only ever wait if the writers fall behind
+        // by more than the queue can hold
+        char fileName[64];
+        snprintf(fileName,sizeof(fileName),"osc_frame_%05i.png",recordedFrames++);
+        output.push(OutputImage(fileName,fbSize,OutputImage::RGBA8,pixels));
+      }
       if (fbTexture == 0)
         glGenTextures(1, &fbTexture);
       
@@ -57,7 +76,7 @@ namespace osc {
       GLenum texFormat = GL_RGBA;
       GLenum texelType = GL_UNSIGNED_BYTE;
       glTexImage2D(GL_TEXTURE_2D, 0, texFormat, fbSize.x, fbSize.y, 0, GL_RGBA,
-                   texelType, pixels.data());
+                   texelType, pixels);
 
       glDisable(GL_LIGHTING);
       glColor3f(1, 1, 1);
@@ -99,7 +118,20 @@ namespace osc {
     {
       fbSize = newSize;
       sample.resize(newSize);
-      pixels.resize(newSize.x*newSize.y);
+      // mapped host memory, so the tone mapper can write the final
+      // pixels directly to where we display them from. Pinned
+      // allocations are expensive, so (like the renderer's own
+      // buffers) we only ever grow this, geometrically
+      const size_t numPixels = size_t(newSize.x)*newSize.y;
+      if (numPixels > pixelsCapacity) {
+        sample.setHostPixels(nullptr);
+        if (pixels) CUDA_CHECK(FreeHost(pixels));
+        pixelsCapacity = grownCapacity(pixelsCapacity,numPixels);
+        CUDA_CHECK(HostAlloc((void**)&pixels,
+                             pixelsCapacity*sizeof(uint32_t),
+                             cudaHostAllocMapped));
+      }
+      sample.setHostPixels(pixels);
     }
 
     virtual void key(int key, int mods)
@@ -124,20 +156,226 @@ namespace osc {
         std::cout << "num samples/pixel now "
                   << sample.launchParams.numPixelSamples << std::endl;
       }
+      if (key == 'S' || key == 's') {
+        static const char *names[] = { "uniform", "stratified", "solid angle" };
+        sample.launchParams.light.sampling
+          = (LightSampling)((sample.launchParams.light.sampling+1) % LIGHT_SAMPLING_COUNT);
+        std::cout << "light sampling now " << names[sample.launchParams.light.sampling] << std::endl;
+      }
+      if (key == 'N' || key == 'n') {
+        sample.launchParams.light.numSamples
+          = std::max(1,sample.launchParams.light.numSamples-1);
+        std::cout << "num light samples now "
+                  << sample.launchParams.light.numSamples << std::endl;
+      }
+      if (key == 'M' || key == 'm') {
+        sample.launchParams.light.numSamples
+          = std::max(1,sample.launchParams.light.numSamples+1);
+        std::cout << "num light samples now "
+                  << sample.launchParams.light.numSamples << std::endl;
+      }
+      if (key == 'B' || key == 'b') {
+        sample.launchParams.pathTracing.enabled = !sample.launchParams.pathTracing.enabled;
+        sample.launchParams.frame.frameID = 0;
+        std::cout << "path tracing now "
+                  << (sample.launchParams.pathTracing.enabled?"ON":"OFF") << std::endl;
+      }
+      if (key == 'T' || key == 't') {
+        static const char *names[] = { "clamp", "reinhard", "aces", "filmic" };
+        sample.toneMap.op
+          = (ToneMapOperator)((sample.toneMap.op+1) % TONE_MAP_OPERATOR_COUNT);
+        std::cout << "tone mapping operator now " << names[sample.toneMap.op] << std::endl;
+      }
+      if (key == 'O' || key == 'o') {
+        static const char *names[] = { "sqrt", "gamma", "srgb", "linear" };
+        sample.toneMap.transfer
+          = (OutputTransform)((sample.toneMap.transfer+1) % OUTPUT_TRANSFORM_COUNT);
+        std::cout << "output transform now " << names[sample.toneMap.transfer] << std::endl;
+      }
+      if (key == 'E' || key == 'e') {
+        sample.toneMap.autoExposure = !sample.toneMap.autoExposure;
+        std::cout << "auto exposure now " << (sample.toneMap.autoExposure?"ON":"OFF") << std::endl;
+      }
+      if (key == 'G' || key == 'g') {
+        sample.toneMap.dither = !sample.toneMap.dither;
+        std::cout << "dithering now " << (sample.toneMap.dither?"ON":"OFF") << std::endl;
+      }
+      if (key == '[') {
+        sample.toneMap.exposure *= 0.5f;
+        std::cout << "exposure now " << sample.toneMap.exposure << std::endl;
+      }
+      if (key == ']') {
+        sample.toneMap.exposure *= 2.f;
+        std::cout << "exposure now " << sample.toneMap.exposure << std::endl;
+      }
+      if (key == 'F' || key == 'f') {
+        packedFrameBuffer = !packedFrameBuffer;
+        sample.setFrameFormat(packedFrameBuffer
+                              ? FrameFormat::packed()
+                              : FrameFormat::full());
+        std::cout << "frame buffer format now "
+                  << (packedFrameBuffer?"half3/oct32/rgba8":"float4") << std::endl;
+        printFrameTraffic();
+      }
+      if (key == 'L' || key == 'l') {
+        tiledDenoising = !tiledDenoising;
+        sample.setDenoiserTileSize(tiledDenoising ? vec2i(512) : vec2i(0));
+        std::cout << "tiled denoising now " << (tiledDenoising?"ON (512x512 tiles)":"OFF") << std::endl;
+      }
+      if (key == 'P' || key == 'p') {
+        // what is on screen, plus the linear color for later grading
+        static int screenshotID = 0;
+        char fileName[64];
+        snprintf(fileName,sizeof(fileName),"osc_screenshot_%03i",screenshotID++);
+        std::vector<vec3f> linear;
+        sample.downloadLinearColor(linear);
+        output.push(OutputImage(std::string(fileName)+".png",fbSize,
+                                OutputImage::RGBA8,pixels));
+        output.push(OutputImage(std::string(fileName)+".exr",fbSize,
+                                OutputImage::FLOAT3,linear.data()));
+        std::cout << "saving " << fileName << ".png and " << fileName << ".exr" << std::endl;
+      }
+      if (key == 'K' || key == 'k') {
+        // keyframes get the (wall clock) time they were taken at, so
+        // playback has the same pacing as the recording
+        const double now = getCurrentTime();
+        if (cameraPath.empty()) pathStartTime = now;
+        cameraPath.addKeyframe(Camera{ cameraFrame.get_from(),
+                                       cameraFrame.get_at(),
+                                       cameraFrame.get_up() },
+                               float(now-pathStartTime));
+        std::cout << "added camera keyframe #" << cameraPath.keyframes.size()
+                  << " at " << (now-pathStartTime) << "s" << std::endl;
+      }
+      if (key == 'J' || key == 'j') {
+        if (cameraPath.empty())
+          std::cout << "no camera keyframes recorded yet (press 'k')" << std::endl;
+        else {
+          cameraPath.save("osc_camera.path");
+          std::cout << "saved " << cameraPath.keyframes.size()
+                    << " camera keyframes to osc_camera.path" << std::endl;
+        }
+      }
+      if (key == 'V' || key == 'v') {
+        recording = !recording;
+        if (recording) {
+          output.resetMetrics();
+          std::cout << "recording frames to osc_frame_#####.png" << std::endl;
+        } else {
+          output.flush();
+          printOutputMetrics();
+        }
+      }
+    }
+
+    /*! how the background writers kept up with the frames we sent */
+    void printOutputMetrics()
+    {
+      const ImageOutput::Metrics metrics = output.getMetrics();
+      std::cout << "recording stopped: " << metrics.numWritten << " images ("
+                << prettyNumber(metrics.bytesWritten) << "B) written"
+                << ", " << metrics.numFailed << " failed"
+                << ", avg encode " << 1e3*metrics.avgEncodeSeconds() << "ms"
+                << ", max queue depth " << metrics.maxQueueDepth
+                << ", waited on the queue " << metrics.numStalls << " times ("
+                << 1e3*metrics.stallSeconds << "ms)"
+                << std::endl;
+    }
+
+    /*! print how many bytes per frame we move through the frame
+        buffer layers, compared to an all-float4 frame buffer */
+    void printFrameTraffic()
+    {
+      const FrameTraffic traffic = sample.getFrameTraffic();
+      const FrameTraffic full
+        = computeFrameTraffic(FrameFormat::full(),fbSize,
+                              sample.accumulate,sample.denoiserOn);
+      std::cout << "frame buffer traffic per frame: "
+                << prettyNumber(traffic.total()) << "B"
+                << " (render " << prettyNumber(traffic.render) << "B"
+                << ", denoise " << prettyNumber(traffic.denoise) << "B"
+                << ", tone map " << prettyNumber(traffic.toneMap) << "B)"
+                << ", all-float4 would be " << prettyNumber(full.total()) << "B"
+                << std::endl;
     }
     
 
     vec2i                 fbSize;
     GLuint                fbTexture {0};
     SampleRenderer        sample;
-    std::vector<uint32_t> pixels;
+    uint32_t             *pixels {nullptr};
+    size_t                pixelsCapacity {0};
+    size_t                reportedDenoiserSetups {0};
+    bool                  packedFrameBuffer {false};
+    bool                  tiledDenoising {false};
+    /*! background writer for screenshots and recorded frames */
+    ImageOutput           output { /*numWorkers*/2, /*maxQueueDepth*/16 };
+    bool                  recording {false};
+    int                   recordedFrames {0};
+    /*! the camera keyframes recorded with 'k' */
+    CameraPath            cameraPath;
+    double                pathStartTime {0.};
   };
+
+  /*! renders a recorded camera path without a window, with a fixed
+      number of frames, and reports the distribution of frame times -
+      a reproducible walkthrough benchmark */
+  void playCameraPathHeadless(const Model *model,
+                              const QuadLight &light,
+                              const std::string &pathFile,
+                              int numFrames,
+                              const vec2i &size,
+                              const EnvironmentMap *environment)
+  {
+    const CameraPath path = CameraPath::load(pathFile);
+    if (path.empty())
+      throw std::runtime_error("camera path '"+pathFile+"' has no keyframes");
+    SampleRenderer sample(model,light);
+    sample.setEnvironment(environment);
+    sample.resize(size);
+    std::vector<uint32_t> pixels(size_t(size.x)*size.y);
+    const FrameTimes times = playCameraPath(sample,path,numFrames,pixels.data());
+    std::cout << "played " << numFrames << " frames (" << size.x << "x" << size.y
+              << ") of " << path.keyframes.size() << " keyframes:"
+              << " mean " << 1e3*times.mean() << "ms"
+              << ", p50 " << 1e3*times.percentile(50) << "ms"
+              << ", p90 " << 1e3*times.percentile(90) << "ms"
+              << ", p99 " << 1e3*times.percentile(99) << "ms"
+              << ", max " << 1e3*times.percentile(100) << "ms" << std::endl;
+  }
   
   
   /*! main entry point to this example - initially optix, print hello
     world, then exit */
   extern "C" int main(int ac, char **av)
   {
+    // --playback <file.path> [--frames <n>] [--size <w> <h>] renders
+    // a recorded camera path headless, instead of opening a window
+    std::string playbackFile;
+    int         playbackFrames = 240;
+    vec2i       playbackSize(1200,800);
+    // --env <file.hdr> replaces the white background with an
+    // (equirectangular) environment map
+    std::string environmentFile;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "--playback" && i+1 < ac)
+        playbackFile = av[++i];
+      else if (arg == "--frames" && i+1 < ac)
+        playbackFrames = std::max(1,atoi(av[++i]));
+      else if (arg == "--size" && i+2 < ac) {
+        playbackSize.x = atoi(av[++i]);
+        playbackSize.y = atoi(av[++i]);
+      } else if (arg == "--env" && i+1 < ac)
+        environmentFile = av[++i];
+      else {
+        std::cout << "usage: " << av[0]
+                  << " [--playback <file.path> [--frames <n>] [--size <w> <h>]]"
+                  << " [--env <environment.hdr>]" << std::endl;
+        exit(1);
+      }
+    }
+
     try {
       Model *model = loadOBJ(
 #ifdef _WIN32
@@ -165,14 +403,37 @@ namespace osc {
       // camera knows how much to move for any given user interaction:
       const float worldScale = length(model->bounds.span());
 
+      EnvironmentMap *environment
+        = environmentFile.empty() ? nullptr : loadEnvironmentMap(environmentFile);
+
+      if (!playbackFile.empty()) {
+        playCameraPathHeadless(model,light,playbackFile,playbackFrames,playbackSize,
+                               environment);
+        return 0;
+      }
+
       SampleWindow *window = new SampleWindow("Optix 7 Course Example",
                                               model,camera,light,worldScale);
+      window->sample.setEnvironment(environment);
       window->enableFlyMode();
       
       std::cout << "Press 'a' to enable/disable accumulation/progressive refinement" << std::endl;
       std::cout << "Press ' ' to enable/disable denoising" << std::endl;
       std::cout << "Press ',' to reduce the number of paths/pixel" << std::endl;
       std::cout << "Press '.' to increase the number of paths/pixel" << std::endl;
+      std::cout << "Press 's' to cycle through light sampling modes (uniform, stratified, solid angle)" << std::endl;
+      std::cout << "Press 'n' / 'm' to decrease/increase the number of light samples per hit" << std::endl;
+      std::cout << "Press 'b' to enable/disable path tracing (diffuse bounces)" << std::endl;
+      std::cout << "Press 't' to cycle through tone mapping operators" << std::endl;
+      std::cout << "Press 'o' to cycle through output transforms" << std::endl;
+      std::cout << "Press 'e' to enable/disable auto exposure" << std::endl;
+      std::cout << "Press '[' / ']' to halve/double the exposure" << std::endl;
+      std::cout << "Press 'g' to enable/disable dithering" << std::endl;
+      std::cout << "Press 'f' to toggle between float4 and packed frame buffer formats" << std::endl;
+      std::cout << "Press 'l' to enable/disable tiled denoising" << std::endl;
+      std::cout << "Press 'p' to save a screenshot (png, plus linear color as exr)" << std::endl;
+      std::cout << "Press 'v' to start/stop recording every frame to png" << std::endl;
+      std::cout << "Press 'k' to add a camera keyframe, 'j' to save them to osc_camera.path" << std::endl;
       window->run();
       
     } catch (std::runtime_error& e) {
@@ -20,26 +20,46 @@ using namespace osc;
 
 namespace osc {
 
-  inline __device__ float4 sqrt(float4 f)
-  {
-    return make_float4(sqrtf(f.x),
-                       sqrtf(f.y),
-                       sqrtf(f.z),
-                       sqrtf(f.w));
-  }
-  inline __device__ float  clampf(float f) { return min(1.f,max(0.f,f)); }
-  inline __device__ float4 clamp(float4 f)
+  /*! number of threads per block for the log-luminance reduction */
+  #define LOG_LUMINANCE_BLOCK_SIZE 256
+  
+  /*! computes the sum of logLuminance() over all pixels, for auto
+      exposure: each block reduces its (grid-strided) share of the
+      pixels in shared memory, then adds that to the global sum */
+  __global__ void computeLogLuminanceKernel(float        *logLuminanceSum,
+                                            const void   *denoisedBuffer,
+                                            ColorFormat   format,
+                                            int           numPixels)
   {
-    return make_float4(clampf(f.x),
-                       clampf(f.y),
-                       clampf(f.z),
-                       clampf(f.w));
+    __shared__ float blockSum[LOG_LUMINANCE_BLOCK_SIZE];
+    
+    float sum = 0.f;
+    for (int pixelID = threadIdx.x + blockIdx.x*blockDim.x;
+         pixelID < numPixels;
+         pixelID += blockDim.x*gridDim.x) {
+      sum += logLuminance(loadColor(format,denoisedBuffer,pixelID));
+    }
+    blockSum[threadIdx.x] = sum;
+    __syncthreads();
+    
+    for (int stride = blockDim.x/2; stride > 0; stride /= 2) {
+      if (threadIdx.x < stride)
+        blockSum[threadIdx.x] += blockSum[threadIdx.x + stride];
+      __syncthreads();
+    }
+    if (threadIdx.x == 0)
+      atomicAdd(logLuminanceSum,blockSum[0]);
   }
   
-  /*! runs a cuda kernel that performs gamma correction and float4-to-rgba conversion */
-  __global__ void computeFinalPixelColorsKernel(uint32_t *finalColorBuffer,
-                                                float4   *denoisedBuffer,
-                                                vec2i     size)
+  /*! runs a cuda kernel that performs tone mapping, gamma correction
+      and float4-to-rgba conversion; all the per-pixel math is shared
+      with the host implementation in oscCore/ToneMap.h */
+  __global__ void computeFinalPixelColorsKernel(uint32_t      *finalColorBuffer,
+                                                const void    *denoisedBuffer,
+                                                ColorFormat    format,
+                                                vec2i          size,
+                                                ToneMapParams  params,
+                                                const float   *logLuminanceSum)
   {
     int pixelX = threadIdx.x + blockIdx.x*blockDim.x;
     int pixelY = threadIdx.y + blockIdx.y*blockDim.y;
@@ -48,26 +68,85 @@ namespace osc {
 
     int pixelID = pixelX + size.x*pixelY;
 
-    float4 f4 = denoisedBuffer[pixelID];
-    f4 = clamp(sqrt(f4));
-    uint32_t rgba = 0;
-    rgba |= (uint32_t)(f4.x * 255.9f) <<  0;
-    rgba |= (uint32_t)(f4.y * 255.9f) <<  8;
-    rgba |= (uint32_t)(f4.z * 255.9f) << 16;
-    rgba |= (uint32_t)255             << 24;
-    finalColorBuffer[pixelID] = rgba;
+    const float exposure
+      = computeExposure(params,
+                        params.autoExposure ? *logLuminanceSum : 0.f,
+                        size.x*size.y);
+    finalColorBuffer[pixelID]
+      = toneMapPixel(params,loadColor(format,denoisedBuffer,pixelID),
+                     exposure,pixelX,pixelY);
+  }
+
+  /*! expands packed normal and/or albedo layers to half3 */
+  __global__ void unpackDenoiserGuidesKernel(Half3       *normalOut,
+                                             Half3       *albedoOut,
+                                             const void  *normalIn,
+                                             const void  *albedoIn,
+                                             FrameFormat  format,
+                                             int          numPixels)
+  {
+    int pixelID = threadIdx.x + blockIdx.x*blockDim.x;
+    if (pixelID >= numPixels) return;
+
+    if (normalOut)
+      storeColor(COLOR_FORMAT_HALF3,normalOut,pixelID,
+                 loadNormal(format.normal,normalIn,pixelID));
+    if (albedoOut)
+      storeColor(COLOR_FORMAT_HALF3,albedoOut,pixelID,
+                 loadAlbedo(format.albedo,albedoIn,pixelID));
+  }
+
+  void SampleRenderer::unpackDenoiserGuides()
+  {
+    const FrameFormat &format = launchParams.frame.format;
+    const int numPixels = launchParams.frame.size.x*launchParams.frame.size.y;
+    const int blockSize = 256;
+    unpackDenoiserGuidesKernel
+      <<<divRoundUp(numPixels,blockSize),blockSize,0,stream>>>
+      (format.normal != NORMAL_FORMAT_FLOAT4 ? (Half3*)denoiserGuideNormal.d_pointer() : nullptr,
+       format.albedo != ALBEDO_FORMAT_FLOAT4 ? (Half3*)denoiserGuideAlbedo.d_pointer() : nullptr,
+       launchParams.frame.normalBuffer,
+       launchParams.frame.albedoBuffer,
+       format,
+       numPixels);
   }
 
   void SampleRenderer::computeFinalPixelColors()
   {
     vec2i fbSize = launchParams.frame.size;
+    const int numPixels = fbSize.x*fbSize.y;
+
+    if (toneMap.autoExposure) {
+      CUDA_CHECK(MemsetAsync((void*)logLuminanceSum.d_pointer(),0,sizeof(float),stream));
+      // a few blocks per SM are plenty to saturate memory bandwidth
+      const int numBlocks
+        = std::min(divRoundUp(numPixels,LOG_LUMINANCE_BLOCK_SIZE),
+                   4*deviceProps.multiProcessorCount);
+      computeLogLuminanceKernel
+        <<<numBlocks,LOG_LUMINANCE_BLOCK_SIZE,0,stream>>>
+        ((float*)logLuminanceSum.d_pointer(),
+         (const void*)denoisedBuffer.d_pointer(),
+         launchParams.frame.format.color,
+         numPixels);
+    }
+    
+    /* if the app gave us mapped host memory we write the final
+       pixels straight into it, and save the separate download */
+    uint32_t *target
+      = hostPixelsOnDevice
+      ? hostPixelsOnDevice
+      : (uint32_t*)finalColorBuffer.d_pointer();
+    
     vec2i blockSize = 32;
     vec2i numBlocks = divRoundUp(fbSize,blockSize);
     computeFinalPixelColorsKernel
-      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y)>>>
-      ((uint32_t*)finalColorBuffer.d_pointer(),
-       (float4*)denoisedBuffer.d_pointer(),
-       fbSize);
+      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y),0,stream>>>
+      (target,
+       (const void*)denoisedBuffer.d_pointer(),
+       launchParams.frame.format.color,
+       fbSize,
+       toneMap,
+       (const float*)logLuminanceSum.d_pointer());
   }
   
 } // ::osc
@@ -0,0 +1,170 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* tests for bvhs that CPUScene does not build itself: one that went
+   through a scene cache has to come back identical to the one that
+   got built, for every build quality, and has to trace the same; and
+   a prebuilt bvh that is not safe to traverse (here, two leaves
+   sharing primIDs entries) has to get rebuilt rather than used.
+   Returns non-zero if any of that does not hold */
+
+#include "oscCore/CPUScene.h"
+#include "oscCore/SceneCache.h"
+#include "gdt/random/random.h"
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  /*! two wavy n x n grids, one above the other */
+  static Model *gridModel(int n)
+  {
+    Model *model = new Model;
+    for (int meshID=0;meshID<2;meshID++) {
+      TriangleMesh *mesh = new TriangleMesh;
+      for (int j=0;j<=n;j++)
+        for (int i=0;i<=n;i++)
+          mesh->vertex.push_back(vec3f(i/float(n),
+                                       .5f*meshID + .1f*sinf(7.f*i/n)*cosf(5.f*j/n),
+                                       j/float(n)));
+      for (int j=0;j<n;j++)
+        for (int i=0;i<n;i++) {
+          const int v = i+j*(n+1);
+          mesh->index.push_back(vec3i(v,v+1,v+n+2));
+          mesh->index.push_back(vec3i(v,v+n+2,v+n+1));
+        }
+      for (auto &v : mesh->vertex) model->bounds.extend(v);
+      model->meshes.push_back(mesh);
+    }
+    return model;
+  }
+
+  /*! rays from all around the model towards points inside it */
+  static std::vector<Ray> testRays(const Model *model, int numRays)
+  {
+    LCG<16> random(7,13);
+    const vec3f center = model->bounds.center();
+    const vec3f size   = model->bounds.span();
+    std::vector<Ray> rays;
+    for (int i=0;i<numRays;i++) {
+      const vec3f org    = center + 2.f*size*(vec3f(random(),random(),random())-.5f);
+      const vec3f target = model->bounds.lower + size*vec3f(random(),random(),random());
+      rays.push_back({ org, 0.f, normalize(target-org), 1e20f });
+    }
+    return rays;
+  }
+
+  static bool sameBVH(const BVH &a, const BVH &b)
+  {
+    return a.nodes.size() == b.nodes.size()
+      && a.primIDs == b.primIDs
+      && !memcmp(a.nodes.data(),b.nodes.data(),a.nodes.size()*sizeof(BVHNode));
+  }
+
+  static bool sameHits(const CPUScene &a, const CPUScene &b, const std::vector<Ray> &rays)
+  {
+    int numHits = 0;
+    for (auto &ray : rays) {
+      Hit hitA, hitB;
+      const bool foundA = a.intersect(ray,hitA);
+      const bool foundB = b.intersect(ray,hitB);
+      if (foundA != foundB) return false;
+      if (foundA && (hitA.t != hitB.t || hitA.meshID != hitB.meshID || hitA.primID != hitB.primID))
+        return false;
+      numHits += foundA;
+    }
+    // (rays that all miss would not tell us much)
+    return numHits > 0;
+  }
+
+  static bool check(bool ok, const std::string &what)
+  {
+    if (!ok) std::cout << "FAILED: " << what << std::endl;
+    return ok;
+  }
+
+  static bool testCacheRoundTrip(const Model *model, BVHBuildQuality quality)
+  {
+    const std::string prefix = "quality " + std::to_string(int(quality)) + ": ";
+    const BVHBuildSettings settings = bvhBuildSettingsFor(quality);
+    const CPUScene built(model,settings);
+    const uint64_t key = CPUScene::bvhCacheKey(model,settings);
+    const std::string cacheFile = "bvhCacheTest.osccache";
+    saveSceneCache(model,cacheFile,{ { key, &built.getBVH() } });
+    std::unique_ptr<Model> loadedModel(loadSceneCache(cacheFile));
+    BVH bvh;
+    const bool found = loadSceneCacheBVH(cacheFile,key,bvh);
+    remove(cacheFile.c_str());
+
+    bool ok = check(CPUScene::bvhCacheKey(loadedModel.get(),settings) == key,
+                    prefix+"loaded model has another bvh cache key")
+      &&      check(found,prefix+"did not find the bvh in the scene cache")
+      &&      check(sameBVH(bvh,built.getBVH()),
+                    prefix+"bvh from the scene cache differs from the one built");
+    if (!ok) return false;
+    const CPUScene loaded(loadedModel.get(),settings,std::vector<int>(),&bvh);
+    return check(loaded.buildSeconds == 0. && sameBVH(loaded.getBVH(),built.getBVH()),
+                 prefix+"did not use the bvh from the scene cache")
+      &&   check(sameHits(built,loaded,testRays(model,4096)),
+                 prefix+"bvh from the scene cache traces differently");
+  }
+
+  /*! a root with two leaves over the same primIDs entries, the
+      larger one first: the second one takes over the first one's
+      leafGroup entry, so the first one's triangles would get written
+      past the end of the groups */
+  static bool testOverlappingLeaves(const Model *model)
+  {
+    const BVHBuildSettings settings = bvhBuildSettingsFor(BVH_BUILD_QUALITY_MEDIUM);
+    BVH bad;
+    const BVHNode root  = { model->bounds.lower, 1u, model->bounds.upper, 0u };
+    const BVHNode small = { model->bounds.lower, 0u, model->bounds.upper, 1u };
+    const BVHNode large = { model->bounds.lower, 0u, model->bounds.upper, 17u };
+    bad.nodes = { root, large, small };
+    for (uint32_t i=0;i<17;i++) bad.primIDs.push_back(i);
+
+    const CPUScene built(model,settings);
+    const CPUScene rebuilt(model,settings,std::vector<int>(),&bad);
+    return check(sameBVH(rebuilt.getBVH(),built.getBVH()),
+                 "a bvh with overlapping leaves did not get rebuilt")
+      &&   check(sameHits(built,rebuilt,testRays(model,4096)),
+                 "rebuilt bvh traces differently");
+  }
+
+  static int bvhCacheTest()
+  {
+    std::unique_ptr<Model> model(gridModel(24));
+    bool ok = true;
+    for (int quality=0;quality<BVH_BUILD_QUALITY_COUNT;quality++)
+      ok &= testCacheRoundTrip(model.get(),(BVHBuildQuality)quality);
+    ok &= testOverlappingLeaves(model.get());
+    std::cout << "bvh cache test: " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+  }
+
+} // ::osc
+
+int main(int, char **)
+{
+  try {
+    return osc::bvhCacheTest();
+  } catch (const std::exception &e) {
+    std::cout << "FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+}
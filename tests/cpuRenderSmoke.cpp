@@ -0,0 +1,128 @@
+// ======================================================================== //
+// Copyright 2018-2019 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* smoke test for the cpu rendering backend: renders a tiny scene - a
+   floor under a small quad light, seen from straight above - and
+   checks the accumulated image against one computed directly from the
+   scene's geometry, with the same ambient term and the light
+   integrated over a fine grid. Returns non-zero if the two differ by
+   more than the noise that is left after accumulating */
+
+#include "oscCore/CPURenderer.h"
+#include <iostream>
+#include <memory>
+
+/*! \namespace osc - Optix Siggraph Course */
+namespace osc {
+
+  static const vec3f floorDiffuse(.6f,.5f,.4f);
+
+  static Model *floorModel()
+  {
+    Model *model = new Model;
+    TriangleMesh *mesh = new TriangleMesh;
+    mesh->vertex  = { vec3f(-1.f,0.f,-1.f), vec3f(1.f,0.f,-1.f),
+                      vec3f(1.f,0.f,1.f),   vec3f(-1.f,0.f,1.f) };
+    mesh->index   = { vec3i(0,1,2), vec3i(0,2,3) };
+    mesh->diffuse = floorDiffuse;
+    model->meshes.push_back(mesh);
+    for (auto &v : mesh->vertex) model->bounds.extend(v);
+    return model;
+  }
+
+  /*! what a (primary) ray that hits the floor at P should see:
+      example 12's ambient term, plus the light's power times
+      NdotL/dist^2, averaged over the light */
+  static vec3f expectedColor(const QuadLight &light, const vec3f &P, const vec3f &rayDir)
+  {
+    const vec3f N(0.f,1.f,0.f);
+    const int n = 32;
+    float irradiance = 0.f;
+    for (int j=0;j<n;j++)
+      for (int i=0;i<n;i++) {
+        const vec3f onLight = light.origin + ((i+.5f)/n)*light.du + ((j+.5f)/n)*light.dv;
+        const vec3f toLight = onLight-P;
+        const float dist2   = dot(toLight,toLight);
+        irradiance += std::max(0.f,dot(N,toLight))/(dist2*sqrtf(dist2));
+      }
+    irradiance /= n*n;
+    return (.1f + .2f*fabsf(dot(N,rayDir)))*floorDiffuse
+      + irradiance*light.power*floorDiffuse;
+  }
+
+  static int cpuRenderSmoke()
+  {
+    std::unique_ptr<Model> model(floorModel());
+    QuadLight light;
+    light.origin = vec3f(-.1f,1.f,-.1f);
+    light.du     = vec3f(.2f,0.f,0.f);
+    light.dv     = vec3f(0.f,0.f,.2f);
+    light.power  = vec3f(.5f);
+    const Camera camera = { vec3f(0.f,2.f,0.f), vec3f(0.f), vec3f(0.f,0.f,1.f) };
+    const vec2i size(32,24);
+
+    CPURenderer renderer(model.get(),light);
+    renderer.resize(size);
+    renderer.setCamera(camera);
+    const int numFrames = 64;
+    for (int i=0;i<numFrames;i++)
+      renderer.render();
+    const FrameBuffer &fb = renderer.getFrameBuffer();
+
+    // the expected image, with the same camera rays as the renderer,
+    // averaged over a grid in each pixel
+    const CameraFrame frame = computeCameraFrame(camera,float(size.x)/size.y);
+    double squaredError = 0., squaredColor = 0.;
+    for (int iy=0;iy<size.y;iy++)
+      for (int ix=0;ix<size.x;ix++) {
+        vec3f expected(0.f);
+        const int n = 4;
+        for (int j=0;j<n;j++)
+          for (int i=0;i<n;i++) {
+            const vec2f screen(vec2f(ix+(i+.5f)/n,iy+(j+.5f)/n) / vec2f(size));
+            const vec3f dir = normalize(frame.direction
+                                        + (screen.x - 0.5f) * frame.horizontal
+                                        + (screen.y - 0.5f) * frame.vertical);
+            const vec3f P = frame.position - (frame.position.y/dir.y)*dir;
+            expected += expectedColor(light,P,dir);
+          }
+        expected *= 1.f/(n*n);
+        const vec3f color = loadColor(fb.format.color,fb.color.data(),ix+size_t(iy)*size.x);
+        const vec3f error = color-expected;
+        squaredError += dot(error,error);
+        squaredColor += dot(expected,expected);
+      }
+    const double relativeError = sqrt(squaredError/squaredColor);
+    std::cout << "cpu render smoke test: relative rms error " << relativeError << std::endl;
+    if (!(relativeError < .01)) {
+      std::cout << "FAILED: rendered image does not match the expected one" << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+} // ::osc
+
+int main(int, char **)
+{
+  try {
+    return osc::cpuRenderSmoke();
+  } catch (const std::exception &e) {
+    std::cout << "FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+}